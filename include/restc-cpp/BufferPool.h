@@ -0,0 +1,149 @@
+#pragma once
+#ifndef RESTC_CPP_BUFFER_POOL_H_
+#define RESTC_CPP_BUFFER_POOL_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace restc_cpp {
+
+/*! Buffers for I/O, shared by all the readers and writers
+ *
+ * Readers and writers borrow a buffer when they need one, and return
+ * it to the pool when they are done, so that idle requests don't hold
+ * on to memory. The buffers come in size classes, from 4 KB to 1 MB,
+ * doubling in size. A request is rounded up to the nearest class.
+ * Larger buffers are allocated and freed directly.
+ *
+ * The pool is thread-safe.
+ */
+class BufferPool
+{
+public:
+    static constexpr std::size_t min_size = 1024 * 4;
+    static constexpr std::size_t max_size = 1024 * 1024;
+    static constexpr std::size_t num_classes = 9; // min_size to max_size
+
+    /*! A snapshot of the pools counters */
+    struct Stats {
+        std::size_t inUse = 0; // Bytes in buffers that are borrowed
+        std::size_t highWaterMark = 0; // Most bytes borrowed at the same time
+        std::size_t idle = 0; // Bytes in buffers kept for reuse
+        std::uint64_t allocated = 0; // Buffers allocated from the heap
+        std::uint64_t reused = 0; // Buffers reused from the pool
+    };
+
+    /*! A borrowed buffer. It returns to the pool when it is destroyed. */
+    class Buffer {
+    public:
+        Buffer() = default;
+        Buffer(const Buffer&) = delete;
+        Buffer& operator = (const Buffer&) = delete;
+
+        Buffer(Buffer&& v) noexcept
+        : pool_{v.pool_}, data_{std::move(v.data_)}, size_{v.size_} {
+            v.pool_ = nullptr;
+            v.size_ = 0;
+        }
+
+        Buffer& operator = (Buffer&& v) noexcept {
+            if (this != &v) {
+                Release();
+                pool_ = v.pool_;
+                data_ = std::move(v.data_);
+                size_ = v.size_;
+                v.pool_ = nullptr;
+                v.size_ = 0;
+            }
+            return *this;
+        }
+
+        ~Buffer() {
+            Release();
+        }
+
+        char *data() noexcept { return data_.get(); }
+        const char *data() const noexcept { return data_.get(); }
+
+        /*! The size of the buffer, which may be larger than asked for */
+        std::size_t size() const noexcept { return size_; }
+
+        bool empty() const noexcept { return size_ == 0; }
+
+        /*! Return the buffer to the pool now */
+        void Release() noexcept {
+            if (pool_) {
+                pool_->Return(std::move(data_), size_);
+                pool_ = nullptr;
+                size_ = 0;
+            }
+        }
+
+    private:
+        friend class BufferPool;
+
+        Buffer(BufferPool *pool, std::unique_ptr<char[]> data, std::size_t size)
+        : pool_{pool}, data_{std::move(data)}, size_{size} {}
+
+        BufferPool *pool_ = nullptr;
+        std::unique_ptr<char[]> data_;
+        std::size_t size_ = 0;
+    };
+
+    /*!
+     * \param maxIdleBytes The most memory kept for reuse in each size class.
+     */
+    explicit BufferPool(std::size_t maxIdleBytes = 1024 * 1024 * 4);
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator = (const BufferPool&) = delete;
+
+    /*! Get a buffer of at least size bytes */
+    Buffer Borrow(std::size_t size);
+
+    /*! Get a snapshot of the pools counters
+     *
+     * This is cheap, and can be called from any thread.
+     */
+    Stats GetStats() const noexcept;
+
+    /*! Start tracking the high-water mark again, from what is in use now */
+    void ResetHighWaterMark() noexcept;
+
+    /*! Free the idle buffers */
+    void Trim();
+
+    /*! The size class a buffer of size bytes is taken from */
+    static std::size_t GetClassSize(std::size_t size) noexcept;
+
+    /*! The pool used by the library
+     *
+     * It is never destroyed, so buffers can safely be returned to
+     * it at any time.
+     */
+    static BufferPool& GetDefault();
+
+private:
+    struct SizeClass {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<char[]>> idle;
+    };
+
+    static std::size_t GetClassIndex(std::size_t size) noexcept;
+    void Return(std::unique_ptr<char[]>&& data, std::size_t size) noexcept;
+
+    const std::size_t max_idle_bytes_;
+    std::array<SizeClass, num_classes> classes_;
+    std::atomic_size_t in_use_{0};
+    std::atomic_size_t high_water_mark_{0};
+    std::atomic_size_t idle_{0};
+    std::atomic<std::uint64_t> allocated_{0};
+    std::atomic<std::uint64_t> reused_{0};
+};
+
+} // restc_cpp
+
+#endif // RESTC_CPP_BUFFER_POOL_H_
@@ -10,10 +10,47 @@
 
 namespace restc_cpp {
 
+class Http2Connection;
+class Pipeline;
+class PipelineTicket;
+
 class ConnectionPool
 {
 public:
     using ptr_t = std::shared_ptr<ConnectionPool>;
+
+    /*! A snapshot of the pools counters
+     *
+     * The counters are totals since the pool was created.
+     */
+    struct Stats {
+        /*! Current state for one endpoint */
+        struct Endpoint {
+            boost::asio::ip::tcp::endpoint endpoint;
+            Connection::Type type = Connection::Type::HTTP;
+            size_t idle = 0;
+            size_t inUse = 0;
+            size_t waiting = 0;
+        };
+
+        std::uint64_t hits = 0; // Idle connections that were reused
+        std::uint64_t misses = 0; // Lookups that found no usable idle connection
+        std::uint64_t created = 0; // New connections
+        std::uint64_t expired = 0; // Idle connections closed after cacheTtlSeconds
+        std::uint64_t purged = 0; // Idle connections closed to make room for new ones
+        std::uint64_t discarded = 0; // Connections released with a closed socket
+        std::uint64_t stale = 0; // Idle connections that were closed by the server
+        std::uint64_t rejected = 0; // Failed with ConstraintException, as the pool was full
+        std::uint64_t waits = 0; // Times a co-routine had to wait for a connection
+        std::uint64_t waitTimeouts = 0; // Waits that timed out
+
+        size_t connections = 0; // Current connections, idle or in use
+        size_t idle = 0; // Current idle connections
+        size_t waiting = 0; // Co-routines currently waiting for a connection
+
+        std::vector<Endpoint> endpoints; // Only set if requested
+    };
+
     virtual ~ConnectionPool() = default;
 
     virtual Connection::ptr_t GetConnection(
@@ -21,7 +58,148 @@ public:
         const Connection::Type connectionType,
         bool new_connection_please = false) = 0;
 
+    /*! Get a connection, and wait for one to become available if the pool is full
+     *
+     * If the pool has no free slots for the endpoint, the co-routine in
+     * ctx is suspended in a first-come, first-served queue until a
+     * connection is released, or until `Request::Properties::cacheWaitTimeoutMs`
+     * expires. Released connections are handed directly to the first waiter.
+     *
+     * If `cacheWaitTimeoutMs` is 0, this behaves like the overload above
+     * and throws ConstraintException immediately when the pool is full.
+     *
+     * \param origin If set, a new connection is registered for this
+     *      origin (see MakeOrigin()), so that it can later be found
+     *      with GetIdleConnection().
+     */
+    virtual Connection::ptr_t GetConnection(
+        const boost::asio::ip::tcp::endpoint ep,
+        const Connection::Type connectionType,
+        Context& ctx,
+        const std::string& origin = {}) = 0;
+
+    /*! Get an idle connection that was made for an origin
+     *
+     * This does not resolve anything, so it is a cheap first try
+     * before the host name in a request is resolved.
+     *
+     * \param origin The origin, from MakeOrigin().
+     * \return An open connection, or nullptr if there were no idle
+     *      connections for the origin.
+     */
+    virtual Connection::ptr_t GetIdleConnection(const std::string& origin) = 0;
+
+    /*! Get a HTTP/2 connection to an origin, to start a new stream on
+     *
+     * This is an internal method.
+     *
+     * Returns the usable connection with the fewest active streams.
+     * If another co-routine is connecting to the origin, this waits
+     * for it, so that the requests share one connection.
+     *
+     * Returns nullptr if the caller must connect. In that case it
+     * must call AddHttp2Connection() or CancelHttp2Connect() when
+     * it is done. nullptr is also returned if the origin is known to
+     * only talk HTTP/1.1.
+     */
+    virtual std::shared_ptr<Http2Connection> GetHttp2Connection(
+        const std::string& origin, Context& ctx) = 0;
+
+    /*! Register a new HTTP/2 connection to an origin
+     *
+     * This is an internal method.
+     *
+     * \param connection The connection, or nullptr if the server did
+     *      not select HTTP/2. The origin is then remembered as
+     *      HTTP/1.1-only for `Request::Properties::cacheTtlSeconds`.
+     */
+    virtual void AddHttp2Connection(const std::string& origin,
+        std::shared_ptr<Http2Connection> connection) = 0;
+
+    /*! Tell the pool that a connect after GetHttp2Connection() failed
+     *
+     * This is an internal method.
+     */
+    virtual void CancelHttp2Connect(const std::string& origin) = 0;
+
+    /*! Get a place for a request on a HTTP/1.1 connection to an origin
+     *  that is busy with other requests (pipelining)
+     *
+     * This is an internal method.
+     *
+     * \return A ticket that owns the connection, or nullptr if no
+     *      pipeline to the origin has room for one more request.
+     */
+    virtual std::unique_ptr<PipelineTicket> JoinPipeline(
+        const std::string& origin) = 0;
+
+    /*! Let other requests to an origin join a pipeline
+     *
+     * This is an internal method.
+     *
+     * The pool only keeps a weak reference to the pipeline.
+     */
+    virtual void AddPipeline(const std::string& origin,
+                             const std::shared_ptr<Pipeline>& pipeline) = 0;
+
+    /*! Make the key that identifies the server for a connection
+     *
+     * Connections to the same host name and port, with the same
+     * protocol and proxy, have the same origin.
+     */
+    static std::string MakeOrigin(const Connection::Type type,
+                                  const std::string& host,
+                                  const std::string& port,
+                                  const Request::Proxy& proxy);
+
+    /*! Open connections to a server in advance, and park them in the pool
+     *
+     * Resolves the host in url, and connects (and does the TLS handshake
+     * for https) up to count new connections. The connections are then
+     * released to the pool as idle connections, so that the next requests
+     * to the server don't have to wait for them.
+     *
+     * Combine with `Request::Properties::cacheMinIdlePerEndpoint` to
+     * keep the connections after `cacheTtlSeconds`. The pool then also
+     * opens new connections to the endpoints that were warmed up, when
+     * there are fewer idle connections than that, for example after the
+     * server closed some of them. This is checked each
+     * `cacheCleanupIntervalSeconds`.
+     *
+     * If an endpoint reaches `cacheMaxConnectionsPerEndpoint`, or fails
+     * to connect, the next address of the host is used.
+     *
+     * Warmup is not supported when a proxy is used.
+     *
+     * \param url Url to the server. Only the protocol, host and port are used.
+     * \param count Number of new connections to open.
+     * \param ctx Context for the co-routine that connects.
+     * \return The number of connections that was opened. This may be
+     *      less than count if the pool is full, or if connect fails.
+     */
+    virtual size_t Warmup(const std::string& url, size_t count, Context& ctx) = 0;
+
+    /*! Pick the least loaded of two random endpoints ("power of two choices")
+     *
+     * The load is the number of connections to the endpoint that are
+     * in use, plus the co-routines waiting for one.
+     *
+     * \return The index of the selected endpoint. endpoints must not be empty.
+     */
+    virtual size_t SelectEndpoint(
+        const std::vector<boost::asio::ip::tcp::endpoint>& endpoints,
+        const Connection::Type connectionType) const = 0;
+
     virtual size_t GetIdleConnections() const = 0;
+
+    /*! Get a snapshot of the pools counters
+     *
+     * This is cheap, and can be called from any thread.
+     *
+     * \param withEndpoints If true, the current state for each endpoint
+     *      is added. This must briefly lock each part of the pool.
+     */
+    virtual Stats GetStats(bool withEndpoints = false) const = 0;
     static std::shared_ptr<ConnectionPool> Create(RestClient& owner);
 
     /*! Close the connection-pool
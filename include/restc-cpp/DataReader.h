@@ -17,6 +17,7 @@ namespace restc_cpp {
 class Connection;
 class Context;
 class DataReaderStream;
+class Http2Stream;
 
 /*! Generic IO interface to read data from the server.
  *
@@ -34,11 +35,29 @@ public:
 
     struct ReadConfig {
         int msReadTimeout = 0;
+
+        /*! Buffers the I/O reader can receive into ahead of the caller
+         *
+         * With 2 or more, the next receive is started when a buffer
+         * is returned, so the caller can work on the data while the
+         * next buffer is filled. 0 or 1 only reads when asked to.
+         */
+        size_t readAheadBuffers = 0;
+
+        /*! Initial size of the receive buffers */
+        size_t bufferSize = RESTC_CPP_IO_BUFFER_SIZE;
+
+        /*! The buffers double in size up to this, when a receive fills one */
+        size_t maxBufferSize = RESTC_CPP_IO_BUFFER_MAX_SIZE;
     };
 
 
     using ptr_t = std::unique_ptr<DataReader>;
-    using add_header_fn_t = std::function<void(std::string&& name, std::string&& value)>;
+    /*! Called for each header received after the body starts (trailers)
+     *
+     * The name and value are only valid during the call.
+     */
+    using add_header_fn_t = std::function<void(boost::string_ref name, boost::string_ref value)>;
 
     DataReader() = default;
     virtual ~DataReader() = default;
@@ -47,13 +66,60 @@ public:
     virtual boost::asio::const_buffers_1 ReadSome() = 0;
     virtual void Finish() = 0; // Make sure there are no pending data for the current request
 
+    /*! True if the reader can produce its data straight into a buffer we own
+     *
+     * Readers that make their own data, like the decompressing readers,
+     * can. Readers that pass on data from the network can't.
+     */
+    virtual bool CanReadInto() const noexcept {
+        return false;
+    }
+
+    /*! Read into the callers buffer. Only if CanReadInto() is true.
+     *
+     * \return The number of bytes written to buffer.
+     */
+    virtual std::size_t ReadInto(boost::asio::mutable_buffer /*buffer*/) {
+        throw NotImplementedException("ReadInto()");
+    }
+
+    /*! Tell the reader that at least bytes more bytes will be read from it
+     *
+     * The readers for the body know how much is left of it. A reader
+     * that reads ahead from the network uses it to never read past the
+     * current reply.
+     */
+    virtual void ReadAhead(std::size_t /*bytes*/) {
+    }
+
     static ptr_t CreateIoReader(const Connection::ptr_t& conn,
                                 Context& ctx, const ReadConfig& cfg);
-    static ptr_t CreateGzipReader(std::unique_ptr<DataReader>&& source);
-    static ptr_t CreateZipReader(std::unique_ptr<DataReader>&& source);
-    static ptr_t CreatePlainReader(size_t contentLength, ptr_t&& source);
+
+    /*! Decompressing readers
+     *
+     * \param bufferSize The size of the output buffer used by ReadSome().
+     *      Larger buffers means fewer calls through the reader chain
+     *      for large bodies. ReadInto() does not use it.
+     */
+    static ptr_t CreateGzipReader(std::unique_ptr<DataReader>&& source,
+                                  std::size_t bufferSize = RESTC_CPP_IO_BUFFER_SIZE);
+    static ptr_t CreateZipReader(std::unique_ptr<DataReader>&& source,
+                                 std::size_t bufferSize = RESTC_CPP_IO_BUFFER_SIZE);
+    static ptr_t CreateZstdReader(std::unique_ptr<DataReader>&& source,
+                                  std::size_t bufferSize = RESTC_CPP_IO_BUFFER_SIZE); // RESTC_CPP_WITH_ZSTD
+    static ptr_t CreateBrotliReader(std::unique_ptr<DataReader>&& source,
+                                    std::size_t bufferSize = RESTC_CPP_IO_BUFFER_SIZE); // RESTC_CPP_WITH_BROTLI
+
+    static ptr_t CreatePlainReader(size_t contentLength,
+                                   std::unique_ptr<DataReaderStream>&& source);
     static ptr_t CreateChunkedReader(add_header_fn_t, std::unique_ptr<DataReaderStream>&& source);
     static ptr_t CreateNoBodyReader();
+    static ptr_t CreateHttp2Reader(std::shared_ptr<Http2Stream> stream,
+                                   add_header_fn_t fn, Context& ctx,
+                                   const ReadConfig& cfg);
+
+    /*! The content codings we can decode, most preferred first */
+    static const std::vector<std::string>& GetSupportedEncodings();
 };
 
 } // namespace
@@ -22,7 +22,12 @@ namespace restc_cpp {
 class DataReaderStream : public DataReader {
 public:
 
-    DataReaderStream(std::unique_ptr<DataReader>&& source);
+    /*!
+     * \param unread Data that was already read from the source.
+     *      It is returned before anything is read from the source.
+     */
+    DataReaderStream(std::unique_ptr<DataReader>&& source,
+                     std::string unread = {});
 
     bool IsEof() const override {
         return eof_;
@@ -39,6 +44,9 @@ public:
     /*! Read up to maxBytes from whatever we have buffered or can get downstream.*/
     boost::asio::const_buffers_1 GetData(size_t maxBytes);
 
+    /*! Pass on what is not buffered here to the source */
+    void ReadAhead(std::size_t bytes) override;
+
     /*! Get one char
      *
      * \exception ParseException on end of stream
@@ -62,6 +70,11 @@ public:
 
     void SetEof();
 
+    /*! True if any data has been received from the source */
+    bool HasReceivedData() const noexcept {
+        return end_ != nullptr;
+    }
+
     char GetCurrentCh() const {
         assert(curr_ != nullptr);
         assert(curr_ <= end_);
@@ -70,21 +83,54 @@ public:
 
     /*! Read standard HTTP headers as a stream until we get an empty line
      *
-     * The next buffer-position will be at the start of the body
+     * The next buffer-position will be at the start of the body.
+     *
+     * Lines that are completely in the current buffer are scanned
+     * in place. Only lines that span buffers are read byte by byte.
      */
     void ReadServerResponse(Reply::HttpResponse& response);
     void ReadHeaderLines(const add_header_fn_t& addHeader);
 
+    /*! Take the data we have buffered, but not returned to the caller
+     *
+     * When a reply is complete, this is the start of the next reply
+     * on the connection.
+     */
+    std::string TakeUnread();
+
 private:
     void Fetch();
     std::string GetHeaderValue();
 
+    /*! Get the start of the buffered data that is not consumed yet
+     *
+     * Fetches a new buffer if there is no such data.
+     */
+    const char *GetBuffered();
+
+    /*! Parse the status line in place if it is in the current buffer
+     *
+     * \return false if nothing was consumed, and the line must be
+     *      read byte by byte.
+     */
+    bool ScanServerResponse(Reply::HttpResponse& response);
+
+    /*! Parse one header line in place if it is in the current buffer
+     *
+     * \return 1 if a header was added, 0 at the empty line after the
+     *      headers and -1 if nothing was consumed, and the line must be
+     *      read byte by byte.
+     */
+    int ScanHeaderLine(const add_header_fn_t& addHeader);
+
     bool eof_ = false;
     const char *curr_ = nullptr;
     const char *end_ = nullptr;
     size_t getc_bytes_ = 0;
     DataReader::ptr_t source_;
     size_t num_headers_ = 0;
+    std::string unread_;
+    bool have_unread_ = false;
 };
 
 } // namespace
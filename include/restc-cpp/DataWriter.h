@@ -16,6 +16,7 @@ namespace restc_cpp {
 
 class Connection;
 class Context;
+class Http2Stream;
 
 
 /*! Generic IO interface to write data from the server.
@@ -35,6 +36,15 @@ public:
 
     struct WriteConfig {
         int msWriteTimeout = 0;
+
+        /*! Max buffers queued for sending while the caller goes on writing
+         *
+         * The data is copied, and sent by a separate co-routine, so that
+         * producing the next data overlaps with sending the last.
+         * Errors are thrown by the next call to the writer.
+         * 0 writes directly, and returns when the data is sent.
+         */
+        size_t writeBehindBuffers = 0;
     };
 
     /*! Allows the user to set the headers in the chunked trailer if required */
@@ -52,6 +62,19 @@ public:
     /*! Write some data */
     virtual void Write(const write_buffers_t& buffers) = 0;
 
+    /*! Write the headers and the first part of the body
+     *
+     * Writers that can, pass both on so that they reach the
+     * network in one write.
+     */
+    virtual void WriteDirectAndData(boost::asio::const_buffers_1 direct,
+                                    const write_buffers_t& buffers) {
+        WriteDirect(direct);
+        if (boost::asio::buffer_size(buffers)) {
+            Write(buffers);
+        }
+    }
+
     /*! Called when all data is written to flush the buffers */
     virtual void Finish() = 0;
 
@@ -65,11 +88,22 @@ public:
 
     static ptr_t CreateIoWriter(const Connection::ptr_t& conn, Context& ctx,
                                 const WriteConfig& cfg);
-    static ptr_t CreateGzipWriter(std::unique_ptr<DataWriter>&& source);
-    static ptr_t CreateZipWriter(std::unique_ptr<DataWriter>&& source);
+
+    /*! Compress the data with zlib
+     *
+     * \param level 1 (fastest) to 9 (smallest), 0 for no compression,
+     *      or -1 for zlib's default (6).
+     */
+    static ptr_t CreateGzipWriter(std::unique_ptr<DataWriter>&& source,
+                                  int level = -1);
+    static ptr_t CreateZipWriter(std::unique_ptr<DataWriter>&& source,
+                                 int level = -1);
+
     static ptr_t CreatePlainWriter(size_t contentLength, ptr_t&& source);
     static ptr_t CreateChunkedWriter(add_header_fn_t, ptr_t&& source);
     static ptr_t CreateNoBodyWriter();
+    static ptr_t CreateHttp2Writer(std::shared_ptr<Http2Stream> stream,
+                                   Context& ctx, const WriteConfig& cfg);
 };
 
 } // namespace
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef RESTC_CPP_DNS_CACHE_H_
+#define RESTC_CPP_DNS_CACHE_H_
+
+#ifndef RESTC_CPP_H_
+#       error "Include restc-cpp.h first"
+#endif
+
+#include <cstdint>
+#include <vector>
+
+namespace restc_cpp {
+
+/*! Cache for host-name lookups
+ *
+ * Shared by all the requests in a RestClient instance.
+ *
+ * Successful lookups are cached for `Request::Properties::dnsCacheTtlSeconds`,
+ * failed lookups for `dnsCacheNegativeTtlSeconds`. When a cached entry is
+ * used close to its expiry, it is refreshed in the background. An
+ * expired entry is still used for up to `dnsCacheStaleSeconds` while
+ * it is being refreshed. At most `dnsCacheMaxEntries` lookups are kept.
+ *
+ * The cache is off by default. Set `dnsCacheTtlSeconds` to turn it on.
+ */
+class DnsCache
+{
+public:
+    using ptr_t = std::shared_ptr<DnsCache>;
+    using endpoints_t = std::vector<boost::asio::ip::tcp::endpoint>;
+
+    /*! A snapshot of the caches counters */
+    struct Stats {
+        std::uint64_t lookups = 0; // Queries sent to the resolver, including refreshes
+        std::uint64_t hits = 0; // Resolve() calls answered from the cache
+        std::uint64_t negativeHits = 0; // Hits on a cached failed lookup
+        std::uint64_t refreshes = 0; // Background refreshes started
+    };
+
+    virtual ~DnsCache() = default;
+
+    /*! Resolve a host and port
+     *
+     * \return The resolved endpoints, in the order they were returned
+     *      by the resolver.
+     * \exception boost::system::system_error if the lookup failed
+     *      (or a recent lookup failed).
+     */
+    virtual endpoints_t Resolve(const std::string& host,
+                                const std::string& port,
+                                Context& ctx) = 0;
+
+    /*! Remove all the cached entries */
+    virtual void Clear() = 0;
+
+    /*! Get a snapshot of the caches counters
+     *
+     * This is cheap, and can be called from any thread.
+     */
+    virtual Stats GetStats() const = 0;
+
+    static ptr_t Create(RestClient& owner);
+};
+
+} // restc_cpp
+
+
+#endif // RESTC_CPP_DNS_CACHE_H_
@@ -2,10 +2,16 @@
 #pragma once
 
 #include "restc-cpp/DataWriter.h"
+#include "restc-cpp/BufferPool.h"
 
 namespace restc_cpp {
 
 /*! Wrapper from rapidjson (output) Stream concept to our DataWriter
+ *
+ * The buffer is borrowed from BufferPool::GetDefault() on the first
+ * Put(). It starts with bufferSizeT characters, and doubles in size
+ * each time it is filled, up to maxBufferSize characters, so that
+ * large documents are written in fewer pieces.
  */
 
 template <typename chT = char, size_t bufferSizeT = 1024 * 16>
@@ -13,8 +19,9 @@ class RapidJsonWriter {
 public:
     using Ch = chT;
 
-    RapidJsonWriter(DataWriter& writer)
-    : writer_{writer} {}
+    RapidJsonWriter(DataWriter& writer,
+                    size_t maxBufferSize = RESTC_CPP_IO_BUFFER_MAX_SIZE / sizeof(Ch))
+    : writer_{writer}, max_buffer_size_{std::max(maxBufferSize, bufferSizeT)} {}
 
     Ch Peek() const { assert(false); return '\0'; }
 
@@ -25,9 +32,14 @@ public:
     Ch* PutBegin() { assert(false); return 0; }
 
     void Put(Ch c) {
-        buffer_[bytes_] = c;
-        if (++bytes_ == buffer_.size()) {
+        if (capacity_ == 0) {
+            Grow();
+        }
+
+        reinterpret_cast<Ch *>(buffer_.data())[bytes_] = c;
+        if (++bytes_ == capacity_) {
             Flush();
+            Grow();
         }
     }
 
@@ -43,8 +55,22 @@ public:
     size_t PutEnd(Ch*) { assert(false); return 0; }
 
 private:
+    // Get the first buffer, or a larger one after the last was filled
+    void Grow() {
+        const auto size = capacity_
+            ? std::min(capacity_ * 2, max_buffer_size_) : bufferSizeT;
+        if (size <= capacity_) {
+            return;
+        }
+
+        buffer_ = BufferPool::GetDefault().Borrow(size * sizeof(Ch));
+        capacity_ = buffer_.size() / sizeof(Ch);
+    }
+
     DataWriter& writer_;
-    std::array<Ch, bufferSizeT> buffer_;
+    const size_t max_buffer_size_; // In characters
+    BufferPool::Buffer buffer_;
+    size_t capacity_ = 0; // In characters
     size_t bytes_ = 0;
 };
 
@@ -60,9 +60,14 @@ public:
     /*! Create a body from a file
      *
      * This will effectively upload the file.
+     *
+     * \param bufferSize Size of the first read from the file.
+     * \param maxBufferSize Each read doubles in size, up to this.
      */
     static std::unique_ptr<RequestBody> CreateFileBody(
-        boost::filesystem::path path);
+        boost::filesystem::path path,
+        std::size_t bufferSize = RESTC_CPP_IO_BUFFER_SIZE,
+        std::size_t maxBufferSize = RESTC_CPP_IO_BUFFER_MAX_SIZE);
 };
 
 } // restc_cpp
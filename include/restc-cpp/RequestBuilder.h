@@ -11,6 +11,7 @@
 //#include "restc-cpp/DataWriter.h"
 #include "restc-cpp/RequestBody.h"
 #include "restc-cpp/RequestBodyWriter.h"
+#include "restc-cpp/DataReader.h"
 #include "restc-cpp/helper.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
@@ -276,7 +277,9 @@ public:
      */
     RequestBuilder& File(const boost::filesystem::path& path) {
         assert(!body_);
-        body_ = RequestBody::CreateFileBody(path);
+        const auto& properties = GetProperties();
+        body_ = RequestBody::CreateFileBody(path, properties.ioBufferSize,
+                                            properties.ioBufferMaxSize);
         return *this;
     }
 
@@ -287,6 +290,24 @@ public:
         return *this;
     }
 
+    /*! Compress the body of the request
+     *
+     * The compressed body is sent chunked, with a Content-Encoding
+     * header. Json from Data() is serialized straight into the
+     * compressor, so the document is never buffered.
+     *
+     * \param level zlib compression level. 1 (fastest) to 9 (smallest),
+     *      or -1 for zlib's default.
+     * \param compression GZIP or DEFLATE
+     */
+    RequestBuilder& CompressBody(int level = -1,
+                                 Request::Properties::BodyCompression compression
+                                    = Request::Properties::BodyCompression::GZIP) {
+        body_compression_ = compression;
+        body_compression_level_ = level;
+        return *this;
+    }
+
     /*! Supply credentials for HTTP Basic Authentication
      *
      * \param name Name to use
@@ -355,26 +376,25 @@ public:
     std::unique_ptr<Request> Build() {
         assert(ctx_);
         static const std::string accept_encoding{"Accept-Encoding"};
-        static const std::string gzip{"gzip"};
 #ifdef DEBUG
         assert(!built_);
         built_ = true;
 #endif
-#if RESTC_CPP_WITH_ZLIB
         if (!disable_compression_) {
             if (!headers_ || (headers_->find(accept_encoding) == headers_->end())) {
-                Header(accept_encoding, gzip);
+                auto encodings = GetAcceptEncoding();
+                if (!encodings.empty()) {
+                    Header(accept_encoding, std::move(encodings));
+                }
             }
         }
-#endif
         auto req = Request::Create(
             url_, type_, ctx_->GetClient(), move(body_), args_, headers_, auth_);
 
-        auto orig = req->GetProperties();
-
         if (properties_) {
             // Merge the headers and args to get what we have already
             // set in Request::Create
+            const auto& orig = req->GetProperties();
             properties_->headers += orig.headers;
 
             // Add the original args
@@ -385,6 +405,14 @@ public:
             req->SetProperties(properties_);
         }
 
+        if (body_compression_ != Request::Properties::BodyCompression::NONE) {
+            auto properties = std::make_shared<Request::Properties>(
+                req->GetProperties());
+            properties->bodyCompression = body_compression_;
+            properties->bodyCompressionLevel = body_compression_level_;
+            req->SetProperties(std::move(properties));
+        }
+
         return req;
     }
 
@@ -414,6 +442,43 @@ public:
     }
 
 private:
+    const Request::Properties& GetProperties() const {
+        assert(ctx_);
+        return properties_
+            ? *properties_ : *ctx_->GetClient().GetConnectionProperties();
+    }
+
+    /* The Accept-Encoding value for the codings we can decode
+     *
+     * The order of preference is given with q-values, as
+     * "zstd, br;q=0.9, gzip;q=0.8".
+     */
+    std::string GetAcceptEncoding() const {
+        const auto& supported = DataReader::GetSupportedEncodings();
+        const auto& properties = GetProperties();
+        const auto& preferred = properties.acceptEncoding.empty()
+            ? supported : properties.acceptEncoding;
+
+        std::string rval;
+        int q = 10;
+        for(const auto& name : preferred) {
+            if (std::find(supported.begin(), supported.end(), name) == supported.end()) {
+                continue;
+            }
+
+            if (!rval.empty()) {
+                rval += ", ";
+            }
+            rval += name;
+            if (q < 10) {
+                rval += ";q=0." + std::to_string(q);
+            }
+            q = std::max(q - 1, 1);
+        }
+
+        return rval;
+    }
+
     Context *ctx_ = nullptr;
     std::string url_;
     Request::Type type_;
@@ -423,6 +488,9 @@ private:
     Request::Properties::ptr_t properties_;
     std::unique_ptr<RequestBody> body_;
     bool disable_compression_ = false;
+    Request::Properties::BodyCompression body_compression_
+        = Request::Properties::BodyCompression::NONE;
+    int body_compression_level_ = -1;
 #ifdef DEBUG
     bool built_ = false;
 #endif
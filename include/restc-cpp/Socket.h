@@ -57,12 +57,29 @@ public:
         bool tcpNodelay,
         boost::asio::yield_context& yield) = 0;
 
+    /*! Complete the connection after the TCP socket is connected
+     *
+     * Sets the socket options, calls the after-connect callback, and
+     * for TLS, does the handshake. AsyncConnect() calls this when
+     * it has connected. Use it directly when the TCP connection was
+     * made some other way, like in a race between several endpoints.
+     */
+    virtual void AsyncSetupConnection(const std::string &host,
+        bool tcpNodelay,
+        boost::asio::yield_context& yield) = 0;
+
     virtual void AsyncShutdown(boost::asio::yield_context& yield) = 0;
 
     virtual void Close(Reason reoson = Reason::DONE) = 0;
 
     virtual bool IsOpen() const noexcept = 0;
 
+    /*! The application protocol the server selected with TLS ALPN
+     *
+     * Empty if no protocol was negotiated.
+     */
+    virtual std::string GetAlpnProtocol() const = 0;
+
     friend std::ostream& operator << (std::ostream& o, const Socket& v) {
         return v.Print(o);
     }
@@ -125,6 +125,12 @@ struct DecompressException : public RestcCppException
     : RestcCppException(cause) {}
 };
 
+struct CompressException : public RestcCppException
+{
+    CompressException(const std::string& cause)
+    : RestcCppException(cause) {}
+};
+
 struct NoDataException : public RestcCppException
 {
     NoDataException(const std::string& cause)
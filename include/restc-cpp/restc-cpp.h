@@ -7,6 +7,7 @@
 #include <string>
 #include <map>
 #include <deque>
+#include <vector>
 #include <memory>
 #include <future>
 #include <fstream>
@@ -47,11 +48,16 @@
 #   define RESTC_CPP_SANE_DATA_LIMIT (1024 * 1024 * 16)
 #endif
 
-/*! Size of fixed size (per connection) IO buffers */
+/*! Default initial size of IO buffers. See Request::Properties::ioBufferSize */
 #ifndef RESTC_CPP_IO_BUFFER_SIZE
 #   define RESTC_CPP_IO_BUFFER_SIZE (1024 * 16)
 #endif
 
+/*! Default size IO buffers may grow to for large bodies */
+#ifndef RESTC_CPP_IO_BUFFER_MAX_SIZE
+#   define RESTC_CPP_IO_BUFFER_MAX_SIZE (1024 * 256)
+#endif
+
 #define RESTC_CPP_IN_COROUTINE_CATCH_ALL \
     catch (boost::coroutines::detail::forced_unwind const&) { \
        throw; /* required for Boost Coroutine! */ \
@@ -65,6 +71,7 @@ class Request;
 class RequestBody;
 class Connection;
 class ConnectionPool;
+class DnsCache;
 class Socket;
 class Request;
 class Reply;
@@ -99,6 +106,8 @@ struct Headers : public std::multimap<std::string, std::string, ciLessLibC>  {
 
 using headers_t = Headers;
 
+class RequestHeaderBlock;
+
 class Request {
 public:
     struct Arg {
@@ -164,9 +173,49 @@ public:
                                                   const Reply& reply)>;
         using general_callback_t = std::function<void()>;
 
+        /*! Which idle connection to an endpoint to reuse first
+         *
+         * LIFO reuses the most recently released connection. That keeps
+         * a small set of warm connections busy, and lets the rest expire.
+         * FIFO rotates over all the idle connections.
+         */
+        enum class CacheReuse { FIFO, LIFO };
+
+        /*! How to choose between the addresses of a host that resolves to more than one
+         *
+         * FIRST uses the order from the resolver, and reuses any idle
+         * connection to the host. LEAST_OUTSTANDING picks the one of two
+         * random addresses that has the fewest requests in progress
+         * ("power of two choices"), and reuses idle connections to that
+         * address. The other addresses are still used as fallbacks if
+         * the connect fails.
+         */
+        enum class LoadBalancing { FIRST, LEAST_OUTSTANDING };
+
+        /*! When to use HTTP/2
+         *
+         * NEGOTIATE offers HTTP/2 to https servers with TLS ALPN, and
+         * falls back to HTTP/1.1 if the server don't select it.
+         * PRIOR_KNOWLEDGE also use HTTP/2 for plain http URL's, without
+         * asking the server first (RFC 7540, section 3.4).
+         * Requests to the same origin share one HTTP/2 connection.
+         * HTTP/2 is not used through HTTP proxies.
+         */
+        enum class Http2 { NEVER, NEGOTIATE, PRIOR_KNOWLEDGE };
+
+        /*! How to compress the request body
+         *
+         * The compressed body is sent chunked (HTTP/1.1), with a
+         * Content-Encoding header. Only available when the library
+         * is built with zlib.
+         */
+        enum class BodyCompression { NONE, GZIP, DEFLATE };
+
         bool tcpNodelay = true;
+        bool tlsSessionResumption = true; // Offer cached TLS sessions to servers we have connected to before
         int maxRedirects = 3;
         int connectTimeoutMs = (1000 * 12);
+        int connectAttemptDelayMs = 250; // Delay before connecting to the next address while a connect is in progress (RFC 8305). 0: one at a time
         int sendTimeoutMs = (1000 * 12); // For each IO operation
         int replyTimeoutMs =  (1000 * 21); // For the reply header
         int recvTimeout = (1000 * 21); // For each IO operation
@@ -174,6 +223,28 @@ public:
         std::size_t cacheMaxConnections = 128;
         int cacheTtlSeconds = 60;
         int cacheCleanupIntervalSeconds = 3;
+        int cacheWaitTimeoutMs = 0; // Max wait for a free connection if the pool is full. 0: don't wait
+        CacheReuse cacheReuse = CacheReuse::FIFO;
+        std::size_t cacheMinIdlePerEndpoint = 0; // Idle connections to an endpoint that are kept after cacheTtlSeconds. Endpoints from ConnectionPool::Warmup() are also reconnected up to this
+        int dnsCacheTtlSeconds = 0; // How long to cache host-name lookups. 0: don't cache
+        int dnsCacheNegativeTtlSeconds = 3; // How long to cache failed host-name lookups
+        int dnsCacheStaleSeconds = 60; // How long to use an expired lookup while it's refreshed
+        std::size_t dnsCacheMaxEntries = 1024; // Host names kept in the DNS cache. When it's full, the oldest lookups are dropped
+        LoadBalancing loadBalancing = LoadBalancing::FIRST;
+        Http2 http2 = Http2::NEVER;
+        std::size_t http2MaxConcurrentStreams = 100; // Our limit for requests in progress on one HTTP/2 connection
+        int http2WindowSize = (1024 * 1024); // Flow control window for each HTTP/2 stream. The connection gets 16 times as much.
+        std::size_t pipelineDepth = 1; // Max requests sent on a HTTP/1.1 connection before their replies are read. Above 1, idempotent requests are pipelined
+        std::size_t expectContinueThreshold = 0; // Send 'Expect: 100-continue' on HTTP/1.1 with bodies of at least this size. 0 disables it
+        int expectContinueTimeoutMs = 1000; // How long to wait for '100 Continue' before the body is sent anyway
+        std::size_t readAheadBuffers = 0; // Buffers for receiving a reply body (HTTP/1.1) while the last one is processed. 0 or 1 disables read-ahead
+        std::size_t writeBehindBuffers = 0; // Buffers queued for sending while a streamed body (HTTP/1.1) is produced. 0 disables write-behind
+        std::size_t ioBufferSize = RESTC_CPP_IO_BUFFER_SIZE; // Initial size of the buffers for receiving replies and reading file bodies. Borrowed from BufferPool::GetDefault()
+        std::size_t ioBufferMaxSize = RESTC_CPP_IO_BUFFER_MAX_SIZE; // The buffers double in size up to this while a large body fills them. ioBufferSize or less disables growth
+        BodyCompression bodyCompression = BodyCompression::NONE;
+        int bodyCompressionLevel = -1; // zlib level. 1 (fastest) to 9 (smallest), -1 for zlib's default
+        std::size_t decompressBufferSize = RESTC_CPP_IO_BUFFER_SIZE; // Output buffer for decompressed data. ReadInto() and GetBodyAsString() don't need it
+        std::vector<std::string> acceptEncoding; // Content codings RequestBuilder asks for, most preferred first. Empty: all we can decode
         headers_t headers;
         args_t args;
         Proxy proxy;
@@ -187,9 +258,39 @@ public:
         size_t threads = 1;
 #endif
         bool throwOnHttpError = true; // If false, the user must detect and deal with the error
+
+        /*! The default headers and arguments, rendered for the wire
+         *
+         * Used internally. The block is reused by all the requests
+         * that use the properties, and rendered again when headers
+         * or args have changed since it was rendered. A copy of the
+         * properties starts without a block.
+         */
+        class HeaderBlockCache {
+        public:
+            HeaderBlockCache() = default;
+            HeaderBlockCache(const HeaderBlockCache&) noexcept {}
+            HeaderBlockCache& operator = (const HeaderBlockCache&) noexcept {
+                block.reset();
+                return *this;
+            }
+
+            std::shared_ptr<const RequestHeaderBlock> block;
+        };
+        mutable HeaderBlockCache headerBlockCache;
     };
 
+    /*! The properties the request uses
+     *
+     * Includes the headers, args and auth given to Create().
+     */
     virtual const Properties& GetProperties() const = 0;
+
+    /*! Replace the properties
+     *
+     * The headers, args and auth given to Create() are dropped,
+     * so add them to the new properties if they are still needed.
+     */
     virtual void SetProperties(Properties::ptr_t propreties) = 0;
 
     /*! Manually send the request */
@@ -232,7 +333,8 @@ public:
 
     struct HttpResponse {
         enum class HttpVersion {
-            HTTP_1_1
+            HTTP_1_1,
+            HTTP_2
         };
         HttpVersion http_version = HttpVersion::HTTP_1_1;
         int status_code = 0;
@@ -273,6 +375,17 @@ public:
      */
     virtual boost::asio::const_buffers_1 GetSomeData() = 0;
 
+    /*! Get some data from the server into your own buffer.
+     *
+     * Decompressed data is written straight into buffer, so
+     * there is no extra copy.
+     *
+     * \return The number of bytes written to buffer. It may be 0
+     *      before the end of the data. Use MoreDataToRead() to
+     *      check for the end.
+     */
+    virtual std::size_t ReadInto(boost::asio::mutable_buffer buffer) = 0;
+
     /*! Returns true as long as you have not yet pulled all
      * the data from the response.
      */
@@ -284,6 +397,13 @@ public:
 
     /*! Get the values from multiple headers with the same name */
     virtual std::deque<std::string> GetHeaders(const std::string& name) = 0;
+
+    /*! Get the value of a header without copying it
+     *
+     * The value is valid as long as the reply.
+     */
+    virtual boost::optional<boost::string_ref>
+        GetHeaderView(boost::string_ref name) const = 0;
 };
 
 /*! The context is used to keep state within a co-routine.
@@ -428,6 +548,7 @@ public:
     }
 
     virtual std::shared_ptr<ConnectionPool> GetConnectionPool() = 0;
+    virtual std::shared_ptr<DnsCache> GetDnsCache() = 0;
     virtual boost::asio::io_service& GetIoService() = 0;
 
 #ifdef RESTC_CPP_WITH_TLS
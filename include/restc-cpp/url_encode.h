@@ -11,6 +11,9 @@ namespace restc_cpp {
 
 std::string url_encode(const boost::string_ref& src);
 
+/*! Append the url-encoded src to out */
+void url_encode(const boost::string_ref& src, std::string& out);
+
 } // namespace
 
 #endif // RESTC_CPP_URL_ENCODE_H_
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+
+#include <boost/asio.hpp>
+#include <boost/asio/spawn.hpp>
+
+namespace restc_cpp {
+
+/*! Lets a co-routine wait until something happens in another co-routine or thread
+ *
+ * Signal() can be called from any thread. The waiting co-routine is
+ * resumed on its own strand. A signal that arrives while nobody waits
+ * is remembered, so it is not lost.
+ *
+ * Only one co-routine can wait at a time.
+ */
+class AsyncEvent {
+public:
+    using ptr_t = std::shared_ptr<AsyncEvent>;
+
+    AsyncEvent(boost::asio::io_service& ioservice)
+    : ioservice_{ioservice} {}
+
+    AsyncEvent(const AsyncEvent&) = delete;
+    AsyncEvent& operator = (const AsyncEvent&) = delete;
+
+    /*! Wait for a signal
+     *
+     * \param timeoutMs Max time to wait. 0 waits forever.
+     * \return false if the wait timed out.
+     */
+    bool Wait(boost::asio::yield_context& yield, int timeoutMs = 0) {
+        std::unique_ptr<boost::asio::deadline_timer> timer;
+        boost::system::error_code ec;
+        auto token = yield[ec];
+
+        boost::asio::async_initiate<boost::asio::yield_context,
+                                    void(boost::system::error_code)>(
+            [&](auto handler) {
+                std::lock_guard<std::mutex> lock{state_->mutex};
+                if (state_->signalled) {
+                    state_->signalled = false;
+                    Complete(std::move(handler), {});
+                    return;
+                }
+
+                state_->handler = std::make_unique<Handler<decltype(handler)>>(
+                    std::move(handler));
+                const auto wait_id = ++state_->waits;
+
+                if (timeoutMs > 0) {
+                    timer = std::make_unique<boost::asio::deadline_timer>(
+                        ioservice_, boost::posix_time::milliseconds(timeoutMs));
+                    timer->async_wait([state = state_, wait_id](
+                                      const boost::system::error_code& ec) {
+                        if (!ec) {
+                            state->Resume(boost::asio::error::timed_out, wait_id);
+                        }
+                    });
+                }
+            }, token);
+
+        if (timer) {
+            timer->cancel();
+        }
+
+        return ec != boost::asio::error::timed_out;
+    }
+
+    /*! Wake up the waiting co-routine, or the next one to wait */
+    void Signal() {
+        state_->Resume({}, 0);
+    }
+
+private:
+    struct HandlerBase {
+        virtual ~HandlerBase() = default;
+        virtual void Complete(const boost::system::error_code& ec) = 0;
+    };
+
+    template <typename HandlerT>
+    struct Handler : public HandlerBase {
+        Handler(HandlerT&& h) : handler{std::move(h)} {}
+
+        void Complete(const boost::system::error_code& ec) override {
+            AsyncEvent::Complete(std::move(handler), ec);
+        }
+
+        HandlerT handler;
+    };
+
+    struct State {
+        // Resume the waiter. A timeout only applies to the wait it was started for.
+        void Resume(const boost::system::error_code& ec, uint64_t waitId) {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (!handler) {
+                if (!ec) {
+                    signalled = true;
+                }
+                return;
+            }
+
+            if (waitId && (waitId != waits)) {
+                return;
+            }
+
+            auto h = std::move(handler);
+            h->Complete(ec);
+        }
+
+        std::mutex mutex;
+        std::unique_ptr<HandlerBase> handler;
+        uint64_t waits = 0;
+        bool signalled = false;
+    };
+
+    // Resume the co-routine on its own executor (strand)
+    template <typename HandlerT>
+    static void Complete(HandlerT&& handler, const boost::system::error_code& ec) {
+        auto executor = boost::asio::get_associated_executor(handler);
+        boost::asio::post(executor, [handler = std::move(handler), ec]() mutable {
+            handler(ec);
+        });
+    }
+
+    boost::asio::io_service& ioservice_;
+    const std::shared_ptr<State> state_ = std::make_shared<State>();
+};
+
+} // restc_cpp
@@ -0,0 +1,129 @@
+
+
+#include <brotli/decode.h>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/DataReader.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/BufferPool.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+/*! Decode a brotli compressed body (RFC 7932) */
+class BrotliReaderImpl : public DataReader {
+public:
+    BrotliReaderImpl(std::unique_ptr<DataReader>&& source, const size_t bufferSize)
+    : source_{move(source)}, buffer_size_{bufferSize}
+    , state_{BrotliDecoderCreateInstance(nullptr, nullptr, nullptr)}
+    {
+        if (!state_) {
+            throw DecompressException("Failed to initialize brotli decompression");
+        }
+    }
+
+    BrotliReaderImpl(const BrotliReaderImpl&) = delete;
+    BrotliReaderImpl(BrotliReaderImpl&&) = delete;
+
+    BrotliReaderImpl& operator = (const BrotliReaderImpl&) = delete;
+    BrotliReaderImpl& operator = (BrotliReaderImpl&&) = delete;
+
+    ~BrotliReaderImpl() override {
+        BrotliDecoderDestroyInstance(state_);
+    }
+
+    bool IsEof() const override {
+        return done_;
+    }
+
+    void Finish() override {
+        if (source_)
+            source_->Finish();
+    }
+
+    boost::asio::const_buffers_1 ReadSome() override {
+        if (out_buffer_.empty()) {
+            // Smaller buffers share the size class of the I/O buffers
+            out_buffer_ = BufferPool::GetDefault().Borrow(
+                max<size_t>(buffer_size_, RESTC_CPP_IO_BUFFER_SIZE));
+        }
+
+        return {out_buffer_.data(), Decode(out_buffer_.data(), buffer_size_)};
+    }
+
+    bool CanReadInto() const noexcept override {
+        return true;
+    }
+
+    size_t ReadInto(boost::asio::mutable_buffer buffer) override {
+        return Decode(boost::asio::buffer_cast<char *>(buffer),
+                      boost::asio::buffer_size(buffer));
+    }
+
+private:
+    size_t Decode(char *dst, const size_t dstLen) {
+        size_t data_len = 0;
+
+        while(!done_ && (data_len < dstLen)) {
+            if (need_input_) {
+                if (data_len) {
+                    break; // Don't wait for more input when we have output
+                }
+
+                const auto buffers = source_->ReadSome();
+                next_in_ = boost::asio::buffer_cast<const uint8_t *>(buffers);
+                avail_in_ = boost::asio::buffer_size(buffers);
+
+                if (!avail_in_) {
+                    throw DecompressException("Decompression failed - premature end of stream.");
+                }
+            }
+
+            auto next_out = reinterpret_cast<uint8_t *>(dst + data_len);
+            size_t avail_out = dstLen - data_len;
+
+            const auto result = BrotliDecoderDecompressStream(
+                state_, &avail_in_, &next_in_, &avail_out, &next_out, nullptr);
+
+            data_len = dstLen - avail_out;
+            need_input_ = false;
+
+            switch(result) {
+                case BROTLI_DECODER_RESULT_SUCCESS:
+                    RESTC_CPP_LOG_TRACE_("BrotliReaderImpl::ReadSome(): End of stream. Done.");
+                    done_ = true;
+                    break;
+                case BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT:
+                    need_input_ = true;
+                    break;
+                case BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT:
+                    return data_len;
+                default:
+                    throw DecompressException(string("Decompression failed: ")
+                        + BrotliDecoderErrorString(BrotliDecoderGetErrorCode(state_)));
+            }
+        }
+
+        return data_len;
+    }
+
+    unique_ptr<DataReader> source_;
+    const size_t buffer_size_;
+    BrotliDecoderState *state_ = nullptr;
+    const uint8_t *next_in_ = nullptr;
+    size_t avail_in_ = 0;
+    bool need_input_ = true;
+    BufferPool::Buffer out_buffer_; // For ReadSome()
+    bool done_ = false;
+};
+
+
+std::unique_ptr<DataReader>
+DataReader::CreateBrotliReader(std::unique_ptr<DataReader>&& source,
+                               size_t bufferSize) {
+    return make_unique<BrotliReaderImpl>(move(source), bufferSize);
+}
+
+} // namespace
+
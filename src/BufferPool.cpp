@@ -0,0 +1,115 @@
+
+#include <cassert>
+
+#include "restc-cpp/BufferPool.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+static_assert((BufferPool::min_size << (BufferPool::num_classes - 1))
+              == BufferPool::max_size, "Size classes don't add up");
+
+BufferPool::BufferPool(const size_t maxIdleBytes)
+: max_idle_bytes_{maxIdleBytes}
+{
+}
+
+size_t BufferPool::GetClassIndex(const size_t size) noexcept {
+    size_t index = 0;
+    for(size_t class_size = min_size; class_size < size; class_size <<= 1) {
+        ++index;
+    }
+    return index;
+}
+
+size_t BufferPool::GetClassSize(const size_t size) noexcept {
+    if (size > max_size) {
+        return size;
+    }
+    return min_size << GetClassIndex(size);
+}
+
+BufferPool::Buffer BufferPool::Borrow(const size_t size) {
+    const auto class_size = GetClassSize(size);
+
+    unique_ptr<char[]> data;
+    if (class_size <= max_size) {
+        auto& sc = classes_[GetClassIndex(class_size)];
+        lock_guard<mutex> lock{sc.mutex};
+        if (!sc.idle.empty()) {
+            data = move(sc.idle.back());
+            sc.idle.pop_back();
+            idle_ -= class_size;
+            ++reused_;
+        }
+    }
+
+    if (!data) {
+        data.reset(new char[class_size]);
+        ++allocated_;
+    }
+
+    // Track the high-water mark
+    const auto in_use = (in_use_ += class_size);
+    auto hwm = high_water_mark_.load();
+    while((in_use > hwm) && !high_water_mark_.compare_exchange_weak(hwm, in_use)) {
+        ;
+    }
+
+    return {this, move(data), class_size};
+}
+
+void BufferPool::Return(unique_ptr<char[]>&& data, const size_t size) noexcept {
+    assert(data);
+    in_use_ -= size;
+
+    if (size > max_size) {
+        return;
+    }
+
+    auto& sc = classes_[GetClassIndex(size)];
+    lock_guard<mutex> lock{sc.mutex};
+    if (((sc.idle.size() + 1) * size) <= max_idle_bytes_) {
+        try {
+            sc.idle.push_back(move(data));
+            idle_ += size;
+        } catch(const bad_alloc&) {
+            ; // The buffer is freed
+        }
+    }
+}
+
+BufferPool::Stats BufferPool::GetStats() const noexcept {
+    Stats stats;
+    stats.inUse = in_use_;
+    stats.highWaterMark = high_water_mark_;
+    stats.idle = idle_;
+    stats.allocated = allocated_;
+    stats.reused = reused_;
+    return stats;
+}
+
+void BufferPool::ResetHighWaterMark() noexcept {
+    high_water_mark_ = in_use_.load();
+}
+
+void BufferPool::Trim() {
+    size_t size = min_size;
+    for(auto& sc : classes_) {
+        decltype(sc.idle) idle;
+        {
+            lock_guard<mutex> lock{sc.mutex};
+            idle.swap(sc.idle);
+            idle_ -= idle.size() * size;
+        }
+        size <<= 1;
+    }
+}
+
+BufferPool& BufferPool::GetDefault() {
+    static auto *pool = new BufferPool;
+    return *pool;
+}
+
+} // restc_cpp
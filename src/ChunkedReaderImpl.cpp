@@ -17,7 +17,7 @@ class ChunkedReaderImpl : public DataReader {
 public:
 
     ChunkedReaderImpl(add_header_fn_t&& fn, unique_ptr<DataReaderStream>&& source)
-    : stream_{move(source)}, add_header_(move(fn))
+    : stream_{move(source)}, add_header_(std::move(fn))
     {
     }
 
@@ -93,6 +93,10 @@ public:
 
         auto data = GetData();
 
+        // The rest of the chunk, and at least "\r\n0\r\n\r\n" will follow
+        static constexpr size_t min_tail = 7;
+        stream_->ReadAhead(chunk_len_ + min_tail);
+
         Log(data, "ChunkedReaderImpl::ReadSome()");
 
         return data;
@@ -171,7 +175,7 @@ private:
 
 DataReader::ptr_t
 DataReader::CreateChunkedReader(add_header_fn_t fn, unique_ptr<DataReaderStream>&& source) {
-    return make_unique<ChunkedReaderImpl>(move(fn), move(source));
+    return make_unique<ChunkedReaderImpl>(std::move(fn), move(source));
 }
 
 
@@ -26,23 +26,43 @@ public:
 
     void Write(boost::asio::const_buffers_1 buffers) override {
         const auto len = boost::asio::buffer_size(buffers);
+        if (len == 0) {
+            return;
+        }
+
         buffers_.resize(2);
         buffers_[1] = buffers;
-        DoWrite(len);
+        PrepareChunk(len);
+        next_->Write(buffers_);
     }
 
     void Write(const write_buffers_t& buffers) override {
         const auto len = boost::asio::buffer_size(buffers);
-        buffers_.resize(1);
-        for(auto &b : buffers) {
-            buffers_.push_back(b);
+        if (len == 0) {
+            return;
+        }
+
+        PrepareChunk(buffers, len);
+        next_->Write(buffers_);
+    }
+
+    void WriteDirectAndData(boost::asio::const_buffers_1 direct,
+                            const write_buffers_t& buffers) override {
+        const auto len = boost::asio::buffer_size(buffers);
+        if (len == 0) {
+            next_->WriteDirect(direct);
+            return;
         }
-        DoWrite(len);
+
+        PrepareChunk(buffers, len);
+        next_->WriteDirectAndData(direct, buffers_);
     }
 
     void Finish() override {
+        // Each chunk ends with its own CRLF, so this is the last-chunk,
+        // the optional trailer and the final CRLF in one buffer.
         static const std::string crlfx2{"\r\n\r\n"};
-        std::string finito = {"\r\n0"};
+        std::string finito = {"0"};
 
         if (add_header_fn_) {
             finito += add_header_fn_();
@@ -65,37 +85,38 @@ public:
     }
 
 private:
-    // Set the chunk header and send the data
-    void DoWrite(const size_t len) {
-        if (len == 0) {
-            return;
+    void PrepareChunk(const write_buffers_t& buffers, const size_t len) {
+        buffers_.resize(1);
+        for(auto &b : buffers) {
+            buffers_.push_back(b);
         }
+        PrepareChunk(len);
+    }
+
+    // Set the chunk header and the trailing CRLF around the data in buffers_,
+    // so that the whole chunk goes out in one write.
+    void PrepareChunk(const size_t len) {
+        static const boost::string_ref crlf{"\r\n"};
 
         if (len > RESTC_CPP_MAX_INPUT_BUFFER_LENGTH) {
             throw ConstraintException("Input buffer is too large");
         }
-        
+
         // The data part of  buffers_ must be properly initialized
         assert(buffers_.size() > 1);
-        std::ostringstream hdr;
 
-        if (first_) {
-            first_ = false;
-        } else {
-            hdr << '\r' << '\n';
-        }
-
-        hdr << hex << len << '\r' << '\n';
-        const auto header = hdr.str();
+        const auto hdr_len = snprintf(chunk_header_.data(), chunk_header_.size(),
+                                      "%zx\r\n", len);
+        assert(hdr_len > 0);
 
-        buffers_[0] = {header.c_str(), header.size()};
-        next_->Write(buffers_);
+        buffers_[0] = {chunk_header_.data(), static_cast<size_t>(hdr_len)};
+        buffers_.push_back({crlf.data(), crlf.size()});
     }
 
-    bool first_ = true;
     unique_ptr<DataWriter> next_;
     write_buffers_t buffers_;
     add_header_fn_t add_header_fn_;
+    std::array<char, 24> chunk_header_ = {}; // Size in hex and CRLF
 };
 
 
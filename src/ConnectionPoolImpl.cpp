@@ -1,21 +1,32 @@
+#include <algorithm>
 #include <atomic>
 #include <iostream>
 #include <thread>
 #include <future>
 #include <queue>
+#include <deque>
+#include <list>
 #include <mutex>
+#include <random>
+#include <unordered_map>
 
 #include <boost/utility/string_ref.hpp>
+#include <boost/functional/hash.hpp>
 
 #include "restc-cpp/restc-cpp.h"
 #include "restc-cpp/Connection.h"
 #include "restc-cpp/ConnectionPool.h"
+#include "restc-cpp/DnsCache.h"
 #include "restc-cpp/logging.h"
 #include "restc-cpp/error.h"
+#include "restc-cpp/IoTimer.h"
+#include "restc-cpp/Url.h"
 #include "restc-cpp/internals/helpers.h"
 
 #include "ConnectionImpl.h"
 #include "SocketImpl.h"
+#include "Http2Connection.h"
+#include "Pipeline.h"
 
 #ifdef RESTC_CPP_WITH_TLS
 #   include "TlsSocketImpl.h"
@@ -41,14 +52,29 @@ public:
         Key& operator = (const Key&) = delete;
         Key& operator = (Key&&) = delete;
 
-        bool operator < (const Key& key) const {
-            if (static_cast<int>(type) < static_cast<int>(key.type)) {
-                return true;
-            }
+        bool operator == (const Key& key) const {
+            return (type == key.type) && (endpoint == key.endpoint);
+        }
 
-            return endpoint < key.endpoint;
+        size_t GetHash() const noexcept {
+            size_t seed = static_cast<size_t>(type);
+            const auto addr = endpoint.address();
+            if (addr.is_v4()) {
+                boost::hash_combine(seed, addr.to_v4().to_ulong());
+            } else {
+                const auto bytes = addr.to_v6().to_bytes();
+                boost::hash_range(seed, bytes.begin(), bytes.end());
+            }
+            boost::hash_combine(seed, endpoint.port());
+            return seed;
         }
 
+        struct Hash {
+            size_t operator()(const Key& key) const noexcept {
+                return key.GetHash();
+            }
+        };
+
         friend std::ostream& operator << (std::ostream& o, const Key& v) {
             return o << "{Key "
                 << (v.type == Connection::Type::HTTPS? "https" : "http")
@@ -57,21 +83,123 @@ public:
                 << "}";
         }
 
+        Connection::Type GetType() const noexcept { return type; }
+        const boost::asio::ip::tcp::endpoint& GetEndpoint() const noexcept { return endpoint; }
+
     private:
         const boost::asio::ip::tcp::endpoint endpoint;
         const Connection::Type type;
     };
 
+    /*! Index from origins to the endpoints we have connections to for them
+     *
+     * Lets a request find a pooled connection by its host name, without
+     * resolving it first. Each connection that knows its origin is counted
+     * here for as long as it exists. The index has its own locks, and they
+     * are never held while a shard is locked.
+     */
+    class OriginIndex {
+    public:
+        using ptr_t = std::shared_ptr<OriginIndex>;
+
+        void Add(const std::string& origin, const Key& key) {
+            auto& part = GetPart(origin);
+            lock_guard<mutex> lock{part.mutex_};
+            auto& keys = part.origins[origin];
+            auto it = keys.find(key);
+            if (it == keys.end()) {
+                keys.emplace(key, 1);
+            } else {
+                ++it->second;
+            }
+        }
+
+        void Remove(const std::string& origin, const Key& key) {
+            auto& part = GetPart(origin);
+            lock_guard<mutex> lock{part.mutex_};
+            auto oit = part.origins.find(origin);
+            assert(oit != part.origins.end());
+            auto kit = oit->second.find(key);
+            assert(kit != oit->second.end());
+            if (--kit->second == 0) {
+                oit->second.erase(kit);
+                if (oit->second.empty()) {
+                    part.origins.erase(oit);
+                }
+            }
+        }
+
+        // Get the endpoints we have connections to for the origin
+        std::vector<Key> Find(const std::string& origin) {
+            std::vector<Key> keys;
+            auto& part = GetPart(origin);
+            lock_guard<mutex> lock{part.mutex_};
+            auto it = part.origins.find(origin);
+            if (it != part.origins.end()) {
+                keys.reserve(it->second.size());
+                for(const auto& k : it->second) {
+                    keys.push_back(k.first);
+                }
+            }
+            return keys;
+        }
+
+    private:
+        static constexpr size_t num_parts = 16;
+
+        struct Part {
+            // Number of connections for each endpoint, by origin
+            std::unordered_map<std::string,
+                std::unordered_map<Key, size_t, Key::Hash>> origins;
+            std::mutex mutex_;
+        };
+
+        Part& GetPart(const std::string& origin) {
+            return parts_[std::hash<std::string>{}(origin) % num_parts];
+        }
+
+        std::array<Part, num_parts> parts_;
+    };
+
     struct Entry {
         using timestamp_t = decltype(chrono::steady_clock::now());
         using ptr_t = std::shared_ptr<Entry>;
-
-        Entry(boost::asio::ip::tcp::endpoint ep,
-              const Connection::Type connectionType,
+        using list_t = std::list<ptr_t>;
+
+        /*! Where an idle entry is linked into the pools lists.
+         *
+         * Only valid while the entry is idle, and only accessed
+         * with the lock for its shard held.
+         */
+        struct IdleLinks {
+            list_t::iterator in_bucket;
+            list_t::iterator in_lru;
+            list_t::iterator in_wheel;
+            uint64_t expires_tick = 0;
+        };
+
+        Entry(const Key& entryKey,
               Connection::ptr_t conn,
-              const Request::Properties& prop)
-        : key{move(ep), connectionType}, connection{move(conn)}, ttl{prop.cacheTtlSeconds}
-        , created{time(nullptr)} {}
+              const Request::Properties& prop,
+              std::string entryOrigin = {},
+              OriginIndex::ptr_t originIndex = {})
+        : key{entryKey}, connection{move(conn)}, ttl{prop.cacheTtlSeconds}
+        , created{time(nullptr)}, origin{move(entryOrigin)}
+        {
+            if (originIndex && !origin.empty()) {
+                origins = move(originIndex);
+                origins->Add(origin, key);
+            }
+        }
+
+        Entry(const Entry&) = delete;
+        Entry& operator = (const Entry&) = delete;
+
+        ~Entry() {
+            if (origins) {
+                origins->Remove(origin, key);
+            }
+        }
 
         friend ostream& operator << (ostream& o, const Entry& e) {
             o << "{Entry " << e.key;
@@ -84,25 +212,25 @@ public:
         }
 
         const Key& GetKey() const noexcept { return key; }
+        // The origin the connection was made for, or empty if it is unknown
+        const std::string& GetOrigin() const noexcept { return origin; }
         Connection::ptr_t& GetConnection() noexcept { return connection; }
         int GetTtl() const noexcept { return ttl; }
         time_t GetCreated() const noexcept { return created;}
-        timestamp_t GetLastUsed() const noexcept {
-            LOCK_ALWAYS_;
-            return last_used;
-        }
-        void SetLastUsed(timestamp_t ts) {
-            LOCK_ALWAYS_;
-            last_used = ts;
-        }
+        // The time-stamps are protected by the lock for the entry's shard
+        timestamp_t GetLastUsed() const noexcept { return last_used; }
+        void SetLastUsed(timestamp_t ts) noexcept { last_used = ts; }
+        IdleLinks& GetLinks() noexcept { return links; }
 
     private:
         const Key key;
         Connection::ptr_t connection;
         const int ttl = 60;
         const time_t created;
-        mutable std::mutex mutex_;
         timestamp_t last_used = chrono::steady_clock::now();
+        IdleLinks links;
+        const std::string origin;
+        OriginIndex::ptr_t origins;
     };
 
     // Owns the connection
@@ -146,6 +274,156 @@ public:
     };
 
 
+    /*! A co-routine waiting for a connection to an endpoint */
+    struct Waiter {
+        using ptr_t = std::shared_ptr<Waiter>;
+        enum class State {
+            WAITING,
+            HAVE_ENTRY, // A released connection is handed over in entry
+            HAVE_SLOT,  // A slot is reserved. The waiter must create the connection
+            RETRY       // Something changed globally. Check the pool again
+        };
+
+        Waiter(boost::asio::io_service& ioservice)
+        : timer{ioservice} {}
+
+        State state = State::WAITING;
+        Entry::ptr_t entry;
+        boost::asio::deadline_timer timer;
+        std::atomic_bool resumed{false};
+    };
+
+    /*! Hashed timer wheel for idle entries
+     *
+     * Time is counted in ticks of one second since the pool was created.
+     * An entry is put in the slot for the tick when it expires, so each
+     * cleanup only has to look at the slots for the ticks that passed
+     * since the last one. Entries that expire more than one revolution
+     * ahead stay in their slot until their tick comes up.
+     */
+    class TimerWheel {
+    public:
+        static constexpr size_t num_slots = 64;
+
+        void Add(const Entry::ptr_t& entry, uint64_t tick) {
+            auto& links = entry->GetLinks();
+            links.expires_tick = max(tick, last_tick_ + 1);
+            auto& slot = slots_[links.expires_tick % num_slots];
+            links.in_wheel = slot.insert(slot.end(), entry);
+        }
+
+        void Remove(Entry& entry) {
+            auto& links = entry.GetLinks();
+            slots_[links.expires_tick % num_slots].erase(links.in_wheel);
+        }
+
+        /* Call fn for, and remove, all the entries that expire at or before now.
+         *
+         * If fn returns false, the entry is kept, and will be checked again
+         * when its ttl has passed once more.
+         */
+        template <typename FnT>
+        void Expire(uint64_t now, FnT fn) {
+            if (now <= last_tick_) {
+                return;
+            }
+
+            const auto ticks = min<uint64_t>(now - last_tick_, num_slots);
+            for(uint64_t tick = now - ticks + 1; tick <= now; ++tick) {
+                auto& slot = slots_[tick % num_slots];
+                for(auto it = slot.begin(); it != slot.end();) {
+                    if ((*it)->GetLinks().expires_tick <= now) {
+                        auto entry = move(*it);
+                        it = slot.erase(it);
+                        if (!fn(entry)) {
+                            Add(entry, now + max(entry->GetTtl(), 0) + 1);
+                        }
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            last_tick_ = now;
+        }
+
+        void Clear() {
+            for(auto& slot : slots_) {
+                slot.clear();
+            }
+        }
+
+    private:
+        std::array<Entry::list_t, num_slots> slots_;
+        uint64_t last_tick_ = 0;
+    };
+
+    /*! All the connections we know about to one endpoint */
+    struct Bucket {
+        Entry::list_t idle; // Least recently released first
+        std::deque<Waiter::ptr_t> waiters;
+        size_t in_use = 0;
+
+        size_t size() const noexcept { return idle.size() + in_use; }
+        bool empty() const noexcept { return size() == 0 && waiters.empty(); }
+    };
+
+    /*! A slice of the pool with its own lock.
+     *
+     * Endpoints are distributed over the shards by the hash of
+     * their key, so threads working on different endpoints
+     * normally don't compete for the same mutex.
+     */
+    struct Shard {
+        std::unordered_map<Key, Bucket, Key::Hash> buckets;
+        Entry::list_t lru; // All the idle entries in the shard, least recently released first
+        TimerWheel wheel;
+        mutable std::mutex mutex_;
+    };
+
+    static constexpr size_t num_shards_ = 16;
+
+    /*! An endpoint Warmup() connected to, kept at cacheMinIdlePerEndpoint */
+    struct WarmEndpoint {
+        std::string host;
+        std::string origin;
+        bool replenishing = false; // A co-routine is connecting
+    };
+
+    /*! HTTP/2 connections to one origin
+     *
+     * They are shared by all the requests to the origin,
+     * so they are never idle in the normal sense.
+     */
+    struct Http2Origin {
+        std::vector<Http2Connection::ptr_t> connections;
+        std::deque<AsyncEvent::ptr_t> waiters; // Waiting for a connect in progress
+        bool connecting = false;
+        std::chrono::steady_clock::time_point http1_until; // Don't try HTTP/2 until then
+    };
+
+    /*! Statistics counters
+     *
+     * Updated with relaxed atomics, so they never take a lock.
+     */
+    struct Counters {
+        using counter_t = std::atomic<std::uint64_t>;
+
+        counter_t hits{0};
+        counter_t misses{0};
+        counter_t created{0};
+        counter_t expired{0};
+        counter_t purged{0};
+        counter_t discarded{0};
+        counter_t stale{0};
+        counter_t rejected{0};
+        counter_t waits{0};
+        counter_t wait_timeouts{0};
+    };
+
+    static void Count(Counters::counter_t& counter) noexcept {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
     ConnectionPoolImpl(RestClient& owner)
     : owner_{owner}, properties_{owner.GetConnectionProperties()}
     , cache_cleanup_timer_{owner.GetIoService()}
@@ -158,30 +436,390 @@ public:
                 const Connection::Type connectionType,
                 bool newConnectionPlease) override {
 
+        if (closed_) {
+            throw ObjectExpiredException("The connection-pool is closed.");
+        }
+
+        const Key key{ep, connectionType};
         if (!newConnectionPlease) {
-            if (auto conn = GetFromCache(ep, connectionType)) {
+            return GetOrCreate(key, {});
+        }
+
+        ForceReserveSlot(key);
+        return CreateNew(key);
+    }
+
+    Connection::ptr_t
+    GetConnection(const boost::asio::ip::tcp::endpoint ep,
+                  const Connection::Type connectionType,
+                  Context& ctx,
+                  const std::string& origin) override {
+
+        if (closed_) {
+            throw ObjectExpiredException("The connection-pool is closed.");
+        }
+
+        const Key key{ep, connectionType};
+        const auto wait_ms = properties_->cacheWaitTimeoutMs;
+        if (wait_ms <= 0) {
+            return GetOrCreate(key, origin);
+        }
+
+        const auto expires = boost::posix_time::microsec_clock::universal_time()
+            + boost::posix_time::milliseconds(wait_ms);
+
+        bool retry = false;
+        while(true) {
+            if (auto conn = GetFromCache(key)) {
                 RESTC_CPP_LOG_TRACE_("Reusing connection from cache "
                     << *conn);
                 return conn;
             }
 
-            if (!CanCreateNewConnection(ep, connectionType)) {
+            if (ReserveSlot(key)) {
+                return CreateNew(key, origin);
+            }
+
+            auto waiter = make_shared<Waiter>(GetCtx());
+            waiter->timer.expires_at(expires);
+            Enqueue(key, waiter, retry);
+
+            if (waiter->state == Waiter::State::WAITING) {
+                RESTC_CPP_LOG_TRACE_("Waiting for a connection to " << key);
+                boost::system::error_code ec;
+                waiter->timer.async_wait(ctx.GetYield()[ec]);
+                waiter->resumed = true;
+            }
+
+            switch(TakeWaiterState(key, waiter)) {
+            case Waiter::State::HAVE_ENTRY:
+                RESTC_CPP_LOG_TRACE_("Got released connection " << *waiter->entry);
+                return make_unique<ConnectionWrapper>(waiter->entry, on_release_);
+            case Waiter::State::HAVE_SLOT:
+                return CreateNew(key, origin);
+            case Waiter::State::RETRY:
+                if (closed_) {
+                    throw ObjectExpiredException("The connection-pool is closed.");
+                }
+                retry = true;
+                break;
+            case Waiter::State::WAITING:
+                RESTC_CPP_LOG_DEBUG_("Timed out waiting for a connection to " << key);
+                Count(counters_.wait_timeouts);
+                Count(counters_.rejected);
                 throw ConstraintException(
-                    "Cannot create connection - too many connections");
+                    "Cannot create connection - too many connections (timed out waiting)");
+            }
+        }
+    }
+
+    size_t Warmup(const std::string& url, size_t count, Context& ctx) override {
+        if (properties_->proxy.type != Request::Proxy::Type::NONE) {
+            throw NotImplementedException("Warmup is not supported with a proxy");
+        }
+
+        const Url parsed_url{url.c_str()};
+        const auto type = (parsed_url.GetProtocol() == Url::Protocol::HTTPS)
+            ? Connection::Type::HTTPS : Connection::Type::HTTP;
+        const auto host = parsed_url.GetHost().to_string();
+
+        const auto port = parsed_url.GetPort().to_string();
+        const auto origin = MakeOrigin(type, host, port, properties_->proxy);
+
+        RESTC_CPP_LOG_TRACE_("Warmup: Resolving " << host << ":" << port);
+
+        size_t warmed = 0;
+        for(const auto& endpoint : owner_.GetDnsCache()->Resolve(host, port, ctx)) {
+            if (warmed >= count) {
+                break;
+            }
+
+            const Key key{endpoint, type};
+            const auto opened = OpenIdle(key, host, origin, count - warmed, ctx);
+            warmed += opened;
+
+            if (opened && properties_->cacheMinIdlePerEndpoint) {
+                lock_guard<mutex> lock{mutex_};
+                warm_[key] = {host, origin};
+            }
+
+            if ((warmed < count) && (connections_ >= properties_->cacheMaxConnections)) {
+                RESTC_CPP_LOG_DEBUG_("Warmup: The pool is full. Opened "
+                    << warmed << " connections to " << url);
+                break;
+            }
+        }
+
+        return warmed;
+    }
+
+    /*! Open up to count connections to the endpoint, and release them to the pool
+     *
+     * Stops when the endpoint or the pool is full, or if connect fails.
+     *
+     * \return The number of connections that was opened.
+     */
+    size_t OpenIdle(const Key& key, const std::string& host,
+                    const std::string& origin, const size_t count, Context& ctx) {
+        static const auto timer_name = "OpenIdle"s;
+
+        size_t opened = 0;
+        while(opened < count) {
+            // Don't purge idle connections, as they may be the ones we just opened
+            if (!ReserveSlot(key, false)) {
+                RESTC_CPP_LOG_DEBUG_("OpenIdle: No more slots. Opened "
+                    << opened << " connections to " << key);
+                break;
+            }
+
+            auto connection = CreateNew(key, origin);
+            auto timer = IoTimer::Create(timer_name,
+                properties_->connectTimeoutMs, connection);
+
+            try {
+                connection->GetSocket().AsyncConnect(
+                    key.GetEndpoint(), host, properties_->tcpNodelay, ctx.GetYield());
+            } catch(const exception& ex) {
+                RESTC_CPP_LOG_DEBUG_("OpenIdle: Failed to connect to "
+                    << key.GetEndpoint() << ": " << ex.what());
+                connection->GetSocket().GetSocket().close();
+                break;
+            }
+
+            RESTC_CPP_LOG_TRACE_("OpenIdle: Opened " << *connection);
+            ++opened;
+        }
+
+        return opened;
+    }
+
+    Connection::ptr_t GetIdleConnection(const std::string& origin) override {
+        if (closed_) {
+            throw ObjectExpiredException("The connection-pool is closed.");
+        }
+
+        for(const auto& key : origins_->Find(origin)) {
+            auto& shard = GetShard(key);
+            lock_guard<mutex> lock{shard.mutex_};
+            auto it = shard.buckets.find(key);
+            if (it == shard.buckets.end()) {
+                continue;
+            }
+
+            auto& bucket = it->second;
+            if (auto entry = TakeIdle(shard, bucket, &origin)) {
+                ++bucket.in_use;
+                RESTC_CPP_LOG_TRACE_("Reusing connection from cache for "
+                    << origin << ": " << *entry);
+                return make_unique<ConnectionWrapper>(move(entry), on_release_);
+            }
+
+            if (bucket.empty()) {
+                shard.buckets.erase(it);
+            }
+        }
+
+        return {};
+    }
+
+    Http2Connection::ptr_t GetHttp2Connection(const std::string& origin,
+                                              Context& ctx) override {
+        const auto expires = chrono::steady_clock::now()
+            + chrono::milliseconds(properties_->connectTimeoutMs);
+
+        while(true) {
+            auto waiter = make_shared<AsyncEvent>(owner_.GetIoService());
+            {
+                LOCK_ALWAYS_;
+                if (closed_) {
+                    throw ObjectExpiredException("The connection-pool is closed.");
+                }
+
+                auto& o = http2_[origin];
+                auto& conns = o.connections;
+                conns.erase(remove_if(conns.begin(), conns.end(),
+                                      [](const Http2Connection::ptr_t& c) {
+                    return !c->IsUsable();
+                }), conns.end());
+
+                if (!conns.empty()) {
+                    return *min_element(conns.begin(), conns.end(),
+                                        [](const Http2Connection::ptr_t& a,
+                                           const Http2Connection::ptr_t& b) {
+                        return a->GetActiveStreams() < b->GetActiveStreams();
+                    });
+                }
+
+                const auto now = chrono::steady_clock::now();
+                if ((o.http1_until > now) || !o.connecting || (now >= expires)) {
+                    // The caller must connect
+                    o.connecting = true;
+                    return {};
+                }
+
+                o.waiters.push_back(waiter);
+            }
+
+            RESTC_CPP_LOG_TRACE_("GetHttp2Connection: Waiting for the connect to "
+                << origin);
+            const auto ms = chrono::duration_cast<chrono::milliseconds>(
+                expires - chrono::steady_clock::now()).count();
+            if (!waiter->Wait(ctx.GetYield(), static_cast<int>(max<decltype(ms)>(ms, 1)))) {
+                LOCK_ALWAYS_;
+                auto& waiters = http2_[origin].waiters;
+                waiters.erase(remove(waiters.begin(), waiters.end(), waiter), waiters.end());
             }
         }
+    }
 
-        return CreateNew(ep, connectionType);
+    void AddHttp2Connection(const std::string& origin,
+                            Http2Connection::ptr_t connection) override {
+        Http2Connection::ptr_t discard;
+        {
+            LOCK_ALWAYS_;
+            if (closed_) {
+                discard = move(connection);
+            } else {
+                auto& o = http2_[origin];
+                if (connection) {
+                    RESTC_CPP_LOG_TRACE_("Adding " << *connection << " for " << origin);
+                    o.connections.push_back(move(connection));
+                } else {
+                    RESTC_CPP_LOG_TRACE_("The server at " << origin
+                        << " does not talk HTTP/2");
+                    o.http1_until = chrono::steady_clock::now()
+                        + chrono::seconds(properties_->cacheTtlSeconds);
+                }
+                o.connecting = false;
+                for(auto& waiter : o.waiters) {
+                    waiter->Signal();
+                }
+                o.waiters.clear();
+            }
+        }
+
+        if (discard) {
+            discard->Close();
+        }
+    }
+
+    void CancelHttp2Connect(const std::string& origin) override {
+        LOCK_ALWAYS_;
+        auto it = http2_.find(origin);
+        if (it != http2_.end()) {
+            auto& o = it->second;
+            o.connecting = false;
+            // Let the next one try
+            if (!o.waiters.empty()) {
+                o.waiters.front()->Signal();
+                o.waiters.pop_front();
+            }
+        }
+    }
+
+    PipelineTicket::ptr_t JoinPipeline(const std::string& origin) override {
+        LOCK_ALWAYS_;
+        if (closed_) {
+            throw ObjectExpiredException("The connection-pool is closed.");
+        }
+
+        auto it = pipelines_.find(origin);
+        if (it == pipelines_.end()) {
+            return {};
+        }
+
+        auto& pipelines = it->second;
+        for(auto p = pipelines.begin(); p != pipelines.end();) {
+            auto pipeline = p->lock();
+            if (!pipeline || !pipeline->IsUsable()) {
+                p = pipelines.erase(p);
+                continue;
+            }
+
+            if (auto ticket = pipeline->Join()) {
+                return ticket;
+            }
+            ++p;
+        }
+
+        if (pipelines.empty()) {
+            pipelines_.erase(it);
+        }
+
+        return {};
+    }
+
+    void AddPipeline(const std::string& origin,
+                     const Pipeline::ptr_t& pipeline) override {
+        LOCK_ALWAYS_;
+        if (!closed_) {
+            pipelines_[origin].push_back(pipeline);
+        }
     }
 
     // Get ctx for internal, syncronized operations;
-    auto& GetCtx() const {
+    boost::asio::io_service& GetCtx() const {
       return owner_.GetIoService();
     }
 
+    size_t SelectEndpoint(const std::vector<boost::asio::ip::tcp::endpoint>& endpoints,
+                          const Connection::Type connectionType) const override {
+        assert(!endpoints.empty());
+        if (endpoints.size() == 1) {
+            return 0;
+        }
+
+        static thread_local std::minstd_rand rnd{std::random_device{}()};
+        size_t first = rnd() % endpoints.size();
+        size_t second = rnd() % (endpoints.size() - 1);
+        if (second >= first) {
+            ++second; // Two different endpoints
+        }
+
+        const auto load_first = GetLoad({endpoints[first], connectionType});
+        const auto load_second = GetLoad({endpoints[second], connectionType});
+        RESTC_CPP_LOG_TRACE_("SelectEndpoint: " << endpoints[first] << " has load " << load_first
+            << ", " << endpoints[second] << " has load " << load_second);
+        return (load_second < load_first) ? second : first;
+    }
+
     size_t GetIdleConnections() const override {
-        LOCK_ALWAYS_;
-        return idle_.size();
+        return idle_connections_;
+    }
+
+    Stats GetStats(bool withEndpoints) const override {
+        static constexpr auto relaxed = std::memory_order_relaxed;
+        Stats stats;
+        stats.hits = counters_.hits.load(relaxed);
+        stats.misses = counters_.misses.load(relaxed);
+        stats.created = counters_.created.load(relaxed);
+        stats.expired = counters_.expired.load(relaxed);
+        stats.purged = counters_.purged.load(relaxed);
+        stats.discarded = counters_.discarded.load(relaxed);
+        stats.stale = counters_.stale.load(relaxed);
+        stats.rejected = counters_.rejected.load(relaxed);
+        stats.waits = counters_.waits.load(relaxed);
+        stats.waitTimeouts = counters_.wait_timeouts.load(relaxed);
+        stats.connections = connections_;
+        stats.idle = idle_connections_;
+        stats.waiting = waiting_;
+
+        if (withEndpoints) {
+            for(const auto& shard : shards_) {
+                lock_guard<mutex> lock{shard.mutex_};
+                for(const auto& it : shard.buckets) {
+                    Stats::Endpoint ep;
+                    ep.endpoint = it.first.GetEndpoint();
+                    ep.type = it.first.GetType();
+                    ep.idle = it.second.idle.size();
+                    ep.inUse = it.second.in_use;
+                    ep.waiting = it.second.waiters.size();
+                    stats.endpoints.push_back(move(ep));
+                }
+            }
+        }
+
+        return stats;
     }
 
     void Close() override {
@@ -189,10 +827,36 @@ public:
         if (!closed_) {
             call_once(close_once_, [this] {
                 RESTC_CPP_LOG_TRACE_("ConnectionPoolImpl::Close: closing *once*.");
-                LOCK_ALWAYS_;
-                closed_ = true;
-                cache_cleanup_timer_.cancel();
-                idle_.clear();
+                decltype(http2_) http2;
+                {
+                    LOCK_ALWAYS_;
+                    closed_ = true;
+                    cache_cleanup_timer_.cancel();
+                    http2.swap(http2_);
+                    pipelines_.clear();
+                }
+                for(auto& it : http2) {
+                    for(auto& conn : it.second.connections) {
+                        conn->Close();
+                    }
+                    for(auto& waiter : it.second.waiters) {
+                        waiter->Signal();
+                    }
+                }
+                for(auto& shard : shards_) {
+                    lock_guard<mutex> lock{shard.mutex_};
+                    shard.lru.clear();
+                    shard.wheel.Clear();
+                    for(auto& it : shard.buckets) {
+                        DropIdle(it.second.idle.size());
+                        it.second.idle.clear();
+                        for(auto& waiter : it.second.waiters) {
+                            --waiting_;
+                            Wake(waiter, Waiter::State::RETRY);
+                        }
+                        it.second.waiters.clear();
+                    }
+                }
             });
         }
         RESTC_CPP_LOG_TRACE_("ConnectionPoolImpl::Close: leave");
@@ -203,6 +867,231 @@ public:
     }
 
 private:
+    Shard& GetShard(const Key& key) {
+        return shards_[key.GetHash() % num_shards_];
+    }
+
+    // Connections to the endpoint in use, and co-routines waiting for one
+    size_t GetLoad(const Key& key) const {
+        const auto& shard = shards_[key.GetHash() % num_shards_];
+        lock_guard<mutex> lock{shard.mutex_};
+        auto it = shard.buckets.find(key);
+        if (it == shard.buckets.end()) {
+            return 0;
+        }
+        return it->second.in_use + it->second.waiters.size();
+    }
+
+    // Remove n idle connections from the counters
+    void DropIdle(size_t n) {
+        idle_connections_ -= n;
+        connections_ -= n;
+    }
+
+    uint64_t GetTick(const Entry::timestamp_t ts) const {
+        return static_cast<uint64_t>(
+            chrono::duration_cast<chrono::seconds>(ts - epoch_).count());
+    }
+
+    // Link a released entry into the idle lists. The shard must be locked.
+    void AddIdle(Shard& shard, Bucket& bucket, const Entry::ptr_t& entry) {
+        const auto now = chrono::steady_clock::now();
+        entry->SetLastUsed(now);
+        auto& links = entry->GetLinks();
+        links.in_bucket = bucket.idle.insert(bucket.idle.end(), entry);
+        links.in_lru = shard.lru.insert(shard.lru.end(), entry);
+        // Round up, so that the entry is kept for at least its ttl
+        shard.wheel.Add(entry, GetTick(now) + max(entry->GetTtl(), 0) + 1);
+        ++idle_connections_;
+    }
+
+    // Unlink an idle entry from the bucket and the lru list. The shard must be locked.
+    void Unlink(Shard& shard, Bucket& bucket, Entry& entry) {
+        auto& links = entry.GetLinks();
+        shard.lru.erase(links.in_lru);
+        bucket.idle.erase(links.in_bucket);
+    }
+
+    /* Take an idle entry for reuse, according to the reuse-policy.
+     *
+     * If origin is set, only entries made for that origin are considered.
+     * Entries where the server has closed the connection are discarded.
+     * Returns nullptr if there are no usable idle entries. The shard must be locked.
+     */
+    Entry::ptr_t TakeIdle(Shard& shard, Bucket& bucket,
+                          const std::string *origin = nullptr) {
+        while(auto entry = FindIdle(bucket, origin)) {
+            shard.wheel.Remove(*entry);
+            Unlink(shard, bucket, *entry);
+            --idle_connections_;
+
+            if (IsAlive(*entry)) {
+                Count(counters_.hits);
+                return entry;
+            }
+
+            Count(counters_.stale);
+
+            RESTC_CPP_LOG_DEBUG_("Discarding " << *entry
+                << ". It was closed while it was idle.");
+            --connections_;
+        }
+
+        return {};
+    }
+
+    Entry::ptr_t FindIdle(const Bucket& bucket, const std::string *origin) const {
+        const auto matches = [origin](const Entry::ptr_t& entry) {
+            return !origin || (entry->GetOrigin() == *origin);
+        };
+
+        if (properties_->cacheReuse == Request::Properties::CacheReuse::LIFO) {
+            auto it = find_if(bucket.idle.rbegin(), bucket.idle.rend(), matches);
+            return it == bucket.idle.rend() ? nullptr : *it;
+        }
+
+        auto it = find_if(bucket.idle.begin(), bucket.idle.end(), matches);
+        return it == bucket.idle.end() ? nullptr : *it;
+    }
+
+    /* Cheap check to see if the server has closed an idle connection.
+     *
+     * Peeks at the socket without blocking. An idle connection should
+     * have nothing to read. For plain HTTP, any data means that the
+     * server has sent something (like a 408 reply) before it closed the
+     * connection. For TLS, there may be protocol messages that are not
+     * yet processed, so only EOF and errors count.
+     */
+    static bool IsAlive(Entry& entry) {
+        auto& sck = entry.GetConnection()->GetSocket().GetSocket();
+        if (!sck.is_open()) {
+            return false;
+        }
+
+        boost::system::error_code ec;
+        sck.non_blocking(true, ec);
+        if (ec) {
+            return true; // We can't tell
+        }
+
+        char ch = {};
+        const auto bytes = sck.receive(boost::asio::buffer(&ch, 1),
+                                       boost::asio::socket_base::message_peek, ec);
+        boost::system::error_code ignore;
+        sck.non_blocking(false, ignore);
+
+        if (ec == boost::asio::error::would_block) {
+            return true;
+        }
+
+        return !ec && (bytes > 0)
+            && (entry.GetKey().GetType() == Connection::Type::HTTPS);
+    }
+
+    /* Put a waiter in the queue for the endpoint, unless a connection
+     * or a slot became available since the caller last checked.
+     */
+    void Enqueue(const Key& key, const Waiter::ptr_t& waiter, bool first) {
+        // Count the waiter before we check, so that a concurrent release
+        // in another shard will look for us.
+        ++waiting_;
+
+        auto& shard = GetShard(key);
+        lock_guard<mutex> lock{shard.mutex_};
+        auto& bucket = shard.buckets[key];
+
+        if (auto entry = TakeIdle(shard, bucket)) {
+            waiter->entry = move(entry);
+            ++bucket.in_use;
+            --waiting_;
+            waiter->state = Waiter::State::HAVE_ENTRY;
+            return;
+        }
+
+        if ((bucket.size() < properties_->cacheMaxConnectionsPerEndpoint)
+            && TryAddConnection()) {
+            ++bucket.in_use;
+            --waiting_;
+            waiter->state = Waiter::State::HAVE_SLOT;
+            return;
+        }
+
+        if (first) {
+            bucket.waiters.push_front(waiter);
+        } else {
+            Count(counters_.waits);
+            bucket.waiters.push_back(waiter);
+        }
+    }
+
+    // Get the state after a wait. Removes the waiter from the queue if it timed out.
+    Waiter::State TakeWaiterState(const Key& key, const Waiter::ptr_t& waiter) {
+        auto& shard = GetShard(key);
+        lock_guard<mutex> lock{shard.mutex_};
+        if (waiter->state == Waiter::State::WAITING) {
+            auto it = shard.buckets.find(key);
+            if (it != shard.buckets.end()) {
+                auto& waiters = it->second.waiters;
+                waiters.erase(remove(waiters.begin(), waiters.end(), waiter),
+                              waiters.end());
+                --waiting_;
+                if (it->second.empty()) {
+                    shard.buckets.erase(it);
+                }
+            }
+        }
+        return waiter->state;
+    }
+
+    // Must be called with the lock for the waiters shard held
+    void Wake(const Waiter::ptr_t& waiter, const Waiter::State state) {
+        waiter->state = state;
+        CancelWait(waiter);
+    }
+
+    void CancelWait(Waiter::ptr_t waiter) {
+        GetCtx().post([self = shared_from_this(), waiter] {
+            if ((waiter->timer.cancel() == 0) && !waiter->resumed) {
+                // The waiter has not yet started to wait. Try again.
+                self->CancelWait(waiter);
+            }
+        });
+    }
+
+    /* A global slot may have become available.
+     *
+     * Give it to a waiter that is only held back by the global limit.
+     */
+    void WakeGlobalWaiter() {
+        if (waiting_ == 0) {
+            return;
+        }
+
+        for(auto& shard : shards_) {
+            lock_guard<mutex> lock{shard.mutex_};
+            for(auto& it : shard.buckets) {
+                auto& bucket = it.second;
+                if (bucket.waiters.empty()
+                    || (bucket.size() >= properties_->cacheMaxConnectionsPerEndpoint)) {
+                    continue;
+                }
+
+                auto waiter = bucket.waiters.front();
+                bucket.waiters.pop_front();
+                --waiting_;
+
+                if (TryAddConnection()) {
+                    ++bucket.in_use;
+                    Wake(waiter, Waiter::State::HAVE_SLOT);
+                } else {
+                    // Let it try to purge an idle connection.
+                    Wake(waiter, Waiter::State::RETRY);
+                }
+                return;
+            }
+        }
+    }
+
     void ScheduleNextCacheCleanup() {
         LOCK_ALWAYS_;
         cache_cleanup_timer_.expires_from_now(
@@ -225,107 +1114,334 @@ private:
 
         RESTC_CPP_LOG_TRACE_("OnCacheCleanup: Cleaning cache...");
 
-        const auto now = std::chrono::steady_clock::now();
-        {
-            LOCK_ALWAYS_;
-            for(auto it = idle_.begin(); !closed_ && it != idle_.end();) {
-
-                auto current = it;
-                ++it;
+        const auto now = GetTick(std::chrono::steady_clock::now());
+        for(auto& shard : shards_) {
+            lock_guard<mutex> lock{shard.mutex_};
+            if (closed_) {
+                break;
+            }
+            shard.wheel.Expire(now, [&](const Entry::ptr_t& entry) {
+                auto it = shard.buckets.find(entry->GetKey());
+                assert(it != shard.buckets.end());
+                if ((it->second.idle.size() <= properties_->cacheMinIdlePerEndpoint)
+                    && IsAlive(*entry)) {
+                    RESTC_CPP_LOG_TRACE_("Keeping " << *entry->GetConnection()
+                        << " to stay at cacheMinIdlePerEndpoint");
+                    return false;
+                }
 
-                const auto& entry = *current->second;
-                auto expires = entry.GetLastUsed() + std::chrono::seconds(entry.GetTtl());
-                if (expires < now) {
-                    RESTC_CPP_LOG_TRACE_("Expiring " << *current->second->GetConnection());
-                    idle_.erase(current);
-                } else {
-                    RESTC_CPP_LOG_TRACE_("Keeping << " << *current->second->GetConnection()
-                        << " expieres in "
-                        << std::chrono::duration_cast<std::chrono::seconds>(expires - now).count()
-                        << " seconds ");
+                RESTC_CPP_LOG_TRACE_("Expiring " << *entry->GetConnection());
+                Unlink(shard, it->second, *entry);
+                DropIdle(1);
+                Count(counters_.expired);
+                if (it->second.empty()) {
+                    shard.buckets.erase(it);
                 }
-            }
+                return true;
+            });
         }
 
+        WakeGlobalWaiter();
+        ExpireHttp2Connections();
+        ExpirePipelines();
+        ReplenishWarmEndpoints();
+
         RESTC_CPP_LOG_TRACE_("OnCacheCleanup: schedule next");
         ScheduleNextCacheCleanup();
         RESTC_CPP_LOG_TRACE_("OnCacheCleanup: leave");
     }
 
-    void OnRelease(const Entry::ptr_t entry) {
+    /* Connect again to the endpoints from Warmup() that have fewer
+     * than cacheMinIdlePerEndpoint idle connections, after some were
+     * used and closed.
+     */
+    void ReplenishWarmEndpoints() {
+        const auto min_idle = properties_->cacheMinIdlePerEndpoint;
+        if (min_idle == 0) {
+            return;
+        }
+
+        std::vector<std::pair<Key, WarmEndpoint>> candidates;
         {
-            LOCK_ALWAYS_;
-            in_use_.erase(entry->GetKey());
+            lock_guard<mutex> lock{mutex_};
+            for(const auto& it : warm_) {
+                if (!it.second.replenishing) {
+                    candidates.emplace_back(it.first, it.second);
+                }
+            }
         }
-        if (closed_ || !entry->GetConnection()->GetSocket().IsOpen()) {
-            RESTC_CPP_LOG_TRACE_("Discarding " << *entry << " after use");
-            return;
+
+        for(auto& candidate : candidates) {
+            const auto& key = candidate.first;
+            size_t idle = 0;
+            {
+                auto& shard = GetShard(key);
+                lock_guard<mutex> lock{shard.mutex_};
+                auto it = shard.buckets.find(key);
+                if (it != shard.buckets.end()) {
+                    idle = it->second.idle.size();
+                }
+            }
+
+            if (idle >= min_idle) {
+                continue;
+            }
+
+            {
+                lock_guard<mutex> lock{mutex_};
+                warm_[key].replenishing = true;
+            }
+
+            RESTC_CPP_LOG_TRACE_("Replenishing " << key << " with "
+                << (min_idle - idle) << " connections");
+
+            owner_.Process([self = shared_from_this(), key, warm = move(candidate.second),
+                            missing = min_idle - idle](Context& ctx) {
+                try {
+                    self->OpenIdle(key, warm.host, warm.origin, missing, ctx);
+                } catch(const exception& ex) {
+                    RESTC_CPP_LOG_DEBUG_("Failed to replenish " << key << ": " << ex.what());
+                }
+
+                lock_guard<mutex> lock{self->mutex_};
+                auto it = self->warm_.find(key);
+                if (it != self->warm_.end()) {
+                    it->second.replenishing = false;
+                }
+            });
         }
+    }
+
+    // Forget the HTTP/2 connections that failed, and close the ones that are idle
+    void ExpireHttp2Connections() {
+        const auto now = chrono::steady_clock::now();
+        const auto ttl = chrono::seconds(properties_->cacheTtlSeconds);
+        std::vector<Http2Connection::ptr_t> expired;
 
-        RESTC_CPP_LOG_TRACE_("Recycling " << *entry << " after use");
-        entry->SetLastUsed(chrono::steady_clock::now());
         {
             LOCK_ALWAYS_;
-            idle_.insert({entry->GetKey(), entry});
+            for(auto it = http2_.begin(); it != http2_.end();) {
+                auto& o = it->second;
+                auto& conns = o.connections;
+                conns.erase(remove_if(conns.begin(), conns.end(),
+                                      [&](const Http2Connection::ptr_t& c) {
+                    if (!c->IsUsable()) {
+                        return true;
+                    }
+                    if ((c->GetActiveStreams() == 0) && ((c->GetIdleSince() + ttl) <= now)) {
+                        RESTC_CPP_LOG_TRACE_("Expiring " << *c);
+                        expired.push_back(c);
+                        return true;
+                    }
+                    return false;
+                }), conns.end());
+
+                if (conns.empty() && !o.connecting && o.waiters.empty()
+                    && (o.http1_until <= now)) {
+                    it = http2_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        for(auto& c : expired) {
+            c->Close();
         }
     }
 
-    // Check the constraints to see if we can create a new connection
-    bool CanCreateNewConnection(const boost::asio::ip::tcp::endpoint& ep,
-                                const Connection::Type connectionType) {
-        if (closed_) {
-            throw ObjectExpiredException("The connection-pool is closed.");
+    // Forget the pipelines that are done
+    void ExpirePipelines() {
+        LOCK_ALWAYS_;
+        for(auto it = pipelines_.begin(); it != pipelines_.end();) {
+            auto& pipelines = it->second;
+            pipelines.erase(remove_if(pipelines.begin(), pipelines.end(),
+                                      [](const weak_ptr<Pipeline>& p) {
+                auto pipeline = p.lock();
+                return !pipeline || !pipeline->IsUsable();
+            }), pipelines.end());
+
+            if (pipelines.empty()) {
+                it = pipelines_.erase(it);
+            } else {
+                ++it;
+            }
         }
+    }
+
+    bool OfferHttp2() const noexcept {
+        return (properties_->http2 != Request::Properties::Http2::NEVER)
+            && (properties_->proxy.type != Request::Proxy::Type::HTTP);
+    }
 
-        promise<bool> pr;
-        auto result = pr.get_future();
+    void OnRelease(const Entry::ptr_t entry) {
+        const bool discard = closed_ || !entry->GetConnection()->GetSocket().IsOpen();
 
-        size_t cnt = 0;
-        const auto key = Key{ep, connectionType};
+        auto& shard = GetShard(entry->GetKey());
         {
-            LOCK_ALWAYS_;
-            cnt = idle_.count(key) + in_use_.count(key);
+            lock_guard<mutex> lock{shard.mutex_};
+            auto it = shard.buckets.find(entry->GetKey());
+            assert(it != shard.buckets.end());
+            auto& bucket = it->second;
+            assert(bucket.in_use > 0);
+
+            if (!bucket.waiters.empty()) {
+                // Hand the connection, or its slot, directly to the first waiter
+                auto waiter = bucket.waiters.front();
+                bucket.waiters.pop_front();
+                --waiting_;
+                if (discard) {
+                    RESTC_CPP_LOG_TRACE_("Handing the slot for " << *entry << " to a waiter");
+                    Count(counters_.discarded);
+                    Wake(waiter, Waiter::State::HAVE_SLOT);
+                } else {
+                    RESTC_CPP_LOG_TRACE_("Handing " << *entry << " to a waiter");
+                    Count(counters_.hits);
+                    waiter->entry = entry;
+                    Wake(waiter, Waiter::State::HAVE_ENTRY);
+                }
+                return;
+            }
+
+            --bucket.in_use;
+
+            if (!discard) {
+                AddIdle(shard, bucket, entry);
+            } else {
+                Count(counters_.discarded);
+                --connections_;
+                if (bucket.empty()) {
+                    shard.buckets.erase(it);
+                }
+            }
         }
 
-        if (cnt >= properties_->cacheMaxConnectionsPerEndpoint) {
-            RESTC_CPP_LOG_DEBUG_("No more available slots for " << key);
-            pr.set_value(false);
-            return false;
+        RESTC_CPP_LOG_TRACE_((discard ? "Discarding " : "Recycling ")
+                             << *entry << " after use");
+
+        WakeGlobalWaiter();
+    }
+
+    // Get an idle connection to the endpoint, or a new one if there is room for it
+    Connection::ptr_t GetOrCreate(const Key& key, const std::string& origin) {
+        if (auto conn = GetFromCache(key)) {
+            RESTC_CPP_LOG_TRACE_("Reusing connection from cache "
+                << *conn);
+            return conn;
+        }
+
+        if (!ReserveSlot(key)) {
+            Count(counters_.rejected);
+            throw ConstraintException(
+                "Cannot create connection - too many connections");
         }
 
+        return CreateNew(key, origin);
+    }
 
-        {
-            LOCK_ALWAYS_;
-            cnt = idle_.size() + in_use_.size();
+    // Count a new connection against the global limit, if there is room for it
+    bool TryAddConnection() {
+        auto cnt = connections_.load();
+        do {
+            if (cnt >= properties_->cacheMaxConnections) {
+                return false;
+            }
+        } while(!connections_.compare_exchange_weak(cnt, cnt + 1));
+        return true;
+    }
+
+    /* Check the constraints and reserve a slot for a new connection if we can
+     *
+     * If purgeIdle is true, idle connections to other endpoints are
+     * purged to make room when the pool is full.
+     */
+    bool ReserveSlot(const Key& key, bool purgeIdle = true) {
+        if (closed_) {
+            throw ObjectExpiredException("The connection-pool is closed.");
         }
-        if (cnt >= properties_->cacheMaxConnections) {
+
+        auto& shard = GetShard(key);
+        while(true) {
+            {
+                lock_guard<mutex> lock{shard.mutex_};
+                auto& bucket = shard.buckets[key];
+                if (bucket.size() >= properties_->cacheMaxConnectionsPerEndpoint) {
+                    RESTC_CPP_LOG_DEBUG_("No more available slots for " << key);
+                    if (bucket.empty()) {
+                        shard.buckets.erase(key);
+                    }
+                    return false;
+                }
+
+                if (TryAddConnection()) {
+                    ++bucket.in_use;
+                    return true;
+                }
+
+                if (bucket.empty()) {
+                    shard.buckets.erase(key);
+                }
+            }
 
             // See if we can release an idle connection.
-            if (!PurgeOldestIdleEntry()) {
+            if (!purgeIdle || !PurgeOldestIdleEntry()) {
                 RESTC_CPP_LOG_DEBUG_("No more available slots (max="
                     << properties_->cacheMaxConnections
-                    << ", used=" << cnt << ')');
-                    pr.set_value(false);
-                    return false;
+                    << ", used=" << connections_ << ')');
+                return false;
             }
         }
+    }
 
-        return true;
+    // Reserve a slot, ignoring the constraints
+    void ForceReserveSlot(const Key& key) {
+        auto& shard = GetShard(key);
+        lock_guard<mutex> lock{shard.mutex_};
+        ++shard.buckets[key].in_use;
+        ++connections_;
     }
 
     bool PurgeOldestIdleEntry() {
         RESTC_CPP_LOG_TRACE_("PurgeOldestIdleEntry: enter");
-        LOCK_ALWAYS_;
-        auto oldest =  idle_.begin();
-        for (auto it = idle_.begin(); it != idle_.end(); ++it) {
-            if (it->second->GetLastUsed() < oldest->second->GetLastUsed()) {
-                oldest = it;
+
+        // The idle entries in each shard are ordered by the time they
+        // were released, so we only have to compare the first ones.
+        while(idle_connections_ > 0) {
+            Shard *oldest_shard = nullptr;
+            Entry::timestamp_t oldest_ts;
+
+            for(auto& shard : shards_) {
+                lock_guard<mutex> lock{shard.mutex_};
+                if (shard.lru.empty()) {
+                    continue;
+                }
+                const auto ts = shard.lru.front()->GetLastUsed();
+                if (!oldest_shard || ts < oldest_ts) {
+                    oldest_shard = &shard;
+                    oldest_ts = ts;
+                }
+            }
+
+            if (!oldest_shard) {
+                break;
+            }
+
+            lock_guard<mutex> lock{oldest_shard->mutex_};
+            if (oldest_shard->lru.empty()) {
+                continue; // Someone else got it first. Try again.
             }
-        }
 
-        if (oldest != idle_.end()) {
-            RESTC_CPP_LOG_TRACE_("LRU-Purging " << *oldest->second);
-            idle_.erase(oldest);
+            auto entry = oldest_shard->lru.front();
+            RESTC_CPP_LOG_TRACE_("LRU-Purging " << *entry);
+            auto it = oldest_shard->buckets.find(entry->GetKey());
+            assert(it != oldest_shard->buckets.end());
+            oldest_shard->wheel.Remove(*entry);
+            Unlink(*oldest_shard, it->second, *entry);
+            DropIdle(1);
+            Count(counters_.purged);
+            if (it->second.empty()) {
+                oldest_shard->buckets.erase(it);
+            }
             RESTC_CPP_LOG_TRACE_("PurgeOldestIdleEntry: success");
             return true;
         }
@@ -335,57 +1451,80 @@ private:
     }
 
     // Get a connection from the cache if it's there.
-    Connection::ptr_t GetFromCache(const boost::asio::ip::tcp::endpoint& ep,
-                                   const Connection::Type connectionType) {
+    Connection::ptr_t GetFromCache(const Key& key) {
         if (closed_) {
             throw ObjectExpiredException("The connection-pool is closed.");
         }
 
-        promise<Connection::ptr_t> pr;
-        auto result = pr.get_future();
-
-        LOCK_ALWAYS_;
-        const auto key = Key{ep, connectionType};
-        auto it = idle_.find(key);
-        if (it != idle_.end()) {
-            auto wrapper = make_unique<ConnectionWrapper>(it->second, on_release_);
-            in_use_.insert(*it);
-            idle_.erase(it);
-            return wrapper;
+        auto& shard = GetShard(key);
+        lock_guard<mutex> lock{shard.mutex_};
+        auto it = shard.buckets.find(key);
+        if (it != shard.buckets.end()) {
+            auto& bucket = it->second;
+            if (auto entry = TakeIdle(shard, bucket)) {
+                ++bucket.in_use;
+                return make_unique<ConnectionWrapper>(move(entry), on_release_);
+            }
+            if (bucket.empty()) {
+                shard.buckets.erase(it);
+            }
         }
 
+        Count(counters_.misses);
         return {};
     }
 
-    Connection::ptr_t CreateNew(const boost::asio::ip::tcp::endpoint& ep,
-                                const Connection::Type connectionType) {
+    // The caller must have reserved a slot for the connection
+    Connection::ptr_t CreateNew(const Key& key, const std::string& origin = {}) {
         unique_ptr<Socket> socket;
-        if (connectionType == Connection::Type::HTTP) {
-            socket = make_unique<SocketImpl>(owner_.GetIoService());
-        }
-        else {
+        try {
+            if (key.GetType() == Connection::Type::HTTP) {
+                socket = make_unique<SocketImpl>(owner_.GetIoService());
+            }
+            else {
 #ifdef RESTC_CPP_WITH_TLS
-            socket = make_unique<TlsSocketImpl>(owner_.GetIoService(), owner_.GetTLSContext());
+                auto tls_context = owner_.GetTLSContext();
+                auto session_cache = properties_->tlsSessionResumption
+                    ? TlsSessionCache::Get(*tls_context) : nullptr;
+                socket = make_unique<TlsSocketImpl>(owner_.GetIoService(),
+                                                    move(tls_context),
+                                                    move(session_cache),
+                                                    OfferHttp2());
 #else
-            throw NotImplementedException(
-                "restc_cpp is compiled without TLS support");
+                throw NotImplementedException(
+                    "restc_cpp is compiled without TLS support");
 #endif
+            }
+        } catch(...) {
+            ReleaseSlot(key);
+            throw;
         }
 
-        auto entry = make_shared<Entry>(ep, connectionType,
+        auto entry = make_shared<Entry>(key,
                                         make_shared<ConnectionImpl>(move(socket)),
-                                        *properties_);
+                                        *properties_, origin, origins_);
 
         RESTC_CPP_LOG_TRACE_("Created new connection " << *entry);
+        Count(counters_.created);
 
-        promise<Connection::ptr_t> pr;
-        auto result = pr.get_future();
+        return make_unique<ConnectionWrapper>(entry, on_release_);
+    }
 
+    // Give back a reserved slot that was not used
+    void ReleaseSlot(const Key& key) {
+        auto& shard = GetShard(key);
         {
-            LOCK_ALWAYS_;
-            in_use_.insert({entry->GetKey(), entry});
+            lock_guard<mutex> lock{shard.mutex_};
+            auto it = shard.buckets.find(key);
+            assert(it != shard.buckets.end());
+            --it->second.in_use;
+            --connections_;
+            if (it->second.empty()) {
+                shard.buckets.erase(it);
+            }
         }
-        return make_unique<ConnectionWrapper>(entry, on_release_);
+
+        WakeGlobalWaiter();
     }
 
 #ifdef RESTC_CPP_THREADED_CTX
@@ -395,17 +1534,47 @@ private:
 #endif
     std::once_flag close_once_;
     RestClient& owner_;
-    multimap<Key, Entry::ptr_t> idle_;
-    multimap<Key, std::weak_ptr<Entry>> in_use_;
-    //std::queue<Entry> pending_;
+    std::array<Shard, num_shards_> shards_;
+    std::atomic_size_t connections_{0}; // idle + in use
+    std::atomic_size_t idle_connections_{0};
+    std::atomic_size_t waiting_{0};
+    Counters counters_;
+    const OriginIndex::ptr_t origins_ = make_shared<OriginIndex>();
+    const Entry::timestamp_t epoch_ = chrono::steady_clock::now();
     const Request::Properties::ptr_t properties_;
     ConnectionWrapper::release_callback_t on_release_;
     boost::asio::deadline_timer cache_cleanup_timer_;
 
     mutable std::mutex mutex_;
+    std::unordered_map<std::string, Http2Origin> http2_; // By origin. Protected by mutex_
+    // HTTP/1.1 connections with pipelined requests, by origin. Protected by mutex_
+    std::unordered_map<std::string, std::vector<std::weak_ptr<Pipeline>>> pipelines_;
+    std::unordered_map<Key, WarmEndpoint, Key::Hash> warm_; // Protected by mutex_
 }; // ConnectionPoolImpl
 
 
+std::string
+ConnectionPool::MakeOrigin(const Connection::Type type,
+                           const std::string& host,
+                           const std::string& port,
+                           const Request::Proxy& proxy) {
+    auto origin = (type == Connection::Type::HTTPS ? "https://"s : "http://"s)
+        + host + ':' + port;
+
+    switch(proxy.type) {
+    case Request::Proxy::Type::NONE:
+        break;
+    case Request::Proxy::Type::HTTP:
+        origin += " via http " + proxy.address;
+        break;
+    case Request::Proxy::Type::SOCKS5:
+        origin += " via socks5 " + proxy.address;
+        break;
+    }
+
+    return origin;
+}
+
 ConnectionPool::ptr_t
 ConnectionPool::Create(RestClient& owner) {
     auto instance = make_shared<ConnectionPoolImpl>(owner);
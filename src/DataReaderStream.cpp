@@ -1,16 +1,28 @@
 
 #include "restc-cpp/DataReaderStream.h"
 #include "restc-cpp/error.h"
+#include "restc-cpp/helper.h"
 #include "restc-cpp/url_encode.h"
 #include "restc-cpp/logging.h"
 #include <restc-cpp/typename.h>
 
+#include "HeaderScanner.h"
+
 using namespace std;
 
 namespace restc_cpp {
 
-DataReaderStream::DataReaderStream(std::unique_ptr<DataReader>&& source)
-: source_{move(source)} {
+namespace {
+constexpr size_t max_version_len = 16;
+constexpr size_t max_phrase_len = 256;
+constexpr size_t max_name_len = 256;
+constexpr size_t max_header_value_len = 1024 * 4;
+constexpr size_t max_headers = 256;
+} // anonymous namespace
+
+DataReaderStream::DataReaderStream(std::unique_ptr<DataReader>&& source,
+                                   std::string unread)
+: source_{move(source)}, unread_{move(unread)}, have_unread_{!unread_.empty()} {
     RESTC_CPP_LOG_TRACE_("DataReaderStream: Chained to "
         << RESTC_CPP_TYPENAME(decltype(*source_)));
 }
@@ -18,7 +30,13 @@ DataReaderStream::DataReaderStream(std::unique_ptr<DataReader>&& source)
 
 void DataReaderStream::Fetch() {
     if (++curr_ >= end_) {
-        auto buf = source_->ReadSome();
+        boost::asio::const_buffers_1 buf{nullptr, 0};
+        if (have_unread_) {
+            have_unread_ = false;
+            buf = {unread_.data(), unread_.size()};
+        } else {
+            buf = source_->ReadSome();
+        }
 
         RESTC_CPP_LOG_TRACE_("DataReaderStream::Fetch: Fetched buffer with "
             << boost::asio::buffer_size(buf) << " bytes.");
@@ -69,14 +87,55 @@ DataReaderStream::GetData(size_t maxBytes) {
 }
 
 
+const char *DataReaderStream::GetBuffered() {
+    if (eof_) {
+        throw ParseException("GetBuffered(): EOF");
+    }
+
+    if (!curr_ || ((curr_ + 1) >= end_)) {
+        Fetch();
+        --curr_; // Fetch() consumes the first byte. We just want to look at it.
+    }
+
+    return curr_ + 1;
+}
+
+bool DataReaderStream::ScanServerResponse(Reply::HttpResponse& response) {
+    static const boost::string_ref http_1_1{"HTTP/1.1"};
+    const char *begin = GetBuffered();
+    const char *eol = header_scanner::FindEndOfLine(begin, end_);
+    if (!eol) {
+        return false;
+    }
+
+    header_scanner::StatusLine status;
+    if (!header_scanner::ScanStatusLine({begin, static_cast<size_t>(eol - begin)},
+                                        status, max_version_len, max_phrase_len)
+        || (status.version.size() != http_1_1.size())
+        || strncasecmp(status.version.data(), http_1_1.data(), http_1_1.size())) {
+        return false;
+    }
+
+    response.status_code = status.status_code;
+    response.reason_phrase.assign(status.reason_phrase.data(),
+                                  status.reason_phrase.size());
+    curr_ = eol + 1; // The LF
+    getc_bytes_ += (eol - begin) + 2;
+    return true;
+}
+
 void DataReaderStream::ReadServerResponse(Reply::HttpResponse& response)
 {
     static const string http_1_1{"HTTP/1.1"};
-    constexpr size_t max_version_len = 16;
-    constexpr size_t max_phrase_len = 256;
     char ch = {};
     getc_bytes_ = 0;
 
+    if (ScanServerResponse(response)) {
+        RESTC_CPP_LOG_TRACE_("HTTP Response: HTTP/1.1 "
+            << response.status_code << ' ' << response.reason_phrase);
+        return;
+    }
+
     // Get HTTP version
     std::string value;
     for(ch = Getc(); ch != ' '; ch = Getc()) {
@@ -145,11 +204,57 @@ void DataReaderStream::ReadServerResponse(Reply::HttpResponse& response)
         << ' ' << response.reason_phrase);
 }
 
-void DataReaderStream::ReadHeaderLines(const add_header_fn_t& addHeader) {
-    constexpr size_t max_name_len = 256;
-    constexpr size_t max_headers = 256;
+int DataReaderStream::ScanHeaderLine(const add_header_fn_t& addHeader) {
+    const char *begin = GetBuffered();
+    const char *eol = header_scanner::FindEndOfLine(begin, end_);
+    if (!eol) {
+        return -1;
+    }
+
+    const char *next = eol + 2;
+    if (eol == begin) {
+        curr_ = eol + 1;
+        getc_bytes_ += 2;
+        return 0; // An empty line marks the end of the headers
+    }
+
+    // A line that starts with white space continues the value,
+    // so we must be able to see the start of the next line.
+    if ((next >= end_) || (*next == ' ') || (*next == '\t')) {
+        return -1;
+    }
 
+    header_scanner::HeaderField field;
+    if (!header_scanner::ScanHeaderLine({begin, static_cast<size_t>(eol - begin)},
+                                        field, max_name_len, max_header_value_len)) {
+        return -1;
+    }
+
+    if (++num_headers_ > max_headers) {
+        throw ConstraintException("Chunk Trailer: Too many lines in header!");
+    }
+
+    curr_ = eol + 1;
+    getc_bytes_ += (eol - begin) + 2;
+
+    RESTC_CPP_LOG_TRACE_(field.name << ": " << field.value);
+    addHeader(field.name, field.value);
+    return 1;
+}
+
+void DataReaderStream::ReadHeaderLines(const add_header_fn_t& addHeader) {
     while(true) {
+        const auto scanned = ScanHeaderLine(addHeader);
+        if (scanned > 0) {
+            continue;
+        }
+        if (scanned == 0) {
+            RESTC_CPP_LOG_TRACE_("ReadHeaderLines: getc_bytes is " <<  getc_bytes_);
+            getc_bytes_ = 0;
+            return;
+        }
+
+        // The line spans buffers, or is unusual. Parse it one byte at the time.
         char ch;
         string name;
         string value;
@@ -190,14 +295,11 @@ void DataReaderStream::ReadHeaderLines(const add_header_fn_t& addHeader) {
         }
 
         RESTC_CPP_LOG_TRACE_(name << ": " << value);
-        addHeader(move(name), move(value));
-        name.clear();
-        value.clear();
+        addHeader(name, value);
     }
 }
 
 std::string DataReaderStream::GetHeaderValue() {
-    constexpr size_t max_header_value_len = 1024 * 4;
     std::string value;
     char ch;
 
@@ -232,6 +334,30 @@ std::string DataReaderStream::GetHeaderValue() {
 }
 
 
+void DataReaderStream::ReadAhead(const std::size_t bytes) {
+    size_t buffered = have_unread_ ? unread_.size() : 0;
+    if (curr_ && ((curr_ + 1) < end_)) {
+        buffered += static_cast<size_t>(end_ - (curr_ + 1));
+    }
+
+    if (bytes > buffered) {
+        source_->ReadAhead(bytes - buffered);
+    }
+}
+
+std::string DataReaderStream::TakeUnread() {
+    std::string unread;
+    if (curr_ && ((curr_ + 1) < end_)) {
+        unread.assign(curr_ + 1, end_);
+        curr_ = end_;
+    }
+    if (have_unread_) {
+        have_unread_ = false;
+        unread += unread_;
+    }
+    return unread;
+}
+
 void DataReaderStream::SetEof() {
     RESTC_CPP_LOG_TRACE_("Reached EOF");
     eof_ = true;
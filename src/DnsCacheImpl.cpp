@@ -0,0 +1,256 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/DnsCache.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/error.h"
+#include "DnsCacheImpl.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+class DnsCacheImpl
+    : public DnsCache
+    , public std::enable_shared_from_this<DnsCacheImpl> {
+public:
+    using clock_t = chrono::steady_clock;
+    using query_t = boost::asio::ip::tcp::resolver::query;
+
+    struct Entry {
+        endpoints_t endpoints;
+        boost::system::error_code error;
+        clock_t::time_point refresh_at; // Refresh in the background after this
+        clock_t::time_point expires;
+        bool refreshing = false;
+    };
+
+    DnsCacheImpl(RestClient& owner)
+    : owner_{owner}, properties_{owner.GetConnectionProperties()}
+    {
+    }
+
+    endpoints_t Resolve(const std::string& host,
+                        const std::string& port,
+                        Context& ctx) override {
+
+        if (properties_->dnsCacheTtlSeconds <= 0) {
+            boost::system::error_code ec;
+            auto endpoints = Lookup(host, port, ctx, ec);
+            if (ec) {
+                throw boost::system::system_error{ec};
+            }
+            return endpoints;
+        }
+
+        const auto key = host + '/' + port;
+        bool refresh = false;
+        boost::optional<Entry> cached;
+        {
+            lock_guard<mutex> lock{mutex_};
+            auto it = entries_.find(key);
+            if (it != entries_.end()) {
+                auto& entry = it->second;
+                const auto now = clock_t::now();
+                const auto stale_until = entry.error ? entry.expires
+                    : entry.expires + chrono::seconds(properties_->dnsCacheStaleSeconds);
+
+                if (now < stale_until) {
+                    if (!entry.error && !entry.refreshing && (now >= entry.refresh_at)) {
+                        entry.refreshing = refresh = true;
+                    }
+                    cached = entry;
+                } else {
+                    entries_.erase(it);
+                }
+            }
+        }
+
+        if (refresh) {
+            RESTC_CPP_LOG_TRACE_("DnsCache: Refreshing " << key << " in the background");
+            ++refreshes_;
+            Refresh(host, port, key);
+        }
+
+        if (cached) {
+            RESTC_CPP_LOG_TRACE_("DnsCache: Using cached entry for " << key);
+            ++hits_;
+            if (cached->error) {
+                ++negative_hits_;
+                throw boost::system::system_error{cached->error};
+            }
+            return move(cached->endpoints);
+        }
+
+        boost::system::error_code ec;
+        auto endpoints = Lookup(host, port, ctx, ec);
+        Store(key, ec, endpoints);
+        if (ec) {
+            throw boost::system::system_error{ec};
+        }
+        return endpoints;
+    }
+
+    void Clear() override {
+        lock_guard<mutex> lock{mutex_};
+        entries_.clear();
+    }
+
+    void SetResolveFn(resolve_fn_t fn) {
+        resolve_fn_ = move(fn);
+    }
+
+    Stats GetStats() const override {
+        Stats stats;
+        stats.lookups = lookups_;
+        stats.hits = hits_;
+        stats.negativeHits = negative_hits_;
+        stats.refreshes = refreshes_;
+        return stats;
+    }
+
+private:
+    endpoints_t Lookup(const std::string& host,
+                       const std::string& port,
+                       Context& ctx,
+                       boost::system::error_code& ec) {
+
+        RESTC_CPP_LOG_TRACE_("DnsCache: Resolving " << host << ":" << port);
+        ++lookups_;
+
+        if (resolve_fn_) {
+            return CallResolveFn(host, port, ec);
+        }
+
+        boost::asio::ip::tcp::resolver resolver(owner_.GetIoService());
+        auto address_it = resolver.async_resolve(query_t{host, port},
+                                                 ctx.GetYield()[ec]);
+        return ToEndpoints(address_it);
+    }
+
+    endpoints_t CallResolveFn(const std::string& host,
+                              const std::string& port,
+                              boost::system::error_code& ec) {
+        try {
+            return resolve_fn_(host, port);
+        } catch(const boost::system::system_error& ex) {
+            ec = ex.code();
+        }
+        return {};
+    }
+
+    static endpoints_t ToEndpoints(boost::asio::ip::tcp::resolver::iterator address_it) {
+        endpoints_t endpoints;
+        const decltype(address_it) addr_end;
+        for(; address_it != addr_end; ++address_it) {
+            endpoints.push_back(address_it->endpoint());
+        }
+        return endpoints;
+    }
+
+    void Refresh(const std::string& host, const std::string& port,
+                 const std::string& key) {
+        ++lookups_;
+        if (resolve_fn_) {
+            // Don't make the caller wait for it
+            owner_.GetIoService().post([self = shared_from_this(), host, port, key] {
+                boost::system::error_code ec;
+                auto endpoints = self->CallResolveFn(host, port, ec);
+                self->Store(key, ec, move(endpoints));
+            });
+            return;
+        }
+
+        auto resolver = make_shared<boost::asio::ip::tcp::resolver>(owner_.GetIoService());
+        resolver->async_resolve(query_t{host, port},
+            [self = shared_from_this(), resolver, key](
+                const boost::system::error_code& ec,
+                boost::asio::ip::tcp::resolver::iterator address_it) {
+            self->Store(key, ec, ToEndpoints(address_it));
+        });
+    }
+
+    void Store(const std::string& key, const boost::system::error_code& ec,
+               endpoints_t endpoints) {
+        const auto now = clock_t::now();
+
+        lock_guard<mutex> lock{mutex_};
+        if ((entries_.size() >= properties_->dnsCacheMaxEntries)
+            && (entries_.find(key) == entries_.end())) {
+            MakeRoom(now);
+        }
+        auto& entry = entries_[key];
+
+        if (ec && entry.refreshing && !entry.error) {
+            // Keep the last known good addresses until they are too stale.
+            RESTC_CPP_LOG_DEBUG_("DnsCache: Failed to refresh " << key
+                << ": " << ec.message());
+            entry.refreshing = false;
+            return;
+        }
+
+        const auto ttl = chrono::seconds(ec ? properties_->dnsCacheNegativeTtlSeconds
+                                            : properties_->dnsCacheTtlSeconds);
+        entry.endpoints = move(endpoints);
+        entry.error = ec;
+        entry.expires = now + ttl;
+        // Refresh when less than one fifth of the ttl remains
+        entry.refresh_at = entry.expires - (ttl / 5);
+        entry.refreshing = false;
+    }
+
+    /* Remove the entries that are too old to be used. If that is not
+     * enough, remove the one that expires first.
+     *
+     * Called with mutex_ locked.
+     */
+    void MakeRoom(const clock_t::time_point now) {
+        const auto stale = chrono::seconds(properties_->dnsCacheStaleSeconds);
+        auto first_to_expire = entries_.end();
+        for(auto it = entries_.begin(); it != entries_.end();) {
+            const auto& entry = it->second;
+            if (!entry.refreshing
+                && (now >= (entry.error ? entry.expires : entry.expires + stale))) {
+                it = entries_.erase(it);
+                continue;
+            }
+
+            if ((first_to_expire == entries_.end())
+                || (entry.expires < first_to_expire->second.expires)) {
+                first_to_expire = it;
+            }
+            ++it;
+        }
+
+        if ((entries_.size() >= properties_->dnsCacheMaxEntries)
+            && (first_to_expire != entries_.end())) {
+            RESTC_CPP_LOG_TRACE_("DnsCache: Full. Removing " << first_to_expire->first);
+            entries_.erase(first_to_expire);
+        }
+    }
+
+    RestClient& owner_;
+    const Request::Properties::ptr_t properties_;
+    resolve_fn_t resolve_fn_; // Used instead of the resolver if set
+    std::unordered_map<std::string, Entry> entries_;
+    std::mutex mutex_;
+    std::atomic<std::uint64_t> lookups_{0};
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> negative_hits_{0};
+    std::atomic<std::uint64_t> refreshes_{0};
+};
+
+
+DnsCache::ptr_t
+DnsCache::Create(RestClient& owner) {
+    return make_shared<DnsCacheImpl>(owner);
+}
+
+void SetResolveFn(DnsCache& cache, resolve_fn_t fn) {
+    dynamic_cast<DnsCacheImpl&>(cache).SetResolveFn(move(fn));
+}
+
+} // restc_cpp
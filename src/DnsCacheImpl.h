@@ -0,0 +1,25 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/DnsCache.h"
+
+namespace restc_cpp {
+
+/*! Looks up a host name instead of the resolver
+ *
+ * Throws boost::system::system_error if the lookup fails.
+ */
+using resolve_fn_t = std::function<DnsCache::endpoints_t (
+    const std::string& host, const std::string& port)>;
+
+/*! Make the cache look up host names with fn instead of the resolver
+ *
+ * For the unit tests, so that a host name can be given any addresses.
+ * Call it before the cache is used.
+ */
+void SetResolveFn(DnsCache& cache, resolve_fn_t fn);
+
+} // restc_cpp
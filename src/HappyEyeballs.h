@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include <boost/asio/ip/tcp.hpp>
+
+namespace restc_cpp {
+
+/*! Order the endpoints for connecting, as suggested in RFC 8305.
+ *
+ * Alternate between the address families, starting with the
+ * family of the first address from the resolver. The order
+ * within each family is kept.
+ */
+inline std::vector<boost::asio::ip::tcp::endpoint>
+InterleaveFamilies(const std::vector<boost::asio::ip::tcp::endpoint>& endpoints) {
+    std::vector<boost::asio::ip::tcp::endpoint> first, other, result;
+    for(const auto& ep : endpoints) {
+        (ep.protocol() == endpoints.front().protocol() ? first : other).push_back(ep);
+    }
+
+    result.reserve(endpoints.size());
+    for(size_t i = 0; result.size() < endpoints.size(); ++i) {
+        if (i < first.size()) {
+            result.push_back(first[i]);
+        }
+        if (i < other.size()) {
+            result.push_back(other[i]);
+        }
+    }
+    return result;
+}
+
+} // restc_cpp
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <boost/utility/string_ref.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define RESTC_CPP_HEADER_SCAN_SSE2 1
+#   include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#   define RESTC_CPP_HEADER_SCAN_AVX2 1
+#   include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#   include <intrin.h>
+#endif
+
+namespace restc_cpp {
+
+/*! Scanning of HTTP header lines that are completely buffered
+ *
+ * This is the fast path for DataReaderStream. It only accepts well
+ * formed lines. Anything unusual, including lines that span buffers,
+ * is left to the incremental parser, which also reports the errors.
+ */
+namespace header_scanner {
+
+inline unsigned CountTrailingZeros(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index = 0;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+/*! Find the first occurrence of a or b in [begin, end), one byte at the time
+ *
+ * This is the fallback for FindFirstOf() when SIMD is not available,
+ * and for the bytes after the last full SIMD block.
+ *
+ * \return end if none of them are found
+ */
+inline const char *FindFirstOfScalar(const char *begin, const char *end,
+                                     const char a, const char b) {
+    for(const char *p = begin; p < end; ++p) {
+        if ((*p == a) || (*p == b)) {
+            return p;
+        }
+    }
+    return end;
+}
+
+/*! Find the first occurrence of a or b in [begin, end)
+ *
+ * \return end if none of them are found
+ */
+inline const char *FindFirstOf(const char *begin, const char *end,
+                               const char a, const char b) {
+    const char *p = begin;
+
+#ifdef RESTC_CPP_HEADER_SCAN_AVX2
+    const auto a32 = _mm256_set1_epi8(a);
+    const auto b32 = _mm256_set1_epi8(b);
+    while ((end - p) >= 32) {
+        const auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        const auto hits = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, a32),
+                                          _mm256_cmpeq_epi8(chunk, b32));
+        const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+        if (mask) {
+            return p + CountTrailingZeros(mask);
+        }
+        p += 32;
+    }
+#endif
+
+#ifdef RESTC_CPP_HEADER_SCAN_SSE2
+    const auto a16 = _mm_set1_epi8(a);
+    const auto b16 = _mm_set1_epi8(b);
+    while ((end - p) >= 16) {
+        const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const auto hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, a16),
+                                       _mm_cmpeq_epi8(chunk, b16));
+        const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+        if (mask) {
+            return p + CountTrailingZeros(mask);
+        }
+        p += 16;
+    }
+#endif
+
+    return FindFirstOfScalar(p, end, a, b);
+}
+
+using find_first_of_t = const char *(*)(const char *, const char *, char, char);
+
+/*! Find the end of the line that starts at begin
+ *
+ * \return A pointer to the CR in the terminating CRLF, or nullptr
+ *      if the CRLF is not in [begin, end), or if a CR or LF appears
+ *      on its own before it.
+ */
+template <find_first_of_t findFirstOf = FindFirstOf>
+inline const char *FindEndOfLine(const char *begin, const char *end) {
+    const char *eol = findFirstOf(begin, end, '\r', '\n');
+    if ((eol + 1) >= end || (eol[0] != '\r') || (eol[1] != '\n')) {
+        return nullptr;
+    }
+    return eol;
+}
+
+/*! The parts of the status line of a reply */
+struct StatusLine {
+    boost::string_ref version;
+    int status_code = 0;
+    boost::string_ref reason_phrase;
+};
+
+/*! Split a status line (without the CRLF)
+ *
+ * \return false if the line must be handled by the incremental parser
+ */
+inline bool ScanStatusLine(const boost::string_ref line, StatusLine& status,
+                           const size_t maxVersionLen, const size_t maxPhraseLen) {
+    const auto sp = line.find(' ');
+    if ((sp == boost::string_ref::npos) || (sp == 0) || (sp > maxVersionLen)) {
+        return false;
+    }
+
+    // "NNN " must follow the version
+    const auto code = line.substr(sp + 1);
+    if ((code.size() < 4) || (code[3] != ' ')) {
+        return false;
+    }
+
+    int value = 0;
+    for(size_t i = 0; i < 3; ++i) {
+        if ((code[i] < '0') || (code[i] > '9')) {
+            return false;
+        }
+        value = (value * 10) + (code[i] - '0');
+    }
+
+    const auto phrase = code.substr(4);
+    if (phrase.size() > maxPhraseLen) {
+        return false;
+    }
+
+    status.version = line.substr(0, sp);
+    status.status_code = value;
+    status.reason_phrase = phrase;
+    return true;
+}
+
+/*! A header field, pointing into the buffer it was scanned from */
+struct HeaderField {
+    boost::string_ref name;
+    boost::string_ref value;
+};
+
+/*! Split a header line (without the CRLF) in name and value
+ *
+ * \return false if the line must be handled by the incremental parser
+ */
+template <find_first_of_t findFirstOf = FindFirstOf>
+inline bool ScanHeaderLine(const boost::string_ref line, HeaderField& field,
+                           const size_t maxNameLen, const size_t maxValueLen) {
+    const char *begin = line.data();
+    const char *end = begin + line.size();
+    const char *colon = findFirstOf(begin, end, ':', ':');
+    if ((colon == end) || (colon == begin)
+        || (static_cast<size_t>(colon - begin) > maxNameLen)) {
+        return false;
+    }
+
+    // The incremental parser drops white space inside names.
+    // Such lines are left to it.
+    if (findFirstOf(begin, colon, ' ', '\t') != colon) {
+        return false;
+    }
+
+    const char *value = colon + 1;
+    while((value < end) && ((*value == ' ') || (*value == '\t'))) {
+        ++value;
+    }
+
+    if (static_cast<size_t>(end - value) > maxValueLen) {
+        return false;
+    }
+
+    field.name = {begin, static_cast<size_t>(colon - begin)};
+    field.value = {value, static_cast<size_t>(end - value)};
+    return true;
+}
+
+} // header_scanner
+} // restc_cpp
@@ -0,0 +1,446 @@
+#include <array>
+#include <cstdint>
+#include <memory>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/error.h"
+
+#include "Hpack.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+namespace {
+
+// RFC 7541, appendix A
+const array<pair<const char *, const char *>, 61> static_table = {{
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"},
+    {":path", "/"}, {":path", "/index.html"}, {":scheme", "http"},
+    {":scheme", "https"}, {":status", "200"}, {":status", "204"},
+    {":status", "206"}, {":status", "304"}, {":status", "400"},
+    {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"}, {"accept-language", ""},
+    {"accept-ranges", ""}, {"accept", ""}, {"access-control-allow-origin", ""},
+    {"age", ""}, {"allow", ""}, {"authorization", ""}, {"cache-control", ""},
+    {"content-disposition", ""}, {"content-encoding", ""},
+    {"content-language", ""}, {"content-length", ""}, {"content-location", ""},
+    {"content-range", ""}, {"content-type", ""}, {"cookie", ""}, {"date", ""},
+    {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""},
+    {"if-match", ""}, {"if-modified-since", ""}, {"if-none-match", ""},
+    {"if-range", ""}, {"if-unmodified-since", ""}, {"last-modified", ""},
+    {"link", ""}, {"location", ""}, {"max-forwards", ""},
+    {"proxy-authenticate", ""}, {"proxy-authorization", ""}, {"range", ""},
+    {"referer", ""}, {"refresh", ""}, {"retry-after", ""}, {"server", ""},
+    {"set-cookie", ""}, {"strict-transport-security", ""},
+    {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""}, {"via", ""},
+    {"www-authenticate", ""}
+}};
+
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t bits;
+};
+
+// RFC 7541, appendix B. The last entry is EOS.
+const array<HuffmanCode, 257> huffman_codes = {{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30}
+}};
+
+/* Tree for decoding, built from huffman_codes
+ *
+ * Each node has two children. A positive value is the index of
+ * the next node, a negative value is -(symbol + 1).
+ */
+class HuffmanTree {
+public:
+    HuffmanTree() {
+        nodes_.push_back({0, 0});
+        for(int symbol = 0; symbol < static_cast<int>(huffman_codes.size()); ++symbol) {
+            const auto& hc = huffman_codes[symbol];
+            size_t node = 0;
+            for(int bit = hc.bits - 1; bit >= 0; --bit) {
+                const auto branch = (hc.code >> bit) & 1;
+                if (bit == 0) {
+                    nodes_[node][branch] = -(symbol + 1);
+                    break;
+                }
+                if (nodes_[node][branch] == 0) {
+                    nodes_[node][branch] = static_cast<int>(nodes_.size());
+                    nodes_.push_back({0, 0});
+                }
+                node = nodes_[node][branch];
+            }
+        }
+    }
+
+    int Next(size_t node, unsigned branch) const noexcept {
+        return nodes_[node][branch];
+    }
+
+    static const HuffmanTree& Get() {
+        static const HuffmanTree tree;
+        return tree;
+    }
+
+private:
+    std::vector<std::array<int, 2>> nodes_;
+};
+
+size_t HuffmanLength(boost::string_ref value) {
+    size_t bits = 0;
+    for(const auto ch : value) {
+        bits += huffman_codes[static_cast<uint8_t>(ch)].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+void HuffmanEncode(boost::string_ref value, std::string& out) {
+    uint64_t acc = 0;
+    int bits = 0;
+    for(const auto ch : value) {
+        const auto& hc = huffman_codes[static_cast<uint8_t>(ch)];
+        acc = (acc << hc.bits) | hc.code;
+        bits += hc.bits;
+        while(bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>(acc >> bits));
+        }
+    }
+
+    if (bits) {
+        // Pad with the most significant bits of EOS (all ones)
+        out.push_back(static_cast<char>((acc << (8 - bits)) | (0xff >> bits)));
+    }
+}
+
+uint64_t DecodeInt(const uint8_t *& p, const uint8_t *end, uint8_t prefixBits) {
+    const uint64_t mask = (1u << prefixBits) - 1;
+    uint64_t value = *p++ & mask;
+    if (value < mask) {
+        return value;
+    }
+
+    for(int shift = 0;; shift += 7) {
+        if ((p == end) || (shift > 56)) {
+            throw ProtocolException("HPACK: Invalid integer");
+        }
+        const auto b = *p++;
+        value += static_cast<uint64_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            return value;
+        }
+    }
+}
+
+std::string DecodeString(const uint8_t *& p, const uint8_t *end) {
+    if (p == end) {
+        throw ProtocolException("HPACK: Missing string");
+    }
+
+    const bool huffman = (*p & 0x80) != 0;
+    const auto len = DecodeInt(p, end, 7);
+    if (len > static_cast<uint64_t>(end - p)) {
+        throw ProtocolException("HPACK: String is longer than the header block");
+    }
+
+    const boost::string_ref data{reinterpret_cast<const char *>(p), static_cast<size_t>(len)};
+    p += len;
+    return huffman ? Hpack::HuffmanDecode(data) : data.to_string();
+}
+
+size_t EntrySize(const Hpack::field_t& field) {
+    return field.first.size() + field.second.size() + 32;
+}
+
+bool NeverIndex(const std::string& name) {
+    return (name == "authorization") || (name == "proxy-authorization");
+}
+
+// Values that change with every request would just push other entries out of the table
+bool DontIndex(const std::string& name) {
+    return (name == ":path") || (name == "content-length");
+}
+
+} // anonymous namespace
+
+std::string Hpack::HuffmanDecode(boost::string_ref data) {
+    const auto& tree = HuffmanTree::Get();
+
+    std::string out;
+    out.reserve(data.size() * 8 / 5);
+
+    size_t node = 0;
+    int bits_in_code = 0;
+    bool all_ones = true;
+    for(const auto ch : data) {
+        for(int bit = 7; bit >= 0; --bit) {
+            const unsigned branch = (static_cast<uint8_t>(ch) >> bit) & 1;
+            const auto next = tree.Next(node, branch);
+            all_ones = all_ones && branch;
+            ++bits_in_code;
+
+            if (next < 0) {
+                const auto symbol = -next - 1;
+                if (symbol == 256) {
+                    throw ProtocolException("HPACK: EOS in Huffman string");
+                }
+                out.push_back(static_cast<char>(symbol));
+                node = 0;
+                bits_in_code = 0;
+                all_ones = true;
+            } else if (next == 0) {
+                throw ProtocolException("HPACK: Invalid Huffman code");
+            } else {
+                node = static_cast<size_t>(next);
+            }
+        }
+    }
+
+    // The padding must be the start of EOS, and shorter than 8 bits
+    if ((bits_in_code > 7) || !all_ones) {
+        throw ProtocolException("HPACK: Invalid Huffman padding");
+    }
+
+    return out;
+}
+
+void Hpack::EncodeInt(uint64_t value, uint8_t prefixBits, uint8_t flags,
+                      std::string& out) {
+    const uint64_t mask = (1u << prefixBits) - 1;
+    if (value < mask) {
+        out.push_back(static_cast<char>(flags | value));
+        return;
+    }
+
+    out.push_back(static_cast<char>(flags | mask));
+    value -= mask;
+    while(value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void Hpack::EncodeString(boost::string_ref value, std::string& out) {
+    const auto huffman_len = HuffmanLength(value);
+    if (huffman_len < value.size()) {
+        EncodeInt(huffman_len, 7, 0x80, out);
+        HuffmanEncode(value, out);
+    } else {
+        EncodeInt(value.size(), 7, 0, out);
+        out.append(value.data(), value.size());
+    }
+}
+
+Hpack::fields_t Hpack::Decoder::Decode(boost::string_ref block) {
+    fields_t fields;
+    auto p = reinterpret_cast<const uint8_t *>(block.data());
+    const auto end = p + block.size();
+
+    while(p != end) {
+        const auto b = *p;
+        if (b & 0x80) { // Indexed header field
+            fields.push_back(Get(DecodeInt(p, end, 7)));
+            continue;
+        }
+
+        if ((b & 0xe0) == 0x20) { // Dynamic table size update
+            const auto size = DecodeInt(p, end, 5);
+            if (size > default_table_size) {
+                throw ProtocolException("HPACK: Table size update exceeds our limit");
+            }
+            max_table_size_ = size;
+            Evict();
+            continue;
+        }
+
+        // Literal header field. With incremental indexing, without
+        // indexing or never indexed.
+        const bool add_to_table = (b & 0x40) != 0;
+        const auto index = DecodeInt(p, end, add_to_table ? 6 : 4);
+        field_t field;
+        field.first = index ? Get(index).first : DecodeString(p, end);
+        field.second = DecodeString(p, end);
+        if (add_to_table) {
+            Insert(field);
+        }
+        fields.push_back(move(field));
+    }
+
+    return fields;
+}
+
+const Hpack::field_t& Hpack::Decoder::Get(size_t index) const {
+    static const auto statics = [] {
+        std::vector<field_t> fields;
+        for(const auto& f : static_table) {
+            fields.emplace_back(f.first, f.second);
+        }
+        return fields;
+    }();
+
+    if ((index > 0) && (index <= statics.size())) {
+        return statics[index - 1];
+    }
+
+    index -= statics.size() + 1;
+    if (index >= table_.size()) {
+        throw ProtocolException("HPACK: Invalid index");
+    }
+    return table_[index];
+}
+
+void Hpack::Decoder::Insert(field_t field) {
+    table_size_ += EntrySize(field);
+    table_.push_front(move(field));
+    Evict();
+}
+
+void Hpack::Decoder::Evict() {
+    while(table_size_ > max_table_size_) {
+        table_size_ -= EntrySize(table_.back());
+        table_.pop_back();
+    }
+}
+
+void Hpack::Encoder::Encode(const fields_t& fields, std::string& block) {
+    if (size_changed_) {
+        EncodeInt(max_table_size_, 5, 0x20, block);
+        size_changed_ = false;
+    }
+
+    for(const auto& field : fields) {
+        Encode(field, block);
+    }
+}
+
+void Hpack::Encoder::SetMaxTableSize(size_t size) {
+    size = min(size, default_table_size);
+    if (size == max_table_size_) {
+        return;
+    }
+
+    max_table_size_ = size;
+    size_changed_ = true;
+    while(table_size_ > max_table_size_) {
+        table_size_ -= EntrySize(table_.back());
+        table_.pop_back();
+    }
+}
+
+void Hpack::Encoder::Encode(const field_t& field, std::string& block) {
+    size_t name_index = 0;
+    for(size_t i = 0; i < static_table.size(); ++i) {
+        if (field.first == static_table[i].first) {
+            if (field.second == static_table[i].second) {
+                EncodeInt(i + 1, 7, 0x80, block);
+                return;
+            }
+            if (!name_index) {
+                name_index = i + 1;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < table_.size(); ++i) {
+        if (field.first == table_[i].first) {
+            if (field.second == table_[i].second) {
+                EncodeInt(static_table.size() + i + 1, 7, 0x80, block);
+                return;
+            }
+            if (!name_index) {
+                name_index = static_table.size() + i + 1;
+            }
+        }
+    }
+
+    if (NeverIndex(field.first)) {
+        EncodeInt(name_index, 4, 0x10, block);
+    } else if (DontIndex(field.first) || (EntrySize(field) > max_table_size_ / 2)) {
+        EncodeInt(name_index, 4, 0, block);
+    } else {
+        EncodeInt(name_index, 6, 0x40, block);
+        Insert(field);
+    }
+
+    if (!name_index) {
+        EncodeString(field.first, block);
+    }
+    EncodeString(field.second, block);
+}
+
+void Hpack::Encoder::Insert(const field_t& field) {
+    table_size_ += EntrySize(field);
+    table_.push_front(field);
+    while(table_size_ > max_table_size_) {
+        table_size_ -= EntrySize(table_.back());
+        table_.pop_back();
+    }
+}
+
+} // restc_cpp
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/utility/string_ref.hpp>
+
+namespace restc_cpp {
+
+/*! Header compression for HTTP/2 (HPACK, RFC 7541) */
+class Hpack {
+public:
+    using field_t = std::pair<std::string, std::string>;
+    using fields_t = std::vector<field_t>;
+
+    // Default size of the dynamic table, until the peer says otherwise
+    static constexpr size_t default_table_size = 4096;
+
+    class Decoder {
+    public:
+        /*! Decode a complete header block
+         *
+         * The dynamic table is updated, so all the header blocks
+         * on a connection must be decoded, in the order they arrive.
+         *
+         * \exception ProtocolException if the block is malformed.
+         */
+        fields_t Decode(boost::string_ref block);
+
+    private:
+        const field_t& Get(size_t index) const;
+        void Insert(field_t field);
+        void Evict();
+
+        std::deque<field_t> table_; // Newest first
+        size_t table_size_ = 0;
+        size_t max_table_size_ = default_table_size;
+    };
+
+    class Encoder {
+    public:
+        /*! Append the encoded header fields to block
+         *
+         * Header names must be in lower case.
+         */
+        void Encode(const fields_t& fields, std::string& block);
+
+        /*! Apply the SETTINGS_HEADER_TABLE_SIZE from the peer */
+        void SetMaxTableSize(size_t size);
+
+    private:
+        void Encode(const field_t& field, std::string& block);
+        void Insert(const field_t& field);
+
+        std::deque<field_t> table_; // Newest first
+        size_t table_size_ = 0;
+        size_t max_table_size_ = default_table_size;
+        bool size_changed_ = false; // Must be signalled in the next block
+    };
+
+    // Exposed for the unit tests
+    static void EncodeInt(uint64_t value, uint8_t prefixBits, uint8_t flags,
+                          std::string& out);
+    static void EncodeString(boost::string_ref value, std::string& out);
+    static std::string HuffmanDecode(boost::string_ref data);
+};
+
+} // restc_cpp
@@ -0,0 +1,866 @@
+#include <algorithm>
+#include <array>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/error.h"
+#include "restc-cpp/Socket.h"
+#include "restc-cpp/IoTimer.h"
+
+#include "Http2Connection.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+namespace {
+
+const std::string client_preface{"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"};
+
+// Highest stream id a client can use
+constexpr uint32_t max_stream_id = 0x7fffffff;
+
+// Largest header block we accept from the server
+constexpr size_t max_header_block_size = 1024 * 1024;
+
+uint32_t Read32(const char *data) {
+    const auto p = reinterpret_cast<const uint8_t *>(data);
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+        | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+void Append32(std::string& out, uint32_t value) {
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+void AppendSetting(std::string& out, uint16_t id, uint32_t value) {
+    out.push_back(static_cast<char>(id >> 8));
+    out.push_back(static_cast<char>(id));
+    Append32(out, value);
+}
+
+// Remove the padding from a DATA or HEADERS frame
+boost::string_ref RemovePadding(uint8_t flags, boost::string_ref payload) {
+    if (flags & Http2Connection::PADDED) {
+        if (payload.empty()) {
+            throw ProtocolException("HTTP/2: Missing pad length");
+        }
+        const auto pad = static_cast<uint8_t>(payload.front());
+        payload.remove_prefix(1);
+        if (pad > payload.size()) {
+            throw ProtocolException("HTTP/2: Too much padding");
+        }
+        payload.remove_suffix(pad);
+    }
+    return payload;
+}
+
+int RemainingMs(int timeoutMs, std::chrono::steady_clock::time_point expires) {
+    if (timeoutMs <= 0) {
+        return 0;
+    }
+    const auto ms = chrono::duration_cast<chrono::milliseconds>(
+        expires - chrono::steady_clock::now()).count();
+    return static_cast<int>(max<decltype(ms)>(ms, 1));
+}
+
+boost::system::system_error ConnectionReset() {
+    return boost::system::system_error{boost::asio::error::connection_reset};
+}
+
+} // anonymous namespace
+
+Http2Stream::Http2Stream(std::shared_ptr<Http2Connection> connection,
+                         uint32_t id, int32_t sendWindow)
+: connection_{move(connection)}, id_{id}
+, event_{connection_->owner_.GetIoService()}
+, send_window_{sendWindow}
+, recv_window_{connection_->properties_->http2WindowSize}
+{
+}
+
+Http2Stream::~Http2Stream() {
+    auto& conn = *connection_;
+    Http2Connection::lock_t lock{conn.mutex_};
+
+    if (!conn.closed_ && !reset_ && !(local_closed_ && remote_closed_)) {
+        RESTC_CPP_LOG_TRACE_("Http2Stream: Resetting unfinished stream #" << id_);
+        conn.ResetStream(*this, Http2Connection::CANCEL);
+    }
+
+    // Give back the connection window for data that was not read
+    auto unread = current_.size();
+    for(const auto& d : data_) {
+        unread += d.size();
+    }
+    conn.ConsumeConnectionWindow(unread);
+
+    conn.OnStreamStateChanged(*this, true);
+    conn.streams_.erase(id_);
+}
+
+const Connection::ptr_t& Http2Stream::GetConnection() const {
+    return connection_->GetConnection();
+}
+
+void Http2Stream::CheckError() const {
+    if (refused_) {
+        // The request was not processed, so it may be sent again
+        throw ConnectionReset();
+    }
+
+    if (reset_) {
+        throw CommunicationException("HTTP/2 stream was reset with error code "
+                                     + to_string(reset_code_));
+    }
+}
+
+Hpack::fields_t Http2Stream::GetResponseHeaders(Context& ctx, int timeoutMs) {
+    auto& conn = *connection_;
+    const auto expires = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+
+    Http2Connection::lock_t lock{conn.mutex_};
+    while(!have_headers_) {
+        CheckError();
+        lock.unlock();
+        const bool signalled = event_.Wait(ctx.GetYield(), RemainingMs(timeoutMs, expires));
+        lock.lock();
+        if (!signalled && !have_headers_) {
+            conn.ResetStream(*this, Http2Connection::CANCEL);
+            throw RequestTimeOutException();
+        }
+    }
+
+    return move(headers_);
+}
+
+boost::asio::const_buffers_1 Http2Stream::ReadSome(Context& ctx, int timeoutMs) {
+    auto& conn = *connection_;
+    const auto expires = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+
+    Http2Connection::lock_t lock{conn.mutex_};
+
+    // The data we returned last time is consumed now
+    conn.OnConsumed(*this, current_.size());
+    current_.clear();
+
+    while(data_.empty()) {
+        if (remote_closed_) {
+            return {nullptr, 0};
+        }
+        CheckError();
+        lock.unlock();
+        const bool signalled = event_.Wait(ctx.GetYield(), RemainingMs(timeoutMs, expires));
+        lock.lock();
+        if (!signalled && data_.empty() && !remote_closed_) {
+            conn.ResetStream(*this, Http2Connection::CANCEL);
+            throw RequestTimeOutException();
+        }
+    }
+
+    current_ = move(data_.front());
+    data_.pop_front();
+    return {current_.data(), current_.size()};
+}
+
+bool Http2Stream::IsEof() const {
+    Http2Connection::lock_t lock{connection_->mutex_};
+    return remote_closed_ && data_.empty();
+}
+
+Hpack::fields_t Http2Stream::TakeTrailers() {
+    Http2Connection::lock_t lock{connection_->mutex_};
+    return move(trailers_);
+}
+
+void Http2Stream::Write(boost::asio::const_buffer buffer, Context& ctx, int timeoutMs) {
+    auto& conn = *connection_;
+    auto data = boost::asio::buffer_cast<const char *>(buffer);
+    auto size = boost::asio::buffer_size(buffer);
+    const auto expires = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+
+    Http2Connection::lock_t lock{conn.mutex_};
+    while(size) {
+        if (local_closed_) {
+            // The server has responded, and does not want the rest of the body
+            return;
+        }
+
+        CheckError();
+        if (conn.closed_) {
+            throw ConnectionReset();
+        }
+
+        const auto window = min(send_window_, conn.send_window_);
+        if (window <= 0) {
+            RESTC_CPP_LOG_TRACE_("Http2Stream: Stream #" << id_
+                << " is waiting for a WINDOW_UPDATE");
+            lock.unlock();
+            const bool signalled = event_.Wait(ctx.GetYield(), RemainingMs(timeoutMs, expires));
+            lock.lock();
+            if (!signalled) {
+                conn.ResetStream(*this, Http2Connection::CANCEL);
+                throw RequestTimeOutException();
+            }
+            continue;
+        }
+
+        const auto chunk = min<size_t>({size, static_cast<size_t>(window),
+                                        conn.peer_max_frame_size_});
+        conn.QueueFrame(Http2Connection::DATA, 0, id_, {data, chunk});
+        send_window_ -= chunk;
+        conn.send_window_ -= chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void Http2Stream::EndStream() {
+    auto& conn = *connection_;
+    Http2Connection::lock_t lock{conn.mutex_};
+    if (local_closed_ || reset_ || conn.closed_) {
+        return;
+    }
+
+    conn.QueueFrame(Http2Connection::DATA, Http2Connection::END_STREAM, id_, {});
+    local_closed_ = true;
+    conn.OnStreamStateChanged(*this);
+}
+
+
+Http2Connection::Http2Connection(Connection::ptr_t connection, RestClient& owner)
+: pool_{owner.GetConnectionPool()}
+, connection_{move(connection)}, owner_{owner}
+, properties_{owner.GetConnectionProperties()}
+, strand_{boost::asio::make_strand(owner.GetIoService())}
+, writer_event_{owner.GetIoService()}
+, max_concurrent_streams_{static_cast<uint32_t>(
+    max<size_t>(properties_->http2MaxConcurrentStreams, 1))}
+, idle_since_{chrono::steady_clock::now()}
+{
+}
+
+Http2Connection::~Http2Connection() {
+    RESTC_CPP_LOG_TRACE_("Http2Connection: " << *connection_ << " is done.");
+}
+
+Http2Connection::ptr_t
+Http2Connection::Create(Connection::ptr_t connection, RestClient& owner) {
+    auto instance = make_shared<Http2Connection>(move(connection), owner);
+    instance->Start();
+    return instance;
+}
+
+void Http2Connection::Start() {
+    RESTC_CPP_LOG_DEBUG_("Http2Connection: Starting HTTP/2 on " << *connection_);
+
+    const auto window = static_cast<uint32_t>(properties_->http2WindowSize);
+    const auto connection_window = static_cast<int64_t>(window) * connection_window_factor;
+
+    std::string settings;
+    AppendSetting(settings, ENABLE_PUSH, 0);
+    AppendSetting(settings, INITIAL_WINDOW_SIZE, window);
+
+    {
+        lock_t lock{mutex_};
+        Queue(client_preface);
+        QueueFrame(SETTINGS, 0, 0, settings);
+        if (connection_window > recv_window_) {
+            QueueWindowUpdate(0, static_cast<uint32_t>(connection_window - recv_window_));
+            recv_window_ = connection_window;
+        }
+    }
+
+    auto self = shared_from_this();
+    boost::asio::spawn(strand_, [self](boost::asio::yield_context yield) {
+        self->ReadFrames(yield);
+    });
+    boost::asio::spawn(strand_, [self](boost::asio::yield_context yield) {
+        self->WriteFrames(yield);
+    });
+}
+
+Http2Stream::ptr_t
+Http2Connection::OpenStream(const Hpack::fields_t& fields, bool endStream,
+                            Context& ctx, int timeoutMs) {
+    const auto expires = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+
+    lock_t lock{mutex_};
+    while(true) {
+        if (closed_ || goaway_ || (next_stream_id_ > max_stream_id)) {
+            throw ConnectionReset();
+        }
+
+        if (active_ < max_concurrent_streams_) {
+            break;
+        }
+
+        RESTC_CPP_LOG_TRACE_("Http2Connection: Waiting for a free stream on "
+            << *connection_);
+        auto waiter = make_shared<AsyncEvent>(owner_.GetIoService());
+        stream_waiters_.push_back(waiter);
+        lock.unlock();
+        const bool signalled = waiter->Wait(ctx.GetYield(), RemainingMs(timeoutMs, expires));
+        lock.lock();
+
+        if (!signalled) {
+            auto it = find(stream_waiters_.begin(), stream_waiters_.end(), waiter);
+            if (it != stream_waiters_.end()) {
+                stream_waiters_.erase(it);
+            } else {
+                // We were woken up as well. Pass it on.
+                WakeStreamWaiter();
+            }
+            throw ConstraintException(
+                "Timed out waiting for a free HTTP/2 stream");
+        }
+    }
+
+    auto stream = make_shared<Http2Stream>(shared_from_this(), next_stream_id_,
+                                           static_cast<int32_t>(peer_initial_window_));
+    next_stream_id_ += 2;
+    streams_[stream->id_] = stream.get();
+    ++active_;
+
+    // HEADERS, followed by CONTINUATION frames if the block is too large for one
+    std::string block;
+    encoder_.Encode(fields, block);
+    size_t offset = 0;
+    do {
+        const auto chunk = min<size_t>(block.size() - offset, peer_max_frame_size_);
+        const bool first = offset == 0;
+        offset += chunk;
+        const uint8_t flags = (offset == block.size() ? END_HEADERS : 0)
+            | (first && endStream ? END_STREAM : 0);
+        QueueFrame(first ? HEADERS : CONTINUATION, flags, stream->id_,
+                   {block.data() + offset - chunk, chunk});
+    } while(offset < block.size());
+
+    stream->local_closed_ = endStream;
+
+    RESTC_CPP_LOG_TRACE_("Http2Connection: Opened stream #" << stream->id_
+        << " on " << *connection_);
+    return stream;
+}
+
+bool Http2Connection::IsUsable() const {
+    lock_t lock{mutex_};
+    return !closed_ && !goaway_ && (next_stream_id_ <= max_stream_id);
+}
+
+size_t Http2Connection::GetActiveStreams() const {
+    lock_t lock{mutex_};
+    return active_;
+}
+
+std::chrono::steady_clock::time_point Http2Connection::GetIdleSince() const {
+    lock_t lock{mutex_};
+    return idle_since_;
+}
+
+void Http2Connection::Close() {
+    Fail(NO_ERROR, "Closed", false);
+
+    // The co-routines may be suspended in the io-service that is stopping,
+    // so we can not rely on the writer to close the socket.
+    boost::system::error_code ec;
+    connection_->GetSocket().GetSocket().close(ec);
+}
+
+void Http2Connection::ReadFrames(boost::asio::yield_context yield) {
+    std::array<char, RESTC_CPP_IO_BUFFER_SIZE> buffer;
+    std::string input;
+
+    try {
+        while(true) {
+            const auto bytes = connection_->GetSocket().AsyncReadSome(
+                {buffer.data(), buffer.size()}, yield);
+            input.append(buffer.data(), bytes);
+
+            size_t pos = 0;
+            while((input.size() - pos) >= frame_header_size) {
+                const auto *header = input.data() + pos;
+                const auto length = (static_cast<uint32_t>(static_cast<uint8_t>(header[0])) << 16)
+                    | (static_cast<uint32_t>(static_cast<uint8_t>(header[1])) << 8)
+                    | static_cast<uint8_t>(header[2]);
+                if (length > default_max_frame_size) {
+                    Fail(FRAME_SIZE_ERROR, "Too large frame", true);
+                    return;
+                }
+
+                if ((input.size() - pos) < (frame_header_size + length)) {
+                    break;
+                }
+
+                const auto type = static_cast<uint8_t>(header[3]);
+                const auto flags = static_cast<uint8_t>(header[4]);
+                const auto stream_id = Read32(header + 5) & max_stream_id;
+
+                OnFrame(type, flags, stream_id,
+                        {header + frame_header_size, length});
+                pos += frame_header_size + length;
+            }
+            input.erase(0, pos);
+        }
+    } catch (boost::coroutines::detail::forced_unwind const&) {
+       throw; // required for Boost Coroutine!
+    } catch(const ProtocolException& ex) {
+        Fail(PROTOCOL_ERROR, ex.what(), true);
+    } catch(const std::exception& ex) {
+        Fail(NO_ERROR, ex.what(), false);
+    }
+}
+
+void Http2Connection::WriteFrames(boost::asio::yield_context yield) {
+    static const auto timer_name = "Http2Connection"s;
+
+    try {
+        std::vector<std::string> frames;
+        write_buffers_t buffers;
+        while(true) {
+            frames.clear();
+            bool closed = false;
+            {
+                lock_t lock{mutex_};
+                frames.swap(out_);
+                closed = closed_;
+            }
+
+            if (frames.empty()) {
+                if (closed) {
+                    break;
+                }
+                writer_event_.Wait(yield);
+                continue;
+            }
+
+            buffers.clear();
+            for(const auto& frame : frames) {
+                buffers.emplace_back(frame.data(), frame.size());
+            }
+
+            auto timer = IoTimer::Create(timer_name, properties_->sendTimeoutMs,
+                                         connection_);
+            connection_->GetSocket().AsyncWrite(buffers, yield);
+        }
+    } catch (boost::coroutines::detail::forced_unwind const&) {
+       throw; // required for Boost Coroutine!
+    } catch(const std::exception& ex) {
+        Fail(NO_ERROR, ex.what(), false);
+    }
+
+    // Makes the reader co-routine finish
+    boost::system::error_code ec;
+    connection_->GetSocket().GetSocket().close(ec);
+}
+
+void Http2Connection::OnFrame(uint8_t type, uint8_t flags, uint32_t streamId,
+                              boost::string_ref payload) {
+
+    if (header_block_stream_ && (type != CONTINUATION)) {
+        throw ProtocolException("HTTP/2: Expected CONTINUATION");
+    }
+
+    switch(type) {
+    case DATA:
+        OnData(flags, streamId, payload);
+        break;
+    case HEADERS:
+        OnHeaders(flags, streamId, payload);
+        break;
+    case CONTINUATION:
+        if (!header_block_stream_ || (streamId != header_block_stream_)) {
+            throw ProtocolException("HTTP/2: Unexpected CONTINUATION");
+        }
+        header_block_.append(payload.data(), payload.size());
+        if (header_block_.size() > max_header_block_size) {
+            throw ProtocolException("HTTP/2: Too large header block");
+        }
+        if (flags & END_HEADERS) {
+            OnHeaderBlock();
+        }
+        break;
+    case SETTINGS:
+        OnSettings(flags, payload);
+        break;
+    case PING:
+        if (!(flags & ACK)) {
+            lock_t lock{mutex_};
+            QueueFrame(PING, ACK, 0, payload);
+        }
+        break;
+    case GOAWAY:
+        OnGoAway(payload);
+        break;
+    case WINDOW_UPDATE:
+        OnWindowUpdate(streamId, payload);
+        break;
+    case RST_STREAM:
+        OnRstStream(streamId, payload);
+        break;
+    case PUSH_PROMISE:
+        throw ProtocolException("HTTP/2: PUSH_PROMISE, but push is disabled");
+    default:
+        ; // PRIORITY and unknown frame types are ignored
+    }
+}
+
+void Http2Connection::OnHeaders(uint8_t flags, uint32_t streamId,
+                                boost::string_ref payload) {
+    payload = RemovePadding(flags, payload);
+    if (flags & PRIORITY_FLAG) {
+        if (payload.size() < 5) {
+            throw ProtocolException("HTTP/2: Too short HEADERS frame");
+        }
+        payload.remove_prefix(5);
+    }
+
+    header_block_.assign(payload.data(), payload.size());
+    header_block_stream_ = streamId;
+    header_block_end_stream_ = (flags & END_STREAM) != 0;
+
+    if (flags & END_HEADERS) {
+        OnHeaderBlock();
+    }
+}
+
+void Http2Connection::OnHeaderBlock() {
+    // Always decode, to keep the dynamic table in sync with the server
+    auto fields = decoder_.Decode(header_block_);
+    const auto stream_id = header_block_stream_;
+    header_block_.clear();
+    header_block_stream_ = 0;
+
+    lock_t lock{mutex_};
+    auto stream = FindStream(stream_id);
+    if (!stream || stream->reset_) {
+        return;
+    }
+
+    if (!stream->have_headers_) {
+        const auto status = find_if(fields.begin(), fields.end(),
+                                    [](const Hpack::field_t& f) {
+            return f.first == ":status";
+        });
+        if ((status != fields.end()) && !status->second.empty()
+            && (status->second.front() == '1') && !header_block_end_stream_) {
+            RESTC_CPP_LOG_TRACE_("Http2Connection: Ignoring informational response "
+                << status->second << " on stream #" << stream_id);
+            return;
+        }
+
+        stream->headers_ = move(fields);
+        stream->have_headers_ = true;
+    } else {
+        stream->trailers_ = move(fields);
+    }
+
+    if (header_block_end_stream_) {
+        stream->remote_closed_ = true;
+        OnStreamStateChanged(*stream);
+    }
+    stream->event_.Signal();
+}
+
+void Http2Connection::OnData(uint8_t flags, uint32_t streamId,
+                             boost::string_ref payload) {
+    // The padding counts in the flow control
+    const auto frame_size = payload.size();
+    const auto data = RemovePadding(flags, payload);
+
+    lock_t lock{mutex_};
+    recv_window_ -= frame_size;
+    if (recv_window_ < 0) {
+        throw ProtocolException("HTTP/2: The server exceeded the connection window");
+    }
+
+    auto stream = FindStream(streamId);
+    if (!stream || stream->remote_closed_ || stream->reset_) {
+        // Nobody wants the data
+        ConsumeConnectionWindow(frame_size);
+        return;
+    }
+
+    stream->recv_window_ -= static_cast<int32_t>(frame_size);
+    if (stream->recv_window_ < 0) {
+        RESTC_CPP_LOG_WARN_("Http2Connection: The server exceeded the window for stream #"
+            << streamId);
+        ConsumeConnectionWindow(frame_size);
+        ResetStream(*stream, FLOW_CONTROL_ERROR);
+        return;
+    }
+
+    OnConsumed(*stream, frame_size - data.size());
+    if (!data.empty()) {
+        stream->data_.emplace_back(data.data(), data.size());
+    }
+
+    if (flags & END_STREAM) {
+        stream->remote_closed_ = true;
+        OnStreamStateChanged(*stream);
+    }
+    stream->event_.Signal();
+}
+
+void Http2Connection::OnSettings(uint8_t flags, boost::string_ref payload) {
+    if (flags & ACK) {
+        return;
+    }
+
+    if (payload.size() % 6) {
+        throw ProtocolException("HTTP/2: Invalid SETTINGS frame");
+    }
+
+    lock_t lock{mutex_};
+    for(size_t pos = 0; pos < payload.size(); pos += 6) {
+        const auto id = (static_cast<uint8_t>(payload[pos]) << 8)
+            | static_cast<uint8_t>(payload[pos + 1]);
+        const auto value = Read32(payload.data() + pos + 2);
+
+        switch(id) {
+        case HEADER_TABLE_SIZE:
+            encoder_.SetMaxTableSize(value);
+            break;
+        case MAX_CONCURRENT_STREAMS:
+            max_concurrent_streams_ = min(value, static_cast<uint32_t>(
+                max<size_t>(properties_->http2MaxConcurrentStreams, 1)));
+            WakeStreamWaiters();
+            break;
+        case INITIAL_WINDOW_SIZE: {
+            if (value > max_stream_id) {
+                throw ProtocolException("HTTP/2: Invalid INITIAL_WINDOW_SIZE");
+            }
+            // Applies to the streams we already have as well
+            const auto delta = static_cast<int64_t>(value) - peer_initial_window_;
+            peer_initial_window_ = value;
+            for(auto& it : streams_) {
+                it.second->send_window_ += delta;
+                it.second->event_.Signal();
+            }
+        } break;
+        case MAX_FRAME_SIZE:
+            if ((value < default_max_frame_size) || (value > 0xffffff)) {
+                throw ProtocolException("HTTP/2: Invalid MAX_FRAME_SIZE");
+            }
+            peer_max_frame_size_ = value;
+            break;
+        default:
+            ; // We don't care about the others
+        }
+    }
+
+    QueueFrame(SETTINGS, ACK, 0, {});
+}
+
+void Http2Connection::OnWindowUpdate(uint32_t streamId, boost::string_ref payload) {
+    if (payload.size() != 4) {
+        throw ProtocolException("HTTP/2: Invalid WINDOW_UPDATE frame");
+    }
+    const auto increment = Read32(payload.data()) & max_stream_id;
+
+    lock_t lock{mutex_};
+    if (streamId == 0) {
+        send_window_ += increment;
+        for(auto& it : streams_) {
+            it.second->event_.Signal();
+        }
+    } else if (auto stream = FindStream(streamId)) {
+        stream->send_window_ += increment;
+        stream->event_.Signal();
+    }
+}
+
+void Http2Connection::OnRstStream(uint32_t streamId, boost::string_ref payload) {
+    if (payload.size() != 4) {
+        throw ProtocolException("HTTP/2: Invalid RST_STREAM frame");
+    }
+    const auto code = Read32(payload.data());
+
+    lock_t lock{mutex_};
+    auto stream = FindStream(streamId);
+    if (!stream) {
+        return;
+    }
+
+    if ((code == NO_ERROR) && stream->remote_closed_) {
+        // The response is complete. The server just don't want the rest of the request.
+        stream->local_closed_ = true;
+    } else {
+        RESTC_CPP_LOG_DEBUG_("Http2Connection: Stream #" << streamId
+            << " was reset by the server. Error code: " << code);
+        stream->reset_ = true;
+        stream->reset_code_ = code;
+        stream->refused_ = (code == REFUSED_STREAM);
+    }
+
+    OnStreamStateChanged(*stream);
+    stream->event_.Signal();
+}
+
+void Http2Connection::OnGoAway(boost::string_ref payload) {
+    if (payload.size() < 8) {
+        throw ProtocolException("HTTP/2: Invalid GOAWAY frame");
+    }
+    const auto last_stream_id = Read32(payload.data()) & max_stream_id;
+    const auto code = Read32(payload.data() + 4);
+
+    RESTC_CPP_LOG_DEBUG_("Http2Connection: GOAWAY from " << *connection_
+        << ". Last stream: " << last_stream_id << ", error code: " << code);
+
+    lock_t lock{mutex_};
+    goaway_ = true;
+
+    // The server did not process these, so they can be sent again
+    for(auto& it : streams_) {
+        if (it.first > last_stream_id) {
+            FailStream(*it.second, code, true);
+        }
+    }
+
+    WakeStreamWaiters();
+    if (active_ == 0) {
+        closed_ = true;
+        writer_event_.Signal();
+    }
+}
+
+void Http2Connection::Fail(uint32_t errorCode, const std::string& reason,
+                           bool sendGoAway) {
+    lock_t lock{mutex_};
+    if (closed_) {
+        return;
+    }
+
+    RESTC_CPP_LOG_DEBUG_("Http2Connection: Closing " << *connection_
+        << ": " << reason);
+
+    closed_ = true;
+    for(auto& it : streams_) {
+        FailStream(*it.second, errorCode, true);
+    }
+
+    if (sendGoAway) {
+        std::string goaway;
+        Append32(goaway, 0); // We never accept streams from the server
+        Append32(goaway, errorCode);
+        QueueFrame(GOAWAY, 0, 0, goaway);
+    }
+
+    WakeStreamWaiters();
+    writer_event_.Signal();
+}
+
+Http2Stream *Http2Connection::FindStream(uint32_t id) {
+    auto it = streams_.find(id);
+    return it == streams_.end() ? nullptr : it->second;
+}
+
+void Http2Connection::FailStream(Http2Stream& stream, uint32_t errorCode,
+                                 bool refused) {
+    if (stream.reset_ || (stream.remote_closed_ && stream.data_.empty())) {
+        return;
+    }
+
+    stream.reset_ = true;
+    stream.reset_code_ = errorCode;
+    stream.refused_ = refused;
+    OnStreamStateChanged(stream);
+    stream.event_.Signal();
+}
+
+void Http2Connection::ResetStream(Http2Stream& stream, uint32_t errorCode) {
+    if (!closed_ && !stream.reset_) {
+        std::string code;
+        Append32(code, errorCode);
+        QueueFrame(RST_STREAM, 0, stream.id_, code);
+    }
+
+    stream.reset_ = true;
+    stream.reset_code_ = errorCode;
+    OnStreamStateChanged(stream);
+}
+
+void Http2Connection::OnStreamStateChanged(Http2Stream& stream, bool destroyed) {
+    if (stream.done_ || !(destroyed || stream.reset_
+                          || (stream.local_closed_ && stream.remote_closed_))) {
+        return;
+    }
+
+    stream.done_ = true;
+    assert(active_ > 0);
+    if (--active_ == 0) {
+        idle_since_ = chrono::steady_clock::now();
+        if (goaway_ && !closed_) {
+            closed_ = true;
+            writer_event_.Signal();
+        }
+    }
+    WakeStreamWaiter();
+}
+
+void Http2Connection::OnConsumed(Http2Stream& stream, size_t bytes) {
+    if (!bytes) {
+        return;
+    }
+
+    ConsumeConnectionWindow(bytes);
+
+    stream.consumed_ += bytes;
+    if (!stream.remote_closed_ && !stream.reset_
+        && (stream.consumed_ >= static_cast<size_t>(properties_->http2WindowSize / 2))) {
+        QueueWindowUpdate(stream.id_, static_cast<uint32_t>(stream.consumed_));
+        stream.recv_window_ += static_cast<int32_t>(stream.consumed_);
+        stream.consumed_ = 0;
+    }
+}
+
+void Http2Connection::ConsumeConnectionWindow(size_t bytes) {
+    consumed_ += bytes;
+    const auto window = static_cast<size_t>(properties_->http2WindowSize) * connection_window_factor;
+    if (!closed_ && (consumed_ >= window / 2)) {
+        QueueWindowUpdate(0, static_cast<uint32_t>(consumed_));
+        recv_window_ += consumed_;
+        consumed_ = 0;
+    }
+}
+
+void Http2Connection::WakeStreamWaiter() {
+    if (!stream_waiters_.empty()) {
+        stream_waiters_.front()->Signal();
+        stream_waiters_.pop_front();
+    }
+}
+
+void Http2Connection::WakeStreamWaiters() {
+    for(auto& waiter : stream_waiters_) {
+        waiter->Signal();
+    }
+    stream_waiters_.clear();
+}
+
+void Http2Connection::Queue(std::string frame) {
+    out_.push_back(move(frame));
+    writer_event_.Signal();
+}
+
+void Http2Connection::QueueFrame(uint8_t type, uint8_t flags, uint32_t streamId,
+                                 boost::string_ref payload) {
+    std::string frame;
+    frame.reserve(frame_header_size + payload.size());
+    Append32(frame, static_cast<uint32_t>(payload.size()) << 8 | type);
+    frame.push_back(static_cast<char>(flags));
+    Append32(frame, streamId);
+    frame.append(payload.data(), payload.size());
+    Queue(move(frame));
+}
+
+void Http2Connection::QueueWindowUpdate(uint32_t streamId, uint32_t increment) {
+    std::string payload;
+    Append32(payload, increment);
+    QueueFrame(WINDOW_UPDATE, 0, streamId, payload);
+}
+
+} // restc_cpp
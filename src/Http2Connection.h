@@ -0,0 +1,256 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/Connection.h"
+#include "restc-cpp/ConnectionPool.h"
+
+#include "AsyncEvent.h"
+#include "Hpack.h"
+
+namespace restc_cpp {
+
+class Http2Connection;
+
+/*! One request and its reply on a HTTP/2 connection
+ *
+ * The stream is reset if it is destroyed before it is complete.
+ */
+class Http2Stream {
+public:
+    using ptr_t = std::shared_ptr<Http2Stream>;
+
+    Http2Stream(std::shared_ptr<Http2Connection> connection, uint32_t id,
+                int32_t sendWindow);
+    Http2Stream(const Http2Stream&) = delete;
+    Http2Stream& operator = (const Http2Stream&) = delete;
+    ~Http2Stream();
+
+    uint32_t GetId() const noexcept { return id_; }
+    const Connection::ptr_t& GetConnection() const;
+
+    /*! Wait for the response header fields
+     *
+     * Informational (1xx) responses are skipped.
+     *
+     * \exception RequestTimeOutException, or boost::system::system_error
+     *      with connection_reset if the stream was refused, or the
+     *      connection failed before the server responded.
+     */
+    Hpack::fields_t GetResponseHeaders(Context& ctx, int timeoutMs);
+
+    /*! Get the next part of the response body
+     *
+     * The data is valid until the next call. An empty buffer
+     * is returned when the body is complete.
+     */
+    boost::asio::const_buffers_1 ReadSome(Context& ctx, int timeoutMs);
+
+    /*! True when all of the response body has been read */
+    bool IsEof() const;
+
+    /*! Get the trailer fields, if the server sent any */
+    Hpack::fields_t TakeTrailers();
+
+    /*! Send some of the request body in DATA frames
+     *
+     * Waits if the flow control windows from the server are exhausted.
+     */
+    void Write(boost::asio::const_buffer buffer, Context& ctx, int timeoutMs);
+
+    /*! Tell the server that the request is complete */
+    void EndStream();
+
+private:
+    friend class Http2Connection;
+
+    // Throws if the stream has failed. Called with the connections mutex locked.
+    void CheckError() const;
+
+    const std::shared_ptr<Http2Connection> connection_;
+    const uint32_t id_;
+    AsyncEvent event_; // Signalled when the state below changes
+
+    // Protected by the connections mutex
+    int64_t send_window_;
+    int32_t recv_window_;
+    size_t consumed_ = 0; // Body bytes read since the last WINDOW_UPDATE
+    bool have_headers_ = false;
+    Hpack::fields_t headers_;
+    Hpack::fields_t trailers_;
+    std::deque<std::string> data_;
+    std::string current_; // The data we returned from ReadSome()
+    bool local_closed_ = false; // We have sent END_STREAM
+    bool remote_closed_ = false; // The server has sent END_STREAM
+    bool refused_ = false; // The server did not process the request. It can be sent again.
+    uint32_t reset_code_ = 0; // Error code from RST_STREAM or GOAWAY
+    bool reset_ = false;
+    bool done_ = false; // No longer counted as an active stream
+};
+
+/*! A HTTP/2 connection (RFC 7540)
+ *
+ * Many requests can be sent at the same time over one connection,
+ * each in its own stream.
+ *
+ * The connection has two co-routines of its own on a strand; one that
+ * reads and dispatches the frames from the server, and one that writes
+ * the frames queued by the streams. The requests co-routines only
+ * exchange data with them through the state protected by the mutex.
+ */
+class Http2Connection : public std::enable_shared_from_this<Http2Connection> {
+public:
+    using ptr_t = std::shared_ptr<Http2Connection>;
+
+    // Frame types
+    enum FrameType : uint8_t {
+        DATA = 0x0, HEADERS = 0x1, PRIORITY = 0x2, RST_STREAM = 0x3,
+        SETTINGS = 0x4, PUSH_PROMISE = 0x5, PING = 0x6, GOAWAY = 0x7,
+        WINDOW_UPDATE = 0x8, CONTINUATION = 0x9
+    };
+
+    // Frame flags
+    enum Flags : uint8_t {
+        END_STREAM = 0x1, ACK = 0x1, END_HEADERS = 0x4, PADDED = 0x8,
+        PRIORITY_FLAG = 0x20
+    };
+
+    // Settings parameters
+    enum Setting : uint16_t {
+        HEADER_TABLE_SIZE = 0x1, ENABLE_PUSH = 0x2, MAX_CONCURRENT_STREAMS = 0x3,
+        INITIAL_WINDOW_SIZE = 0x4, MAX_FRAME_SIZE = 0x5, MAX_HEADER_LIST_SIZE = 0x6
+    };
+
+    // Error codes
+    enum Error : uint32_t {
+        NO_ERROR = 0x0, PROTOCOL_ERROR = 0x1, INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3, FRAME_SIZE_ERROR = 0x6, REFUSED_STREAM = 0x7,
+        CANCEL = 0x8
+    };
+
+    static constexpr size_t frame_header_size = 9;
+    static constexpr uint32_t default_window = 65535;
+    static constexpr uint32_t default_max_frame_size = 16384;
+    // The connection window is this many times the stream window
+    static constexpr uint32_t connection_window_factor = 16;
+
+    Http2Connection(Connection::ptr_t connection, RestClient& owner);
+    Http2Connection(const Http2Connection&) = delete;
+    Http2Connection& operator = (const Http2Connection&) = delete;
+    ~Http2Connection();
+
+    /*! Start HTTP/2 on a connected socket
+     *
+     * Sends the connection preface, and starts the co-routines
+     * that serve the connection.
+     */
+    static ptr_t Create(Connection::ptr_t connection, RestClient& owner);
+
+    /*! Send the header fields for a new request
+     *
+     * Waits if the server's limit for concurrent streams is reached.
+     *
+     * \param endStream True if the request has no body.
+     * \exception ConstraintException if no stream became available
+     *      in time, or boost::system::system_error with connection_reset
+     *      if the connection can not be used any more.
+     */
+    Http2Stream::ptr_t OpenStream(const Hpack::fields_t& fields,
+                                  bool endStream, Context& ctx,
+                                  int timeoutMs);
+
+    /*! True as long as we can start new requests on the connection */
+    bool IsUsable() const;
+
+    /*! Number of streams that are in use */
+    size_t GetActiveStreams() const;
+
+    /*! When the last stream was closed */
+    std::chrono::steady_clock::time_point GetIdleSince() const;
+
+    const Connection::ptr_t& GetConnection() const noexcept {
+        return connection_;
+    }
+
+    /*! Close the connection. All the active streams fail. */
+    void Close();
+
+    friend std::ostream& operator << (std::ostream& o, const Http2Connection& v) {
+        return o << "{Http2Connection " << *v.connection_ << '}';
+    }
+
+private:
+    friend class Http2Stream;
+    using lock_t = std::unique_lock<std::mutex>;
+
+    void Start();
+    void ReadFrames(boost::asio::yield_context yield);
+    void WriteFrames(boost::asio::yield_context yield);
+    void OnFrame(uint8_t type, uint8_t flags, uint32_t streamId,
+                 boost::string_ref payload);
+    void OnHeaders(uint8_t flags, uint32_t streamId, boost::string_ref payload);
+    void OnHeaderBlock();
+    void OnData(uint8_t flags, uint32_t streamId, boost::string_ref payload);
+    void OnSettings(uint8_t flags, boost::string_ref payload);
+    void OnWindowUpdate(uint32_t streamId, boost::string_ref payload);
+    void OnRstStream(uint32_t streamId, boost::string_ref payload);
+    void OnGoAway(boost::string_ref payload);
+
+    // Fail the connection, and tell the server why if the socket is still good
+    void Fail(uint32_t errorCode, const std::string& reason, bool sendGoAway);
+
+    // The methods below must be called with mutex_ locked
+    Http2Stream *FindStream(uint32_t id);
+    void FailStream(Http2Stream& stream, uint32_t errorCode, bool refused);
+    void ResetStream(Http2Stream& stream, uint32_t errorCode);
+    void OnStreamStateChanged(Http2Stream& stream, bool destroyed = false);
+    void OnConsumed(Http2Stream& stream, size_t bytes);
+    void ConsumeConnectionWindow(size_t bytes);
+    void WakeStreamWaiter();
+    void WakeStreamWaiters();
+    void Queue(std::string frame);
+    void QueueFrame(uint8_t type, uint8_t flags, uint32_t streamId,
+                    boost::string_ref payload);
+    void QueueWindowUpdate(uint32_t streamId, uint32_t increment);
+
+    // Keeps the pool alive until our connection is released to it,
+    // so it must be declared before connection_
+    const ConnectionPool::ptr_t pool_;
+    const Connection::ptr_t connection_;
+    RestClient& owner_;
+    const Request::Properties::ptr_t properties_;
+    boost::asio::strand<boost::asio::io_service::executor_type> strand_;
+    AsyncEvent writer_event_; // Signalled when there are frames to write
+
+    mutable std::mutex mutex_;
+    std::map<uint32_t, Http2Stream *> streams_;
+    std::deque<AsyncEvent::ptr_t> stream_waiters_; // Waiting for a free stream
+    std::vector<std::string> out_; // Frames to write
+    Hpack::Encoder encoder_;
+    uint32_t next_stream_id_ = 1;
+    uint32_t max_concurrent_streams_;
+    uint32_t peer_initial_window_ = default_window;
+    uint32_t peer_max_frame_size_ = default_max_frame_size;
+    int64_t send_window_ = default_window;
+    int64_t recv_window_ = default_window;
+    size_t consumed_ = 0; // Body bytes read since the last connection WINDOW_UPDATE
+    size_t active_ = 0; // Streams that are not done
+    bool closed_ = false;
+    bool goaway_ = false;
+    std::chrono::steady_clock::time_point idle_since_;
+
+    // Only used by the reader co-routine
+    Hpack::Decoder decoder_;
+    std::string header_block_; // Until we have END_HEADERS
+    uint32_t header_block_stream_ = 0;
+    bool header_block_end_stream_ = false;
+};
+
+} // restc_cpp
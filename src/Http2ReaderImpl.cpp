@@ -0,0 +1,66 @@
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/DataReader.h"
+#include "restc-cpp/logging.h"
+
+#include "Http2Connection.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+
+class Http2ReaderImpl : public DataReader {
+public:
+    Http2ReaderImpl(std::shared_ptr<Http2Stream>&& stream, add_header_fn_t&& fn,
+                    Context& ctx, const ReadConfig& cfg)
+    : ctx_{ctx}, stream_{move(stream)}, add_header_{std::move(fn)}, cfg_{cfg}
+    {
+    }
+
+    void Finish() override {
+    }
+
+    boost::asio::const_buffers_1 ReadSome() override {
+        auto data = stream_->ReadSome(ctx_, cfg_.msReadTimeout);
+        const auto bytes = boost::asio::buffer_size(data);
+
+        RESTC_CPP_LOG_TRACE_("Read #" << bytes
+            << " bytes from HTTP/2 stream #" << stream_->GetId());
+
+        if (stream_->IsEof()) {
+            AddTrailers();
+        }
+
+        return data;
+    }
+
+    bool IsEof() const override {
+        return stream_->IsEof();
+    }
+
+private:
+    // The trailer fields arrive after the body
+    void AddTrailers() {
+        if (add_header_) {
+            for(auto& field : stream_->TakeTrailers()) {
+                add_header_(field.first, field.second);
+            }
+            add_header_ = {};
+        }
+    }
+
+    Context& ctx_;
+    const std::shared_ptr<Http2Stream> stream_;
+    add_header_fn_t add_header_;
+    const ReadConfig cfg_;
+};
+
+
+DataReader::ptr_t
+DataReader::CreateHttp2Reader(std::shared_ptr<Http2Stream> stream,
+                              add_header_fn_t fn, Context& ctx,
+                              const ReadConfig& cfg) {
+    return make_unique<Http2ReaderImpl>(move(stream), std::move(fn), ctx, cfg);
+}
+
+} // namespace
@@ -0,0 +1,66 @@
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/DataWriter.h"
+#include "restc-cpp/logging.h"
+
+#include "Http2Connection.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+
+/*! Writes the request body to a HTTP/2 stream, as DATA frames
+ *
+ * The headers are sent when the stream is opened, so this
+ * is only used for the body.
+ */
+class Http2WriterImpl : public DataWriter {
+public:
+    Http2WriterImpl(std::shared_ptr<Http2Stream> stream, Context& ctx,
+                    const WriteConfig& cfg)
+    : ctx_{ctx}, cfg_{cfg}, stream_{move(stream)}
+    {
+    }
+
+    void WriteDirect(boost::asio::const_buffers_1 buffers) override {
+        Write(buffers);
+    }
+
+    void Write(boost::asio::const_buffers_1 buffers) override {
+        stream_->Write(*buffers.begin(), ctx_, cfg_.msWriteTimeout);
+
+        RESTC_CPP_LOG_TRACE_("Wrote #" << boost::asio::buffer_size(buffers)
+            << " bytes to HTTP/2 stream #" << stream_->GetId());
+    }
+
+    void Write(const write_buffers_t& buffers) override {
+        for(const auto& b : buffers) {
+            stream_->Write(b, ctx_, cfg_.msWriteTimeout);
+        }
+
+        RESTC_CPP_LOG_TRACE_("Wrote #" << boost::asio::buffer_size(buffers)
+            << " bytes to HTTP/2 stream #" << stream_->GetId());
+    }
+
+    void Finish() override {
+        stream_->EndStream();
+    }
+
+    void SetHeaders(Request::headers_t& ) override {
+        ;
+    }
+
+private:
+    Context& ctx_;
+    WriteConfig cfg_;
+    const std::shared_ptr<Http2Stream> stream_;
+};
+
+
+DataWriter::ptr_t
+DataWriter::CreateHttp2Writer(std::shared_ptr<Http2Stream> stream, Context& ctx,
+                              const WriteConfig& cfg) {
+    return make_unique<Http2WriterImpl>(move(stream), ctx, cfg);
+}
+
+} // namespace
@@ -4,27 +4,171 @@
 #include "restc-cpp/DataReader.h"
 #include "restc-cpp/logging.h"
 #include "restc-cpp/IoTimer.h"
+#include "restc-cpp/BufferPool.h"
+
+#include "AsyncEvent.h"
 
 using namespace std;
 
 namespace restc_cpp {
 
+namespace {
+
+/* The size of the next receive buffer
+ *
+ * The buffer doubles in size when a receive fills it, so that
+ * large bodies are read in fewer, larger pieces.
+ */
+size_t GetNextBufferSize(const size_t current, const size_t received,
+                         const size_t maxSize) noexcept {
+    if ((received < current) || (current >= maxSize)) {
+        return current;
+    }
+    return min(current * 2, maxSize);
+}
+
+/* Buffers for reading ahead, shared with the co-routine that reads
+ *
+ * The buffers are used as a ring. In order, there is the buffer
+ * returned to the caller, the filled buffers, the buffer that is
+ * being read into (if any), and the free buffers. The buffers are
+ * borrowed from the pool when they are first read into, and when
+ * they are too small.
+ *
+ * It is only used by the co-routine that reads the reply and the
+ * co-routine it spawns to read ahead, which share a strand.
+ */
+struct ReadAheadState {
+    ReadAheadState(boost::asio::io_service& ioservice, size_t numBuffers,
+                   size_t bufferSize, size_t maxBufferSize)
+    : buffers(numBuffers), bytes(numBuffers), buffer_size{bufferSize}
+    , max_buffer_size{maxBufferSize}, wake{ioservice}, ready{ioservice}
+    {
+    }
+
+    bool CanRead() const noexcept {
+        return !done && !error && !reading
+            && (filled_bytes < promised)
+            && ((filled + 1) < buffers.size());
+    }
+
+    size_t GetReadSlot() const noexcept {
+        return (next + filled) % buffers.size();
+    }
+
+    // Get a free buffer to read into
+    BufferPool::Buffer& GetBuffer(const size_t slot) {
+        auto& buffer = buffers[slot];
+        if (buffer.size() < buffer_size) {
+            buffer = BufferPool::GetDefault().Borrow(buffer_size);
+            buffer_size = buffer.size();
+        }
+        return buffer;
+    }
+
+    void SetReceived(const size_t slot, const size_t received) noexcept {
+        bytes[slot] = received;
+        buffer_size = GetNextBufferSize(buffer_size, received, max_buffer_size);
+    }
+
+    std::vector<BufferPool::Buffer> buffers;
+    std::vector<size_t> bytes; // Received bytes in each buffer
+    size_t buffer_size; // Size of the buffers we read into
+    const size_t max_buffer_size;
+    size_t next = 0; // The next filled buffer to return to the caller
+    size_t filled = 0;
+    size_t filled_bytes = 0;
+    size_t promised = 0; // Bytes the caller will read after what it has got
+    AsyncEvent wake; // Signalled when the reader may be able to read more
+    AsyncEvent ready; // Signalled when a read is complete
+    std::exception_ptr error;
+    bool reading = false;
+    bool running = false; // The read-ahead co-routine is running
+    bool done = false;
+};
+
+} // anonymous namespace
 
 class IoReaderImpl : public DataReader {
 public:
-    using buffer_t = std::array<char, RESTC_CPP_IO_BUFFER_SIZE>;
-
     IoReaderImpl(const Connection::ptr_t& conn, Context& ctx,
                  const ReadConfig& cfg)
-    : ctx_{ctx}, connection_{conn}, cfg_{cfg}
+    : ctx_{ctx}, connection_{conn}, cfg_{cfg}, buffer_size_{cfg.bufferSize}
     {
+        if (cfg_.readAheadBuffers > 1) {
+            read_ahead_ = make_shared<ReadAheadState>(
+                ctx_.GetClient().GetIoService(), cfg_.readAheadBuffers,
+                cfg_.bufferSize, cfg_.maxBufferSize);
+        }
     }
 
-    void Finish() override {
+    IoReaderImpl(const IoReaderImpl&) = delete;
+    IoReaderImpl& operator = (const IoReaderImpl&) = delete;
+
+    ~IoReaderImpl() override {
+        if (read_ahead_ && read_ahead_->running) {
+            // A read in progress completes (or fails when the
+            // connection is closed) before the co-routine quits.
+            read_ahead_->done = true;
+            read_ahead_->wake.Signal();
+        }
     }
 
+    void Finish() override {
+    }
 
     boost::asio::const_buffers_1 ReadSome() override {
+        if (read_ahead_) {
+            return ReadSomeAhead();
+        }
+
+        // The data we returned last time is consumed by now
+        if (buffer_.size() < buffer_size_) {
+            buffer_ = BufferPool::GetDefault().Borrow(buffer_size_);
+            buffer_size_ = buffer_.size();
+        }
+
+        const auto rval = Read({buffer_.data(), buffer_.size()});
+        buffer_size_ = GetNextBufferSize(buffer_size_,
+                                         boost::asio::buffer_size(rval),
+                                         cfg_.maxBufferSize);
+        return rval;
+    }
+
+    void ReadAhead(const std::size_t bytes) override {
+        if (!read_ahead_) {
+            return;
+        }
+
+        auto& ra = *read_ahead_;
+        ra.promised = max(ra.promised, bytes);
+        if (!ra.CanRead()) {
+            return;
+        }
+
+        if (ra.running) {
+            ra.wake.Signal();
+            return;
+        }
+
+        ra.running = true;
+        boost::asio::spawn(ctx_.GetYield(),
+                           [state = read_ahead_, connection = connection_,
+                           timeout = cfg_.msReadTimeout](
+                               boost::asio::yield_context yield) {
+            ReadAheadLoop(*state, connection, timeout, yield);
+        });
+    }
+
+    bool IsEof() const override {
+        if (auto conn = connection_.lock()) {
+            return !conn->GetSocket().IsOpen();
+        }
+        return true;
+    }
+
+private:
+    boost::asio::const_buffers_1 Read(boost::asio::mutable_buffers_1 buffer) {
         if (auto conn = connection_.lock()) {
             auto timer = IoTimer::Create("IoReaderImpl",
                                         cfg_.msReadTimeout,
@@ -39,8 +183,7 @@ public:
                         RESTC_CPP_LOG_DEBUG_("IoReaderImpl::ReadSome: Waking up. Will try to read from the socket now.");
                     }
 
-                    bytes = conn->GetSocket().AsyncReadSome(
-                        {buffer_.data(), buffer_.size()}, ctx_.GetYield());
+                    bytes = conn->GetSocket().AsyncReadSome(buffer, ctx_.GetYield());
                 } catch (const boost::system::system_error& ex) {
                     if (ex.code() == boost::system::errc::resource_unavailable_try_again) {
                         if ( retries < 32) {
@@ -60,7 +203,7 @@ public:
                     << " bytes from " << conn);
 
                 timer->Cancel();
-                return {buffer_.data(), bytes};
+                return {boost::asio::buffer_cast<const char *>(buffer), bytes};
             }
         }
 
@@ -68,18 +211,112 @@ public:
         throw ObjectExpiredException("Connection expired");
     }
 
-    bool IsEof() const override {
-        if (auto conn = connection_.lock()) {
-            return !conn->GetSocket().IsOpen();
+    /* Return the next filled buffer, or wait for the read in progress
+     *
+     * Without either, we read like without read-ahead. That is also
+     * how we recover after a read-ahead that failed with EAGAIN.
+     */
+    boost::asio::const_buffers_1 ReadSomeAhead() {
+        auto& ra = *read_ahead_;
+
+        // If the co-routine is woken, but has not started the read yet,
+        // we wait for it too.
+        while(!ra.filled && (ra.reading || (ra.running && ra.CanRead()))) {
+            ra.ready.Wait(ctx_.GetYield());
         }
-        return true;
+
+        if (ra.error && !ra.filled) {
+            auto error = ra.error;
+            try {
+                rethrow_exception(error);
+            } catch (const boost::system::system_error& ex) {
+                if (ex.code() != boost::system::errc::resource_unavailable_try_again) {
+                    throw;
+                }
+                ra.error = nullptr;
+            }
+        }
+
+        const auto slot = ra.next;
+        ra.next = (ra.next + 1) % ra.buffers.size();
+
+        boost::asio::const_buffers_1 rval{nullptr, 0};
+        if (ra.filled) {
+            --ra.filled;
+            ra.filled_bytes -= ra.bytes[slot];
+            rval = {ra.buffers[slot].data(), ra.bytes[slot]};
+        } else {
+            // Keep the co-routine off the socket while we read
+            auto& buffer = ra.GetBuffer(slot);
+            ra.reading = true;
+            try {
+                rval = Read({buffer.data(), buffer.size()});
+            } catch(...) {
+                ra.reading = false;
+                throw;
+            }
+            ra.reading = false;
+            ra.SetReceived(slot, boost::asio::buffer_size(rval));
+        }
+
+        const auto bytes = boost::asio::buffer_size(rval);
+        ra.promised -= min(ra.promised, bytes);
+
+        // A buffer may have been freed for the co-routine
+        if (ra.running && ra.CanRead()) {
+            ra.wake.Signal();
+        }
+        return rval;
+    }
+
+    static void ReadAheadLoop(ReadAheadState& ra,
+                              const std::weak_ptr<Connection>& connection,
+                              const int timeout,
+                              boost::asio::yield_context& yield) {
+        while(!ra.done) {
+            if (!ra.CanRead()) {
+                ra.wake.Wait(yield);
+                continue;
+            }
+
+            const auto slot = ra.GetReadSlot();
+            ra.reading = true;
+
+            try {
+                auto conn = connection.lock();
+                if (!conn) {
+                    throw ObjectExpiredException("Connection expired");
+                }
+
+                auto timer = IoTimer::Create("IoReaderImpl", timeout, conn);
+                auto& buffer = ra.GetBuffer(slot);
+                ra.SetReceived(slot, conn->GetSocket().AsyncReadSome(
+                    {buffer.data(), buffer.size()}, yield));
+                timer->Cancel();
+
+                RESTC_CPP_LOG_TRACE_("Read ahead #" << ra.bytes[slot]
+                    << " bytes from " << conn);
+
+                ++ra.filled;
+                ra.filled_bytes += ra.bytes[slot];
+            } catch (const exception& ex) {
+                RESTC_CPP_LOG_DEBUG_("IoReaderImpl: Read-ahead failed: " << ex.what());
+                ra.error = current_exception();
+            }
+
+            ra.reading = false;
+            ra.ready.Signal();
+        }
+
+        ra.running = false;
     }
 
-private:
     Context& ctx_;
     const std::weak_ptr<Connection> connection_;
     const ReadConfig cfg_;
-    buffer_t buffer_ = {};
+    BufferPool::Buffer buffer_; // Borrowed on the first read
+    size_t buffer_size_; // Size of the buffer for the next read
+    shared_ptr<ReadAheadState> read_ahead_; // Only in read-ahead mode
 };
 
 
@@ -91,5 +328,3 @@ DataReader::CreateIoReader(const Connection::ptr_t& conn, Context& ctx,
 }
 
 } // namespace
-
-
@@ -1,15 +1,48 @@
 
+#include <deque>
+#include <exception>
+
 #include "restc-cpp/restc-cpp.h"
 #include "restc-cpp/Connection.h"
 #include "restc-cpp/Socket.h"
 #include "restc-cpp/DataWriter.h"
 #include "restc-cpp/logging.h"
 #include "restc-cpp/IoTimer.h"
+#include "restc-cpp/BufferPool.h"
+
+#include "AsyncEvent.h"
 
 using namespace std;
 
 namespace restc_cpp {
 
+namespace {
+
+/* Buffers waiting to be sent by the write-behind co-routine
+ *
+ * The buffers are borrowed from the pool, and returned when sent.
+ * It is only used by the co-routine that writes the request and the
+ * co-routine it spawns to send the data, which share a strand.
+ */
+struct WriteQueue {
+    struct Item {
+        BufferPool::Buffer buffer;
+        size_t bytes = 0;
+    };
+
+    WriteQueue(boost::asio::io_service& ioservice)
+    : queued{ioservice}, sent{ioservice} {}
+
+    std::deque<Item> buffers;
+    size_t in_flight = 0; // Buffers at the front of buffers that are being sent
+    AsyncEvent queued; // Signalled when a buffer is queued, or when we are done
+    AsyncEvent sent; // Signalled when buffers are sent, or if the send failed
+    std::exception_ptr error;
+    bool sending = false; // The sender co-routine is running
+    bool done = false;
+};
+
+} // anonymous namespace
 
 class IoWriterImpl : public DataWriter {
 public:
@@ -17,6 +50,21 @@ public:
                  const WriteConfig& cfg)
     : ctx_{ctx}, cfg_{cfg}, connection_{conn}
     {
+        if (cfg_.writeBehindBuffers) {
+            queue_ = make_shared<WriteQueue>(ctx_.GetClient().GetIoService());
+        }
+    }
+
+    IoWriterImpl(const IoWriterImpl&) = delete;
+    IoWriterImpl& operator = (const IoWriterImpl&) = delete;
+
+    ~IoWriterImpl() override {
+        if (queue_ && queue_->sending) {
+            // Let the sender complete what it is sending, and then quit
+            queue_->buffers.resize(queue_->in_flight);
+            queue_->done = true;
+            queue_->queued.Signal();
+        }
     }
 
     void WriteDirect(boost::asio::const_buffers_1 buffers) override {
@@ -24,6 +72,10 @@ public:
     }
 
     void Write(boost::asio::const_buffers_1 buffers) override {
+        if (queue_) {
+            Enqueue(buffers);
+            return;
+        }
 
         {
             auto timer = IoTimer::Create("IoWriterImpl",
@@ -40,6 +92,10 @@ public:
     }
 
     void Write(const write_buffers_t& buffers) override {
+        if (queue_) {
+            Enqueue(buffers);
+            return;
+        }
 
         {
             auto timer = IoTimer::Create("IoWriterImpl",
@@ -55,8 +111,30 @@ public:
             << " bytes to " << connection_);
     }
 
+    void WriteDirectAndData(boost::asio::const_buffers_1 direct,
+                            const write_buffers_t& buffers) override {
+        buffers_.clear();
+        buffers_.push_back(direct);
+        for(const auto& b : buffers) {
+            buffers_.push_back(b);
+        }
+        Write(buffers_);
+    }
+
     void Finish() override {
-        ;
+        if (!queue_) {
+            return;
+        }
+
+        // Wait for the queue to drain
+        auto& q = *queue_;
+        while(!q.buffers.empty() && !q.error) {
+            q.sent.Wait(ctx_.GetYield());
+        }
+        ThrowIfFailed();
+
+        q.done = true;
+        q.queued.Signal();
     }
 
     void SetHeaders(Request::headers_t& ) override {
@@ -64,9 +142,100 @@ public:
     }
 
 private:
+    /* Copy the data to a buffer in the queue, and let the sender send it
+     *
+     * Waits if the queue is full. If a write has failed, the
+     * error is thrown here, and by all later calls.
+     */
+    template <typename BuffersT>
+    void Enqueue(const BuffersT& buffers) {
+        const auto bytes = boost::asio::buffer_size(buffers);
+        if (bytes == 0) {
+            return;
+        }
+
+        auto& q = *queue_;
+        ThrowIfFailed();
+        while(q.buffers.size() >= cfg_.writeBehindBuffers) {
+            q.sent.Wait(ctx_.GetYield());
+            ThrowIfFailed();
+        }
+
+        WriteQueue::Item item{BufferPool::GetDefault().Borrow(bytes), bytes};
+        boost::asio::buffer_copy(
+            boost::asio::mutable_buffers_1{item.buffer.data(), bytes}, buffers);
+        q.buffers.push_back(std::move(item));
+
+        if (q.sending) {
+            q.queued.Signal();
+            return;
+        }
+
+        q.sending = true;
+        boost::asio::spawn(ctx_.GetYield(),
+                           [queue = queue_, connection = connection_,
+                           timeout = cfg_.msWriteTimeout](
+                               boost::asio::yield_context yield) {
+            Send(*queue, connection, timeout, yield);
+        });
+    }
+
+    void ThrowIfFailed() {
+        if (queue_->error) {
+            rethrow_exception(queue_->error);
+        }
+    }
+
+    // The write-behind co-routine. Sends all that is queued in one write.
+    static void Send(WriteQueue& q, const Connection::ptr_t& connection,
+                     const int timeout, boost::asio::yield_context& yield) {
+        write_buffers_t buffers;
+
+        while(true) {
+            if (q.buffers.empty()) {
+                if (q.done) {
+                    break;
+                }
+                q.queued.Wait(yield);
+                continue;
+            }
+
+            buffers.clear();
+            for(const auto& item : q.buffers) {
+                buffers.push_back({item.buffer.data(), item.bytes});
+            }
+            q.in_flight = q.buffers.size();
+
+            try {
+                auto timer = IoTimer::Create("IoWriterImpl", timeout, connection);
+                connection->GetSocket().AsyncWrite(buffers, yield);
+            } catch(const std::exception& ex) {
+                RESTC_CPP_LOG_DEBUG_("IoWriterImpl: Write-behind failed: "
+                    << ex.what());
+                q.error = current_exception();
+                q.buffers.clear();
+                q.in_flight = 0;
+                q.sent.Signal();
+                break;
+            }
+
+            RESTC_CPP_LOG_TRACE_("Wrote #" << boost::asio::buffer_size(buffers)
+                << " bytes from " << q.in_flight << " buffers to " << connection);
+
+            for(; q.in_flight > 0; --q.in_flight) {
+                q.buffers.pop_front();
+            }
+            q.sent.Signal();
+        }
+
+        q.sending = false;
+    }
+
     Context& ctx_;
     WriteConfig cfg_;
     const Connection::ptr_t& connection_;
+    write_buffers_t buffers_;
+    shared_ptr<WriteQueue> queue_; // Only in write-behind mode
 };
 
 
@@ -78,5 +247,3 @@ DataWriter::CreateIoWriter(const Connection::ptr_t& conn, Context& ctx,
 }
 
 } // namespace
-
-
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <cassert>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/error.h"
+#include "restc-cpp/Socket.h"
+
+#include "Pipeline.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+PipelineTicket::PipelineTicket(std::shared_ptr<Pipeline> pipeline,
+                               Connection::ptr_t connection, uint64_t seq)
+: pipeline_{move(pipeline)}, connection_{move(connection)}, seq_{seq}
+{
+}
+
+PipelineTicket::~PipelineTicket() {
+    if (!done_) {
+        RESTC_CPP_LOG_TRACE_("PipelineTicket: Request #" << seq_
+            << " on " << *connection_ << " did not complete");
+        pipeline_->Fail();
+    }
+}
+
+void PipelineTicket::WaitForSendTurn(Context& ctx, int timeoutMs) {
+    Pipeline::lock_t lock{pipeline_->mutex_};
+    pipeline_->WaitForTurn(lock, pipeline_->send_seq_, seq_, ctx, timeoutMs);
+}
+
+void PipelineTicket::SetSent() {
+    if (!sent_) {
+        sent_ = true;
+        Pipeline::lock_t lock{pipeline_->mutex_};
+        pipeline_->Advance(pipeline_->send_seq_);
+    }
+}
+
+std::string PipelineTicket::WaitForReadTurn(Context& ctx, int timeoutMs) {
+    Pipeline::lock_t lock{pipeline_->mutex_};
+    pipeline_->WaitForTurn(lock, pipeline_->read_seq_, seq_, ctx, timeoutMs);
+    return move(pipeline_->unread_);
+}
+
+void PipelineTicket::SetDone(std::string unread, bool keepAlive) {
+    assert(sent_);
+    done_ = true;
+
+    {
+        Pipeline::lock_t lock{pipeline_->mutex_};
+        if (keepAlive && !pipeline_->failed_) {
+            // If nobody is waiting for it, the server sent more than we asked for
+            keepAlive = unread.empty()
+                || (pipeline_->next_seq_ > (pipeline_->read_seq_ + 1));
+            pipeline_->unread_ = move(unread);
+            pipeline_->Advance(pipeline_->read_seq_);
+        }
+    }
+
+    if (!keepAlive) {
+        pipeline_->Fail();
+    }
+
+    // The connection goes back to the pool when the last ticket is done with it
+    connection_.reset();
+}
+
+Pipeline::Pipeline(const Connection::ptr_t& connection, size_t maxDepth,
+                   boost::asio::io_service& ioservice)
+: connection_{connection}, max_depth_{maxDepth}, ioservice_{ioservice}
+{
+}
+
+PipelineTicket::ptr_t Pipeline::Join() {
+    lock_t lock{mutex_};
+    if (failed_ || ((next_seq_ - read_seq_) >= max_depth_)) {
+        return {};
+    }
+
+    auto connection = connection_.lock();
+    if (!connection || !connection->GetSocket().IsOpen()) {
+        return {};
+    }
+
+    RESTC_CPP_LOG_TRACE_("Pipeline: Request #" << next_seq_ << " joins "
+        << *connection << " with " << (next_seq_ - read_seq_)
+        << " requests in progress");
+
+    return make_unique<PipelineTicket>(shared_from_this(), move(connection),
+                                       next_seq_++);
+}
+
+bool Pipeline::IsUsable() const {
+    lock_t lock{mutex_};
+    return !failed_ && !connection_.expired();
+}
+
+void Pipeline::WaitForTurn(lock_t& lock, const uint64_t& next, uint64_t seq,
+                           Context& ctx, int timeoutMs) {
+    const auto expires = chrono::steady_clock::now()
+        + chrono::milliseconds(timeoutMs);
+
+    while(next != seq) {
+        if (failed_) {
+            // The request was not processed, so it may be sent again
+            throw boost::system::system_error{boost::asio::error::connection_reset};
+        }
+
+        auto event = make_shared<AsyncEvent>(ioservice_);
+        waiters_[seq] = event;
+
+        int ms = 0;
+        if (timeoutMs > 0) {
+            const auto remaining = chrono::duration_cast<chrono::milliseconds>(
+                expires - chrono::steady_clock::now()).count();
+            ms = static_cast<int>(max<decltype(remaining)>(remaining, 1));
+        }
+
+        lock.unlock();
+        const bool signalled = event->Wait(ctx.GetYield(), ms);
+        lock.lock();
+
+        waiters_.erase(seq);
+        if (!signalled && (next != seq) && !failed_) {
+            throw RequestTimeOutException();
+        }
+    }
+
+    if (failed_) {
+        throw boost::system::system_error{boost::asio::error::connection_reset};
+    }
+}
+
+void Pipeline::Advance(uint64_t& next) {
+    auto it = waiters_.find(++next);
+    if (it != waiters_.end()) {
+        it->second->Signal();
+    }
+}
+
+void Pipeline::Fail() {
+    Connection::ptr_t connection;
+    {
+        lock_t lock{mutex_};
+        if (failed_) {
+            return;
+        }
+        failed_ = true;
+        for(auto& w : waiters_) {
+            w.second->Signal();
+        }
+        connection = connection_.lock();
+    }
+
+    // Any data from the server that is still on the way belongs
+    // to requests that will be sent again.
+    if (connection && connection->GetSocket().IsOpen()) {
+        RESTC_CPP_LOG_DEBUG_("Pipeline: Closing " << *connection);
+        connection->GetSocket().Close();
+    }
+}
+
+} // restc_cpp
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/Connection.h"
+
+#include "AsyncEvent.h"
+
+namespace restc_cpp {
+
+class Pipeline;
+
+/*! One requests place in a pipeline
+ *
+ * The request must wait for its turn to send, and its reply must wait
+ * for its turn to read. If the ticket is destroyed before the reply is
+ * read, the pipeline fails, and the requests behind it must be sent
+ * again on another connection.
+ */
+class PipelineTicket {
+public:
+    using ptr_t = std::unique_ptr<PipelineTicket>;
+
+    PipelineTicket(std::shared_ptr<Pipeline> pipeline,
+                   Connection::ptr_t connection, uint64_t seq);
+    PipelineTicket(const PipelineTicket&) = delete;
+    PipelineTicket& operator = (const PipelineTicket&) = delete;
+    ~PipelineTicket();
+
+    const Connection::ptr_t& GetConnection() const noexcept {
+        return connection_;
+    }
+
+    /*! Wait until the requests before this one are sent
+     *
+     * \exception RequestTimeOutException, or boost::system::system_error
+     *      with connection_reset if the pipeline failed.
+     */
+    void WaitForSendTurn(Context& ctx, int timeoutMs);
+
+    /*! The request is sent. The next request can be sent. */
+    void SetSent();
+
+    /*! Wait until the replies before this one are read
+     *
+     * \return The data that was read ahead of the previous reply.
+     *      It is the start of our reply.
+     * \exception RequestTimeOutException, or boost::system::system_error
+     *      with connection_reset if the pipeline failed.
+     */
+    std::string WaitForReadTurn(Context& ctx, int timeoutMs);
+
+    /*! The reply is read. The next reply can be read.
+     *
+     * \param unread Data that was read after the end of the reply.
+     * \param keepAlive False if the connection can not be used for more
+     *      requests. The pipeline then fails.
+     */
+    void SetDone(std::string unread, bool keepAlive);
+
+private:
+    const std::shared_ptr<Pipeline> pipeline_;
+    Connection::ptr_t connection_;
+    const uint64_t seq_;
+    bool sent_ = false;
+    bool done_ = false;
+};
+
+/*! Requests that are sent on a HTTP/1.1 connection before the replies
+ *  to the earlier ones are read (pipelining, RFC 7230, section 6.3.2)
+ *
+ * The server sends the replies in the same order as it got the requests.
+ * Each request gets a ticket with a sequence number. The requests are
+ * sent in that order, and each reply is read when the replies before
+ * it are read.
+ *
+ * The pipeline does not own the connection. The tickets do, so the
+ * connection goes back to the pool when the last reply is read.
+ */
+class Pipeline : public std::enable_shared_from_this<Pipeline> {
+public:
+    using ptr_t = std::shared_ptr<Pipeline>;
+
+    Pipeline(const Connection::ptr_t& connection, size_t maxDepth,
+             boost::asio::io_service& ioservice);
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator = (const Pipeline&) = delete;
+
+    /*! Get a ticket for one more request
+     *
+     * \return nullptr if the pipeline is full or failed, or if the
+     *      connection was released.
+     */
+    PipelineTicket::ptr_t Join();
+
+    /*! True as long as more requests can join */
+    bool IsUsable() const;
+
+private:
+    friend class PipelineTicket;
+    using lock_t = std::unique_lock<std::mutex>;
+
+    // Wait until next is seq. Must be called with the lock held.
+    void WaitForTurn(lock_t& lock, const uint64_t& next, uint64_t seq,
+                     Context& ctx, int timeoutMs);
+    void Advance(uint64_t& next);
+    void Fail();
+
+    const std::weak_ptr<Connection> connection_;
+    const size_t max_depth_;
+    boost::asio::io_service& ioservice_;
+
+    mutable std::mutex mutex_;
+    uint64_t next_seq_ = 0; // For the next ticket
+    uint64_t send_seq_ = 0; // The ticket that can send
+    uint64_t read_seq_ = 0; // The ticket that can read
+    std::map<uint64_t, AsyncEvent::ptr_t> waiters_; // By sequence number
+    std::string unread_; // Data the previous reply read from the next one
+    bool failed_ = false;
+};
+
+} // restc_cpp
@@ -2,6 +2,7 @@
 #include "restc-cpp/Connection.h"
 #include "restc-cpp/Socket.h"
 #include "restc-cpp/DataReader.h"
+#include "restc-cpp/DataReaderStream.h"
 #include "restc-cpp/error.h"
 
 using namespace std;
@@ -11,7 +12,7 @@ namespace restc_cpp {
 class PlainReaderImpl : public DataReader {
 public:
 
-    PlainReaderImpl(size_t contentLength, ptr_t&& source)
+    PlainReaderImpl(size_t contentLength, unique_ptr<DataReaderStream>&& source)
     : remaining_{contentLength},
       source_{move(source)} {}
 
@@ -30,24 +31,24 @@ public:
             return {nullptr, 0};
         }
 
-        auto buffer = source_->ReadSome();
-        const auto bytes = boost::asio::buffer_size(buffer);
-
-        if ((static_cast<int64_t>(remaining_)
-            - static_cast<int64_t>(bytes)) < 0) {
-            throw ProtocolException("Body-size exceeds content-size");
+        // Don't read past the body. With pipelining, the
+        // next reply may already be in the buffer.
+        auto buffer = source_->GetData(remaining_);
+        remaining_ -= boost::asio::buffer_size(buffer);
+        if (remaining_) {
+            source_->ReadAhead(remaining_);
         }
-        remaining_ -= bytes;
         return buffer;
     }
 
 private:
     size_t remaining_;
-    ptr_t source_;
+    unique_ptr<DataReaderStream> source_;
 };
 
 DataReader::ptr_t
-DataReader::CreatePlainReader(size_t contentLength, ptr_t&& source) {
+DataReader::CreatePlainReader(size_t contentLength,
+                              unique_ptr<DataReaderStream>&& source) {
     return make_unique<PlainReaderImpl>(contentLength, move(source));
 }
 
@@ -29,6 +29,11 @@ public:
         next_->Write(buffers);
     }
 
+    void WriteDirectAndData(boost::asio::const_buffers_1 direct,
+                            const write_buffers_t& buffers) override {
+        next_->WriteDirectAndData(direct, buffers);
+    }
+
     void Finish() override {
         next_->Finish();
     }
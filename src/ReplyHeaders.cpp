@@ -0,0 +1,183 @@
+
+#include <algorithm>
+#include <cstring>
+
+#include "ReplyHeaders.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+namespace {
+
+inline char ToLower(const char ch) noexcept {
+    return ((ch >= 'A') && (ch <= 'Z')) ? static_cast<char>(ch + ('a' - 'A')) : ch;
+}
+
+struct WellKnownHeader {
+    boost::string_ref name;
+    uint32_t hash;
+};
+
+// In the same order as ReplyHeaders::Id
+const std::array<WellKnownHeader, 5>& GetWellKnownHeaders() {
+    static const std::array<WellKnownHeader, 5> headers = [] {
+        std::array<WellKnownHeader, 5> rval = {{
+            {"content-length", 0},
+            {"transfer-encoding", 0},
+            {"content-encoding", 0},
+            {"connection", 0},
+            {"location", 0}
+        }};
+        for(auto& h : rval) {
+            h.hash = ReplyHeaders::Hash(h.name);
+        }
+        return rval;
+    }();
+
+    return headers;
+}
+
+} // anonymous namespace
+
+ReplyHeaders::ReplyHeaders() {
+    static_assert(num_ids == 5, "Update GetWellKnownHeaders()");
+    fields_.reserve(16);
+    first_.fill(-1);
+}
+
+uint32_t ReplyHeaders::Hash(const boost::string_ref name) noexcept {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for(const auto ch : name) {
+        hash ^= static_cast<uint8_t>(ToLower(ch));
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool ReplyHeaders::Equals(const boost::string_ref a,
+                          const boost::string_ref b) noexcept {
+    if (a.size() != b.size()) {
+        return false;
+    }
+
+    for(size_t i = 0; i < a.size(); ++i) {
+        if (ToLower(a[i]) != ToLower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ReplyHeaders::Id ReplyHeaders::GetId(const boost::string_ref name) {
+    return GetId(name, Hash(name));
+}
+
+ReplyHeaders::Id ReplyHeaders::GetId(const boost::string_ref name,
+                                     const uint32_t hash) {
+    const auto& known = GetWellKnownHeaders();
+    for(size_t i = 0; i < known.size(); ++i) {
+        if ((known[i].hash == hash) && Equals(known[i].name, name)) {
+            return static_cast<Id>(i);
+        }
+    }
+    return Id::OTHER;
+}
+
+void ReplyHeaders::Add(const boost::string_ref name,
+                       const boost::string_ref value) {
+    Field field;
+    field.hash = Hash(name);
+    field.name = Store(name);
+    field.value = Store(value);
+    field.id = GetId(name, field.hash);
+
+    if (field.id != Id::OTHER) {
+        auto& first = first_[static_cast<size_t>(field.id)];
+        if (first < 0) {
+            first = static_cast<int>(fields_.size());
+        }
+    }
+
+    fields_.push_back(field);
+}
+
+void ReplyHeaders::Set(const boost::string_ref name,
+                       const boost::string_ref value) {
+    const auto index = FindFirst(name, Hash(name));
+    if (index < 0) {
+        Add(name, value);
+        return;
+    }
+
+    fields_[static_cast<size_t>(index)].value = Store(value);
+}
+
+boost::optional<boost::string_ref> ReplyHeaders::Get(const Id id) const {
+    if (id == Id::OTHER) {
+        return {};
+    }
+
+    const auto index = first_[static_cast<size_t>(id)];
+    if (index < 0) {
+        return {};
+    }
+    return fields_[static_cast<size_t>(index)].value;
+}
+
+boost::optional<boost::string_ref>
+ReplyHeaders::Get(const boost::string_ref name) const {
+    const auto index = FindFirst(name, Hash(name));
+    if (index < 0) {
+        return {};
+    }
+    return fields_[static_cast<size_t>(index)].value;
+}
+
+void ReplyHeaders::Clear() {
+    fields_.clear();
+    first_.fill(-1);
+    blocks_.clear();
+    free_ = nullptr;
+    free_len_ = 0;
+}
+
+int ReplyHeaders::FindFirst(const boost::string_ref name,
+                            const uint32_t hash) const {
+    for(size_t i = 0; i < fields_.size(); ++i) {
+        const auto& field = fields_[i];
+        if ((field.hash == hash) && Equals(field.name, name)) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+boost::string_ref ReplyHeaders::Store(const boost::string_ref data) {
+    if (data.empty()) {
+        return {};
+    }
+
+    if (data.size() > free_len_) {
+        if (data.size() > (block_size / 4)) {
+            // Big values get a block of their own, so that we can
+            // keep using what is left of the current block.
+            blocks_.emplace_back(new char[data.size()]);
+            memcpy(blocks_.back().get(), data.data(), data.size());
+            return {blocks_.back().get(), data.size()};
+        }
+
+        blocks_.emplace_back(new char[block_size]);
+        free_ = blocks_.back().get();
+        free_len_ = block_size;
+    }
+
+    char *dst = free_;
+    memcpy(dst, data.data(), data.size());
+    free_ += data.size();
+    free_len_ -= data.size();
+    return {dst, data.size()};
+}
+
+} // restc_cpp
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <boost/optional.hpp>
+#include <boost/utility/string_ref.hpp>
+
+namespace restc_cpp {
+
+/*! The headers received with a reply
+ *
+ * Names and values are copied into an arena owned by the container,
+ * and the fields are kept in a flat vector in the order they arrived.
+ * Each field has a precomputed case-insensitive hash of its name,
+ * so a lookup is a linear scan comparing integers.
+ *
+ * The headers we need to handle the reply are recognized when they
+ * are added, and can be found without looking at their names.
+ *
+ * The string_refs returned are valid until the container is cleared
+ * or destroyed.
+ */
+class ReplyHeaders {
+public:
+    enum class Id : uint8_t {
+        CONTENT_LENGTH,
+        TRANSFER_ENCODING,
+        CONTENT_ENCODING,
+        CONNECTION,
+        LOCATION,
+        OTHER // Must be the last one
+    };
+
+    ReplyHeaders();
+    ReplyHeaders(const ReplyHeaders&) = delete;
+    ReplyHeaders& operator = (const ReplyHeaders&) = delete;
+
+    /*! Add a header, keeping any headers with the same name */
+    void Add(boost::string_ref name, boost::string_ref value);
+
+    /*! Replace the value of the first header with this name
+     *
+     * The header is added if there is no such header.
+     */
+    void Set(boost::string_ref name, boost::string_ref value);
+
+    /*! Get the value of the first header with this id */
+    boost::optional<boost::string_ref> Get(Id id) const;
+
+    /*! Get the value of the first header with this name */
+    boost::optional<boost::string_ref> Get(boost::string_ref name) const;
+
+    /*! Call fn(value) for each header with this name, in the order received */
+    template <typename FnT>
+    void ForEach(boost::string_ref name, const FnT& fn) const {
+        const auto hash = Hash(name);
+        for(const auto& field : fields_) {
+            if ((field.hash == hash) && Equals(field.name, name)) {
+                fn(field.value);
+            }
+        }
+    }
+
+    void Clear();
+
+    size_t size() const noexcept {
+        return fields_.size();
+    }
+
+    bool empty() const noexcept {
+        return fields_.empty();
+    }
+
+    /*! Get the id of a header name. Unknown names are Id::OTHER */
+    static Id GetId(boost::string_ref name);
+
+    /*! Case-insensitive (ASCII) hash of a header name */
+    static uint32_t Hash(boost::string_ref name) noexcept;
+
+    /*! Case-insensitive (ASCII) comparison */
+    static bool Equals(boost::string_ref a, boost::string_ref b) noexcept;
+
+private:
+    static constexpr size_t num_ids = static_cast<size_t>(Id::OTHER);
+    static constexpr size_t block_size = 2048;
+
+    struct Field {
+        boost::string_ref name;
+        boost::string_ref value;
+        uint32_t hash = 0;
+        Id id = Id::OTHER;
+    };
+
+    static Id GetId(boost::string_ref name, uint32_t hash);
+    int FindFirst(boost::string_ref name, uint32_t hash) const;
+    boost::string_ref Store(boost::string_ref data);
+
+    std::vector<Field> fields_;
+    std::array<int, num_ids> first_; // Index in fields_, or -1
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char *free_ = nullptr;
+    size_t free_len_ = 0;
+};
+
+} // restc_cpp
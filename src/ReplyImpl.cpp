@@ -10,6 +10,8 @@
 #include "restc-cpp/url_encode.h"
 
 #include "ReplyImpl.h"
+#include "Http2Connection.h"
+#include "Pipeline.h"
 
 
 using namespace std;
@@ -20,9 +22,8 @@ namespace restc_cpp {
 boost::optional<string> ReplyImpl::GetHeader(const string& name) {
     boost::optional<string> rval;
 
-    auto it = headers_.find(name);
-    if (it != headers_.end()) {
-        rval = it->second;
+    if (const auto value = headers_.Get(name)) {
+        rval = value->to_string();
     }
 
     return rval;
@@ -31,14 +32,18 @@ boost::optional<string> ReplyImpl::GetHeader(const string& name) {
 std::deque<std::string> ReplyImpl::GetHeaders(const std::string& name) {
     std::deque<std::string> rval;
 
-    auto range = headers_.equal_range(name);
-    for (auto it = range.first; it != range.second; ++it) {
-        rval.push_back(it->second);
-    }
+    headers_.ForEach(name, [&rval](boost::string_ref value) {
+        rval.push_back(value.to_string());
+    });
 
     return rval;
 }
 
+boost::optional<boost::string_ref>
+ReplyImpl::GetHeaderView(boost::string_ref name) const {
+    return headers_.Get(name);
+}
+
 ReplyImpl::ReplyImpl(Connection::ptr_t connection,
                      Context& ctx,
                      RestClient& owner,
@@ -82,60 +87,206 @@ ReplyImpl::~ReplyImpl() {
 }
 
 void ReplyImpl::StartReceiveFromServer(DataReader::ptr_t&& reader) {
+    StartReceiveFromServer(move(reader), {});
+}
+
+void ReplyImpl::StartReceiveFromServer(DataReader::ptr_t&& reader,
+                                       unique_ptr<PipelineTicket>&& ticket) {
     if (reader_) {
         throw RestcCppException("StartReceiveFromServer() is already called.");
     }
 
     static const auto timer_name = "StartReceiveFromServer"s;
 
+    std::string unread;
+    if (ticket) {
+        // The replies to the requests sent before ours come first
+        ticket_ = move(ticket);
+        unread = ticket_->WaitForReadTurn(ctx_, properties_->replyTimeoutMs);
+    }
+
     auto timer = IoTimer::Create(timer_name,
                                      properties_->replyTimeoutMs,
                                      connection_);
 
     assert(reader);
-    auto stream = make_unique<DataReaderStream>(move(reader));
-    stream->ReadServerResponse(response_);
-    stream->ReadHeaderLines(
-        [this](std::string&& name, std::string&& value) {
-            headers_.insert({move(name), move(value)});
-    });
+    auto stream = make_unique<DataReaderStream>(move(reader), move(unread));
+    if (ticket_) {
+        stream_ = stream.get();
+    }
+
+    ReadHeader(*stream, false);
+    HandleHeader(move(stream));
+}
+
+bool ReplyImpl::StartReceiveAfterExpect(DataReader::ptr_t&& reader,
+                                        std::string unread) {
+    if (reader_ || continue_stream_) {
+        throw RestcCppException("StartReceiveAfterExpect() is already called.");
+    }
+
+    static const auto timer_name = "StartReceiveAfterExpect"s;
+    auto timer = IoTimer::Create(timer_name,
+                                     properties_->replyTimeoutMs,
+                                     connection_);
+
+    assert(reader);
+    auto stream = make_unique<DataReaderStream>(move(reader), move(unread));
+    ReadHeader(*stream, true);
+
+    if (response_.status_code == 100) {
+        RESTC_CPP_LOG_TRACE_("Got '100 Continue' on " << *connection_);
+        response_ = {};
+        headers_.Clear();
+        continue_stream_ = move(stream);
+        return true;
+    }
 
+    // The server may still read what it thinks is the body as the
+    // next request, so the connection can not be used again.
+    do_close_connection_ = true;
+    HandleHeader(move(stream));
+    return false;
+}
+
+void ReplyImpl::ContinueReceiveFromServer() {
+    if (!continue_stream_) {
+        throw RestcCppException("ContinueReceiveFromServer() without '100 Continue'.");
+    }
+
+    static const auto timer_name = "ContinueReceiveFromServer"s;
+    auto timer = IoTimer::Create(timer_name,
+                                     properties_->replyTimeoutMs,
+                                     connection_);
+
+    auto stream = move(continue_stream_);
+    ReadHeader(*stream, false);
+    HandleHeader(move(stream));
+}
+
+void ReplyImpl::ReadHeader(DataReaderStream& stream, bool stopAtContinue) {
+    while(true) {
+        try {
+            stream.ReadServerResponse(response_);
+        } catch(...) {
+            have_received_data_ = have_received_data_ || stream.HasReceivedData();
+            throw;
+        }
+        have_received_data_ = true;
+        stream.ReadHeaderLines(
+            [this](boost::string_ref name, boost::string_ref value) {
+                headers_.Add(name, value);
+        });
+
+        // Interim replies (1xx) are followed by the final reply.
+        // "101 Switching Protocols" ends the HTTP/1.1 conversation.
+        const auto code = response_.status_code;
+        if ((code / 100 != 1) || (code == 101)
+            || (stopAtContinue && (code == 100))) {
+            return;
+        }
+
+        RESTC_CPP_LOG_TRACE_("Skipping interim reply " << code
+            << " on " << *connection_);
+        response_ = {};
+        headers_.Clear();
+    }
+}
+
+void ReplyImpl::HandleHeader(unique_ptr<DataReaderStream>&& stream) {
     HandleContentType(move(stream));
     HandleConnectionLifetime();
     HandleDecompression();
     CheckIfWeAreDone();
 }
 
+void ReplyImpl::StartReceiveFromHttp2(std::shared_ptr<Http2Stream> stream) {
+    if (reader_) {
+        throw RestcCppException("StartReceiveFromHttp2() is already called.");
+    }
+
+    // We only have the connection for its id
+    connection_.reset();
+
+    auto fields = stream->GetResponseHeaders(ctx_, properties_->replyTimeoutMs);
+    have_received_data_ = true;
+
+    for(auto& field : fields) {
+        if (field.first == ":status") {
+            try {
+                response_.status_code = stoi(field.second);
+            } catch(const exception&) {
+                throw ProtocolException("Invalid HTTP/2 :status");
+            }
+        } else if (!field.first.empty() && (field.first.front() != ':')) {
+            headers_.Add(field.first, field.second);
+        }
+    }
+
+    if (!response_.status_code) {
+        throw ProtocolException("Missing HTTP/2 :status");
+    }
+
+    response_.http_version = HttpResponse::HttpVersion::HTTP_2;
+    RESTC_CPP_LOG_TRACE_("HTTP/2 Response on stream #" << stream->GetId()
+        << ": " << response_.status_code);
+
+    if (const auto cl = GetHeader(ReplyHeaders::Id::CONTENT_LENGTH)) {
+        content_length_ = stoi(cl->to_string());
+    }
+
+    if (request_type_ == Request::Type::HEAD) {
+        reader_ = DataReader::CreateNoBodyReader();
+    } else {
+        reader_ = DataReader::CreateHttp2Reader(move(stream),
+            [this](boost::string_ref name, boost::string_ref value) {
+                headers_.Add(name, value);
+            }, ctx_, {properties_->recvTimeout});
+    }
+
+    HandleDecompression();
+    CheckIfWeAreDone();
+}
+
 void ReplyImpl::HandleContentType(unique_ptr<DataReaderStream>&& stream) {
-    static const std::string content_len_name{"Content-Length"};
-    static const std::string transfer_encoding_name{"Transfer-Encoding"};
-    static const std::string chunked_name{"chunked"};
+    static const boost::string_ref chunked_name{"chunked"};
 
     if (request_type_ == Request::Type::HEAD) {
         reader_ = DataReader::CreateNoBodyReader();
-    } else if (const auto cl = GetHeader(content_len_name)) {
-        content_length_ = stoi(*cl);
+    } else if (const auto cl = GetHeader(ReplyHeaders::Id::CONTENT_LENGTH)) {
+        content_length_ = stoi(cl->to_string());
         reader_ = DataReader::CreatePlainReader(*content_length_, move(stream));
     } else {
-        auto te = GetHeader(transfer_encoding_name);
-        if (te && ciEqLibC()(*te, chunked_name)) {
-            reader_ = DataReader::CreateChunkedReader([this](string&& name, string&& value) {
-                headers_[name] = move(value);
+        const auto te = GetHeader(ReplyHeaders::Id::TRANSFER_ENCODING);
+        if (te && ReplyHeaders::Equals(*te, chunked_name)) {
+            reader_ = DataReader::CreateChunkedReader(
+                [this](boost::string_ref name, boost::string_ref value) {
+                    headers_.Set(name, value);
             },  move(stream));
         } else {
             reader_ = DataReader::CreateNoBodyReader();
+            // Any body would end when the server closes the connection
+            const auto code = response_.status_code;
+            keep_alive_ = (code / 100 == 1) || (code == 204) || (code == 304);
         }
     }
+
+    if (stream) {
+        // The reply has no body, so the next reply starts here
+        if (ticket_) {
+            unread_ = stream->TakeUnread();
+        }
+        stream_ = nullptr;
+    }
 }
 
 void ReplyImpl::HandleConnectionLifetime() {
-    static const std::string connection_name{"Connection"};
-    static const std::string close_name{"close"};
+    static const boost::string_ref close_name{"close"};
 
     // Check for Connection: close header and tag the
     // connection for close
-    const auto conn_hdr = GetHeader(connection_name);
-    if (conn_hdr && ciEqLibC()(*conn_hdr, close_name)) {
+    const auto conn_hdr = GetHeader(ReplyHeaders::Id::CONNECTION);
+    if (conn_hdr && ReplyHeaders::Equals(*conn_hdr, close_name)) {
         if (connection_) {
             RESTC_CPP_LOG_TRACE_("'Connection: close' header. "
                 << "Tagging " << *connection_ << " for close.");
@@ -144,37 +295,75 @@ void ReplyImpl::HandleConnectionLifetime() {
     }
 }
 
-void ReplyImpl::HandleDecompression() {
-    static const std::string content_encoding{"Content-Encoding"};
-    static const std::string gzip{"gzip"};
-    static const std::string deflate{"deflate"};
+namespace {
+
+struct ContentDecoder {
+    std::string name;
+    DataReader::ptr_t (*create)(DataReader::ptr_t&& source, size_t bufferSize);
+};
+
+// Most preferred first
+const std::vector<ContentDecoder> content_decoders = {
+#ifdef RESTC_CPP_WITH_ZSTD
+    {"zstd", &DataReader::CreateZstdReader},
+#endif
+#ifdef RESTC_CPP_WITH_BROTLI
+    {"br", &DataReader::CreateBrotliReader},
+#endif
+#ifdef RESTC_CPP_WITH_ZLIB
+    {"gzip", &DataReader::CreateGzipReader},
+    {"deflate", &DataReader::CreateZipReader},
+#endif
+};
+
+} // anon ns
+
+const std::vector<std::string>& DataReader::GetSupportedEncodings() {
+    static const auto names = [] {
+        std::vector<std::string> rval;
+        for(const auto& d : content_decoders) {
+            rval.push_back(d.name);
+        }
+        return rval;
+    }();
+
+    return names;
+}
 
-    const auto te_hdr = GetHeader(content_encoding);
+void ReplyImpl::HandleDecompression() {
+    const auto te_hdr = GetHeader(ReplyHeaders::Id::CONTENT_ENCODING);
     if (!te_hdr) {
         return;
     }
 
-    boost::tokenizer<> tok(*te_hdr);
+    const auto encodings = te_hdr->to_string();
+    boost::tokenizer<> tok(encodings);
     for(auto it = tok.begin(); it != tok.end(); ++it) {
-#ifdef RESTC_CPP_WITH_ZLIB
-        if (ciEqLibC()(gzip, *it)) {
-            RESTC_CPP_LOG_TRACE_("Adding gzip reader to " << *connection_);
-            reader_ = DataReader::CreateGzipReader(move(reader_));
-        } else if (ciEqLibC()(deflate, *it)) {
-            RESTC_CPP_LOG_TRACE_("Adding deflate reader to " << *connection_);
-            reader_ = DataReader::CreateZipReader(move(reader_));
-        } else
-#endif // RESTC_CPP_WITH_ZLIB
-        {
+        const auto decoder = find_if(content_decoders.begin(), content_decoders.end(),
+            [&it](const ContentDecoder& d) { return ciEqLibC()(d.name, *it); });
+
+        if (decoder == content_decoders.end()) {
             RESTC_CPP_LOG_ERROR_("Unsupported compression: '"
                 << url_encode(*it)
-                << "' from server on " << *connection_);
+                << "' from server on " << GetConnectionId());
             throw NotSupportedException("Unsupported compression.");
         }
+
+        RESTC_CPP_LOG_TRACE_("Adding " << decoder->name << " reader to "
+            << GetConnectionId());
+        reader_ = decoder->create(move(reader_),
+                                  properties_->decompressBufferSize);
     }
 }
 
 boost::asio::const_buffers_1 ReplyImpl::GetSomeData()  {
+    if (boost::asio::buffer_size(pending_)) {
+        // Left over from ReadInto()
+        const boost::asio::const_buffers_1 rval{pending_};
+        pending_ = {};
+        return rval;
+    }
+
     auto rval = reader_
         ? reader_->ReadSome()
         : boost::asio::const_buffers_1{nullptr, 0};
@@ -182,25 +371,46 @@ boost::asio::const_buffers_1 ReplyImpl::GetSomeData()  {
     return rval;
 }
 
+size_t ReplyImpl::ReadInto(boost::asio::mutable_buffer buffer) {
+    size_t len = 0;
+    if (!boost::asio::buffer_size(pending_) && reader_ && reader_->CanReadInto()) {
+        len = reader_->ReadInto(buffer);
+    } else {
+        if (!boost::asio::buffer_size(pending_) && reader_) {
+            pending_ = reader_->ReadSome();
+        }
+        len = boost::asio::buffer_copy(buffer, pending_);
+        pending_ += len;
+    }
+
+    CheckIfWeAreDone();
+    return len;
+}
+
 string ReplyImpl::GetBodyAsString(const size_t maxSize) {
+    // Without compression, Content-Length is the size of the body.
+    // With compression, it is where we start.
+    static constexpr size_t min_size = 1024 * 4;
     std::string buffer;
     if (content_length_) {
-        buffer.reserve(*content_length_);
+        buffer.resize(min(*content_length_, maxSize));
     }
 
+    size_t len = 0;
     while(!IsEof()) {
-        auto data = reader_->ReadSome();
+        if (len == buffer.size()) {
+            buffer.resize(max(buffer.size() * 2, min_size));
+        }
+
+        len += ReadInto({&buffer[len], buffer.size() - len});
 
-        const auto buffer_size = boost::asio::buffer_size(data);
-        if ((buffer.size() + buffer_size) >= maxSize) {
+        if (len >= maxSize) {
             throw ConstraintException(
                 "Too much data for the curent buffer limit.");
         }
-
-        buffer.append(boost::asio::buffer_cast<const char*>(data),
-                      buffer_size);
     }
 
+    buffer.resize(len);
     ReleaseConnection();
     return buffer;
 }
@@ -213,6 +423,16 @@ void ReplyImpl::CheckIfWeAreDone() {
 }
 
 void ReplyImpl::ReleaseConnection() {
+    if (ticket_) {
+        // Let the next reply on the pipeline continue where we stopped
+        const bool keep_alive = keep_alive_ && !do_close_connection_
+            && connection_ && connection_->GetSocket().IsOpen();
+        ticket_->SetDone(stream_ ? stream_->TakeUnread() : move(unread_),
+                         keep_alive);
+        ticket_.reset();
+        stream_ = nullptr;
+    }
+
     if (connection_ && do_close_connection_) {
         RESTC_CPP_LOG_TRACE_("Closing connection because do_close_connection_ is true: "
             << *connection_);
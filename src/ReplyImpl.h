@@ -14,10 +14,15 @@
 #include "restc-cpp/IoTimer.h"
 #include "restc-cpp/DataReader.h"
 
+#include "ReplyHeaders.h"
+
 using namespace std;
 
 namespace restc_cpp {
 
+class Http2Stream;
+class PipelineTicket;
+
 class ReplyImpl : public Reply {
 public:
     enum class ChunkedState
@@ -34,9 +39,48 @@ public:
 
     boost::optional<string> GetHeader(const string& name) override;
     std::deque<std::string> GetHeaders(const std::string& name) override;
+    boost::optional<boost::string_ref> GetHeaderView(boost::string_ref name) const override;
+
+    /*! Get the value of a well known header */
+    boost::optional<boost::string_ref> GetHeader(ReplyHeaders::Id id) const {
+        return headers_.Get(id);
+    }
 
     void StartReceiveFromServer(DataReader::ptr_t&& reader);
 
+    /*! Receive the reply to a pipelined request
+     *
+     * \param ticket The requests place in the pipeline. The reply
+     *      waits until the replies before it are read.
+     */
+    void StartReceiveFromServer(DataReader::ptr_t&& reader,
+                                std::unique_ptr<PipelineTicket>&& ticket);
+
+    /*! Receive the servers answer to "Expect: 100-continue"
+     *
+     * \param unread What the server has sent so far.
+     * \return true if the server sent "100 Continue". The request body
+     *      must then be sent before ContinueReceiveFromServer() reads
+     *      the final reply. If false, the server sent the final reply
+     *      without waiting for the body, and the body must not be sent.
+     */
+    bool StartReceiveAfterExpect(DataReader::ptr_t&& reader, std::string unread);
+
+    /*! Receive the final reply after "100 Continue" */
+    void ContinueReceiveFromServer();
+
+    /*! True after "100 Continue", until the final reply is received */
+    bool IsWaitingForFinalReply() const noexcept {
+        return static_cast<bool>(continue_stream_);
+    }
+
+    /*! Receive the reply from a HTTP/2 stream
+     *
+     * The connection is shared with other requests, so the reply
+     * does not release or close it.
+     */
+    void StartReceiveFromHttp2(std::shared_ptr<Http2Stream> stream);
+
     int GetResponseCode() const override {
         return response_.status_code;
     }
@@ -47,6 +91,8 @@ public:
 
     boost::asio::const_buffers_1 GetSomeData() override;
 
+    size_t ReadInto(boost::asio::mutable_buffer buffer) override;
+
     string GetBodyAsString(size_t maxSize
         = RESTC_CPP_SANE_DATA_LIMIT) override;
 
@@ -71,7 +117,13 @@ public:
     }
 
     bool IsEof() const {
-        return !reader_ || reader_->IsEof();
+        return (!reader_ || reader_->IsEof())
+            && !boost::asio::buffer_size(pending_);
+    }
+
+    /*! True if any part of the reply was received from the server */
+    bool HasReceivedData() const noexcept {
+        return have_received_data_;
     }
 
 
@@ -81,18 +133,27 @@ protected:
     void HandleDecompression();
     void HandleContentType(std::unique_ptr<DataReaderStream>&& stream);
     void HandleConnectionLifetime();
+    void ReadHeader(DataReaderStream& stream, bool stopAtContinue);
+    void HandleHeader(std::unique_ptr<DataReaderStream>&& stream);
 
     Connection::ptr_t connection_;
     Context& ctx_;
     Request::Properties::ptr_t properties_;
     RestClient& owner_;
     Reply::HttpResponse response_;
-    headers_t headers_;
+    ReplyHeaders headers_;
     bool do_close_connection_ = false;
+    bool have_received_data_ = false;
     boost::optional<size_t> content_length_;
     const boost::uuids::uuid connection_id_;
     std::unique_ptr<DataReader> reader_;
     const Request::Type request_type_;
+    std::unique_ptr<PipelineTicket> ticket_;
+    DataReaderStream *stream_ = nullptr; // Owned by reader_. Only set when pipelined.
+    std::string unread_; // Read past the end of a reply without a body
+    bool keep_alive_ = true; // The end of the body is known without closing the connection
+    std::unique_ptr<DataReaderStream> continue_stream_; // The final reply follows "100 Continue" here
+    boost::asio::const_buffer pending_; // Data from reader_ that ReadInto() had no room for
 };
 
 
@@ -1,11 +1,11 @@
 #include <cassert>
-#include <array>
 
 #include <boost/utility/string_ref.hpp>
 #include "restc-cpp/restc-cpp.h"
 #include "restc-cpp/logging.h"
 #include "restc-cpp/RequestBody.h"
 #include "restc-cpp/DataWriter.h"
+#include "restc-cpp/BufferPool.h"
 
 using namespace std;
 
@@ -18,9 +18,11 @@ namespace impl {
 class RequestBodyFileImpl : public RequestBody
 {
 public:
-    RequestBodyFileImpl(boost::filesystem::path path)
+    RequestBodyFileImpl(boost::filesystem::path path, size_t bufferSize,
+                        size_t maxBufferSize)
     : path_{move(path)}
     , size_{boost::filesystem::file_size(path_)}
+    , buffer_size_{bufferSize}, max_buffer_size_{max(bufferSize, maxBufferSize)}
     {
         file_ = make_unique<ifstream>(path_.string(), ios::binary);
     }
@@ -38,12 +40,22 @@ public:
         if (bytes_left == 0) {
             eof_ = true;
             file_.reset();
+            buffer_.Release();
             RESTC_CPP_LOG_DEBUG_("Successfully uploaded file "
                 << path_
                 << " of size " << size_ << " bytes.");
             return false;
         }
 
+        // The last buffer is sent by now. Double the size for each read,
+        // but don't borrow more than what is left of the file.
+        const auto want_size = static_cast<size_t>(
+            min<uint64_t>(buffer_size_, bytes_left));
+        if (buffer_.size() < want_size) {
+            buffer_ = BufferPool::GetDefault().Borrow(want_size);
+        }
+        buffer_size_ = min(buffer_size_ * 2, max_buffer_size_);
+
         auto want_bytes = min(buffer_.size(), static_cast<size_t>(bytes_left));
         file_->read(buffer_.data(), want_bytes);
         const auto read_this_time = static_cast<size_t>(file_->gcount());
@@ -71,17 +83,19 @@ private:
     unique_ptr<ifstream> file_;
     uint64_t bytes_read_ = 0;
     const uint64_t size_;
-    static constexpr size_t buffer_size_ = 1024 * 8;
-    array<char, buffer_size_> buffer_ = {};
+    size_t buffer_size_; // Size of the buffer for the next read
+    const size_t max_buffer_size_;
+    BufferPool::Buffer buffer_;
 };
 
 
 } // impl
 
 unique_ptr<RequestBody> RequestBody::CreateFileBody(
-    boost::filesystem::path path) {
+    boost::filesystem::path path, size_t bufferSize, size_t maxBufferSize) {
 
-    return make_unique<impl::RequestBodyFileImpl>(move(path));
+    return make_unique<impl::RequestBodyFileImpl>(move(path), bufferSize,
+                                                  maxBufferSize);
 }
 
 } // restc_cpp
@@ -0,0 +1,201 @@
+
+#include <algorithm>
+#include <atomic>
+
+#include "restc-cpp/url_encode.h"
+
+#include "RequestHeaderBlock.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+namespace {
+
+const boost::string_ref crlf{"\r\n"};
+const boost::string_ref column{": "};
+
+size_t HeaderLineSize(const Request::headers_t::value_type& header) {
+    return header.first.size() + column.size() + header.second.size() + crlf.size();
+}
+
+void AppendHeaderLine(const Request::headers_t::value_type& header, std::string& out) {
+    out.append(header.first);
+    out.append(column.data(), column.size());
+    out.append(header.second);
+    out.append(crlf.data(), crlf.size());
+}
+
+void AppendArgs(const Request::args_t& args, std::string& out) {
+    for(const auto& arg : args) {
+        if (!out.empty() && (out.back() != '?')) {
+            out += '&';
+        }
+
+        url_encode(arg.name, out);
+        out += '=';
+        url_encode(arg.value, out);
+    }
+}
+
+size_t ArgsSize(const Request::args_t *args) {
+    size_t len = 0;
+    if (args) {
+        for(const auto& arg : *args) {
+            // Each byte takes up to 3 when encoded
+            len += ((arg.name.size() + arg.value.size()) * 3) + 2;
+        }
+    }
+    return len;
+}
+
+bool SameArgs(const Request::args_t& a, const Request::args_t& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                      [](const Request::Arg& x, const Request::Arg& y) {
+        return (x.name == y.name) && (x.value == y.value);
+    });
+}
+
+bool Contains(const Request::headers_t *headers, const std::string& name) {
+    return headers && (headers->find(name) != headers->end());
+}
+
+} // anonymous namespace
+
+RequestHeaderBlock::RequestHeaderBlock(const Request::Properties& properties)
+: headers_{properties.headers}, args_{properties.args}
+{
+    size_t len = 0;
+    for(const auto& header : headers_) {
+        len += HeaderLineSize(header);
+    }
+
+    header_lines_.reserve(len);
+    for(const auto& header : headers_) {
+        AppendHeaderLine(header, header_lines_);
+    }
+
+    AppendArgs(args_, encoded_args_);
+}
+
+std::shared_ptr<const RequestHeaderBlock>
+RequestHeaderBlock::Get(const Request::Properties& properties) {
+    auto& cache = properties.headerBlockCache;
+    auto block = atomic_load(&cache.block);
+    if (!block || !block->IsCurrent(properties)) {
+        block = make_shared<const RequestHeaderBlock>(properties);
+        atomic_store(&cache.block, block);
+    }
+
+    return block;
+}
+
+bool RequestHeaderBlock::IsCurrent(const Request::Properties& properties) const noexcept {
+    // The multimap compares the sizes first
+    return (headers_ == properties.headers) && SameArgs(args_, properties.args);
+}
+
+void RequestHeaderBlock::AppendPath(const boost::string_ref path,
+                                    const bool encodePath,
+                                    const Request::args_t *requestArgs,
+                                    std::string& out) const {
+    if (!encodePath) {
+        out.append(path.data(), path.size());
+        return;
+    }
+
+    url_encode(path, out);
+    const bool have_request_args = requestArgs && !requestArgs->empty();
+    if (encoded_args_.empty() && !have_request_args) {
+        return;
+    }
+
+    out += '?';
+    out += encoded_args_;
+    if (have_request_args) {
+        AppendArgs(*requestArgs, out);
+    }
+}
+
+void RequestHeaderBlock::Render(const RequestHead& head,
+                                const Request::Properties& properties,
+                                std::string& out) {
+    static const boost::string_ref http_1_1{" HTTP/1.1\r\n"};
+    static const string host{"Host"};
+
+    const auto block = Get(properties);
+
+    // The headers for this request may replace some of the defaults,
+    // and the headers from the writers may replace any of them.
+    bool replaces_defaults = false;
+    size_t len = head.verb.size() + 1 + head.proxyPrefix.size() + http_1_1.size()
+        + block->GetHeaderLines().size() + crlf.size();
+    if (head.requestHeaders) {
+        for(const auto& header : *head.requestHeaders) {
+            replaces_defaults = replaces_defaults || block->HasHeader(header.first);
+            len += HeaderLineSize(header);
+        }
+    }
+    for(const auto& header : head.headers) {
+        replaces_defaults = replaces_defaults || block->HasHeader(header.first);
+        len += HeaderLineSize(header);
+    }
+
+    const bool add_host = !block->HasHeader(host)
+        && !Contains(head.requestHeaders, host) && !head.headers.count(host);
+    if (add_host) {
+        len += host.size() + column.size() + head.host.size() + crlf.size();
+    }
+
+    if (head.encodePath) {
+        // Each byte takes up to 3 when encoded
+        len += (head.path.size() * 3) + 2 + block->GetEncodedArgs().size()
+            + ArgsSize(head.requestArgs);
+    } else {
+        len += head.path.size();
+    }
+
+    out.clear();
+    out.reserve(len);
+
+    out.append(head.verb.data(), head.verb.size());
+    out += ' ';
+    out += head.proxyPrefix;
+    block->AppendPath(head.path, head.encodePath, head.requestArgs, out);
+    out.append(http_1_1.data(), http_1_1.size());
+
+    if (add_host) {
+        out += host;
+        out.append(column.data(), column.size());
+        out.append(head.host.data(), head.host.size());
+        out.append(crlf.data(), crlf.size());
+    }
+
+    if (replaces_defaults) {
+        for(const auto& header : block->headers_) {
+            if (!Contains(head.requestHeaders, header.first)
+                && !head.headers.count(header.first)) {
+                AppendHeaderLine(header, out);
+            }
+        }
+    } else {
+        out += block->GetHeaderLines();
+    }
+
+    if (head.requestHeaders) {
+        for(const auto& header : *head.requestHeaders) {
+            if (!head.headers.count(header.first)) {
+                AppendHeaderLine(header, out);
+            }
+        }
+    }
+
+    for(const auto& header : head.headers) {
+        AppendHeaderLine(header, out);
+    }
+
+    // End the header section.
+    out.append(crlf.data(), crlf.size());
+}
+
+} // restc_cpp
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <boost/utility/string_ref.hpp>
+
+#include "restc-cpp/restc-cpp.h"
+
+namespace restc_cpp {
+
+/*! What it takes to render the head of one HTTP/1.1 request */
+struct RequestHead {
+    boost::string_ref verb;
+
+    /*! Scheme, host and port of the target when we talk to a HTTP proxy */
+    std::string proxyPrefix;
+
+    boost::string_ref path;
+
+    /*! Url-encode the path and add the arguments from the properties
+     *
+     * After a redirect, the path from the server is used as it is.
+     */
+    bool encodePath = true;
+
+    /*! Value for the Host header, unless the properties has one */
+    boost::string_ref host;
+
+    /*! Headers given to Request::Create() for this request
+     *
+     * They replace default headers with the same name.
+     */
+    const Request::headers_t *requestHeaders = nullptr;
+
+    /*! Arguments given to Request::Create(), added after the defaults */
+    const Request::args_t *requestArgs = nullptr;
+
+    /*! Headers set by the writers, like Content-Length
+     *
+     * They replace default and request headers with the same name.
+     */
+    Request::headers_t headers;
+};
+
+/*! The default headers and arguments from Request::Properties,
+ * rendered for the wire.
+ *
+ * A block is cached in the properties it was rendered from, and
+ * reused by all the requests that use them, as long as their
+ * headers and args are unchanged.
+ */
+class RequestHeaderBlock {
+public:
+    explicit RequestHeaderBlock(const Request::Properties& properties);
+
+    /*! Get the current block for the properties
+     *
+     * Renders and caches a new block if there is none, or if the
+     * headers or args have changed since it was rendered. Comparing
+     * them costs much less than rendering them.
+     */
+    static std::shared_ptr<const RequestHeaderBlock>
+        Get(const Request::Properties& properties);
+
+    /*! Render the request line and the header section into out
+     *
+     * The size is calculated first, so out is allocated once.
+     */
+    static void Render(const RequestHead& head,
+                       const Request::Properties& properties,
+                       std::string& out);
+
+    /*! Append the request path with the default and the request arguments to out */
+    void AppendPath(boost::string_ref path, bool encodePath,
+                    const Request::args_t *requestArgs,
+                    std::string& out) const;
+
+    /*! True if the block was rendered from the current headers and args of the properties */
+    bool IsCurrent(const Request::Properties& properties) const noexcept;
+
+    bool HasHeader(const std::string& name) const {
+        return headers_.find(name) != headers_.end();
+    }
+
+    /*! The default headers as "name: value\r\n" lines */
+    const std::string& GetHeaderLines() const noexcept {
+        return header_lines_;
+    }
+
+    /*! The default arguments as "name=value&name=value" */
+    const std::string& GetEncodedArgs() const noexcept {
+        return encoded_args_;
+    }
+
+private:
+    const Request::headers_t headers_;
+    const Request::args_t args_;
+    std::string header_lines_;
+    std::string encoded_args_;
+};
+
+} // restc_cpp
@@ -5,17 +5,23 @@
 #include <array>
 
 #include <boost/utility/string_ref.hpp>
+#include <boost/algorithm/string/case_conv.hpp>
 
 #include "restc-cpp/restc-cpp.h"
 #include "restc-cpp/logging.h"
 #include "restc-cpp/Url.h"
 #include "restc-cpp/Socket.h"
 #include "restc-cpp/ConnectionPool.h"
+#include "restc-cpp/DnsCache.h"
 #include "restc-cpp/IoTimer.h"
 #include "restc-cpp/error.h"
 #include "restc-cpp/url_encode.h"
 #include "restc-cpp/RequestBody.h"
 #include "ReplyImpl.h"
+#include "Http2Connection.h"
+#include "Pipeline.h"
+#include "RequestHeaderBlock.h"
+#include "HappyEyeballs.h"
 
 using namespace std;
 using namespace std::string_literals;
@@ -320,26 +326,21 @@ public:
                 const boost::optional<headers_t>& headers,
                 const boost::optional<auth_t>& auth = {})
     : url_{move(url)}, parsed_url_{url_.c_str()} , request_type_{requestType}
-    , body_{move(body)}, owner_{owner}
+    , body_{move(body)}, properties_{owner.GetConnectionProperties()}
+    , owner_{owner}
     {
-       if (args || headers || auth) {
-            Properties::ptr_t props = owner_.GetConnectionProperties();
-            assert(props);
-            properties_ = make_shared<Properties>(*props);
+        assert(properties_);
 
-            if (args) {
-                properties_->args.insert(properties_->args.end(),
-                                         args->begin(), args->end());
-            }
-
-            merge_map(headers, properties_->headers);
+        // Kept apart from the properties, so that the rendered default
+        // headers in the properties can be used for this request too.
+        if (args) {
+            request_args_ = *args;
+        }
 
-            if (auth) {
-                SetAuth(*auth);
-            }
+        merge_map(headers, request_headers_);
 
-        } else {
-            properties_ = owner_.GetConnectionProperties();
+        if (auth) {
+            SetAuth(*auth);
         }
     }
 
@@ -374,21 +375,51 @@ public:
         static const string basic_sp{"Basic "};
 
         std::string pre_base = auth.name + ':' + auth.passwd;
-        properties_->headers[authorization]
+        request_headers_[authorization]
             = basic_sp + Base64Encode(pre_base);
         std::memset(&pre_base[0], 0, pre_base.capacity());
         pre_base.clear();
     }
 
     const Properties& GetProperties() const override {
-        return *properties_;
+        if (request_headers_.empty() && request_args_.empty()) {
+            return *properties_;
+        }
+
+        // Only made for the caller. The request uses the parts as they are.
+        if (!merged_properties_) {
+            auto merged = make_shared<Properties>(*properties_);
+            merged->headers += request_headers_;
+            merged->args.insert(merged->args.end(),
+                                request_args_.begin(), request_args_.end());
+            merged_properties_ = move(merged);
+        }
+        return *merged_properties_;
     }
 
     void SetProperties(Properties::ptr_t propreties) override {
         properties_ = move(propreties);
+        request_headers_.clear();
+        request_args_.clear();
+        merged_properties_.reset();
     }
 
-    const std::string& Verb(const Type requestType) {
+    // Find a header for this request, or a default header
+    const std::string *FindHeader(const std::string& name) const {
+        auto h = request_headers_.find(name);
+        if (h != request_headers_.end()) {
+            return &h->second;
+        }
+
+        h = properties_->headers.find(name);
+        if (h != properties_->headers.end()) {
+            return &h->second;
+        }
+
+        return nullptr;
+    }
+
+    const std::string& Verb(const Type requestType) const {
         static const std::array<std::string, 7> names =
             {{ "GET", "POST", "PUT", "DELETE", "OPTIONS",
                 "HEAD", "PATCH"
@@ -467,64 +498,101 @@ private:
         }
     }
 
-    std::string BuildOutgoingRequest() {
-        static const std::string crlf{"\r\n"};
-        static const std::string column{": "};
-        static const string host{"Host"};
-
-        std::ostringstream request_buffer;
-
-        // Build the request-path
-        request_buffer << Verb(request_type_) << ' ';
+    /*! Render the request line and headers into request_head_
+     *
+     * The default headers and arguments come pre-rendered from
+     * the properties.
+     */
+    void BuildOutgoingRequest() {
+        RequestHead head;
+        head.verb = Verb(request_type_);
 
         if (properties_->proxy.type == Request::Proxy::Type::HTTP) {
-            request_buffer << parsed_url_.GetProtocolName() << parsed_url_.GetHost() << ":" << parsed_url_.GetPort();
-        }
-
-        // Add arguments to the path as ?name=value&name=value...
-        bool first_arg = true;
-        if (add_url_args_) {
-            // Normal processing.
-            request_buffer << url_encode(parsed_url_.GetPath());
-            for(const auto& arg : properties_->args) {
-                if (first_arg) {
-                    first_arg = false;
-                    request_buffer << '?';
-                } else {
-                    request_buffer << '&';
-                }
-
-                request_buffer
-                    << url_encode(arg.name)
-                    << '=' << url_encode(arg.value);
-            }
-        } else {
-            // After a redirect. We The redirect-url in parsed_url_ should be encoded,
-            // and may be exactly what the target expects - so we do nothing here.
-            request_buffer << parsed_url_.GetPath();
+            head.proxyPrefix = parsed_url_.GetProtocolName().to_string()
+                + parsed_url_.GetHost().to_string() + ':'
+                + parsed_url_.GetPort().to_string();
         }
 
-        request_buffer << " HTTP/1.1" << crlf;
+        // After a redirect. The redirect-url in parsed_url_ should be encoded,
+        // and may be exactly what the target expects - so we use it as it is.
+        head.encodePath = add_url_args_;
+        head.path = parsed_url_.GetPath();
+        head.host = parsed_url_.GetHost();
+        head.requestHeaders = &request_headers_;
+        head.requestArgs = &request_args_;
 
-        // Build the header buffers
-        headers_t headers = properties_->headers;
         assert(writer_);
 
         // Let the writers set their individual headers.
-        writer_->SetHeaders(headers);
+        writer_->SetHeaders(head.headers);
+
+        if (expect_continue_) {
+            static const string expect{"Expect"};
+            static const string continue_100{"100-continue"};
+            head.headers[expect] = continue_100;
+        }
+
+        RequestHeaderBlock::Render(head, *properties_, request_head_);
+    }
+
+    /*! Build the header fields for a HTTP/2 request
+     *
+     * Header names are lower case in HTTP/2, and the headers that
+     * only makes sense for a HTTP/1.1 connection are left out.
+     */
+    Hpack::fields_t BuildHttp2Fields() const {
+        static const std::array<std::string, 6> connection_specific = {{
+            "connection", "host", "keep-alive", "proxy-connection",
+            "transfer-encoding", "upgrade"
+        }};
+        static const string host{"Host"};
 
-        if (headers.find(host) == headers.end()) {
-            request_buffer << host << ": " << parsed_url_.GetHost().to_string() << crlf;
+        const bool https = parsed_url_.GetProtocol() == Url::Protocol::HTTPS;
+        std::string authority;
+        if (const auto *h = FindHeader(host)) {
+            authority = *h;
+        } else {
+            authority = parsed_url_.GetHost().to_string();
+            if (parsed_url_.GetPort() != (https ? "443" : "80")) {
+                authority += ':' + parsed_url_.GetPort().to_string();
+            }
         }
 
-        for(const auto& it : headers) {
-            request_buffer << it.first << column << it.second << crlf;
+        std::string path;
+        RequestHeaderBlock::Get(*properties_)->AppendPath(
+            parsed_url_.GetPath(), add_url_args_, &request_args_, path);
+
+        Hpack::fields_t fields;
+        fields.emplace_back(":method", Verb(request_type_));
+        fields.emplace_back(":scheme", https ? "https" : "http");
+        fields.emplace_back(":authority", move(authority));
+        fields.emplace_back(":path", move(path));
+
+        const auto add_header = [&](const Request::headers_t::value_type& header) {
+            auto name = boost::algorithm::to_lower_copy(header.first);
+            if (find(connection_specific.begin(), connection_specific.end(), name)
+                == connection_specific.end()) {
+                fields.emplace_back(move(name), header.second);
+            }
+        };
+
+        for(const auto& it : properties_->headers) {
+            if (request_headers_.find(it.first) == request_headers_.end()) {
+                add_header(it);
+            }
+        }
+        for(const auto& it : request_headers_) {
+            add_header(it);
         }
 
-        // End the header section.
-        request_buffer << crlf;
+        if (CompressBody()) {
+            fields.emplace_back("content-encoding", (properties_->bodyCompression
+                == Properties::BodyCompression::GZIP) ? "gzip" : "deflate");
+        } else if (body_ && (body_->GetType() == RequestBody::Type::FIXED_SIZE)) {
+            fields.emplace_back("content-length", to_string(body_->GetFixedSize()));
+        }
 
-        return request_buffer.str();
+        return fields;
     }
 
     boost::asio::ip::tcp::resolver::query GetRequestEndpoint() {
@@ -604,18 +672,12 @@ private:
             return {protocol, static_cast<uint16_t>(port_num)};
         }
 
-        boost::asio::ip::tcp::resolver::query q{host, port};
-        boost::asio::ip::tcp::resolver resolver(owner_.GetIoService());
-
-        auto ep = resolver.async_resolve(q, ctx.GetYield());
-        const decltype(ep) addr_end;
-        for(; ep != addr_end; ++ep)
-        if (ep != addr_end) {
+        for(const auto& ep : owner_.GetDnsCache()->Resolve(host, port, ctx)) {
 
-            RESTC_CPP_LOG_TRACE_("ep=" << ep->endpoint() << ", protocol=" << ep->endpoint().protocol().protocol());
+            RESTC_CPP_LOG_TRACE_("ep=" << ep << ", protocol=" << ep.protocol().protocol());
 
-            if (protocol == ep->endpoint().protocol()) {
-                return ep->endpoint();
+            if (protocol == ep.protocol()) {
+                return ep;
             }
 
             RESTC_CPP_LOG_TRACE_("Incorrect protocol, looping for next alternative");
@@ -649,159 +711,473 @@ private:
         return p;
     }
 
-    Connection::ptr_t Connect(Context& ctx) {
+    /*! State shared by Connect() and its connect attempts
+     *
+     * The attempts run as co-routines on the same strand as the
+     * request, so this is never accessed concurrently.
+     */
+    struct ConnectRace {
+        struct Attempt {
+            boost::asio::ip::tcp::endpoint endpoint;
+            Connection::ptr_t connection;
+            IoTimer::wrapper_t timer;
+        };
+
+        ConnectRace(boost::asio::io_service& ioservice)
+        : signal{ioservice} {}
+
+        // Called by an attempt when the TCP connect has completed
+        void Done(size_t attempt, const boost::system::error_code& ec) {
+            completed.emplace_back(attempt, ec);
+            if (waiting) {
+                signal.cancel();
+            }
+        }
 
-        static const auto timer_name = "Connect"s;
+        std::vector<Attempt> attempts;
+        std::deque<std::pair<size_t, boost::system::error_code>> completed;
+        boost::asio::deadline_timer signal; // Wakes up Connect() when an attempt is done
+        bool waiting = false;
+    };
 
-        auto prot_filter = GetBindProtocols(properties_->bindToLocalAddress, ctx);
+    void BindToLocalAddress(Connection& connection,
+                            const boost::asio::ip::tcp::endpoint& endpoint,
+                            Context& ctx) {
+        RESTC_CPP_LOG_TRACE_("Binding to local address: "
+            << properties_->bindToLocalAddress);
+
+        boost::system::error_code ec;
+        auto local_ep = ToEp(properties_->bindToLocalAddress, endpoint.protocol(), ctx);
+        auto& sck = connection.GetSocket().GetSocket();
+        sck.open(local_ep.protocol());
+        sck.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+        sck.bind(local_ep, ec);
+
+        if (ec) {
+            RESTC_CPP_LOG_ERROR_("Failed to bind to local address '"
+                << local_ep
+                << "': " << ec.message());
+
+            sck.close();
+            throw RestcCppException{"Failed to bind to local address: "s
+                                    + properties_->bindToLocalAddress};
+        }
+    }
 
-        const Connection::Type protocol_type =
-            (parsed_url_.GetProtocol() == Url::Protocol::HTTPS)
+    Connection::Type GetProtocolType() const {
+        return (parsed_url_.GetProtocol() == Url::Protocol::HTTPS)
             ? Connection::Type::HTTPS
             : Connection::Type::HTTP;
+    }
+
+    std::string GetOrigin() const {
+        return ConnectionPool::MakeOrigin(GetProtocolType(),
+            parsed_url_.GetHost().to_string(),
+            parsed_url_.GetPort().to_string(),
+            properties_->proxy);
+    }
+
+    /*! True if we should look for a HTTP/2 connection to the server */
+    bool WantHttp2() const {
+        if ((properties_->http2 == Properties::Http2::NEVER)
+            || (properties_->proxy.type == Proxy::Type::HTTP)) {
+            return false;
+        }
+
+        return (parsed_url_.GetProtocol() == Url::Protocol::HTTPS)
+            || (properties_->http2 == Properties::Http2::PRIOR_KNOWLEDGE);
+    }
+
+    /*! True if the request can be sent on a connection before the replies to the earlier requests are read
+     *
+     * Only requests that can be sent again if the connection fails
+     * are pipelined. Our request is written while the previous reply
+     * is read, and a TLS stream only allows that from one thread.
+     */
+    bool CanPipeline() const {
+        if ((properties_->pipelineDepth <= 1) || !CanSendAgain()
+            || UseExpectContinue()) {
+            return false;
+        }
+
+        return (GetProtocolType() == Connection::Type::HTTP)
+            || (owner_.GetConnectionProperties()->threads <= 1);
+    }
+
+    /*! True if the body is compressed on its way to the server */
+    bool CompressBody() const {
+        return body_ && (properties_->bodyCompression
+            != Properties::BodyCompression::NONE);
+    }
+
+    /*! Let the body pass through a compressor before writer_ */
+    void AddCompression() {
+        if (!CompressBody()) {
+            return;
+        }
+
+#ifdef RESTC_CPP_WITH_ZLIB
+        const auto level = properties_->bodyCompressionLevel;
+        if (properties_->bodyCompression == Properties::BodyCompression::GZIP) {
+            writer_ = DataWriter::CreateGzipWriter(move(writer_), level);
+        } else {
+            writer_ = DataWriter::CreateZipWriter(move(writer_), level);
+        }
+#else
+        throw NotSupportedException("Body compression requires zlib");
+#endif // RESTC_CPP_WITH_ZLIB
+    }
+
+    /*! True if we ask the server if it wants the body before we send it */
+    bool UseExpectContinue() const {
+        return properties_->expectContinueThreshold && body_
+            && (body_->GetType() == RequestBody::Type::FIXED_SIZE)
+            && (body_->GetFixedSize() >= properties_->expectContinueThreshold);
+    }
+
+    /*! Let other requests to the server join connection_ until our reply is read */
+    void StartPipeline() {
+        auto pipeline = make_shared<Pipeline>(connection_,
+                                              properties_->pipelineDepth,
+                                              owner_.GetIoService());
+        pipeline_ticket_ = pipeline->Join();
+        if (pipeline_ticket_) {
+            owner_.GetConnectionPool()->AddPipeline(GetOrigin(), pipeline);
+        }
+    }
+
+    /*! Get a connection for the request
+     *
+     * Returns a HTTP/2 connection if we have, or can make one to the
+     * server. Else connection_ is set to a HTTP/1.1 connection.
+     */
+    Http2Connection::ptr_t ConnectHttp2(Context& ctx) {
+        auto pool = owner_.GetConnectionPool();
+        const auto origin = GetOrigin();
+        const bool want_http2 = WantHttp2();
+
+        if (want_http2) {
+            if (auto session = pool->GetHttp2Connection(origin, ctx)) {
+                RESTC_CPP_LOG_TRACE_("Using " << *session << " for " << origin);
+                reused_connection_ = true;
+                return session;
+            }
+        }
+
+        try {
+            connection_ = Connect(ctx);
+        } catch(...) {
+            if (want_http2) {
+                pool->CancelHttp2Connect(origin);
+            }
+            throw;
+        }
+
+        // The server may select HTTP/2 with ALPN even if this request did not ask for it,
+        // if the client offers it.
+        const bool negotiated = connection_->GetSocket().GetAlpnProtocol() == "h2";
+        const bool tls = GetProtocolType() == Connection::Type::HTTPS;
+        if (negotiated || (want_http2 && !tls && !reused_connection_)) {
+            auto session = Http2Connection::Create(move(connection_), owner_);
+            pool->AddHttp2Connection(origin, session);
+            return session;
+        }
+
+        if (want_http2) {
+            if (tls) {
+                // Don't ask again for a while
+                pool->AddHttp2Connection(origin, nullptr);
+            } else {
+                pool->CancelHttp2Connect(origin);
+            }
+        }
+
+        return {};
+    }
+
+    Connection::ptr_t Connect(Context& ctx) {
+
+        const Connection::Type protocol_type = GetProtocolType();
+
+        const bool balance = (properties_->loadBalancing
+            == Properties::LoadBalancing::LEAST_OUTSTANDING);
+
+        // Try to reuse a connection to the host before we resolve anything.
+        // When we balance the load, the address must be selected first.
+        const auto origin = GetOrigin();
+
+        if (!balance) {
+            if (auto connection = owner_.GetConnectionPool()->GetIdleConnection(origin)) {
+                reused_connection_ = true;
+                return connection;
+            }
+        }
+
+        // Then try to send it on a connection that is busy with other requests
+        if (CanPipeline()) {
+            if (auto ticket = owner_.GetConnectionPool()->JoinPipeline(origin)) {
+                reused_connection_ = true;
+                auto connection = ticket->GetConnection();
+                pipeline_ticket_ = move(ticket);
+                return connection;
+            }
+        }
+
+        auto prot_filter = GetBindProtocols(properties_->bindToLocalAddress, ctx);
 
-        boost::asio::ip::tcp::resolver resolver(owner_.GetIoService());
         // Resolve the hostname
         const auto query = GetRequestEndpoint();
 
         RESTC_CPP_LOG_TRACE_("Resolving " << query.host_name() << ":"
             << query.service_name());
 
-        auto address_it = resolver.async_resolve(query,
-                                                 ctx.GetYield());
-        const decltype(address_it) addr_end;
+        auto endpoints = InterleaveFamilies(owner_.GetDnsCache()->Resolve(
+            query.host_name(), query.service_name(), ctx));
+
+        if (!properties_->bindToLocalAddress.empty() && !prot_filter.empty()) {
+            // Only connect outwards to protocols we can bind to
+            endpoints.erase(remove_if(endpoints.begin(), endpoints.end(),
+                [&](const boost::asio::ip::tcp::endpoint& ep) {
+                    if (find(prot_filter.begin(), prot_filter.end(), ep.protocol())
+                            == prot_filter.end()) {
+                        RESTC_CPP_LOG_TRACE_("Filtered out " << ep
+                            << " (protocol mismatch) local address: "
+                            << properties_->bindToLocalAddress);
+                        return true;
+                    }
+                    return false;
+                }), endpoints.end());
+        }
+
+        if (balance && (endpoints.size() > 1)) {
+            // Try the selected endpoint first, and keep the others as fallbacks
+            const auto selected = owner_.GetConnectionPool()->SelectEndpoint(
+                endpoints, protocol_type);
+            RESTC_CPP_LOG_TRACE_("Selected endpoint " << endpoints[selected]);
+            rotate(endpoints.begin(), endpoints.begin() + selected,
+                   endpoints.begin() + selected + 1);
+        }
 
-        for(; address_it != addr_end; ++address_it) {
-//            if (owner_.IsClosing()) {
-//                RESTC_CPP_LOG_DEBUG_("RequestImpl::Connect: The rest client is closed (at first loop). Aborting.");
-//                throw FailedToConnectException("Failed to connect (closed)");
-//            }
+        for(size_t retries = 0; retries < 8; ++retries) {
+            if (retries) {
+                RESTC_CPP_LOG_DEBUG_("RequestImpl::Connect: taking a nap");
+                ctx.Sleep(retries * 20ms);
+                RESTC_CPP_LOG_DEBUG_("RequestImpl::Connect: Waking up. Will try to connect again.");
+            }
 
-            const auto endpoint = address_it->endpoint();
+            bool try_again = false;
+            if (auto connection = ConnectToAny(endpoints, protocol_type, origin,
+                                               query.host_name(), try_again, ctx)) {
+                return connection;
+            }
 
-            RESTC_CPP_LOG_TRACE_("Trying endpoint " << endpoint);
+            if (!try_again) {
+                break;
+            }
+        }
+
+        throw FailedToConnectException("Failed to connect (exhausted all options)");
+    }
+
+    /* Connect to the first endpoint that answers ("Happy Eyeballs", RFC 8305)
+     *
+     * A new attempt is started every connectAttemptDelayMs, or as soon
+     * as all the started attempts have failed. The first attempt that
+     * connects wins, and the others are closed.
+     *
+     * Returns nullptr if all the attempts failed. tryAgain is set if
+     * some of them failed with a temporary error.
+     */
+    Connection::ptr_t ConnectToAny(
+        const std::vector<boost::asio::ip::tcp::endpoint>& endpoints,
+        const Connection::Type protocolType,
+        const std::string& origin,
+        const std::string& host,
+        bool& tryAgain,
+        Context& ctx) {
+
+        static const auto timer_name = "Connect"s;
+        const auto delay = boost::posix_time::milliseconds(
+            max(properties_->connectAttemptDelayMs, 0));
+
+        auto race = make_shared<ConnectRace>(owner_.GetIoService());
+        race->attempts.reserve(endpoints.size());
+
+        // Close the attempts that did not win, however we leave
+        struct CloseLosers {
+            ~CloseLosers() {
+                for(auto& attempt : race.attempts) {
+                    attempt.timer.reset();
+                    if (attempt.connection) {
+                        boost::system::error_code ec;
+                        attempt.connection->GetSocket().GetSocket().close(ec);
+                    }
+                }
+            }
+            ConnectRace& race;
+        } close_losers{*race};
+
+        size_t next = 0;
+        size_t in_flight = 0;
+        auto next_attempt_at = boost::posix_time::microsec_clock::universal_time();
+
+        while(true) {
+            if ((next < endpoints.size())
+                && ((in_flight == 0)
+                    || ((delay.total_milliseconds() > 0)
+                        && (boost::posix_time::microsec_clock::universal_time()
+                            >= next_attempt_at)))) {
+
+                const auto& endpoint = endpoints[next++];
+                RESTC_CPP_LOG_TRACE_("Trying endpoint " << endpoint);
 
-            for(size_t retries = 0; retries < 8; ++retries) {
                 // Get a connection from the pool
-                auto connection = owner_.GetConnectionPool()->GetConnection(
-                    endpoint, protocol_type);
+                Connection::ptr_t connection;
+                try {
+                    connection = owner_.GetConnectionPool()->GetConnection(
+                        endpoint, protocolType, ctx, origin);
+                } catch(const ConstraintException&) {
+                    if (in_flight == 0) {
+                        throw;
+                    }
+                    // Let the attempts we have started finish
+                    next = endpoints.size();
+                    continue;
+                }
 
                 // Connect if the connection is new.
                 if (connection->GetSocket().IsOpen()) {
+                    reused_connection_ = true;
                     return connection;
                 }
 
                 RESTC_CPP_LOG_DEBUG_("Connecting to " << endpoint);
 
                 if (!properties_->bindToLocalAddress.empty()) {
-
-                    // Only connect outwards to protocols we can bind to
-                    if (!prot_filter.empty()) {
-                        if (std::find(prot_filter.begin(), prot_filter.end(), endpoint.protocol())
-                                == prot_filter.end()) {
-                            RESTC_CPP_LOG_TRACE_("Filtered out (protocol mismatch) local address: "
-                                << properties_->bindToLocalAddress);
-                            break; // Break out of retry loop, re-enter endpoint loop
-                        }
-                    }
-
-                    RESTC_CPP_LOG_TRACE_("Binding to local address: "
-                        << properties_->bindToLocalAddress);
-
-                    boost::system::error_code ec;
-                    auto local_ep = ToEp(properties_->bindToLocalAddress, endpoint.protocol(), ctx);
-                    auto& sck = connection->GetSocket().GetSocket();
-                    sck.open(local_ep.protocol());
-                    sck.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-                    sck.bind(local_ep, ec);
-
-                    if (ec) {
-                        RESTC_CPP_LOG_ERROR_("Failed to bind to local address '"
-                            << local_ep
-                            << "': " << ec.message());
-
-                        sck.close();
-                        throw RestcCppException{"Failed to bind to local address: "s
-                                                + properties_->bindToLocalAddress};
-                    }
+                    BindToLocalAddress(*connection, endpoint, ctx);
                 }
 
-
-//                if (owner_.IsClosed()) {
-//                    RESTC_CPP_LOG_DEBUG_("RequestImpl::Connect: The rest client is closed. Aborting.");
-//                    throw FailedToConnectException("Failed to connect (closed)");
-//                }
-
                 auto timer = IoTimer::Create(timer_name,
                     properties_->connectTimeoutMs, connection);
+                race->attempts.push_back({endpoint, move(connection), move(timer)});
 
-                try {
-                    if (retries) {
-                        RESTC_CPP_LOG_DEBUG_("RequestImpl::Connect: taking a nap");
-                        ctx.Sleep(retries * 20ms);
-                        RESTC_CPP_LOG_DEBUG_("RequestImpl::Connect: Waking up. Will try to read from the socket now.");
-                    }
+                const auto attempt = race->attempts.size() - 1;
+                boost::asio::spawn(ctx.GetYield(),
+                                   [race, attempt](boost::asio::yield_context yield) {
+                    boost::system::error_code ec;
+                    auto& a = race->attempts[attempt];
+                    a.connection->GetSocket().GetSocket().async_connect(
+                        a.endpoint, yield[ec]);
+                    race->Done(attempt, ec);
+                });
+
+                ++in_flight;
+                next_attempt_at = boost::posix_time::microsec_clock::universal_time() + delay;
+                continue;
+            }
 
-                    if (properties_->proxy.type == Proxy::Type::SOCKS5) {
-                        connection->GetSocket().SetAfterConnectCallback([&]() {
-                            RESTC_CPP_LOG_TRACE_("RequestImpl::Connect: In Socks5 callback");
+            if (!race->completed.empty()) {
+                const auto attempt = race->completed.front().first;
+                auto ec = race->completed.front().second;
+                race->completed.pop_front();
+                --in_flight;
 
-                            DoSocks5Handshake(*connection, parsed_url_, *properties_, ctx);
+                auto& a = race->attempts[attempt];
+                if (!ec) {
+                    try {
+                        if (properties_->proxy.type == Proxy::Type::SOCKS5) {
+                            auto *conn = a.connection.get();
+                            a.connection->GetSocket().SetAfterConnectCallback([this, conn, &ctx]() {
+                                RESTC_CPP_LOG_TRACE_("RequestImpl::Connect: In Socks5 callback");
 
-                            RESTC_CPP_LOG_TRACE_("RequestImpl::Connect: Leaving Socks5 callback");
-                        });
-                    }
+                                DoSocks5Handshake(*conn, parsed_url_, *properties_, ctx);
 
-                    RESTC_CPP_LOG_TRACE_("RequestImpl::Connect: calling AsyncConnect --> " << endpoint);
-                    connection->GetSocket().AsyncConnect(
-                        endpoint, address_it->host_name(),
-                        properties_->tcpNodelay, ctx.GetYield());
-                    RESTC_CPP_LOG_TRACE_("RequestImpl::Connect: OK AsyncConnect --> " << endpoint);
-                    return connection;
-                } catch (const boost::system::system_error& ex) {
-                    RESTC_CPP_LOG_TRACE_("RequestImpl::Connect:: Caught boost::system::system_error exception: \"" << ex.what()
-                                         << "\". Will close connection " << *connection);
-                    connection->GetSocket().GetSocket().close();
-
-                    if (ex.code() == boost::system::errc::resource_unavailable_try_again) {
-                        if ( retries < 8) {
-                            RESTC_CPP_LOG_DEBUG_(
-                                "RequestImpl::Connect:: Caught boost::system::system_error exception: \""
-                                    << ex.what()
-                                    << "\" while connecting to " << endpoint
-                                    << ". I will continue the retry loop.");
-                            continue;
+                                RESTC_CPP_LOG_TRACE_("RequestImpl::Connect: Leaving Socks5 callback");
+                            });
                         }
+
+                        a.connection->GetSocket().AsyncSetupConnection(
+                            host, properties_->tcpNodelay, ctx.GetYield());
+                        RESTC_CPP_LOG_TRACE_("RequestImpl::Connect: OK AsyncConnect --> " << a.endpoint);
+                        return move(a.connection);
+                    } catch (const boost::system::system_error& ex) {
+                        ec = ex.code();
+                    } catch(const exception& ex) {
+                        RESTC_CPP_LOG_WARN_("Connect to "
+                            << a.endpoint
+                            << " failed with exception type: "
+                            << typeid(ex).name()
+                            << ", message: " << ex.what());
                     }
-                    RESTC_CPP_LOG_DEBUG_(
-                        "RequestImpl::Connect:: Caught boost::system::system_error exception: \""
-                            << ex.what()
-                            << "\" while connecting to " << endpoint);
-                    break; // Go to the next endpoint
-                } catch(const exception& ex) {
-                    RESTC_CPP_LOG_WARN_("Connect to "
-                        << endpoint
-                        << " failed with exception type: "
-                        << typeid(ex).name()
-                        << ", message: " << ex.what());
-
-                    connection->GetSocket().GetSocket().close();
                 }
 
-            } // retries
-        } // endpoints
+                if (ec) {
+                    RESTC_CPP_LOG_DEBUG_("RequestImpl::Connect: Failed to connect to "
+                        << a.endpoint << ": " << ec.message());
+                }
 
-        throw FailedToConnectException("Failed to connect (exhausted all options)");
+                if (ec == boost::system::errc::resource_unavailable_try_again) {
+                    tryAgain = true;
+                }
+
+                a.timer.reset();
+                a.connection->GetSocket().GetSocket().close(ec);
+                a.connection.reset();
+                continue;
+            }
+
+            if (in_flight == 0) {
+                return {};
+            }
+
+            // Wait for an attempt to finish, or for the time to start the next one
+            race->signal.expires_at(((next < endpoints.size()) && (delay.total_milliseconds() > 0))
+                ? next_attempt_at : boost::posix_time::pos_infin);
+            race->waiting = true;
+            boost::system::error_code ec;
+            race->signal.async_wait(ctx.GetYield()[ec]);
+            race->waiting = false;
+        }
+    }
+
+    /* Get the next part of the body
+     *
+     * Returns false when there is nothing more to send.
+     */
+    bool GetBodyData(write_buffers_t& buffers) {
+        if (body_) {
+            switch(body_->GetType()) {
+                case RequestBody::Type::FIXED_SIZE:
+                case RequestBody::Type::CHUNKED_LAZY_PULL:
+                    return body_->GetData(buffers);
+                case RequestBody::Type::CHUNKED_LAZY_PUSH:
+                    body_->PushData(*writer_);
+            }
+        }
+        return false;
+    }
+
+    bool IsBodyPushed() const {
+        return body_ && (body_->GetType() == RequestBody::Type::CHUNKED_LAZY_PUSH);
     }
 
+    /* Send the request headers, followed by the body
+     *
+     * The headers and the first part of the body are sent in one write,
+     * unless the body pushes its data to the writer itself.
+     *
+     * If write_buffer is empty, the headers are already sent (HTTP/2),
+     * and only the body is sent.
+     */
     void SendRequestPayload(Context& /*ctx*/,
                       write_buffers_t write_buffer) {
 
         static const auto timer_name = "SendRequestPayload"s;
-        bool have_sent_headers = false;
+        bool have_sent_headers = write_buffer.empty();
+        bool have_more_data = true;
 
-        if (properties_->beforeWriteFn) {
-            properties_->beforeWriteFn();
+        if (have_sent_headers || !IsBodyPushed()) {
+            have_more_data = GetBodyData(write_buffer);
         }
 
         while(boost::asio::buffer_size(write_buffer))
@@ -810,27 +1186,24 @@ private:
                 properties_->sendTimeoutMs, connection_);
 
             try {
+                const auto bytes = boost::asio::buffer_size(write_buffer);
 
                 if (!have_sent_headers) {
 
                     auto b = write_buffer[0];
+                    write_buffer.erase(write_buffer.begin());
 
-                    writer_->WriteDirect(
+                    writer_->WriteDirectAndData(
                         {boost::asio::buffer_cast<const char *>(b),
-                        boost::asio::buffer_size(b)});
+                        boost::asio::buffer_size(b)}, write_buffer);
 
                     have_sent_headers = true;
 
-                    if (write_buffer.size() > 1) {
-                        write_buffer.erase(write_buffer.begin());
-                        writer_->Write(write_buffer);
-                    }
-
                 } else {
                     writer_->Write(write_buffer);
                 }
 
-                bytes_sent_ += boost::asio::buffer_size(write_buffer);
+                bytes_sent_ += bytes;
 
             } catch(const exception& ex) {
                 RESTC_CPP_LOG_WARN_("Write failed with exception type: "
@@ -841,33 +1214,138 @@ private:
 
             write_buffer.clear();
 
-            if (body_) {
-                switch(body_->GetType()) {
-                    case RequestBody::Type::FIXED_SIZE:
-                    case RequestBody::Type::CHUNKED_LAZY_PULL:
-                        if (!body_->GetData(write_buffer)) {
-                            return;
-                        }
-                        break;
-                    case RequestBody::Type::CHUNKED_LAZY_PUSH:
-                        body_->PushData(*writer_);
-                }
-            } else {
+            if (!have_more_data || !GetBodyData(write_buffer)) {
                 return; // No more data to send
             }
         }
     }
 
+    /*! Send the headers, and then the body if the server wants it
+     *
+     * The server answers "Expect: 100-continue" with "100 Continue"
+     * if it wants the body, or with the final reply if it does not.
+     * Servers that don't know about it only answer after the body,
+     * so we send it anyway when the timeout expires.
+     */
+    void SendRequestExpectingContinue(Context& ctx,
+                                      write_buffers_t& write_buffer) {
+        static const auto timer_name = "SendRequestHeaders"s;
+
+        {
+            auto timer = IoTimer::Create(timer_name,
+                properties_->sendTimeoutMs, connection_);
+
+            auto b = write_buffer.at(0);
+            writer_->WriteDirect(
+                {boost::asio::buffer_cast<const char *>(b),
+                boost::asio::buffer_size(b)});
+            bytes_sent_ += boost::asio::buffer_size(b);
+        }
+
+        auto answer = WaitForContinue(ctx);
+        if (!answer.empty()) {
+            reply_started_ = true;
+
+            DataReader::ReadConfig cfg;
+            cfg.msReadTimeout = properties_->recvTimeout;
+            cfg.readAheadBuffers = properties_->readAheadBuffers;
+            cfg.bufferSize = properties_->ioBufferSize;
+            cfg.maxBufferSize = properties_->ioBufferMaxSize;
+            expect_reply_ = ReplyImpl::Create(connection_, ctx, owner_,
+                                              properties_, request_type_);
+            if (!expect_reply_->StartReceiveAfterExpect(
+                DataReader::CreateIoReader(connection_, ctx, cfg),
+                move(answer))) {
+                RESTC_CPP_LOG_DEBUG_("The server answered "
+                    << expect_reply_->GetResponseCode()
+                    << " before the body was sent " << *connection_);
+                return;
+            }
+        }
+
+        SendRequestPayload(ctx, {});
+    }
+
+    /*! Wait a little for the server to answer "Expect: 100-continue"
+     *
+     * When the timeout expires, the read is cancelled rather than
+     * the connection closed, so the request can go on.
+     *
+     * \return What the server sent, or an empty string if it
+     *      sent nothing before the timeout.
+     */
+    std::string WaitForContinue(Context& ctx) {
+        static const auto timer_name = "WaitForContinue"s;
+
+        std::weak_ptr<Connection> weak_connection = connection_;
+        auto timer = IoTimer::Create(timer_name,
+            properties_->expectContinueTimeoutMs,
+#if (BOOST_VERSION >= 106900)
+            connection_->GetSocket().GetSocket().get_executor(),
+#else
+            connection_->GetSocket().GetSocket().get_io_service(),
+#endif
+            [weak_connection]() {
+                if (auto connection = weak_connection.lock()) {
+                    boost::system::error_code ec;
+                    connection->GetSocket().GetSocket().cancel(ec);
+                }
+            });
+        IoTimer::Wrapper cancel_timer{IoTimer::ptr_t{timer}};
+
+        std::string buffer(RESTC_CPP_IO_BUFFER_SIZE, '\0');
+        try {
+            const auto bytes = connection_->GetSocket().AsyncReadSome(
+                {&buffer[0], buffer.size()}, ctx.GetYield());
+            buffer.resize(bytes);
+        } catch(const boost::system::system_error& ex) {
+            if (!timer->IsExpiered()
+                || (ex.code() != boost::asio::error::operation_aborted)) {
+                throw;
+            }
+
+            RESTC_CPP_LOG_TRACE_("No answer to 'Expect: 100-continue' from "
+                << *connection_ << ". Sending the body.");
+            buffer.clear();
+        }
+
+        return buffer;
+    }
+
     DataWriter& SendRequest(Context& ctx) override {
         bytes_sent_ = 0;
+        reused_connection_ = false;
+        reply_started_ = false;
+        expect_continue_ = false;
+        http2_stream_.reset();
+        pipeline_ticket_.reset();
+        expect_reply_.reset();
+
+        if (auto session = ConnectHttp2(ctx)) {
+            return SendHttp2Request(*session, ctx);
+        }
+
+        if (!pipeline_ticket_ && CanPipeline()) {
+            StartPipeline();
+        }
+
+        if (pipeline_ticket_) {
+            // The requests before ours on the connection must be sent first
+            pipeline_ticket_->WaitForSendTurn(ctx, properties_->sendTimeoutMs);
+        }
+
+        expect_continue_ = UseExpectContinue();
 
-        connection_ = Connect(ctx);
         DataWriter::WriteConfig cfg;
         cfg.msWriteTimeout = properties_->sendTimeoutMs;
+        if (body_ && (body_->GetType() != RequestBody::Type::FIXED_SIZE)) {
+            cfg.writeBehindBuffers = properties_->writeBehindBuffers;
+        }
         writer_ = DataWriter::CreateIoWriter(connection_, ctx, cfg);
 
         if (body_) {
-            if (body_->GetType() == RequestBody::Type::FIXED_SIZE) {
+            if ((body_->GetType() == RequestBody::Type::FIXED_SIZE)
+                && !CompressBody()) {
                 writer_ = DataWriter::CreatePlainWriter(
                     body_->GetFixedSize(), move(writer_));
             } else {
@@ -876,26 +1354,33 @@ private:
         } else {
             static const string transfer_encoding{"Transfer-Encoding"};
             static const string chunked{"chunked"};
-            auto h = properties_->headers.find(transfer_encoding);
-            if ((h != properties_->headers.end()) && ciEqLibC()(h->second, chunked)) {
+            const auto *h = FindHeader(transfer_encoding);
+            if (h && ciEqLibC()(*h, chunked)) {
                 writer_ = DataWriter::CreateChunkedWriter(nullptr, move(writer_));
             } else {
                 writer_ = DataWriter::CreatePlainWriter(0, move(writer_));
             }
         }
 
-        // TODO: Add compression
+        AddCompression();
 
         write_buffers_t write_buffer;
-        ToBuffer headers(BuildOutgoingRequest());
-        write_buffer.push_back(headers);
+        BuildOutgoingRequest();
+        write_buffer.push_back(boost::asio::buffer(request_head_));
         header_size_ = boost::asio::buffer_size(write_buffer);
 
-        RESTC_CPP_LOG_TRACE_("Request: " << (const boost::string_ref)headers
+        RESTC_CPP_LOG_TRACE_("Request: " << request_head_
             << ' ' << *connection_);
 
         PrepareBody();
-        SendRequestPayload(ctx, write_buffer);
+        if (properties_->beforeWriteFn) {
+            properties_->beforeWriteFn();
+        }
+        if (expect_continue_) {
+            SendRequestExpectingContinue(ctx, write_buffer);
+        } else {
+            SendRequestPayload(ctx, write_buffer);
+        }
         if (properties_->afterWriteFn) {
             properties_->afterWriteFn();
         }
@@ -907,41 +1392,107 @@ private:
         return *writer_;
     }
 
+    DataWriter& SendHttp2Request(Http2Connection& session, Context& ctx) {
+        static const string transfer_encoding{"Transfer-Encoding"};
+        static const string chunked{"chunked"};
+
+        // Without a body, the user may still write one after SendRequest()
+        bool has_body = static_cast<bool>(body_);
+        if (!has_body) {
+            const auto *h = FindHeader(transfer_encoding);
+            has_body = h && ciEqLibC()(*h, chunked);
+        }
+
+        PrepareBody();
+        header_size_ = 0;
+        http2_stream_ = session.OpenStream(BuildHttp2Fields(), !has_body, ctx,
+                                           properties_->sendTimeoutMs);
+
+        RESTC_CPP_LOG_TRACE_("Request: " << Verb(request_type_) << ' ' << url_
+            << " on stream #" << http2_stream_->GetId() << ' ' << session);
+
+        DataWriter::WriteConfig cfg;
+        cfg.msWriteTimeout = properties_->sendTimeoutMs;
+        writer_ = DataWriter::CreateHttp2Writer(http2_stream_, ctx, cfg);
+        AddCompression();
+
+        if (properties_->beforeWriteFn) {
+            properties_->beforeWriteFn();
+        }
+        SendRequestPayload(ctx, {});
+        if (properties_->afterWriteFn) {
+            properties_->afterWriteFn();
+        }
+
+        RESTC_CPP_LOG_DEBUG_("Sent " << Verb(request_type_) << " request to '" << url_ << "' "
+            << session);
+
+        return *writer_;
+    }
+
     unique_ptr<Reply> GetReply(Context& ctx) override {
         constexpr auto http_301 = 301;
         constexpr auto http_302 = 302;
 
-        // We will not send more data regarding the current request
-        writer_->Finish();
+        // We will not send more data regarding the current request.
+        // If the server answered "Expect: 100-continue" with its final
+        // reply, the body was never started. Finishing the writer would
+        // still send the end of a compressed (and chunked) body, which
+        // the server would take for the start of the next request.
+        if (!expect_reply_ || expect_reply_->IsWaitingForFinalReply()) {
+            writer_->Finish();
+        }
         writer_.reset();
+        if (pipeline_ticket_) {
+            pipeline_ticket_->SetSent();
+        }
 
         RESTC_CPP_LOG_TRACE_("GetReply: writer is reset.");
 
         DataReader::ReadConfig cfg;
         cfg.msReadTimeout = properties_->recvTimeout;
-        auto reply = ReplyImpl::Create(connection_, ctx, owner_, properties_,
-                                       request_type_);
+        cfg.readAheadBuffers = properties_->readAheadBuffers;
+        cfg.bufferSize = properties_->ioBufferSize;
+        cfg.maxBufferSize = properties_->ioBufferMaxSize;
+        auto reply = expect_reply_ ? move(expect_reply_) : ReplyImpl::Create(
+            http2_stream_ ? http2_stream_->GetConnection() : connection_,
+            ctx, owner_, properties_, request_type_);
 
         RESTC_CPP_LOG_TRACE_("GetReply: Calling StartReceiveFromServer");
         try {
-            reply->StartReceiveFromServer(
-                DataReader::CreateIoReader(connection_, ctx, cfg));
+            if (reply->HasReceivedData()) {
+                // The server answered "Expect: 100-continue"
+                if (reply->IsWaitingForFinalReply()) {
+                    reply->ContinueReceiveFromServer();
+                }
+            } else if (http2_stream_) {
+                reply->StartReceiveFromHttp2(move(http2_stream_));
+            } else if (pipeline_ticket_) {
+                reply->StartReceiveFromServer(
+                    DataReader::CreateIoReader(connection_, ctx, cfg),
+                    move(pipeline_ticket_));
+            } else {
+                reply->StartReceiveFromServer(
+                    DataReader::CreateIoReader(connection_, ctx, cfg));
+            }
         } catch (const exception& ex) {
             RESTC_CPP_LOG_DEBUG_("GetReply: exception from StartReceiveFromServer: " << ex.what());
+            reply_started_ = reply->HasReceivedData();
             throw;
         }
+        reply_started_ = true;
 
         RESTC_CPP_LOG_TRACE_("GetReply: Returned from StartReceiveFromServer. code=" << reply->GetResponseCode());
 
         const auto http_code = reply->GetResponseCode();
         if (http_code == http_301 || http_code == http_302) {
-            auto redirect_location = reply->GetHeader("Location");
+            auto redirect_location = reply->GetHeader(ReplyHeaders::Id::LOCATION);
             if (!redirect_location) {
                 throw ProtocolException(
                     "No Location header in redirect reply");
             }
             RESTC_CPP_LOG_TRACE_("GetReply: RedirectException. location=" << *redirect_location);
-            throw RedirectException(http_code, *redirect_location, move(reply));
+            throw RedirectException(http_code, redirect_location->to_string(), move(reply));
         }
 
         if (properties_->throwOnHttpError) {
@@ -961,22 +1512,98 @@ private:
 
 
     unique_ptr<Reply> DoExecute(Context& ctx) {
+        try {
+            SendRequest(ctx);
+            return GetReply(ctx);
+        } catch(const boost::system::system_error& ex) {
+            if (!CanReplay(ex.code())) {
+                throw;
+            }
+
+            RESTC_CPP_LOG_DEBUG_("Replaying " << Verb(request_type_)
+                << " request to '" << url_
+                << "'. The reused connection failed with: " << ex.what());
+        }
+
+        // Make sure the dead connection is not recycled
+        writer_.reset();
+        http2_stream_.reset();
+        pipeline_ticket_.reset();
+        expect_reply_.reset();
+        if (connection_) {
+            boost::system::error_code ec;
+            connection_->GetSocket().GetSocket().close(ec);
+            connection_.reset();
+        }
+
         SendRequest(ctx);
         return GetReply(ctx);
     }
 
+    /* Can we send the request again after a failure?
+     *
+     * Only if the server closed a connection from the pool before we
+     * got anything back, and only for idempotent requests with a body
+     * we can send again.
+     */
+    bool CanReplay(const boost::system::error_code& ec) const {
+        if (!reused_connection_ || reply_started_) {
+            return false;
+        }
+
+        if ((ec != boost::asio::error::eof)
+            && (ec != boost::asio::error::connection_reset)
+            && (ec != boost::asio::error::connection_aborted)
+            && (ec != boost::asio::error::broken_pipe)) {
+            return false;
+        }
+
+        return CanSendAgain();
+    }
+
+    /* Can the request be sent again if we got no reply?
+     *
+     * Only idempotent requests with a body we can send again.
+     */
+    bool CanSendAgain() const {
+        if (body_ && (body_->GetType() == RequestBody::Type::CHUNKED_LAZY_PUSH)) {
+            return false;
+        }
+
+        switch(request_type_) {
+            case Type::GET:
+            case Type::HEAD:
+            case Type::PUT:
+            case Type::DELETE:
+            case Type::OPTIONS:
+                return true;
+            default:
+                return false;
+        }
+    }
+
     std::string url_;
     Url parsed_url_;
     const Type request_type_;
     std::unique_ptr<RequestBody> body_;
     Connection::ptr_t connection_;
+    Http2Stream::ptr_t http2_stream_; // Used instead of connection_ for HTTP/2
+    PipelineTicket::ptr_t pipeline_ticket_; // Our place on a pipelined connection
+    std::unique_ptr<ReplyImpl> expect_reply_; // The servers answer to "Expect: 100-continue"
     std::unique_ptr<DataWriter> writer_;
     Properties::ptr_t properties_;
+    headers_t request_headers_; // Headers for this request, on top of the defaults
+    args_t request_args_; // Arguments for this request, after the defaults
+    mutable Properties::ptr_t merged_properties_; // Returned by GetProperties() when we have our own headers or args
     RestClient &owner_;
+    std::string request_head_; // Request line and headers. Reused after redirects
     size_t header_size_ = 0;
     std::uint64_t bytes_sent_ = 0;
     bool dirty_ = false;
+    bool reused_connection_ = false; // The connection came from the pool
+    bool reply_started_ = false; // We have received data from the server
     bool add_url_args_ = true;
+    bool expect_continue_ = false; // We send "Expect: 100-continue"
 };
 
 
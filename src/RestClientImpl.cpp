@@ -10,6 +10,7 @@
 #include "restc-cpp/restc-cpp.h"
 #include "restc-cpp/logging.h"
 #include "restc-cpp/ConnectionPool.h"
+#include "restc-cpp/DnsCache.h"
 #include "restc-cpp/RequestBody.h"
 #include "restc-cpp/internals/helpers.h"
 
@@ -196,6 +197,7 @@ public:
         }
 
         pool_ = ConnectionPool::Create(*this);
+        dns_cache_ = DnsCache::Create(*this);
 
         if (useMainThread) {
             return;
@@ -361,6 +363,11 @@ public:
         return pool_;
     }
 
+    std::shared_ptr<DnsCache> GetDnsCache() override {
+        assert(dns_cache_);
+        return dns_cache_;
+    }
+
     boost::asio::io_service& GetIoService() override { return *io_service_; }
 
 #ifdef RESTC_CPP_WITH_TLS
@@ -403,6 +410,7 @@ private:
     unique_ptr<boost::asio::io_service> ioservice_instance_;
     boost::asio::io_service *io_service_ = nullptr;
     ConnectionPool::ptr_t pool_;
+    DnsCache::ptr_t dns_cache_;
     unique_ptr<boost::asio::io_service::work> work_;
 #ifdef RESTC_CPP_THREADED_CTX
     atomic_size_t current_tasks_{0};
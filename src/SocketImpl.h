@@ -61,6 +61,14 @@ public:
                     boost::asio::yield_context& yield) override {
         return WrapException<void>([&] {
             socket_.async_connect(ep, yield);
+            AsyncSetupConnection(host, tcpNodelay, yield);
+        });
+    }
+
+    void AsyncSetupConnection(const std::string &host,
+                              bool tcpNodelay,
+                              boost::asio::yield_context& yield) override {
+        return WrapException<void>([&] {
             socket_.lowest_layer().set_option(boost::asio::ip::tcp::no_delay(tcpNodelay));
             OnAfterConnect();
         });
@@ -82,6 +90,10 @@ public:
         return socket_.is_open();
     }
 
+    std::string GetAlpnProtocol() const override {
+        return {};
+    }
+
 protected:
     std::ostream& Print(std::ostream& o) const override {
         if (IsOpen()) {
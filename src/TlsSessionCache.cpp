@@ -0,0 +1,158 @@
+#include <ctime>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+
+#include "TlsSessionCache.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+namespace {
+
+void FreeCacheData(void * /*parent*/, void *ptr, CRYPTO_EX_DATA * /*ad*/,
+                   int /*idx*/, long /*argl*/, void * /*argp*/) {
+    delete static_cast<TlsSessionCache::ptr_t *>(ptr);
+}
+
+// Index for the TlsSessionCache::ptr_t in the SSL_CTX
+int GetCtxIndex() {
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr,
+                                                      nullptr, FreeCacheData);
+    return index;
+}
+
+// Index for the cache-key in the SSL
+int GetSslIndex() {
+    static const int index = SSL_get_ex_new_index(0, nullptr, nullptr,
+                                                  nullptr, nullptr);
+    return index;
+}
+
+bool IsExpired(const SSL_SESSION *session, const time_t now) {
+    return (SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session)) <= now;
+}
+
+// TLS 1.3 tickets should only be used once (RFC 8446, appendix C.4)
+bool IsSingleUse(const SSL_SESSION *session) {
+    return SSL_SESSION_get_protocol_version(session) >= TLS1_3_VERSION;
+}
+
+} // anonymous namespace
+
+TlsSessionCache::~TlsSessionCache() {
+    for(auto& it : sessions_) {
+        for(auto session : it.second) {
+            SSL_SESSION_free(session);
+        }
+    }
+}
+
+TlsSessionCache::ptr_t
+TlsSessionCache::Get(boost::asio::ssl::context& ctx) {
+    static std::mutex mutex;
+
+    auto native = ctx.native_handle();
+    const auto index = GetCtxIndex();
+
+    lock_guard<std::mutex> lock{mutex};
+    if (auto data = static_cast<ptr_t *>(SSL_CTX_get_ex_data(native, index))) {
+        return *data;
+    }
+
+    auto cache = make_shared<TlsSessionCache>();
+    SSL_CTX_set_ex_data(native, index, new ptr_t{cache});
+    SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_CLIENT
+                                   | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(native, OnNewSession);
+    return cache;
+}
+
+void TlsSessionCache::Attach(SSL *ssl, const std::string& key) {
+    SSL_set_ex_data(ssl, GetSslIndex(), const_cast<std::string *>(&key));
+
+    SSL_SESSION *session = nullptr;
+    {
+        lock_guard<std::mutex> lock{mutex_};
+        auto it = sessions_.find(key);
+        if (it == sessions_.end()) {
+            return;
+        }
+
+        auto& sessions = it->second;
+        const auto now = time(nullptr);
+        while(!sessions.empty() && IsExpired(sessions.back(), now)) {
+            SSL_SESSION_free(sessions.back());
+            sessions.pop_back();
+        }
+
+        if (!sessions.empty()) {
+            if (IsSingleUse(sessions.back())) {
+                session = sessions.back();
+                sessions.pop_back();
+            } else {
+                // Offer a copy, as the connection may leave its session
+                // not resumable when it is closed.
+                session = SSL_SESSION_dup(sessions.back());
+            }
+        }
+
+        if (sessions.empty()) {
+            sessions_.erase(it);
+        }
+    }
+
+    if (session) {
+        RESTC_CPP_LOG_TRACE_("TlsSessionCache: Offering cached session for " << key);
+        SSL_set_session(ssl, session);
+        SSL_SESSION_free(session);
+    }
+}
+
+int TlsSessionCache::OnNewSession(SSL *ssl, SSL_SESSION *session) {
+    const auto key = static_cast<const std::string *>(SSL_get_ex_data(ssl, GetSslIndex()));
+    const auto data = static_cast<ptr_t *>(
+        SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), GetCtxIndex()));
+
+    if (key && data && SSL_SESSION_is_resumable(session)) {
+        // Store a copy. OpenSSL marks the original as not resumable if
+        // the connection is closed without a TLS shutdown.
+        if (auto copy = SSL_SESSION_dup(session)) {
+            (*data)->Store(*key, copy);
+        }
+    }
+
+    return 0; // We did not keep a reference to session
+}
+
+void TlsSessionCache::Store(const std::string& key, SSL_SESSION *session) {
+    RESTC_CPP_LOG_TRACE_("TlsSessionCache: Storing session for " << key);
+
+    lock_guard<std::mutex> lock{mutex_};
+    if ((sessions_.size() >= max_keys) && (sessions_.find(key) == sessions_.end())) {
+        // Make room. We don't track which server was used last.
+        auto victim = sessions_.begin();
+        for(auto s : victim->second) {
+            SSL_SESSION_free(s);
+        }
+        sessions_.erase(victim);
+    }
+
+    auto& sessions = sessions_[key];
+    if (!sessions.empty() && !IsSingleUse(session)) {
+        // A TLS 1.2 session replaces the ones we have
+        for(auto s : sessions) {
+            SSL_SESSION_free(s);
+        }
+        sessions.clear();
+    }
+
+    sessions.push_back(session);
+    if (sessions.size() > max_sessions_per_key) {
+        SSL_SESSION_free(sessions.front());
+        sessions.pop_front();
+    }
+}
+
+} // restc_cpp
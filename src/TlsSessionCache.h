@@ -0,0 +1,70 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <boost/asio/ssl.hpp>
+
+#include "restc-cpp/config.h"
+
+#if !defined(RESTC_CPP_WITH_TLS)
+#   error "Do not include when compiling without TLS"
+#endif
+
+namespace restc_cpp {
+
+/*! Client side cache for TLS sessions
+ *
+ * Lets a new connection to a server resume an earlier TLS session
+ * (TLS 1.2 session id or TLS 1.3 ticket), which saves the certificate
+ * exchange and verification of a full handshake.
+ *
+ * Sessions are keyed by the SNI host name and port. The cache is
+ * attached to the SSL_CTX, so it is shared by all the RestClient
+ * instances that use the same boost::asio::ssl::context.
+ */
+class TlsSessionCache
+{
+public:
+    using ptr_t = std::shared_ptr<TlsSessionCache>;
+
+    // Most sessions we keep for one server. TLS 1.3 servers normally send two tickets.
+    static constexpr size_t max_sessions_per_key = 4;
+    // Most servers we keep sessions for
+    static constexpr size_t max_keys = 1024;
+
+    TlsSessionCache() = default;
+    TlsSessionCache(const TlsSessionCache&) = delete;
+    TlsSessionCache& operator = (const TlsSessionCache&) = delete;
+    ~TlsSessionCache();
+
+    /*! Get the cache for a TLS context
+     *
+     * The first call enables client side session caching in the
+     * context, and installs the callback that collects new sessions.
+     */
+    static ptr_t Get(boost::asio::ssl::context& ctx);
+
+    /*! Prepare a connection before its handshake
+     *
+     * Offers a cached session for key to the server, and makes sure
+     * that the sessions the server sends are stored under key.
+     *
+     * \param key Must stay valid for as long as ssl exists.
+     */
+    void Attach(SSL *ssl, const std::string& key);
+
+private:
+    using sessions_t = std::deque<SSL_SESSION *>; // Oldest first
+
+    static int OnNewSession(SSL *ssl, SSL_SESSION *session);
+    void Store(const std::string& key, SSL_SESSION *session);
+
+    std::unordered_map<std::string, sessions_t> sessions_;
+    std::mutex mutex_;
+};
+
+} // restc_cpp
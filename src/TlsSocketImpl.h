@@ -13,6 +13,8 @@
 #include "restc-cpp/Socket.h"
 #include "restc-cpp/config.h"
 
+#include "TlsSessionCache.h"
+
 #if !defined(RESTC_CPP_WITH_TLS)
 #   error "Do not include when compiling without TLS"
 #endif
@@ -24,7 +26,10 @@ public:
 
     using ssl_socket_t = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
 
-    TlsSocketImpl(boost::asio::io_service& io_service, shared_ptr<boost::asio::ssl::context> ctx)
+    TlsSocketImpl(boost::asio::io_service& io_service, shared_ptr<boost::asio::ssl::context> ctx,
+                  TlsSessionCache::ptr_t sessionCache = {},
+                  bool offerHttp2 = false)
+    : session_cache_{move(sessionCache)}, offer_http2_{offerHttp2}
     {
         ssl_socket_ = std::make_unique<ssl_socket_t>(io_service, *ctx);
     }
@@ -69,6 +74,17 @@ public:
                     const string &host,
                     bool tcpNodelay,
                     boost::asio::yield_context& yield) override {
+        return WrapException<void>([&] {
+            RESTC_CPP_LOG_TRACE_("AsyncConnect - Calling async_connect");
+            GetSocket().async_connect(ep, yield);
+
+            AsyncSetupConnection(host, tcpNodelay, yield);
+        });
+    }
+
+    void AsyncSetupConnection(const string &host,
+                              bool tcpNodelay,
+                              boost::asio::yield_context& yield) override {
         return WrapException<void>([&] {
             //TLS-SNI (without this option, handshakes attempts with hosts behind CDNs will fail,
             //due to the fact that the CDN does not have enough information at the TLS layer
@@ -77,9 +93,6 @@ public:
             RESTC_CPP_LOG_TRACE_("AsyncConnect - Calling SSL_set_tlsext_host_name --> " << host);
             SSL_set_tlsext_host_name(ssl_socket_->native_handle(), host.c_str());
 
-            RESTC_CPP_LOG_TRACE_("AsyncConnect - Calling async_connect");
-            GetSocket().async_connect(ep, yield);
-
             RESTC_CPP_LOG_TRACE_("AsyncConnect - Calling lowest_layer().set_option");
             ssl_socket_->lowest_layer().set_option(
                         boost::asio::ip::tcp::no_delay(tcpNodelay));
@@ -87,11 +100,31 @@ public:
             RESTC_CPP_LOG_TRACE_("AsyncConnect - Calling OnAfterConnect()");
             OnAfterConnect();
 
+            if (session_cache_) {
+                session_key_ = host + ':' + std::to_string(GetSocket().remote_endpoint().port());
+                session_cache_->Attach(ssl_socket_->native_handle(), session_key_);
+            }
+
+            if (offer_http2_) {
+                // ALPN protocol list, in order of preference
+                static const std::string protocols{"\x02h2\x08http/1.1"};
+                SSL_set_alpn_protos(ssl_socket_->native_handle(),
+                                    reinterpret_cast<const unsigned char *>(protocols.data()),
+                                    static_cast<unsigned int>(protocols.size()));
+            }
+
             RESTC_CPP_LOG_TRACE_("AsyncConnect - Calling async_handshake");
             ssl_socket_->async_handshake(boost::asio::ssl::stream_base::client,
                                          yield);
 
-            RESTC_CPP_LOG_TRACE_("AsyncConnect - Done");
+            const unsigned char *alpn = nullptr;
+            unsigned int alpn_len = 0;
+            SSL_get0_alpn_selected(ssl_socket_->native_handle(), &alpn, &alpn_len);
+            alpn_protocol_.assign(reinterpret_cast<const char *>(alpn), alpn_len);
+
+            RESTC_CPP_LOG_TRACE_("AsyncConnect - Done"
+                << (SSL_session_reused(ssl_socket_->native_handle()) ? " (resumed session)" : "")
+                << (alpn_protocol_.empty() ? "" : " ALPN: ") << alpn_protocol_);
         });
     }
 
@@ -113,6 +146,10 @@ public:
         return ssl_socket_->lowest_layer().is_open();
     }
 
+    std::string GetAlpnProtocol() const override {
+        return alpn_protocol_;
+    }
+
 protected:
     std::ostream& Print(std::ostream& o) const override {
         if (IsOpen()) {
@@ -134,6 +171,10 @@ protected:
 
 
 private:
+    TlsSessionCache::ptr_t session_cache_;
+    std::string session_key_; // Referenced by the SSL object, so it must outlive ssl_socket_
+    const bool offer_http2_;
+    std::string alpn_protocol_;
     std::unique_ptr<ssl_socket_t> ssl_socket_;
 };
 
@@ -1,26 +1,121 @@
 #include <zlib.h>
 
+#include <limits>
+
 #include "restc-cpp/restc-cpp.h"
 #include "restc-cpp/DataReader.h"
 #include "restc-cpp/logging.h"
+#include "restc-cpp/BufferPool.h"
 
 using namespace std;
 
 namespace restc_cpp {
 
+namespace {
+
+// Let zlib allocate with operator new, like the rest of us
+voidpf ZAlloc(voidpf /*opaque*/, uInt items, uInt size) {
+    return ::operator new(static_cast<size_t>(items) * size, nothrow);
+}
+
+void ZFree(voidpf /*opaque*/, voidpf address) {
+    ::operator delete(address);
+}
+
+/*! zlib inflate state
+ *
+ * The state and the window that zlib allocates for a stream is
+ * about 40 KB. It is reset and used again for the next body
+ * rather than freed.
+ */
+struct InflateContext {
+    InflateContext() {
+        strm.zalloc = ZAlloc;
+        strm.zfree = ZFree;
+        if (inflateInit2(&strm, MAX_WBITS) != Z_OK) {
+            throw DecompressException("Failed to initialize decompression");
+        }
+    }
+
+    InflateContext(const InflateContext&) = delete;
+    InflateContext& operator = (const InflateContext&) = delete;
+
+    ~InflateContext() {
+        inflateEnd(&strm);
+    }
+
+    z_stream strm = {};
+};
+
+/*! Idle inflate contexts for one thread
+ *
+ * A reader gets its context from the pool of the thread that creates
+ * it, and returns it to the pool of the thread that deletes it. No
+ * locking is needed.
+ */
+class InflatePool {
+public:
+    using ptr_t = std::unique_ptr<InflateContext>;
+
+    // Most idle contexts we keep for one thread
+    static constexpr size_t max_idle = 8;
+
+    InflatePool() {
+        idle_.reserve(max_idle);
+    }
+
+    ptr_t Get(const int windowBits) {
+        ptr_t ctx;
+        if (idle_.empty()) {
+            ctx = make_unique<InflateContext>();
+        } else {
+            ctx = move(idle_.back());
+            idle_.pop_back();
+        }
+
+        // Keeps the window as long as the size is the same
+        if (inflateReset2(&ctx->strm, windowBits) != Z_OK) {
+            throw DecompressException("Failed to reset decompression");
+        }
+
+        // The reset leaves the buffers alone. They point into buffers of
+        // the last reader, which may have been deleted before it was done.
+        ctx->strm.next_in = nullptr;
+        ctx->strm.avail_in = 0;
+        ctx->strm.next_out = nullptr;
+        ctx->strm.avail_out = 0;
+
+        return ctx;
+    }
+
+    void Release(ptr_t&& ctx) noexcept {
+        if (idle_.size() < max_idle) {
+            idle_.push_back(move(ctx));
+        }
+    }
+
+    static InflatePool& GetForThisThread() {
+        static thread_local InflatePool pool;
+        return pool;
+    }
+
+private:
+    std::vector<ptr_t> idle_;
+};
+
+} // anonymous namespace
+
 class ZipReaderImpl : public DataReader {
 public:
     enum class Format { DEFLATE, GZIP };
 
     ZipReaderImpl(std::unique_ptr<DataReader>&& source,
-                const Format format)
-    : source_{move(source)}
+                const Format format, const size_t bufferSize)
+    : source_{move(source)}, buffer_size_{bufferSize}
+    , ctx_{InflatePool::GetForThisThread().Get(
+        (format == Format::GZIP) ? (MAX_WBITS | 16) : MAX_WBITS)}
+    , strm_{ctx_->strm}
     {
-        const auto wsize = (format == Format::GZIP) ? (MAX_WBITS | 16) : MAX_WBITS;
-
-        if (inflateInit2(&strm_, wsize) != Z_OK) {
-            throw DecompressException("Failed to initialize decompression");
-        }
     }
 
     ZipReaderImpl(const ZipReaderImpl&) = delete;
@@ -29,9 +124,8 @@ public:
     ZipReaderImpl& operator = (const ZipReaderImpl&) = delete;
     ZipReaderImpl& operator = (ZipReaderImpl&&) = delete;
 
-
     ~ZipReaderImpl() override {
-        inflateEnd(&strm_);
+        InflatePool::GetForThisThread().Release(move(ctx_));
     }
 
     bool IsEof() const override {
@@ -48,10 +142,30 @@ public:
     }
 
     boost::asio::const_buffers_1 ReadSome() override {
+        if (out_buffer_.empty()) {
+            // Smaller buffers share the size class of the I/O buffers
+            out_buffer_ = BufferPool::GetDefault().Borrow(
+                max<size_t>(buffer_size_, RESTC_CPP_IO_BUFFER_SIZE));
+        }
+
+        return {out_buffer_.data(), Inflate(out_buffer_.data(), buffer_size_)};
+    }
 
+    bool CanReadInto() const noexcept override {
+        return true;
+    }
+
+    size_t ReadInto(boost::asio::mutable_buffer buffer) override {
+        return Inflate(boost::asio::buffer_cast<char *>(buffer),
+                       boost::asio::buffer_size(buffer));
+    }
+
+private:
+    // Inflate into dst until it is full, or the stream ends
+    size_t Inflate(char *dst, const size_t dstLen) {
         size_t data_len = 0;
 
-        while(!done_) {
+        while(!done_ && (data_len < dstLen)) {
             boost::string_ref src;
             if (HaveMoreBufferedInput()) {
                 src = {};
@@ -66,22 +180,17 @@ public:
                 }
             }
 
-            boost::string_ref out = {out_buffer_.data() + data_len,
-                out_buffer_.size() - data_len};
+            boost::string_ref out = {dst + data_len, min<size_t>(
+                dstLen - data_len, numeric_limits<uInt>::max())};
 
             // Decompress sets leftover to cover unread input data
             Decompress(src, out);
             data_len += out.size();
-
-            if ((out_buffer_.size() - data_len) == 0) {
-                break;
-            }
         }
 
-        return {out_buffer_.data(), data_len};
+        return data_len;
     }
 
-private:
     void Decompress(boost::string_ref& src,
                     boost::string_ref& dst) {
 
@@ -139,23 +248,28 @@ private:
     }
 
     unique_ptr<DataReader> source_;
-    static constexpr size_t out_buffer_len_ = 1024*8;
-    array<char, out_buffer_len_> out_buffer_ = {};
-    z_stream strm_ = {};
+    const size_t buffer_size_;
+    InflatePool::ptr_t ctx_;
+    z_stream& strm_;
+    BufferPool::Buffer out_buffer_; // For ReadSome()
     bool done_ = false;
 };
 
 
 std::unique_ptr<DataReader>
-DataReader::CreateZipReader(std::unique_ptr<DataReader>&& source) {
+DataReader::CreateZipReader(std::unique_ptr<DataReader>&& source,
+                            size_t bufferSize) {
     return make_unique<ZipReaderImpl>(move(source),
-                                      ZipReaderImpl::Format::DEFLATE);
+                                      ZipReaderImpl::Format::DEFLATE,
+                                      bufferSize);
 }
 
 std::unique_ptr<DataReader>
-DataReader::CreateGzipReader(std::unique_ptr<DataReader>&& source) {
+DataReader::CreateGzipReader(std::unique_ptr<DataReader>&& source,
+                             size_t bufferSize) {
     return make_unique<ZipReaderImpl>(move(source),
-                                      ZipReaderImpl::Format::GZIP);
+                                      ZipReaderImpl::Format::GZIP,
+                                      bufferSize);
 }
 
 } // namepsace
@@ -0,0 +1,176 @@
+
+
+#include <zlib.h>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/DataWriter.h"
+#include "restc-cpp/logging.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+/*! Compress the data on its way to the next writer
+ *
+ * The data is deflated as it is written, so a body can be streamed
+ * through the compressor without being buffered. The size of the
+ * compressed body is not known up front, so the next writer should
+ * be a chunked writer.
+ */
+class ZipWriterImpl : public DataWriter {
+public:
+    enum class Format { DEFLATE, GZIP };
+
+    ZipWriterImpl(ptr_t&& source, const Format format, const int level)
+    : next_{move(source)}, format_{format}
+    {
+        const auto wsize = (format == Format::GZIP) ? (MAX_WBITS | 16) : MAX_WBITS;
+
+        if (deflateInit2(&strm_, level, Z_DEFLATED, wsize, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw CompressException("Failed to initialize compression");
+        }
+    }
+
+    ZipWriterImpl(const ZipWriterImpl&) = delete;
+    ZipWriterImpl(ZipWriterImpl&&) = delete;
+
+    ZipWriterImpl& operator = (const ZipWriterImpl&) = delete;
+    ZipWriterImpl& operator = (ZipWriterImpl&&) = delete;
+
+    ~ZipWriterImpl() override {
+        deflateEnd(&strm_);
+    }
+
+    void WriteDirect(boost::asio::const_buffers_1 buffers) override {
+        next_->WriteDirect(buffers);
+    }
+
+    /* The headers are held back until the compressor writes its first
+     * output, so that they go out in the same write as the compressed data.
+     */
+    void WriteDirectAndData(boost::asio::const_buffers_1 direct,
+                            const write_buffers_t& buffers) override {
+        pending_direct_ = direct;
+        have_pending_direct_ = true;
+        Write(buffers);
+    }
+
+    void Write(boost::asio::const_buffers_1 buffers) override {
+        Compress({boost::asio::buffer_cast<const char *>(buffers),
+                 boost::asio::buffer_size(buffers)}, Z_NO_FLUSH);
+    }
+
+    void Write(const write_buffers_t& buffers) override {
+        for(const auto& b : buffers) {
+            Compress({boost::asio::buffer_cast<const char *>(b),
+                     boost::asio::buffer_size(b)}, Z_NO_FLUSH);
+        }
+    }
+
+    void Finish() override {
+        Compress({}, Z_FINISH);
+        if (have_pending_direct_) {
+            have_pending_direct_ = false;
+            next_->WriteDirect(pending_direct_);
+        }
+        next_->Finish();
+    }
+
+    void SetHeaders(Request::headers_t& headers) override {
+        static const string content_encoding{"Content-Encoding"};
+        static const string gzip{"gzip"};
+        static const string deflate{"deflate"};
+
+        headers[content_encoding] = (format_ == Format::GZIP) ? gzip : deflate;
+
+        next_->SetHeaders(headers);
+    }
+
+private:
+    // Deflate src. The output is collected in out_buffer_, and written to
+    // the next writer when the buffer is full, or when we finish.
+    void Compress(boost::string_ref src, const int flush) {
+        if (src.empty() && (flush == Z_NO_FLUSH)) {
+            return;
+        }
+
+        strm_.next_in = const_cast<Bytef *>(
+            reinterpret_cast<const Bytef *>(src.data()));
+        strm_.avail_in = static_cast<decltype(strm_.avail_in)>(src.size());
+
+        int result = Z_OK;
+        do {
+            strm_.next_out = reinterpret_cast<Bytef *>(out_buffer_.data() + out_len_);
+            strm_.avail_out
+                = static_cast<decltype(strm_.avail_out)>(out_buffer_.size() - out_len_);
+
+            result = deflate(&strm_, flush);
+            if ((result != Z_OK) && (result != Z_STREAM_END)
+                && (result != Z_BUF_ERROR)) {
+                std::string errmsg = "Compression failed";
+                if (strm_.msg != nullptr) {
+                    errmsg += ": ";
+                    errmsg += strm_.msg;
+                }
+                throw CompressException(errmsg);
+            }
+
+            out_len_ = out_buffer_.size() - strm_.avail_out;
+            if (strm_.avail_out == 0) {
+                Flush();
+            }
+        } while((strm_.avail_out == 0) && (result != Z_STREAM_END));
+
+        assert(strm_.avail_in == 0);
+
+        if (flush == Z_FINISH) {
+            Flush();
+        }
+    }
+
+    void Flush() {
+        if (out_len_ == 0) {
+            return;
+        }
+
+        RESTC_CPP_LOG_TRACE_("ZipWriterImpl::Flush: " << out_len_
+            << " bytes out");
+
+        if (have_pending_direct_) {
+            have_pending_direct_ = false;
+            out_.resize(1);
+            out_[0] = {out_buffer_.data(), out_len_};
+            next_->WriteDirectAndData(pending_direct_, out_);
+        } else {
+            next_->Write({out_buffer_.data(), out_len_});
+        }
+        out_len_ = 0;
+    }
+
+    unique_ptr<DataWriter> next_;
+    const Format format_;
+    static constexpr size_t out_buffer_len_ = 1024*8;
+    array<char, out_buffer_len_> out_buffer_ = {};
+    size_t out_len_ = 0; // Compressed bytes in out_buffer_, not yet written
+    z_stream strm_ = {};
+    boost::asio::const_buffers_1 pending_direct_{nullptr, 0};
+    bool have_pending_direct_ = false;
+    write_buffers_t out_;
+};
+
+
+DataWriter::ptr_t
+DataWriter::CreateZipWriter(ptr_t&& source, int level) {
+    return make_unique<ZipWriterImpl>(move(source),
+                                      ZipWriterImpl::Format::DEFLATE, level);
+}
+
+DataWriter::ptr_t
+DataWriter::CreateGzipWriter(ptr_t&& source, int level) {
+    return make_unique<ZipWriterImpl>(move(source),
+                                      ZipWriterImpl::Format::GZIP, level);
+}
+
+} // namespace
+
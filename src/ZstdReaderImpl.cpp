@@ -0,0 +1,141 @@
+
+
+#include <zstd.h>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/DataReader.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/BufferPool.h"
+
+using namespace std;
+
+namespace restc_cpp {
+
+/*! Decode a zstd compressed body (RFC 8878)
+ *
+ * The body may hold more than one frame. It ends with the
+ * source when the last frame is complete.
+ */
+class ZstdReaderImpl : public DataReader {
+public:
+    ZstdReaderImpl(std::unique_ptr<DataReader>&& source, const size_t bufferSize)
+    : source_{move(source)}, buffer_size_{bufferSize}
+    , dstream_{ZSTD_createDStream()}
+    {
+        if (!dstream_ || ZSTD_isError(ZSTD_initDStream(dstream_))) {
+            ZSTD_freeDStream(dstream_);
+            throw DecompressException("Failed to initialize zstd decompression");
+        }
+    }
+
+    ZstdReaderImpl(const ZstdReaderImpl&) = delete;
+    ZstdReaderImpl(ZstdReaderImpl&&) = delete;
+
+    ZstdReaderImpl& operator = (const ZstdReaderImpl&) = delete;
+    ZstdReaderImpl& operator = (ZstdReaderImpl&&) = delete;
+
+    ~ZstdReaderImpl() override {
+        ZSTD_freeDStream(dstream_);
+    }
+
+    bool IsEof() const override {
+        return done_;
+    }
+
+    void Finish() override {
+        if (source_)
+            source_->Finish();
+    }
+
+    bool HaveMoreBufferedInput() const noexcept {
+        return in_.pos < in_.size;
+    }
+
+    boost::asio::const_buffers_1 ReadSome() override {
+        if (out_buffer_.empty()) {
+            // Smaller buffers share the size class of the I/O buffers
+            out_buffer_ = BufferPool::GetDefault().Borrow(
+                max<size_t>(buffer_size_, RESTC_CPP_IO_BUFFER_SIZE));
+        }
+
+        return {out_buffer_.data(), Decode(out_buffer_.data(), buffer_size_)};
+    }
+
+    bool CanReadInto() const noexcept override {
+        return true;
+    }
+
+    size_t ReadInto(boost::asio::mutable_buffer buffer) override {
+        return Decode(boost::asio::buffer_cast<char *>(buffer),
+                      boost::asio::buffer_size(buffer));
+    }
+
+private:
+    size_t Decode(char *dst, const size_t dstLen) {
+        size_t data_len = 0;
+
+        while(!done_ && (data_len < dstLen)) {
+            if (!HaveMoreBufferedInput() && !more_output_) {
+                if (data_len) {
+                    break; // Don't wait for more input when we have output
+                }
+
+                if (frame_done_ && source_->IsEof()) {
+                    done_ = true;
+                    break;
+                }
+
+                const auto buffers = source_->ReadSome();
+                in_.src = boost::asio::buffer_cast<const char *>(buffers);
+                in_.size = boost::asio::buffer_size(buffers);
+                in_.pos = 0;
+
+                if (!in_.size) {
+                    if (frame_done_ && source_->IsEof()) {
+                        done_ = true;
+                        break;
+                    }
+                    throw DecompressException("Decompression failed - premature end of stream.");
+                }
+            }
+
+            ZSTD_outBuffer out = {dst + data_len, dstLen - data_len, 0};
+
+            const auto result = ZSTD_decompressStream(dstream_, &out, &in_);
+            if (ZSTD_isError(result)) {
+                throw DecompressException(
+                    string("Decompression failed: ") + ZSTD_getErrorName(result));
+            }
+
+            // 0 means that a frame is complete, and all of it is flushed
+            frame_done_ = (result == 0);
+            // If the output is full, zstd may have more for us without more input
+            more_output_ = (out.pos == out.size);
+            data_len += out.pos;
+
+            RESTC_CPP_LOG_TRACE_("ZstdReaderImpl::Decode: dst=" << out.pos
+                << " bytes, frame done=" << frame_done_);
+        }
+
+        return data_len;
+    }
+
+    unique_ptr<DataReader> source_;
+    const size_t buffer_size_;
+    ZSTD_DStream *dstream_ = nullptr;
+    ZSTD_inBuffer in_ = {nullptr, 0, 0};
+    BufferPool::Buffer out_buffer_; // For ReadSome()
+    bool frame_done_ = false;
+    bool more_output_ = false;
+    bool done_ = false;
+};
+
+
+std::unique_ptr<DataReader>
+DataReader::CreateZstdReader(std::unique_ptr<DataReader>&& source,
+                             size_t bufferSize) {
+    return make_unique<ZstdReaderImpl>(move(source), bufferSize);
+}
+
+} // namespace
+
@@ -36,24 +36,28 @@ allchars_t get_normal_ch() {
 } // anonymous namespace
 
 std::string url_encode(const boost::string_ref& src) {
+    std::string rval;
+    rval.reserve(src.size() * 2);
+    url_encode(src, rval);
+    return rval;
+}
+
+void url_encode(const boost::string_ref& src, std::string& out) {
     constexpr auto magic_4 = 4;
     constexpr auto magic_0x0f = 0x0f;
 
     static const string hex{"0123456789ABCDEF"};
     static auto normal_ch = get_normal_ch();
-    std::string rval;
-    rval.reserve(src.size() * 2);
 
     for(auto ch : src) {
         if (normal_ch[static_cast<uint8_t>(ch)]) {
-            rval += ch;
+            out += ch;
         } else {
-            rval += '%';
-            rval += hex[(ch >> magic_4) & magic_0x0f];
-            rval += hex[ch & magic_0x0f];
+            out += '%';
+            out += hex[(ch >> magic_4) & magic_0x0f];
+            out += hex[ch & magic_0x0f];
         }
     }
-    return rval;
 }
 
 } // namespace
@@ -0,0 +1,151 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/BufferPool.h"
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+
+using namespace std;
+using namespace restc_cpp;
+
+TEST(BufferPool, SizeClasses) {
+    EXPECT_EQ(1024 * 4, BufferPool::GetClassSize(0));
+    EXPECT_EQ(1024 * 4, BufferPool::GetClassSize(1));
+    EXPECT_EQ(1024 * 4, BufferPool::GetClassSize(1024 * 4));
+    EXPECT_EQ(1024 * 8, BufferPool::GetClassSize(1024 * 4 + 1));
+    EXPECT_EQ(1024 * 16, BufferPool::GetClassSize(10000));
+    EXPECT_EQ(1024 * 1024, BufferPool::GetClassSize(1024 * 1024));
+
+    // Too large for the pool
+    EXPECT_EQ(1024 * 1024 + 1, BufferPool::GetClassSize(1024 * 1024 + 1));
+}
+
+TEST(BufferPool, BufferIsReused) {
+    BufferPool pool;
+
+    const char *data = nullptr;
+    {
+        auto buffer = pool.Borrow(10000);
+        EXPECT_EQ(1024 * 16, buffer.size());
+        data = buffer.data();
+        EXPECT_EQ(1024 * 16, pool.GetStats().inUse);
+    }
+
+    auto stats = pool.GetStats();
+    EXPECT_EQ(0, stats.inUse);
+    EXPECT_EQ(1024 * 16, stats.idle);
+    EXPECT_EQ(1, stats.allocated);
+    EXPECT_EQ(0, stats.reused);
+
+    // Same size class
+    auto buffer = pool.Borrow(1024 * 16);
+    EXPECT_EQ(data, buffer.data());
+
+    stats = pool.GetStats();
+    EXPECT_EQ(0, stats.idle);
+    EXPECT_EQ(1, stats.allocated);
+    EXPECT_EQ(1, stats.reused);
+
+    // Another size class
+    auto other = pool.Borrow(1024 * 32);
+    EXPECT_EQ(2, pool.GetStats().allocated);
+}
+
+TEST(BufferPool, HighWaterMark) {
+    BufferPool pool;
+
+    {
+        auto a = pool.Borrow(1024 * 4);
+        auto b = pool.Borrow(1024 * 8);
+        {
+            auto c = pool.Borrow(1024 * 16);
+        }
+        auto d = pool.Borrow(1024 * 4);
+        EXPECT_EQ(1024 * 16, pool.GetStats().inUse);
+    }
+
+    auto stats = pool.GetStats();
+    EXPECT_EQ(0, stats.inUse);
+    EXPECT_EQ(1024 * 28, stats.highWaterMark);
+
+    auto buffer = pool.Borrow(1024 * 4);
+    pool.ResetHighWaterMark();
+    EXPECT_EQ(1024 * 4, pool.GetStats().highWaterMark);
+}
+
+TEST(BufferPool, OversizedBuffer) {
+    BufferPool pool;
+
+    {
+        auto buffer = pool.Borrow(1024 * 1024 * 2);
+        EXPECT_EQ(1024 * 1024 * 2, buffer.size());
+        EXPECT_EQ(1024 * 1024 * 2, pool.GetStats().inUse);
+    }
+
+    // Counted, but not kept
+    auto stats = pool.GetStats();
+    EXPECT_EQ(0, stats.inUse);
+    EXPECT_EQ(0, stats.idle);
+    EXPECT_EQ(1024 * 1024 * 2, stats.highWaterMark);
+}
+
+TEST(BufferPool, MaxIdleBytes) {
+    BufferPool pool{1024 * 8};
+
+    {
+        auto a = pool.Borrow(1024 * 4);
+        auto b = pool.Borrow(1024 * 4);
+        auto c = pool.Borrow(1024 * 4);
+    }
+
+    EXPECT_EQ(1024 * 8, pool.GetStats().idle);
+}
+
+TEST(BufferPool, MoveBuffer) {
+    BufferPool pool;
+
+    auto a = pool.Borrow(100);
+    const auto *data = a.data();
+
+    BufferPool::Buffer b{std::move(a)};
+    EXPECT_TRUE(a.empty());
+    EXPECT_EQ(data, b.data());
+
+    a = pool.Borrow(100);
+    EXPECT_EQ(1024 * 8, pool.GetStats().inUse);
+
+    // Returns the buffer a had to the pool
+    a = std::move(b);
+    EXPECT_EQ(data, a.data());
+    EXPECT_EQ(1024 * 4, pool.GetStats().inUse);
+    EXPECT_EQ(1024 * 4, pool.GetStats().idle);
+
+    a.Release();
+    EXPECT_TRUE(a.empty());
+    EXPECT_EQ(0, pool.GetStats().inUse);
+}
+
+TEST(BufferPool, Trim) {
+    BufferPool pool;
+
+    {
+        auto a = pool.Borrow(1024 * 4);
+        auto b = pool.Borrow(1024 * 64);
+    }
+    EXPECT_EQ(1024 * 68, pool.GetStats().idle);
+
+    pool.Trim();
+    EXPECT_EQ(0, pool.GetStats().idle);
+
+    auto buffer = pool.Borrow(1024 * 4);
+    EXPECT_EQ(3, pool.GetStats().allocated);
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
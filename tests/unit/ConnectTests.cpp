@@ -0,0 +1,219 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "../src/DnsCacheImpl.h"
+#include "../src/HappyEyeballs.h"
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace restc_cpp;
+using namespace restc_cpp::unittests;
+
+namespace {
+
+using endpoint_t = boost::asio::ip::tcp::endpoint;
+using endpoints_t = std::vector<endpoint_t>;
+
+endpoint_t Ep(const char *address, unsigned short port = 80) {
+    return {boost::asio::ip::make_address(address), port};
+}
+
+// Answers each request with "OK"
+void ServeOk(TestServer::socket_t& socket) {
+    boost::asio::streambuf buffer;
+    while(true) {
+        TestServer::ReadHead(socket, buffer);
+        boost::asio::write(socket, boost::asio::buffer(
+            "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nOK"s));
+    }
+}
+
+// An endpoint where nobody listens, so the connect is refused
+endpoint_t RefusingEndpoint() {
+    boost::asio::io_service ioservice;
+    boost::asio::ip::tcp::acceptor acceptor{ioservice, Ep("127.0.0.1", 0)};
+    return acceptor.local_endpoint();
+}
+
+/* An endpoint where the connect never completes
+ *
+ * The listen queue is full, so the kernel drops the SYN packets.
+ */
+class HangingEndpoint {
+public:
+    HangingEndpoint()
+    : acceptor_{ioservice_, Ep("127.0.0.1", 0)}
+    , filler_{ioservice_}
+    {
+        acceptor_.listen(0);
+        filler_.connect(acceptor_.local_endpoint());
+    }
+
+    endpoint_t GetEndpoint() const {
+        return acceptor_.local_endpoint();
+    }
+
+    // Connects to the endpoint in progress in this process (Linux)
+    int CountConnecting() const {
+        char port[8];
+        snprintf(port, sizeof(port), ":%04X", acceptor_.local_endpoint().port());
+
+        std::ifstream tcp{"/proc/net/tcp"};
+        std::string line;
+        int count = 0;
+        while(getline(tcp, line)) {
+            std::istringstream fields{line};
+            std::string slot, local, remote, state;
+            fields >> slot >> local >> remote >> state;
+            if (boost::ends_with(remote, port) && (state == "02")) { // SYN_SENT
+                ++count;
+            }
+        }
+        return count;
+    }
+
+private:
+    boost::asio::io_service ioservice_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    boost::asio::ip::tcp::socket filler_;
+};
+
+// A client that resolves every host name to the endpoints
+unique_ptr<RestClient> CreateClient(endpoints_t endpoints, int delayMs,
+                                    int timeoutMs = 10000) {
+    auto properties = TestProperties();
+    properties.connectAttemptDelayMs = delayMs;
+    properties.connectTimeoutMs = timeoutMs;
+    auto client = RestClient::Create(properties);
+    SetResolveFn(*client->GetDnsCache(),
+                 [endpoints](const std::string&, const std::string&) {
+        return endpoints;
+    });
+    return client;
+}
+
+// Get "OK" from the host, and return how long it took
+chrono::milliseconds TimeGet(RestClient& client) {
+    const auto start = chrono::steady_clock::now();
+    client.ProcessWithPromise([&](Context& ctx) {
+        EXPECT_EQ("OK", ctx.Get("http://test.example/")->GetBodyAsString());
+    }).get();
+    return chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now() - start);
+}
+
+} // anon ns
+
+TEST(InterleaveFamilies, StartsWithFirstFamily) {
+    const endpoints_t endpoints = {
+        Ep("2001:db8::1"), Ep("2001:db8::2"), Ep("2001:db8::3"),
+        Ep("192.0.2.1"), Ep("192.0.2.2")};
+
+    const endpoints_t expected = {
+        Ep("2001:db8::1"), Ep("192.0.2.1"), Ep("2001:db8::2"),
+        Ep("192.0.2.2"), Ep("2001:db8::3")};
+
+    EXPECT_EQ(expected, InterleaveFamilies(endpoints));
+
+    const endpoints_t ipv4_first = {
+        Ep("192.0.2.1"), Ep("192.0.2.2"), Ep("2001:db8::1"), Ep("2001:db8::2")};
+
+    const endpoints_t ipv4_expected = {
+        Ep("192.0.2.1"), Ep("2001:db8::1"), Ep("192.0.2.2"), Ep("2001:db8::2")};
+
+    EXPECT_EQ(ipv4_expected, InterleaveFamilies(ipv4_first));
+}
+
+TEST(InterleaveFamilies, OneFamilyKeepsOrder) {
+    const endpoints_t endpoints = {
+        Ep("192.0.2.3"), Ep("192.0.2.1"), Ep("192.0.2.2")};
+
+    EXPECT_EQ(endpoints, InterleaveFamilies(endpoints));
+    EXPECT_TRUE(InterleaveFamilies({}).empty());
+}
+
+TEST(Connect, TriesOtherFamilySecond) {
+    std::unique_ptr<TestServer> ipv6;
+    try {
+        ipv6 = make_unique<TestServer>(ServeOk, boost::asio::ip::address_v6::loopback());
+    } catch(const boost::system::system_error&) {
+        GTEST_SKIP() << "No IPv6 loopback";
+    }
+
+    HangingEndpoint hanging;
+    TestServer ipv4{ServeOk};
+
+    // The second IPv4 address would answer, but the IPv6 address is tried before it
+    auto client = CreateClient({
+        hanging.GetEndpoint(), ipv4.GetEndpoint(), ipv6->GetEndpoint()}, 50);
+
+    TimeGet(*client);
+    EXPECT_EQ(1, ipv6->GetAccepts());
+    EXPECT_EQ(0, ipv4.GetAccepts());
+}
+
+TEST(Connect, FallsBackWhenRefused) {
+    TestServer server{ServeOk};
+    auto client = CreateClient(
+        {RefusingEndpoint(), server.GetEndpoint()}, 2000);
+
+    // The next address is tried as soon as the first one fails
+    EXPECT_LT(TimeGet(*client).count(), 1000);
+    EXPECT_EQ(1, server.GetAccepts());
+}
+
+TEST(Connect, StartsNextAttemptAfterDelay) {
+    HangingEndpoint hanging;
+    TestServer server{ServeOk};
+    auto client = CreateClient(
+        {hanging.GetEndpoint(), server.GetEndpoint()}, 200, 10000);
+
+    const auto elapsed = TimeGet(*client).count();
+    EXPECT_GE(elapsed, 200);
+    EXPECT_LT(elapsed, 2000);
+    EXPECT_EQ(1, server.GetAccepts());
+}
+
+TEST(Connect, FallsBackWhenTimesOut) {
+    HangingEndpoint hanging;
+    TestServer server{ServeOk};
+
+    // One attempt at the time, so the next only starts when the first times out
+    auto client = CreateClient(
+        {hanging.GetEndpoint(), server.GetEndpoint()}, 0, 300);
+
+    const auto elapsed = TimeGet(*client).count();
+    EXPECT_GE(elapsed, 300);
+    EXPECT_LT(elapsed, 3000);
+    EXPECT_EQ(1, server.GetAccepts());
+}
+
+TEST(Connect, ClosesLosingAttempts) {
+    HangingEndpoint hanging;
+    TestServer server{ServeOk};
+    auto client = CreateClient(
+        {hanging.GetEndpoint(), server.GetEndpoint()}, 50, 10000);
+
+    TimeGet(*client);
+    EXPECT_EQ(1, server.GetAccepts());
+
+    // The attempt to the hanging endpoint is not left to time out
+    EXPECT_EQ(0, hanging.CountConnecting());
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
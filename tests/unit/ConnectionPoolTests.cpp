@@ -0,0 +1,657 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/ConnectionPool.h"
+#include "restc-cpp/DnsCache.h"
+#include "restc-cpp/Socket.h"
+#include "restc-cpp/Url.h"
+
+#include "../src/DnsCacheImpl.h"
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace restc_cpp;
+using namespace restc_cpp::unittests;
+
+using namespace std::literals::chrono_literals;
+
+namespace {
+
+boost::asio::ip::tcp::endpoint MakeEp(unsigned int offset = 0, uint16_t port = 80) {
+    const auto addr = boost::asio::ip::address_v4::from_string("127.0.0.1").to_ulong();
+    return {boost::asio::ip::address_v4{static_cast<unsigned int>(addr + offset)}, port};
+}
+
+// A local port that accepts tcp connections (in the listen backlog)
+struct Listener {
+    Listener()
+    : acceptor{ioservice, {boost::asio::ip::address_v4::loopback(), 0}}
+    {
+        acceptor.listen();
+    }
+
+    std::string GetUrl() const {
+        return "http://127.0.0.1:"s + std::to_string(acceptor.local_endpoint().port());
+    }
+
+    boost::asio::io_service ioservice;
+    boost::asio::ip::tcp::acceptor acceptor;
+};
+
+// Connect the socket, so the pool will recycle the connection
+void OpenSocket(Connection& conn) {
+    static Listener listener;
+    auto& sck = conn.GetSocket().GetSocket();
+    if (!sck.is_open()) {
+        sck.connect(listener.acceptor.local_endpoint());
+    }
+}
+
+/* Answers the first request on a connection, and closes the
+ * connection when the next request arrives.
+ *
+ * So a connection from the pool passes the probe on checkout,
+ * but the request sent on it gets no reply.
+ */
+void ServeOnce(TestServer::socket_t& socket, std::atomic_int& heads) {
+    boost::asio::streambuf buffer;
+    const auto head = TestServer::ReadHead(socket, buffer);
+    ++heads;
+    TestServer::Skip(socket, buffer, TestServer::GetContentLength(head));
+    boost::asio::write(socket, boost::asio::buffer(
+        "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nOK"s));
+
+    TestServer::ReadHead(socket, buffer);
+    ++heads;
+    socket.shutdown(TestServer::socket_t::shutdown_both);
+    socket.close();
+}
+
+} // anon ns
+
+TEST(ConnectionPool, ReuseIdleConnection) {
+    auto rest_client = RestClient::Create();
+    auto pool = rest_client->GetConnectionPool();
+
+    auto conn = pool->GetConnection(MakeEp(), Connection::Type::HTTP);
+    OpenSocket(*conn);
+    const auto id = conn->GetId();
+    conn.reset();
+
+    EXPECT_EQ(1, static_cast<int>(pool->GetIdleConnections()));
+
+    conn = pool->GetConnection(MakeEp(), Connection::Type::HTTP);
+    EXPECT_EQ(id, conn->GetId());
+    EXPECT_EQ(0, static_cast<int>(pool->GetIdleConnections()));
+}
+
+TEST(ConnectionPool, ClosedConnectionIsDiscarded) {
+    auto rest_client = RestClient::Create();
+    auto pool = rest_client->GetConnectionPool();
+
+    auto conn = pool->GetConnection(MakeEp(), Connection::Type::HTTP);
+    conn.reset();
+
+    EXPECT_EQ(0, static_cast<int>(pool->GetIdleConnections()));
+}
+
+TEST(ConnectionPool, EndpointsAreSeparated) {
+    auto rest_client = RestClient::Create();
+    auto pool = rest_client->GetConnectionPool();
+
+    auto first = pool->GetConnection(MakeEp(0, 80), Connection::Type::HTTP);
+    OpenSocket(*first);
+    const auto id = first->GetId();
+    first.reset();
+
+    auto other_port = pool->GetConnection(MakeEp(0, 81), Connection::Type::HTTP);
+    EXPECT_NE(id, other_port->GetId());
+
+    auto other_type = pool->GetConnection(MakeEp(0, 80), Connection::Type::HTTPS);
+    EXPECT_NE(id, other_type->GetId());
+
+    auto same = pool->GetConnection(MakeEp(0, 80), Connection::Type::HTTP);
+    EXPECT_EQ(id, same->GetId());
+}
+
+TEST(ConnectionPool, MaxConnectionsToEndpoint) {
+    auto rest_client = RestClient::Create();
+    auto pool = rest_client->GetConnectionPool();
+    auto config = rest_client->GetConnectionProperties();
+
+    std::vector<Connection::ptr_t> connections;
+    for(size_t i = 0; i < config->cacheMaxConnectionsPerEndpoint; ++i) {
+        connections.push_back(pool->GetConnection(MakeEp(), Connection::Type::HTTP));
+    }
+
+    EXPECT_THROW(pool->GetConnection(MakeEp(), Connection::Type::HTTP),
+                 ConstraintException);
+
+    // Releasing one gives room for another one
+    connections.pop_back();
+    EXPECT_NO_THROW(connections.push_back(
+        pool->GetConnection(MakeEp(), Connection::Type::HTTP)));
+}
+
+TEST(ConnectionPool, MaxConnectionsPurgesIdle) {
+    auto rest_client = RestClient::Create();
+    auto pool = rest_client->GetConnectionPool();
+    auto config = rest_client->GetConnectionProperties();
+
+    std::vector<Connection::ptr_t> connections;
+    unsigned int i = 0;
+    for(; i < config->cacheMaxConnections; ++i) {
+        connections.push_back(pool->GetConnection(MakeEp(i), Connection::Type::HTTP));
+        OpenSocket(*connections.back());
+    }
+
+    EXPECT_THROW(pool->GetConnection(MakeEp(i), Connection::Type::HTTP),
+                 ConstraintException);
+
+    // An idle connection can be purged to make room for a new endpoint
+    connections.front().reset();
+    EXPECT_EQ(1, static_cast<int>(pool->GetIdleConnections()));
+    EXPECT_NO_THROW(connections.push_back(
+        pool->GetConnection(MakeEp(i), Connection::Type::HTTP)));
+    EXPECT_EQ(0, static_cast<int>(pool->GetIdleConnections()));
+}
+
+TEST(ConnectionPool, PurgesLeastRecentlyUsed) {
+    Request::Properties properties;
+    properties.cacheMaxConnections = 3;
+    auto rest_client = RestClient::Create(properties);
+    auto pool = rest_client->GetConnectionPool();
+
+    std::vector<Connection::ptr_t> connections;
+    std::vector<boost::uuids::uuid> ids;
+    for(unsigned int i = 0; i < 3; ++i) {
+        connections.push_back(pool->GetConnection(MakeEp(i), Connection::Type::HTTP));
+        OpenSocket(*connections.back());
+        ids.push_back(connections.back()->GetId());
+    }
+
+    // Release in the order 1, 0, 2
+    connections[1].reset();
+    connections[0].reset();
+    connections[2].reset();
+    EXPECT_EQ(3, static_cast<int>(pool->GetIdleConnections()));
+
+    // A new endpoint must purge the connection to endpoint 1
+    auto conn = pool->GetConnection(MakeEp(3), Connection::Type::HTTP);
+    EXPECT_EQ(2, static_cast<int>(pool->GetIdleConnections()));
+    EXPECT_EQ(ids[0], pool->GetConnection(MakeEp(0), Connection::Type::HTTP)->GetId());
+    EXPECT_EQ(ids[2], pool->GetConnection(MakeEp(2), Connection::Type::HTTP)->GetId());
+}
+
+TEST(ConnectionPool, PurgedConnectionIsNotExpired) {
+    Request::Properties properties;
+    properties.cacheMaxConnections = 2;
+    properties.cacheTtlSeconds = 0;
+    properties.cacheCleanupIntervalSeconds = 1;
+    auto rest_client = RestClient::Create(properties);
+    auto pool = rest_client->GetConnectionPool();
+
+    auto first = pool->GetConnection(MakeEp(0), Connection::Type::HTTP);
+    OpenSocket(*first);
+    auto second = pool->GetConnection(MakeEp(1), Connection::Type::HTTP);
+    OpenSocket(*second);
+    first.reset();
+
+    // Purges the connection to endpoint 0, before the cleanup gets to it
+    auto third = pool->GetConnection(MakeEp(2), Connection::Type::HTTP);
+    second.reset();
+
+    std::this_thread::sleep_for(2500ms);
+
+    const auto stats = pool->GetStats();
+    EXPECT_EQ(1, static_cast<int>(stats.purged));
+    EXPECT_EQ(1, static_cast<int>(stats.expired));
+    EXPECT_EQ(1, static_cast<int>(stats.connections));
+    EXPECT_EQ(0, static_cast<int>(stats.idle));
+}
+
+TEST(ConnectionPool, ReusePolicy) {
+    for(const auto policy : {Request::Properties::CacheReuse::FIFO,
+                             Request::Properties::CacheReuse::LIFO}) {
+        Request::Properties properties;
+        properties.cacheReuse = policy;
+        auto rest_client = RestClient::Create(properties);
+        auto pool = rest_client->GetConnectionPool();
+
+        auto first = pool->GetConnection(MakeEp(), Connection::Type::HTTP);
+        auto second = pool->GetConnection(MakeEp(), Connection::Type::HTTP);
+        OpenSocket(*first);
+        OpenSocket(*second);
+        const auto first_id = first->GetId();
+        const auto second_id = second->GetId();
+        first.reset();
+        second.reset();
+
+        auto conn = pool->GetConnection(MakeEp(), Connection::Type::HTTP);
+        EXPECT_EQ(policy == Request::Properties::CacheReuse::FIFO ? first_id : second_id,
+                  conn->GetId());
+    }
+}
+
+TEST(ConnectionPool, Warmup) {
+    Listener listener;
+    Request::Properties properties;
+    properties.cacheMaxConnectionsPerEndpoint = 3;
+    auto rest_client = RestClient::Create(properties);
+    auto pool = rest_client->GetConnectionPool();
+
+    auto f = rest_client->ProcessWithPromiseT<size_t>([&](Context& ctx) {
+        return pool->Warmup(listener.GetUrl(), 4, ctx);
+    });
+
+    EXPECT_EQ(3, static_cast<int>(f.get()));
+    EXPECT_EQ(3, static_cast<int>(pool->GetIdleConnections()));
+}
+
+TEST(ConnectionPool, WarmupUsesNextAddressWhenEndpointIsFull) {
+    Listener first, second;
+    Request::Properties properties;
+    properties.cacheMaxConnectionsPerEndpoint = 2;
+    auto rest_client = RestClient::Create(properties);
+    SetResolveFn(*rest_client->GetDnsCache(),
+                 [&](const std::string&, const std::string&) {
+        return DnsCache::endpoints_t{first.acceptor.local_endpoint(),
+                                     second.acceptor.local_endpoint()};
+    });
+    auto pool = rest_client->GetConnectionPool();
+
+    auto f = rest_client->ProcessWithPromiseT<size_t>([&](Context& ctx) {
+        return pool->Warmup("http://test.example", 3, ctx);
+    });
+
+    EXPECT_EQ(3, static_cast<int>(f.get()));
+    EXPECT_EQ(3, static_cast<int>(pool->GetIdleConnections()));
+}
+
+TEST(ConnectionPool, WarmupStopsWhenPoolIsFull) {
+    Listener first, second;
+    Request::Properties properties;
+    properties.cacheMaxConnectionsPerEndpoint = 2;
+    properties.cacheMaxConnections = 3;
+    auto rest_client = RestClient::Create(properties);
+    SetResolveFn(*rest_client->GetDnsCache(),
+                 [&](const std::string&, const std::string&) {
+        return DnsCache::endpoints_t{first.acceptor.local_endpoint(),
+                                     second.acceptor.local_endpoint()};
+    });
+    auto pool = rest_client->GetConnectionPool();
+
+    auto f = rest_client->ProcessWithPromiseT<size_t>([&](Context& ctx) {
+        return pool->Warmup("http://test.example", 10, ctx);
+    });
+
+    EXPECT_EQ(3, static_cast<int>(f.get()));
+    EXPECT_EQ(3, static_cast<int>(pool->GetIdleConnections()));
+}
+
+TEST(ConnectionPool, LookupByOrigin) {
+    auto rest_client = RestClient::Create();
+    auto pool = rest_client->GetConnectionPool();
+    const Request::Proxy no_proxy;
+    const auto origin = ConnectionPool::MakeOrigin(
+        Connection::Type::HTTP, "example.com", "80", no_proxy);
+
+    EXPECT_NE(origin, ConnectionPool::MakeOrigin(
+        Connection::Type::HTTPS, "example.com", "80", no_proxy));
+
+    rest_client->ProcessWithPromise([&](Context& ctx) {
+        EXPECT_FALSE(pool->GetIdleConnection(origin));
+
+        {
+            auto conn = pool->GetConnection(MakeEp(), Connection::Type::HTTP, ctx, origin);
+            OpenSocket(*conn);
+            // Not idle
+            EXPECT_FALSE(pool->GetIdleConnection(origin));
+        }
+
+        // Another host on the same endpoint must not get it
+        const auto other = ConnectionPool::MakeOrigin(
+            Connection::Type::HTTP, "example.org", "80", no_proxy);
+        EXPECT_FALSE(pool->GetIdleConnection(other));
+
+        auto conn = pool->GetIdleConnection(origin);
+        ASSERT_TRUE(conn);
+        EXPECT_TRUE(conn->GetSocket().IsOpen());
+        EXPECT_EQ(0, static_cast<int>(pool->GetIdleConnections()));
+    }).get();
+
+    // The index is cleaned up with the connection
+    rest_client->ProcessWithPromise([&](Context& ctx) {
+        {
+            auto conn = pool->GetIdleConnection(origin);
+            ASSERT_TRUE(conn);
+            conn->GetSocket().GetSocket().close();
+        }
+        EXPECT_FALSE(pool->GetIdleConnection(origin));
+    }).get();
+}
+
+TEST(ConnectionPool, WarmupIsFoundByOrigin) {
+    Listener listener;
+    auto rest_client = RestClient::Create();
+    auto pool = rest_client->GetConnectionPool();
+
+    rest_client->ProcessWithPromise([&](Context& ctx) {
+        EXPECT_EQ(1, static_cast<int>(pool->Warmup(listener.GetUrl(), 1, ctx)));
+    }).get();
+
+    const auto url_str = listener.GetUrl();
+    const Url url{url_str.c_str()};
+    auto conn = pool->GetIdleConnection(ConnectionPool::MakeOrigin(
+        Connection::Type::HTTP, url.GetHost().to_string(),
+        url.GetPort().to_string(), Request::Proxy{}));
+    EXPECT_TRUE(conn);
+}
+
+TEST(ConnectionPool, SelectLeastOutstandingEndpoint) {
+    auto rest_client = RestClient::Create();
+    auto pool = rest_client->GetConnectionPool();
+    const std::vector<boost::asio::ip::tcp::endpoint> endpoints{MakeEp(0), MakeEp(1)};
+    const auto select = [&] {
+        return static_cast<int>(pool->SelectEndpoint(endpoints, Connection::Type::HTTP));
+    };
+
+    EXPECT_EQ(0, static_cast<int>(pool->SelectEndpoint({MakeEp()}, Connection::Type::HTTP)));
+
+    {
+        auto first = pool->GetConnection(endpoints[0], Connection::Type::HTTP);
+        OpenSocket(*first);
+        for(int i = 0; i < 10; ++i) {
+            EXPECT_EQ(1, select());
+        }
+
+        auto second = pool->GetConnection(endpoints[1], Connection::Type::HTTP);
+        auto third = pool->GetConnection(endpoints[1], Connection::Type::HTTP);
+        OpenSocket(*second);
+        OpenSocket(*third);
+        for(int i = 0; i < 10; ++i) {
+            EXPECT_EQ(0, select());
+        }
+    }
+
+    // Idle connections don't count
+    EXPECT_EQ(3, static_cast<int>(pool->GetIdleConnections()));
+    auto conn = pool->GetConnection(endpoints[1], Connection::Type::HTTP);
+    for(int i = 0; i < 10; ++i) {
+        EXPECT_EQ(0, select());
+    }
+}
+
+TEST(ConnectionPool, MinIdlePerEndpoint) {
+    Listener listener;
+    Request::Properties properties;
+    properties.cacheTtlSeconds = 0;
+    properties.cacheCleanupIntervalSeconds = 1;
+    properties.cacheMinIdlePerEndpoint = 1;
+    auto rest_client = RestClient::Create(properties);
+    auto pool = rest_client->GetConnectionPool();
+
+    rest_client->ProcessWithPromise([&](Context& ctx) {
+        EXPECT_EQ(3, static_cast<int>(pool->Warmup(listener.GetUrl(), 3, ctx)));
+    }).get();
+
+    EXPECT_EQ(3, static_cast<int>(pool->GetIdleConnections()));
+    std::this_thread::sleep_for(2500ms);
+    EXPECT_EQ(1, static_cast<int>(pool->GetIdleConnections()));
+}
+
+TEST(ConnectionPool, MinIdlePerEndpointIsRestored) {
+    Listener listener;
+    Request::Properties properties;
+    properties.cacheCleanupIntervalSeconds = 1;
+    properties.cacheMinIdlePerEndpoint = 2;
+    auto rest_client = RestClient::Create(properties);
+    auto pool = rest_client->GetConnectionPool();
+
+    rest_client->ProcessWithPromise([&](Context& ctx) {
+        EXPECT_EQ(2, static_cast<int>(pool->Warmup(listener.GetUrl(), 2, ctx)));
+    }).get();
+
+    // Use the warm connections, and close them
+    for(int i = 0; i < 2; ++i) {
+        auto conn = pool->GetConnection(listener.acceptor.local_endpoint(),
+                                        Connection::Type::HTTP);
+        EXPECT_TRUE(conn->GetSocket().IsOpen());
+        conn->GetSocket().GetSocket().close();
+    }
+    EXPECT_EQ(0, static_cast<int>(pool->GetIdleConnections()));
+
+    std::this_thread::sleep_for(1500ms);
+    EXPECT_EQ(2, static_cast<int>(pool->GetIdleConnections()));
+    EXPECT_EQ(2, static_cast<int>(pool->GetStats().connections));
+}
+
+TEST(ConnectionPool, ClosedByServerIsDiscarded) {
+    Listener listener;
+    auto rest_client = RestClient::Create();
+    auto pool = rest_client->GetConnectionPool();
+
+    rest_client->ProcessWithPromise([&](Context& ctx) {
+        EXPECT_EQ(1, static_cast<int>(pool->Warmup(listener.GetUrl(), 1, ctx)));
+    }).get();
+    EXPECT_EQ(1, static_cast<int>(pool->GetIdleConnections()));
+
+    boost::asio::ip::tcp::socket server{listener.ioservice};
+    listener.acceptor.accept(server);
+    server.close();
+    std::this_thread::sleep_for(50ms);
+
+    auto conn = pool->GetConnection(listener.acceptor.local_endpoint(),
+                                    Connection::Type::HTTP);
+    EXPECT_FALSE(conn->GetSocket().IsOpen());
+    EXPECT_EQ(0, static_cast<int>(pool->GetIdleConnections()));
+}
+
+TEST(ConnectionPool, ReplaysIdempotentRequestOnce) {
+    std::atomic_int heads{0};
+    TestServer server{[&](TestServer::socket_t& socket) { ServeOnce(socket, heads); }};
+    auto rest_client = RestClient::Create(TestProperties());
+
+    rest_client->ProcessWithPromise([&](Context& ctx) {
+        EXPECT_EQ("OK", ctx.Get(server.GetUrl("/"))->GetBodyAsString());
+
+        // Sent on the pooled connection, and again on a new one
+        EXPECT_EQ("OK", ctx.Get(server.GetUrl("/"))->GetBodyAsString());
+    }).get();
+
+    EXPECT_EQ(2, server.GetAccepts());
+    EXPECT_EQ(3, static_cast<int>(heads));
+}
+
+TEST(ConnectionPool, DoesNotReplayPost) {
+    std::atomic_int heads{0};
+    TestServer server{[&](TestServer::socket_t& socket) { ServeOnce(socket, heads); }};
+    auto rest_client = RestClient::Create(TestProperties());
+
+    rest_client->ProcessWithPromise([&](Context& ctx) {
+        EXPECT_EQ("OK", ctx.Get(server.GetUrl("/"))->GetBodyAsString());
+
+        EXPECT_THROW(ctx.Post(server.GetUrl("/"), "data"s), boost::system::system_error);
+    }).get();
+
+    EXPECT_EQ(1, server.GetAccepts());
+    EXPECT_EQ(2, static_cast<int>(heads));
+}
+
+TEST(ConnectionPool, Stats) {
+    Request::Properties properties;
+    properties.cacheMaxConnectionsPerEndpoint = 1;
+    auto rest_client = RestClient::Create(properties);
+    auto pool = rest_client->GetConnectionPool();
+
+    auto conn = pool->GetConnection(MakeEp(), Connection::Type::HTTP);
+    OpenSocket(*conn);
+    EXPECT_THROW(pool->GetConnection(MakeEp(), Connection::Type::HTTP),
+                 ConstraintException);
+
+    auto other = pool->GetConnection(MakeEp(1), Connection::Type::HTTP);
+    other.reset(); // Not connected, so it's discarded
+
+    auto stats = pool->GetStats(true);
+    EXPECT_EQ(0, static_cast<int>(stats.hits));
+    EXPECT_EQ(3, static_cast<int>(stats.misses));
+    EXPECT_EQ(2, static_cast<int>(stats.created));
+    EXPECT_EQ(1, static_cast<int>(stats.rejected));
+    EXPECT_EQ(1, static_cast<int>(stats.discarded));
+    EXPECT_EQ(1, static_cast<int>(stats.connections));
+    ASSERT_EQ(1, static_cast<int>(stats.endpoints.size()));
+    EXPECT_EQ(MakeEp(), stats.endpoints.front().endpoint);
+    EXPECT_EQ(1, static_cast<int>(stats.endpoints.front().inUse));
+    EXPECT_EQ(0, static_cast<int>(stats.endpoints.front().idle));
+
+    conn.reset();
+    conn = pool->GetConnection(MakeEp(), Connection::Type::HTTP);
+    stats = pool->GetStats();
+    EXPECT_EQ(1, static_cast<int>(stats.hits));
+    EXPECT_TRUE(stats.endpoints.empty());
+}
+
+TEST(ConnectionPool, WaitForReleasedConnection) {
+    Request::Properties properties;
+    properties.cacheMaxConnectionsPerEndpoint = 1;
+    properties.cacheWaitTimeoutMs = 2000;
+    auto rest_client = RestClient::Create(properties);
+    auto pool = rest_client->GetConnectionPool();
+
+    boost::uuids::uuid first_id = {}, second_id = {};
+
+    auto first = rest_client->ProcessWithPromise([&](Context& ctx) {
+        auto conn = pool->GetConnection(MakeEp(), Connection::Type::HTTP, ctx);
+        OpenSocket(*conn);
+        first_id = conn->GetId();
+        ctx.Sleep(100ms);
+    });
+
+    auto second = rest_client->ProcessWithPromise([&](Context& ctx) {
+        const auto start = std::chrono::steady_clock::now();
+        auto conn = pool->GetConnection(MakeEp(), Connection::Type::HTTP, ctx);
+        const auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        second_id = conn->GetId();
+        EXPECT_CLOSE(100, waited, 50);
+    });
+
+    EXPECT_NO_THROW(first.get());
+    EXPECT_NO_THROW(second.get());
+    EXPECT_EQ(first_id, second_id);
+    EXPECT_EQ(1, static_cast<int>(pool->GetIdleConnections()));
+}
+
+TEST(ConnectionPool, WaitForDiscardedConnectionSlot) {
+    Request::Properties properties;
+    properties.cacheMaxConnectionsPerEndpoint = 1;
+    properties.cacheWaitTimeoutMs = 2000;
+    auto rest_client = RestClient::Create(properties);
+    auto pool = rest_client->GetConnectionPool();
+
+    boost::uuids::uuid first_id = {}, second_id = {};
+
+    auto first = rest_client->ProcessWithPromise([&](Context& ctx) {
+        auto conn = pool->GetConnection(MakeEp(), Connection::Type::HTTP, ctx);
+        first_id = conn->GetId();
+        ctx.Sleep(50ms);
+    });
+
+    auto second = rest_client->ProcessWithPromise([&](Context& ctx) {
+        auto conn = pool->GetConnection(MakeEp(), Connection::Type::HTTP, ctx);
+        second_id = conn->GetId();
+    });
+
+    EXPECT_NO_THROW(first.get());
+    EXPECT_NO_THROW(second.get());
+    EXPECT_NE(first_id, second_id);
+}
+
+TEST(ConnectionPool, WaitForConnectionTimesOut) {
+    Request::Properties properties;
+    properties.cacheMaxConnectionsPerEndpoint = 1;
+    properties.cacheWaitTimeoutMs = 100;
+    auto rest_client = RestClient::Create(properties);
+    auto pool = rest_client->GetConnectionPool();
+
+    auto busy = pool->GetConnection(MakeEp(), Connection::Type::HTTP);
+
+    auto f = rest_client->ProcessWithPromise([&](Context& ctx) {
+        const auto start = std::chrono::steady_clock::now();
+        EXPECT_THROW(pool->GetConnection(MakeEp(), Connection::Type::HTTP, ctx),
+                     ConstraintException);
+        const auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        EXPECT_CLOSE(100, waited, 50);
+    });
+
+    EXPECT_NO_THROW(f.get());
+
+    // The timed out waiter must not be handed the connection
+    busy.reset();
+    EXPECT_EQ(0, static_cast<int>(pool->GetIdleConnections()));
+}
+
+/* Not really a unit test, but a benchmark that checks out and returns
+ * connections from a number of threads in parallel.
+ *
+ * It is disabled. Run it with --gtest_also_run_disabled_tests
+ */
+TEST(ConnectionPool, DISABLED_ContentionBenchmark) {
+    constexpr size_t iterations = 20000;
+    constexpr unsigned int endpoints = 8;
+
+    for(const size_t num_threads : {1, 4, 16}) {
+        Request::Properties properties;
+        properties.cacheMaxConnectionsPerEndpoint = num_threads;
+        properties.cacheMaxConnections = num_threads * endpoints;
+
+        auto rest_client = RestClient::Create(properties);
+        auto pool = rest_client->GetConnectionPool();
+
+        std::atomic_size_t failures{0};
+        std::vector<std::thread> threads;
+        const auto start = std::chrono::steady_clock::now();
+        for(size_t t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&, t] {
+                for(size_t i = 0; i < iterations; ++i) {
+                    try {
+                        auto conn = pool->GetConnection(
+                            MakeEp(static_cast<unsigned int>((i + t) % endpoints)),
+                            Connection::Type::HTTP);
+                        OpenSocket(*conn);
+                    } catch(const std::exception&) {
+                        ++failures;
+                    }
+                }
+            });
+        }
+
+        for(auto& thd : threads) {
+            thd.join();
+        }
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        const auto ops = num_threads * iterations;
+
+        std::clog << "ConnectionPool: " << num_threads << " thread(s), "
+            << ops << " checkouts in " << (elapsed / 1000) << " ms ("
+            << (ops * 1000000 / std::max<decltype(elapsed)>(elapsed, 1))
+            << " checkouts/sec)" << std::endl;
+
+        EXPECT_EQ(0, static_cast<int>(failures));
+        EXPECT_GE(properties.cacheMaxConnections, pool->GetIdleConnections());
+    }
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
@@ -0,0 +1,344 @@
+
+// Include before boost::log headers
+#include "restc-cpp/logging.h"
+
+#include "restc-cpp/DataWriter.h"
+#include "../src/ReplyImpl.h"
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace restc_cpp;
+using namespace restc_cpp::unittests;
+
+namespace {
+
+// The body that the test vectors are compressed from
+std::string Body() {
+    std::string body;
+    for(int i = 0; i < 200; ++i) {
+        body += "line " + to_string(i)
+            + ": The quick brown fox jumps over the lazy dog\n";
+    }
+    return body;
+}
+
+#ifdef RESTC_CPP_WITH_ZSTD
+// 377 bytes
+const unsigned char zstd_body[] = {
+    0x28, 0xb5, 0x2f, 0xfd, 0x60, 0xc2, 0x28, 0x7d, 0x0b, 0x00, 0x76, 0x16,
+    0x38, 0x19, 0x60, 0x57, 0xb1, 0x01, 0x0f, 0x25, 0x3d, 0x94, 0xf4, 0x08,
+    0x0a, 0xea, 0x29, 0x0a, 0x6a, 0x44, 0x76, 0x77, 0xef, 0xe4, 0x80, 0x05,
+    0x22, 0x95, 0xae, 0x3e, 0x00, 0x2c, 0x00, 0x2a, 0x00, 0x56, 0x37, 0xd5,
+    0x6a, 0xe2, 0x59, 0xdd, 0xf4, 0xd5, 0xc4, 0xb3, 0xba, 0x4d, 0x5e, 0x4d,
+    0x3c, 0xab, 0x1b, 0x80, 0x80, 0x18, 0x1c, 0xcd, 0x66, 0xd0, 0x70, 0x9e,
+    0x44, 0xc5, 0x99, 0x3c, 0x17, 0x88, 0x43, 0x89, 0x38, 0x2c, 0x0b, 0x27,
+    0x03, 0x39, 0x38, 0x0f, 0x0c, 0x64, 0x42, 0x70, 0x18, 0x05, 0x85, 0x45,
+    0xe2, 0x3c, 0x09, 0x81, 0x13, 0x20, 0xe7, 0x79, 0x28, 0x1a, 0x01, 0xa4,
+    0x94, 0x84, 0x74, 0x64, 0x54, 0x74, 0x32, 0x91, 0x57, 0x13, 0xcf, 0xea,
+    0xa6, 0x5d, 0x4d, 0x3c, 0xab, 0x9b, 0x74, 0x35, 0xf1, 0xac, 0x6e, 0xca,
+    0xd5, 0xc4, 0xb3, 0xba, 0x09, 0x57, 0x13, 0xcf, 0xea, 0xa6, 0x5b, 0x4d,
+    0x3c, 0xab, 0x9b, 0x6c, 0x35, 0xf1, 0x02, 0x57, 0xf7, 0xf3, 0xd1, 0xad,
+    0xa9, 0xa5, 0xa1, 0x9d, 0x99, 0x95, 0xdd, 0x6c, 0x64, 0x5b, 0x5a, 0x59,
+    0x58, 0x57, 0x56, 0x55, 0x2f, 0x17, 0xd5, 0x5e, 0x9f, 0xc7, 0xdf, 0xed,
+    0xf5, 0xdf, 0xa7, 0xaf, 0xd5, 0x69, 0xf4, 0xd9, 0x5c, 0xbe, 0x6d, 0xf2,
+    0x06, 0xd6, 0xcd, 0xc5, 0xbd, 0xb5, 0xad, 0xfd, 0x7a, 0x69, 0x57, 0x55,
+    0x53, 0xf1, 0xd4, 0x2e, 0xbd, 0x5a, 0x49, 0x37, 0x35, 0x33, 0x31, 0x2f,
+    0x2d, 0x2b, 0x9f, 0x4e, 0xca, 0x45, 0xc5, 0x44, 0xc4, 0x43, 0xc3, 0xc2,
+    0xa3, 0x91, 0x70, 0x4f, 0x2f, 0x0f, 0xef, 0xce, 0x02, 0x80, 0xc8, 0xa8,
+    0x11, 0xe0, 0xf5, 0xf6, 0xff, 0x0d, 0xe0, 0x99, 0xb6, 0x03, 0x12, 0x48,
+    0x10, 0xf8, 0xff, 0xff, 0x11, 0xfc, 0x01, 0x6d, 0x14, 0x64, 0x84, 0x88,
+    0x88, 0x88, 0x94, 0x44, 0x08, 0xb2, 0x89, 0xa1, 0x40, 0x46, 0xcc, 0xcc,
+    0xcc, 0xcc, 0x9c, 0x99, 0x99, 0x19, 0x33, 0x33, 0x33, 0x33, 0x66, 0x66,
+    0x66, 0x86, 0x99, 0x99, 0x99, 0x19, 0x33, 0x33, 0x33, 0x63, 0x66, 0x66,
+    0x66, 0xc6, 0xcc, 0xcc, 0xcc, 0x98, 0x99, 0x99, 0x99, 0x31, 0x66, 0x66,
+    0x66, 0xcc, 0xcc, 0x51, 0x81, 0x32, 0xc8, 0x21, 0x32, 0x32, 0x33, 0x43,
+    0x46, 0x44, 0x84, 0x88, 0xc0, 0x8c, 0x08, 0x11, 0x22, 0x02, 0x63, 0x44,
+    0x44, 0x44, 0x04, 0xcc, 0x88, 0x88, 0x10, 0x11, 0x98, 0x11, 0x21, 0x22,
+    0x22, 0x30, 0x46, 0x44, 0x88, 0x88, 0x80, 0x19, 0x11, 0x11, 0x22, 0x02,
+    0x33, 0x22, 0x44, 0x44, 0x18, 0xe0, 0x80, 0x00, 0x11, 0x11, 0x91, 0xd1,
+    0x1d, 0x5d, 0x80, 0xac, 0x02,
+};
+
+// The first and the second half of the body in separate frames
+// 420 bytes
+const unsigned char zstd_two_frames[] = {
+    0x28, 0xb5, 0x2f, 0xfd, 0x60, 0xe1, 0x13, 0x7d, 0x06, 0x00, 0x82, 0xc9,
+    0x1d, 0x1e, 0x60, 0x55, 0xd3, 0x06, 0x63, 0xcc, 0xe8, 0xa4, 0x3a, 0x68,
+    0x70, 0xa8, 0xad, 0xc5, 0xe3, 0xc4, 0x15, 0x45, 0xc0, 0xcb, 0xee, 0xee,
+    0xee, 0x45, 0x08, 0x28, 0x08, 0x20, 0xcd, 0x01, 0xc9, 0xbb, 0xbb, 0xbb,
+    0xbb, 0xbb, 0x99, 0x99, 0x99, 0x99, 0x99, 0x77, 0x77, 0x77, 0x77, 0x77,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x33, 0x33, 0x33, 0x33, 0x33, 0x11, 0x11,
+    0x11, 0x11, 0x11, 0xef, 0xee, 0xee, 0xee, 0xee, 0xcc, 0xcc, 0xcc, 0xcc,
+    0xcc, 0xfe, 0xff, 0xff, 0xdf, 0xbc, 0x9a, 0x78, 0xf6, 0xc1, 0x22, 0x25,
+    0x8a, 0xa0, 0xc0, 0xc0, 0x14, 0x52, 0x00, 0xca, 0x41, 0x01, 0xa9, 0x22,
+    0x0f, 0xc7, 0xc3, 0xa8, 0x81, 0xa4, 0xa8, 0x46, 0x20, 0x39, 0x87, 0x6a,
+    0x20, 0x96, 0x07, 0x52, 0x48, 0x29, 0x14, 0x21, 0x29, 0xd4, 0x2c, 0x4c,
+    0x65, 0xa8, 0x21, 0xf8, 0xf6, 0xff, 0x0e, 0xc0, 0x33, 0x4a, 0xd7, 0x12,
+    0x48, 0x10, 0xf8, 0xff, 0xff, 0x11, 0xfc, 0x01, 0x99, 0x4a, 0x22, 0x92,
+    0x4c, 0x12, 0x99, 0x44, 0x22, 0x91, 0x24, 0x92, 0x44, 0x92, 0x91, 0x24,
+    0x92, 0x44, 0x92, 0x98, 0x24, 0x92, 0x88, 0x24, 0x91, 0x49, 0x24, 0x89,
+    0x24, 0x91, 0x4c, 0x24, 0x89, 0x24, 0x91, 0x3c, 0x15, 0x64, 0x28, 0x30,
+    0x13, 0x24, 0x12, 0x98, 0x08, 0x12, 0x08, 0xcc, 0x03, 0x89, 0x03, 0xea,
+    0xd2, 0x40, 0xc4, 0x00, 0x00, 0x00, 0x08, 0x30, 0x90, 0x4b, 0x17, 0xd0,
+    0xaa, 0x28, 0xb5, 0x2f, 0xfd, 0x60, 0xe1, 0x13, 0x0d, 0x06, 0x00, 0x12,
+    0x8a, 0x1e, 0x1c, 0x50, 0xc5, 0xa6, 0x03, 0x7c, 0xd4, 0xd8, 0x1a, 0xe9,
+    0x37, 0xc6, 0x45, 0xa3, 0x3f, 0x83, 0x98, 0x99, 0x3c, 0x91, 0x64, 0x37,
+    0x79, 0x18, 0x8c, 0xaa, 0x31, 0xba, 0x09, 0xef, 0xcd, 0xab, 0x89, 0x67,
+    0xff, 0xde, 0xbc, 0x9a, 0x78, 0xe6, 0xef, 0xcd, 0xab, 0x89, 0x67, 0xfd,
+    0xde, 0xbc, 0x9a, 0x78, 0xc6, 0xef, 0xcd, 0xab, 0x89, 0x67, 0xfb, 0xde,
+    0xbc, 0x9a, 0x78, 0xa6, 0xef, 0xcd, 0xab, 0x89, 0x67, 0xf9, 0xde, 0xbc,
+    0x9a, 0x78, 0x86, 0xef, 0xcd, 0xab, 0x89, 0x67, 0xf7, 0xde, 0xbc, 0x9a,
+    0xc8, 0x04, 0x12, 0xe9, 0x50, 0x00, 0x01, 0x04, 0xa6, 0x90, 0x02, 0x29,
+    0x07, 0x45, 0x52, 0x3d, 0x1a, 0x8c, 0x47, 0x51, 0x93, 0x84, 0xa8, 0x46,
+    0x92, 0x9c, 0x42, 0x2d, 0x0c, 0xcb, 0xe3, 0x28, 0xa4, 0x0c, 0x4a, 0x70,
+    0x76, 0x85, 0x9a, 0x25, 0x63, 0xa8, 0x11, 0xa0, 0x5f, 0xff, 0xef, 0xe0,
+    0x37, 0x03, 0x12, 0x50, 0x10, 0xf8, 0xff, 0xff, 0x04, 0x01, 0xfe, 0x4b,
+    0x92, 0x44, 0x9a, 0x42, 0x25, 0x49, 0xa2, 0x4a, 0x4a, 0x92, 0xa4, 0xa2,
+    0x52, 0x92, 0x24, 0x15, 0x25, 0x25, 0x49, 0x52, 0x51, 0x52, 0x92, 0x24,
+    0x15, 0x25, 0x25, 0x49, 0x52, 0x51, 0x29, 0x49, 0x92, 0x8a, 0x92, 0x92,
+    0x24, 0xa9, 0x50, 0x29, 0x49, 0x92, 0xb4, 0x66, 0xb7, 0x0c, 0x48, 0x55,
+};
+#endif // RESTC_CPP_WITH_ZSTD
+
+#ifdef RESTC_CPP_WITH_BROTLI
+// 299 bytes
+const unsigned char brotli_body[] = {
+    0x1b, 0xc1, 0x29, 0x00, 0x9c, 0x09, 0x36, 0x4e, 0xa8, 0x77, 0x37, 0x3c,
+    0x55, 0xa7, 0x90, 0xc6, 0x2f, 0x87, 0xf1, 0x6a, 0x68, 0x0d, 0x72, 0x86,
+    0xa7, 0xa7, 0xc2, 0xde, 0x1a, 0x44, 0x61, 0x2e, 0x2f, 0x45, 0x7a, 0x01,
+    0xd8, 0xe0, 0x22, 0xb4, 0xa0, 0x4d, 0xea, 0x15, 0xfd, 0xf8, 0xdb, 0x79,
+    0x0e, 0xfb, 0xdd, 0x92, 0xc8, 0xb1, 0xb6, 0xd8, 0x43, 0x55, 0xb6, 0xbd,
+    0xf7, 0x79, 0xf4, 0xbe, 0xc9, 0x73, 0xc7, 0xed, 0xfb, 0xfb, 0x5e, 0xd3,
+    0x69, 0x68, 0x6a, 0x69, 0xeb, 0xe8, 0xd6, 0xa3, 0x57, 0xdf, 0x3c, 0xc6,
+    0x30, 0x0e, 0x70, 0x72, 0x71, 0xf3, 0xf0, 0xe6, 0xc3, 0x57, 0x5f, 0xce,
+    0xe2, 0xe0, 0xe4, 0xe2, 0xe6, 0xe1, 0xcd, 0x87, 0xaf, 0xbe, 0x5c, 0xc5,
+    0xc1, 0xc9, 0xc5, 0xcd, 0xc3, 0x9b, 0x0f, 0x5f, 0x7d, 0xb9, 0x8b, 0x83,
+    0x93, 0x8b, 0x9b, 0x87, 0x37, 0x1f, 0xbe, 0xfa, 0xf2, 0x14, 0x07, 0x27,
+    0x17, 0x37, 0x0f, 0x6f, 0x3e, 0x7c, 0xf5, 0xe5, 0x5d, 0x1c, 0x9c, 0x5c,
+    0xdc, 0x3c, 0xbc, 0xf9, 0xf0, 0xd5, 0x97, 0x4f, 0x71, 0x70, 0x72, 0x71,
+    0xf3, 0xf0, 0xe6, 0xc3, 0x57, 0x5f, 0xbe, 0xc5, 0xc1, 0xc9, 0xc5, 0xcd,
+    0xc3, 0x9b, 0x0f, 0x5f, 0x7d, 0xf9, 0x15, 0x07, 0x27, 0x17, 0x37, 0x0f,
+    0x6f, 0x3e, 0x7c, 0x7f, 0xf8, 0x52, 0xcd, 0x17, 0x3c, 0x3c, 0xbd, 0xbc,
+    0x7d, 0x7c, 0xfb, 0xf1, 0xcb, 0xaf, 0x47, 0x79, 0x78, 0x7a, 0x79, 0xfb,
+    0xf8, 0xf6, 0xe3, 0x97, 0x5f, 0xcf, 0xf2, 0xf0, 0xf4, 0xf2, 0xf6, 0xf1,
+    0xed, 0xc7, 0x2f, 0xbf, 0x5e, 0xe5, 0xe1, 0xe9, 0xe5, 0xed, 0xe3, 0xdb,
+    0x8f, 0x5f, 0x7e, 0xbd, 0xcb, 0xc3, 0xd3, 0xcb, 0xdb, 0xc7, 0xb7, 0x1f,
+    0xbf, 0xfc, 0xfa, 0x94, 0x87, 0xa7, 0x97, 0xb7, 0x8f, 0x6f, 0x3f, 0x7e,
+    0xf9, 0xf5, 0x5d, 0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0xfd, 0xf8, 0xe5,
+    0xd7, 0x4f, 0x79, 0x78, 0x7a, 0x79, 0xfb, 0xf8, 0xf6, 0xe3, 0x97, 0x5f,
+    0xbf, 0xe5, 0xe1, 0xe9, 0xe5, 0xed, 0xe3, 0xdb, 0x8f, 0x5f, 0x7e, 0xfd,
+    0x95, 0x87, 0xa7, 0x97, 0xb7, 0x8f, 0x6f, 0x3f, 0x7e, 0xe1, 0x01,
+};
+#endif // RESTC_CPP_WITH_BROTLI
+
+template <size_t len>
+std::string ToString(const unsigned char (&data)[len]) {
+    return {reinterpret_cast<const char *>(data), len};
+}
+
+std::string ReadAll(DataReader& reader) {
+    std::string rval;
+    while(!reader.IsEof()) {
+        const auto b = reader.ReadSome();
+        rval.append(boost::asio::buffer_cast<const char *>(b),
+                    boost::asio::buffer_size(b));
+    }
+    return rval;
+}
+
+class TestReply : public ReplyImpl
+{
+public:
+    TestReply(Context& ctx, RestClient& owner, std::string reply)
+    : ReplyImpl(nullptr, ctx, owner, Request::Type::GET), reply_{move(reply)}
+    {
+    }
+
+    void SimulateServerReply() {
+        StartReceiveFromServer(make_unique<MockReader>(reply_, 100));
+    }
+
+private:
+    const std::string reply_;
+};
+
+using read_fn_t = std::function<std::string (Reply&)>;
+
+std::string GetReplyBody(const std::string& encoding, const std::string& body,
+                         const read_fn_t& read = [](Reply& reply) {
+                             return reply.GetBodyAsString();
+                         }) {
+    auto client = RestClient::Create();
+    return client->ProcessWithPromiseT<std::string>([&](Context& ctx) {
+        TestReply reply(ctx, *client, "HTTP/1.1 200 OK\r\n"
+            + (encoding.empty() ? ""s : "Content-Encoding: " + encoding + "\r\n")
+            + "Content-Length: " + to_string(body.size()) + "\r\n\r\n" + body);
+        reply.SimulateServerReply();
+        return read(reply);
+    }).get();
+}
+
+// Read the body with ReadInto() into a small buffer
+std::string ReadInPieces(Reply& reply) {
+    std::string rval;
+    std::array<char, 100> buffer;
+    while(reply.MoreDataToRead()) {
+        const auto len = reply.ReadInto(boost::asio::buffer(buffer));
+        EXPECT_LE(len, buffer.size());
+        rval.append(buffer.data(), len);
+    }
+    return rval;
+}
+
+#ifdef RESTC_CPP_WITH_ZLIB
+std::string Gzip(const std::string& data) {
+    std::string rval;
+
+    auto writer = DataWriter::CreateGzipWriter(make_unique<StringWriter>(rval));
+    writer->Write({data.data(), data.size()});
+    writer->Finish();
+    return rval;
+}
+#endif // RESTC_CPP_WITH_ZLIB
+
+bool IsSupported(const std::string& encoding) {
+    const auto& supported = DataReader::GetSupportedEncodings();
+    return find(supported.begin(), supported.end(), encoding) != supported.end();
+}
+
+} // anon ns
+
+TEST(ContentDecoding, SupportedEncodings) {
+#ifdef RESTC_CPP_WITH_ZLIB
+    EXPECT_TRUE(IsSupported("gzip"));
+    EXPECT_TRUE(IsSupported("deflate"));
+#endif
+#ifdef RESTC_CPP_WITH_ZSTD
+    EXPECT_EQ("zstd", DataReader::GetSupportedEncodings().front());
+#else
+    EXPECT_FALSE(IsSupported("zstd"));
+#endif
+#ifdef RESTC_CPP_WITH_BROTLI
+    EXPECT_TRUE(IsSupported("br"));
+#else
+    EXPECT_FALSE(IsSupported("br"));
+#endif
+}
+
+TEST(ContentDecoding, ReadIntoPlainBody) {
+    EXPECT_EQ(Body(), GetReplyBody("", Body(), ReadInPieces));
+    EXPECT_EQ(Body(), GetReplyBody("", Body()));
+}
+
+TEST(ContentDecoding, ReadIntoThenGetSomeData) {
+    const auto body = GetReplyBody("", Body(), [](Reply& reply) {
+        std::array<char, 10> buffer;
+        const auto len = reply.ReadInto(boost::asio::buffer(buffer));
+        std::string rval{buffer.data(), len};
+
+        // The rest of the data we got from the server comes first
+        while(reply.MoreDataToRead()) {
+            const auto b = reply.GetSomeData();
+            rval.append(boost::asio::buffer_cast<const char *>(b),
+                        boost::asio::buffer_size(b));
+        }
+        return rval;
+    });
+
+    EXPECT_EQ(Body(), body);
+}
+
+#ifdef RESTC_CPP_WITH_ZLIB
+TEST(ContentDecoding, GzipReadIntoFillsTheBuffer) {
+    const auto body = Body();
+    auto reader = DataReader::CreateGzipReader(
+        make_unique<MockReader>(Gzip(body), 100));
+    EXPECT_TRUE(reader->CanReadInto());
+
+    std::string out(body.size() + 100, '\0');
+    EXPECT_EQ(body.size(), reader->ReadInto(boost::asio::buffer(&out[0], out.size())));
+    EXPECT_TRUE(reader->IsEof());
+    out.resize(body.size());
+    EXPECT_EQ(body, out);
+}
+
+TEST(ContentDecoding, GzipBufferSize) {
+    const auto body = Body();
+    auto reader = DataReader::CreateGzipReader(
+        make_unique<MockReader>(Gzip(body), 100000), 1024);
+
+    const auto first = reader->ReadSome();
+    EXPECT_EQ(1024, boost::asio::buffer_size(first));
+    std::string out{boost::asio::buffer_cast<const char *>(first), 1024};
+    EXPECT_EQ(body, out + ReadAll(*reader));
+}
+
+TEST(ContentDecoding, GzipReply) {
+    EXPECT_EQ(Body(), GetReplyBody("gzip", Gzip(Body())));
+    EXPECT_EQ(Body(), GetReplyBody("gzip", Gzip(Body()), ReadInPieces));
+}
+#endif // RESTC_CPP_WITH_ZLIB
+
+TEST(ContentDecoding, UnsupportedEncoding) {
+    EXPECT_THROW(GetReplyBody("x-unknown", "data"), NotSupportedException);
+}
+
+#ifdef RESTC_CPP_WITH_ZSTD
+TEST(ContentDecoding, Zstd) {
+    for(size_t piece : {1, 7, 100, 100000}) {
+        auto reader = DataReader::CreateZstdReader(
+            make_unique<MockReader>(ToString(zstd_body), piece));
+        EXPECT_EQ(Body(), ReadAll(*reader));
+    }
+}
+
+TEST(ContentDecoding, ZstdFrames) {
+    auto reader = DataReader::CreateZstdReader(
+        make_unique<MockReader>(ToString(zstd_two_frames), 50));
+    EXPECT_EQ(Body(), ReadAll(*reader));
+}
+
+TEST(ContentDecoding, ZstdReply) {
+    EXPECT_EQ(Body(), GetReplyBody("zstd", ToString(zstd_body)));
+}
+
+TEST(ContentDecoding, ZstdTruncated) {
+    auto data = ToString(zstd_body);
+    data.resize(data.size() / 2);
+    auto reader = DataReader::CreateZstdReader(
+        make_unique<MockReader>(data, 1000));
+    EXPECT_THROW(ReadAll(*reader), DecompressException);
+}
+#endif // RESTC_CPP_WITH_ZSTD
+
+#ifdef RESTC_CPP_WITH_BROTLI
+TEST(ContentDecoding, Brotli) {
+    for(size_t piece : {1, 7, 100, 100000}) {
+        auto reader = DataReader::CreateBrotliReader(
+            make_unique<MockReader>(ToString(brotli_body), piece));
+        EXPECT_EQ(Body(), ReadAll(*reader));
+    }
+}
+
+TEST(ContentDecoding, BrotliReply) {
+    EXPECT_EQ(Body(), GetReplyBody("br", ToString(brotli_body)));
+}
+
+TEST(ContentDecoding, BrotliCorrupt) {
+    auto data = ToString(brotli_body);
+    data[data.size() / 2] ^= 0x55;
+    auto reader = DataReader::CreateBrotliReader(
+        make_unique<MockReader>(data, 1000));
+    EXPECT_THROW(ReadAll(*reader), DecompressException);
+}
+#endif // RESTC_CPP_WITH_BROTLI
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
@@ -0,0 +1,191 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/DnsCache.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../src/DnsCacheImpl.h"
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+
+using namespace std;
+using namespace restc_cpp;
+
+namespace {
+
+Request::Properties CacheProperties(int ttl, int negativeTtl = 30, int stale = 0) {
+    Request::Properties properties;
+    properties.dnsCacheTtlSeconds = ttl;
+    properties.dnsCacheNegativeTtlSeconds = negativeTtl;
+    properties.dnsCacheStaleSeconds = stale;
+    return properties;
+}
+
+void ExpectLookupFails(RestClient& client, const std::string& host) {
+    client.ProcessWithPromise([&](Context& ctx) {
+        EXPECT_THROW(client.GetDnsCache()->Resolve(host, "80", ctx),
+                     boost::system::system_error);
+    }).get();
+}
+
+void ExpectLoopback(RestClient& client) {
+    client.ProcessWithPromise([&](Context& ctx) {
+        const auto endpoints = client.GetDnsCache()->Resolve("127.0.0.1", "8080", ctx);
+        ASSERT_EQ(1, static_cast<int>(endpoints.size()));
+        EXPECT_EQ(boost::asio::ip::address_v4::loopback(), endpoints.front().address());
+    }).get();
+}
+
+} // anon ns
+
+TEST(DnsCache, ResolveAddress) {
+    auto rest_client = RestClient::Create(CacheProperties(30));
+    auto cache = rest_client->GetDnsCache();
+
+    rest_client->ProcessWithPromise([&](Context& ctx) {
+        const auto endpoints = cache->Resolve("127.0.0.1", "8080", ctx);
+        ASSERT_EQ(1, static_cast<int>(endpoints.size()));
+        EXPECT_EQ(boost::asio::ip::address_v4::loopback(), endpoints.front().address());
+        EXPECT_EQ(8080, endpoints.front().port());
+        EXPECT_EQ(1, cache->GetStats().lookups);
+
+        // Cached
+        EXPECT_EQ(endpoints, cache->Resolve("127.0.0.1", "8080", ctx));
+        EXPECT_EQ(1, cache->GetStats().lookups);
+        EXPECT_EQ(1, cache->GetStats().hits);
+
+        // The port is part of the key
+        EXPECT_EQ(80, cache->Resolve("127.0.0.1", "80", ctx).front().port());
+        EXPECT_EQ(2, cache->GetStats().lookups);
+    }).get();
+}
+
+TEST(DnsCache, FailedLookupIsCached) {
+    auto rest_client = RestClient::Create(CacheProperties(30));
+
+    ExpectLookupFails(*rest_client, "restc-cpp.invalid");
+    ExpectLookupFails(*rest_client, "restc-cpp.invalid");
+
+    const auto stats = rest_client->GetDnsCache()->GetStats();
+    EXPECT_EQ(1, stats.lookups);
+    EXPECT_EQ(1, stats.hits);
+    EXPECT_EQ(1, stats.negativeHits);
+}
+
+TEST(DnsCache, EntryExpires) {
+    auto rest_client = RestClient::Create(CacheProperties(1));
+    auto cache = rest_client->GetDnsCache();
+
+    ExpectLoopback(*rest_client);
+    ExpectLoopback(*rest_client);
+    EXPECT_EQ(1, cache->GetStats().lookups);
+
+    std::this_thread::sleep_for(1100ms);
+    ExpectLoopback(*rest_client);
+
+    const auto stats = cache->GetStats();
+    EXPECT_EQ(2, stats.lookups);
+    EXPECT_EQ(1, stats.hits);
+    EXPECT_EQ(0, stats.refreshes);
+}
+
+TEST(DnsCache, FailedLookupExpires) {
+    auto rest_client = RestClient::Create(CacheProperties(30, 1));
+    auto cache = rest_client->GetDnsCache();
+
+    ExpectLookupFails(*rest_client, "restc-cpp.invalid");
+    std::this_thread::sleep_for(1100ms);
+    ExpectLookupFails(*rest_client, "restc-cpp.invalid");
+
+    const auto stats = cache->GetStats();
+    EXPECT_EQ(2, stats.lookups);
+    EXPECT_EQ(0, stats.negativeHits);
+}
+
+TEST(DnsCache, StaleEntryIsRefreshed) {
+    auto rest_client = RestClient::Create(CacheProperties(1, 30, 60));
+    auto cache = rest_client->GetDnsCache();
+
+    ExpectLoopback(*rest_client);
+    std::this_thread::sleep_for(1100ms);
+
+    // The expired entry is used while it is refreshed
+    ExpectLoopback(*rest_client);
+
+    const auto stats = cache->GetStats();
+    EXPECT_EQ(1, stats.hits);
+    EXPECT_EQ(1, stats.refreshes);
+    EXPECT_EQ(2, stats.lookups);
+}
+
+TEST(DnsCache, RefreshWithResolveFnDoesNotBlock) {
+    auto properties = CacheProperties(1, 30, 60);
+    std::atomic_int calls{0};
+    auto rest_client = RestClient::Create(properties);
+    SetResolveFn(*rest_client->GetDnsCache(),
+                 [&](const std::string&, const std::string& port) {
+        if (++calls > 1) {
+            std::this_thread::sleep_for(500ms);
+        }
+        return DnsCache::endpoints_t{{boost::asio::ip::address_v4::loopback(),
+                                      static_cast<unsigned short>(stoi(port))}};
+    });
+
+    ExpectLoopback(*rest_client);
+    std::this_thread::sleep_for(1100ms);
+
+    rest_client->ProcessWithPromise([&](Context& ctx) {
+        const auto start = std::chrono::steady_clock::now();
+        rest_client->GetDnsCache()->Resolve("127.0.0.1", "8080", ctx);
+        EXPECT_LT(std::chrono::steady_clock::now() - start, 250ms);
+    }).get();
+
+    // The refresh runs after the request
+    rest_client->ProcessWithPromise([&](Context&) {
+        EXPECT_EQ(2, static_cast<int>(calls));
+    }).get();
+}
+
+TEST(DnsCache, MaxEntries) {
+    auto properties = CacheProperties(30);
+    properties.dnsCacheMaxEntries = 2;
+    auto rest_client = RestClient::Create(properties);
+    auto cache = rest_client->GetDnsCache();
+
+    rest_client->ProcessWithPromise([&](Context& ctx) {
+        for(const auto port : {"1", "2", "3"}) {
+            cache->Resolve("127.0.0.1", port, ctx);
+        }
+        EXPECT_EQ(3, cache->GetStats().lookups);
+
+        // The first lookup was dropped to make room for the third
+        cache->Resolve("127.0.0.1", "3", ctx);
+        EXPECT_EQ(3, cache->GetStats().lookups);
+        cache->Resolve("127.0.0.1", "1", ctx);
+        EXPECT_EQ(4, cache->GetStats().lookups);
+    }).get();
+}
+
+TEST(DnsCache, DisabledByDefault) {
+    auto rest_client = RestClient::Create();
+    auto cache = rest_client->GetDnsCache();
+
+    ExpectLoopback(*rest_client);
+    ExpectLoopback(*rest_client);
+
+    const auto stats = cache->GetStats();
+    EXPECT_EQ(2, stats.lookups);
+    EXPECT_EQ(0, stats.hits);
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
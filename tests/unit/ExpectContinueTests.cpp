@@ -0,0 +1,226 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/error.h"
+
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace restc_cpp;
+using namespace restc_cpp::unittests;
+
+namespace {
+
+/* A small HTTP/1.1 server that knows about "Expect: 100-continue"
+ *
+ * The reply to a request with a body is the size of the body.
+ *
+ * Paths:
+ *   /continue  Sends "100 Continue", then reads the body
+ *   /reject    Sends "413 Payload Too Large" without reading the body,
+ *              and counts what the client sends after that
+ *   /ignore    Does not answer before it has read the body
+ *   /late      Like /ignore, but sends "100 Continue" before the reply
+ */
+class ExpectServer {
+public:
+    std::string GetUrl(const std::string& path) const {
+        return server_.GetUrl(path);
+    }
+
+    int GetAccepts() const { return server_.GetAccepts(); }
+    int GetExpects() const { return expects_; }
+
+    // Wait until a client has closed a connection to /reject
+    size_t WaitForRejectedBytes() {
+        for(int i = 0; (i < 500) && !rejected_closed_; ++i) {
+            std::this_thread::sleep_for(10ms);
+        }
+        EXPECT_TRUE(rejected_closed_);
+        return rejected_bytes_;
+    }
+
+private:
+    void Serve(TestServer::socket_t& socket) {
+        boost::asio::streambuf buffer;
+
+        while(true) {
+            const auto head = TestServer::ReadHead(socket, buffer);
+            const auto body_len = TestServer::GetContentLength(head);
+            const auto path = TestServer::GetPath(head);
+            const bool expect = TestServer::HasHeaderLine(head, "expect: 100-continue");
+            if (expect) {
+                ++expects_;
+            }
+
+            if (expect && (path == "/reject")) {
+                boost::asio::write(socket, boost::asio::buffer(
+                    "HTTP/1.1 413 Payload Too Large\r\n"
+                    "Content-Length: 8\r\n\r\ntoo big!"s));
+
+                // Count what the client sends anyway
+                rejected_bytes_ = buffer.size();
+                boost::system::error_code ec;
+                std::array<char, 1024> data;
+                while(!ec) {
+                    rejected_bytes_ += socket.read_some(
+                        boost::asio::buffer(data), ec);
+                }
+                rejected_closed_ = true;
+                return;
+            }
+
+            if (expect && (path == "/continue")) {
+                boost::asio::write(socket, boost::asio::buffer(
+                    "HTTP/1.1 100 Continue\r\n\r\n"s));
+            }
+
+            TestServer::Skip(socket, buffer, body_len);
+
+            std::string reply;
+            if (path == "/late") {
+                reply = "HTTP/1.1 100 Continue\r\n\r\n";
+            }
+
+            const auto body = to_string(body_len);
+            reply += "HTTP/1.1 200 OK\r\nContent-Length: "
+                + to_string(body.size()) + "\r\n\r\n" + body;
+            boost::asio::write(socket, boost::asio::buffer(reply));
+        }
+    }
+
+    std::atomic_int expects_{0};
+    std::atomic_size_t rejected_bytes_{0};
+    std::atomic_bool rejected_closed_{false};
+    // Last, so the sessions are done before the members above go away
+    TestServer server_{[this](TestServer::socket_t& socket) { Serve(socket); }};
+};
+
+Request::Properties ExpectProperties(size_t threshold) {
+    auto properties = TestProperties();
+    properties.expectContinueThreshold = threshold;
+    properties.expectContinueTimeoutMs = 200;
+    properties.throwOnHttpError = false;
+    return properties;
+}
+
+const std::string large_body(100000, 'x');
+
+} // anon ns
+
+TEST(ExpectContinue, SendsBodyAfterContinue) {
+    ExpectServer server;
+    auto client = RestClient::Create(ExpectProperties(1000));
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        auto reply = ctx.Post(server.GetUrl("/continue"), large_body);
+        EXPECT_EQ(200, reply->GetResponseCode());
+        EXPECT_EQ("100000", reply->GetBodyAsString());
+
+        // The connection is still good
+        reply = ctx.Post(server.GetUrl("/continue"), large_body);
+        EXPECT_EQ("100000", reply->GetBodyAsString());
+    }).get();
+
+    EXPECT_EQ(2, server.GetExpects());
+    EXPECT_EQ(1, server.GetAccepts());
+}
+
+TEST(ExpectContinue, EarlyFinalReplySkipsBody) {
+    ExpectServer server;
+    auto client = RestClient::Create(ExpectProperties(1000));
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        auto reply = ctx.Post(server.GetUrl("/reject"), large_body);
+        EXPECT_EQ(413, reply->GetResponseCode());
+        EXPECT_EQ("too big!", reply->GetBodyAsString());
+    }).get();
+
+    EXPECT_EQ(1, server.GetExpects());
+    EXPECT_EQ(0, server.WaitForRejectedBytes());
+}
+
+#ifdef RESTC_CPP_WITH_ZLIB
+// A compressed body is sent chunked. Nothing of it, not even
+// the end of the gzip stream or the last chunk, is sent.
+TEST(ExpectContinue, EarlyFinalReplySkipsCompressedBody) {
+    ExpectServer server;
+    auto properties = ExpectProperties(1000);
+    properties.bodyCompression = Request::Properties::BodyCompression::GZIP;
+    auto client = RestClient::Create(properties);
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        auto reply = ctx.Post(server.GetUrl("/reject"), large_body);
+        EXPECT_EQ(413, reply->GetResponseCode());
+        EXPECT_EQ("too big!", reply->GetBodyAsString());
+    }).get();
+
+    EXPECT_EQ(1, server.GetExpects());
+    EXPECT_EQ(0, server.WaitForRejectedBytes());
+}
+#endif // RESTC_CPP_WITH_ZLIB
+
+TEST(ExpectContinue, SendsBodyWhenServerIgnoresExpect) {
+    ExpectServer server;
+    auto client = RestClient::Create(ExpectProperties(1000));
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        auto reply = ctx.Post(server.GetUrl("/ignore"), large_body);
+        EXPECT_EQ(200, reply->GetResponseCode());
+        EXPECT_EQ("100000", reply->GetBodyAsString());
+    }).get();
+
+    EXPECT_EQ(1, server.GetExpects());
+}
+
+TEST(ExpectContinue, SkipsLateContinue) {
+    ExpectServer server;
+    auto client = RestClient::Create(ExpectProperties(1000));
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        auto reply = ctx.Post(server.GetUrl("/late"), large_body);
+        EXPECT_EQ(200, reply->GetResponseCode());
+        EXPECT_EQ("100000", reply->GetBodyAsString());
+
+        reply = ctx.Post(server.GetUrl("/late"), large_body);
+        EXPECT_EQ("100000", reply->GetBodyAsString());
+    }).get();
+
+    EXPECT_EQ(1, server.GetAccepts());
+}
+
+TEST(ExpectContinue, SmallBodiesAreSentAtOnce) {
+    ExpectServer server;
+    auto client = RestClient::Create(ExpectProperties(1000));
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        auto reply = ctx.Post(server.GetUrl("/continue"), "small");
+        EXPECT_EQ("5", reply->GetBodyAsString());
+    }).get();
+
+    EXPECT_EQ(0, server.GetExpects());
+}
+
+TEST(ExpectContinue, DisabledByDefault) {
+    ExpectServer server;
+    auto client = RestClient::Create(ExpectProperties(0));
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        auto reply = ctx.Post(server.GetUrl("/continue"), large_body);
+        EXPECT_EQ("100000", reply->GetBodyAsString());
+    }).get();
+
+    EXPECT_EQ(0, server.GetExpects());
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
@@ -0,0 +1,242 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/DataWriter.h"
+
+#include <dlfcn.h>
+#include <sys/socket.h>
+
+#include <atomic>
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace restc_cpp;
+using namespace restc_cpp::unittests;
+
+namespace {
+
+// Set in the coroutines that sends the requests we count
+thread_local bool count_writes = false;
+std::atomic_int socket_writes{0};
+
+template <typename FnT>
+FnT GetLibcFunction(const char *name) {
+    return reinterpret_cast<FnT>(dlsym(RTLD_NEXT, name));
+}
+
+} // anon ns
+
+/* Count the system calls that writes to a socket
+ *
+ * These replace the functions in the C library for the whole executable,
+ * and pass the calls on to them.
+ */
+extern "C" ssize_t sendmsg(int fd, const struct msghdr *msg, int flags) {
+    using sendmsg_t = ssize_t (*)(int, const struct msghdr *, int);
+    static const auto real_sendmsg = GetLibcFunction<sendmsg_t>("sendmsg");
+    if (count_writes) {
+        ++socket_writes;
+    }
+    return real_sendmsg(fd, msg, flags);
+}
+
+extern "C" ssize_t send(int fd, const void *buf, size_t len, int flags) {
+    using send_t = ssize_t (*)(int, const void *, size_t, int);
+    static const auto real_send = GetLibcFunction<send_t>("send");
+    if (count_writes) {
+        ++socket_writes;
+    }
+    return real_send(fd, buf, len, flags);
+}
+
+namespace {
+
+/* The reply to a request is the size of the body it received,
+ * after the chunked encoding (if any) is removed.
+ */
+void ServeBodySize(TestServer::socket_t& socket) {
+    boost::asio::streambuf buffer;
+
+    while(true) {
+        const auto head = TestServer::ReadHead(socket, buffer);
+
+        size_t body_len = 0;
+        if (TestServer::HasHeaderLine(head, "transfer-encoding: chunked")) {
+            while(true) {
+                const auto chunk_len = stoul(TestServer::ReadLine(socket, buffer),
+                                             nullptr, 16);
+                if (chunk_len == 0) {
+                    TestServer::ReadLine(socket, buffer); // No trailer
+                    break;
+                }
+                TestServer::Skip(socket, buffer, chunk_len);
+                EXPECT_EQ("\r\n", TestServer::ReadLine(socket, buffer));
+                body_len += chunk_len;
+            }
+        } else {
+            body_len = TestServer::GetContentLength(head);
+            TestServer::Skip(socket, buffer, body_len);
+        }
+
+        const auto body = to_string(body_len);
+        const auto reply = "HTTP/1.1 200 OK\r\nContent-Length: "s
+            + to_string(body.size()) + "\r\n\r\n" + body;
+        boost::asio::write(socket, boost::asio::buffer(reply));
+    }
+}
+
+// Count the socket writes it takes to send one request and get the reply
+int CountWrites(RestClient& client, const std::string& url,
+                const std::string& body, std::string& reply_body) {
+    int writes = 0;
+    client.ProcessWithPromise([&](Context& ctx) {
+        // Connect first, so only the request is counted
+        ctx.Get(url)->GetBodyAsString();
+
+        socket_writes = 0;
+        count_writes = true;
+        auto reply = ctx.Post(url, body);
+        count_writes = false;
+        writes = socket_writes;
+
+        reply_body = reply->GetBodyAsString();
+    }).get();
+
+    return writes;
+}
+
+// Collects the writes from a writer, one string per write
+class RecordingWriter : public DataWriter {
+public:
+    explicit RecordingWriter(std::vector<std::string>& writes)
+    : writes_{writes} {}
+
+    void WriteDirect(boost::asio::const_buffers_1 buffers) override {
+        Write(buffers);
+    }
+
+    void Write(boost::asio::const_buffers_1 buffers) override {
+        writes_.emplace_back(boost::asio::buffer_cast<const char *>(buffers),
+                             boost::asio::buffer_size(buffers));
+    }
+
+    void Write(const write_buffers_t& buffers) override {
+        std::string data;
+        for(const auto& b : buffers) {
+            data.append(boost::asio::buffer_cast<const char *>(b),
+                        boost::asio::buffer_size(b));
+        }
+        writes_.push_back(move(data));
+    }
+
+    void WriteDirectAndData(boost::asio::const_buffers_1 direct,
+                            const write_buffers_t& buffers) override {
+        write_buffers_t all{direct};
+        all.insert(all.end(), buffers.begin(), buffers.end());
+        Write(all);
+    }
+
+    void Finish() override {
+    }
+
+    void SetHeaders(Request::headers_t& ) override {
+    }
+
+private:
+    std::vector<std::string>& writes_;
+};
+
+} // anon ns
+
+TEST(GatherWrite, HeadersAndSmallBodyInOneWrite) {
+    TestServer server{ServeBodySize};
+    auto client = RestClient::Create(TestProperties());
+
+    std::string reply_body;
+    EXPECT_EQ(1, CountWrites(*client, server.GetUrl("/"),
+                             std::string(300, 'x'), reply_body));
+    EXPECT_EQ("300", reply_body);
+}
+
+TEST(GatherWrite, HeadersWithoutBodyInOneWrite) {
+    TestServer server{ServeBodySize};
+    auto client = RestClient::Create(TestProperties());
+
+    std::string reply_body;
+    EXPECT_EQ(1, CountWrites(*client, server.GetUrl("/"), {}, reply_body));
+    EXPECT_EQ("0", reply_body);
+}
+
+#ifdef RESTC_CPP_WITH_ZLIB
+TEST(GatherWrite, CompressedBodyIsSentWithHeaders) {
+    TestServer server{ServeBodySize};
+    auto properties = TestProperties();
+    properties.bodyCompression = Request::Properties::BodyCompression::GZIP;
+    auto client = RestClient::Create(properties);
+
+    // The headers and the only chunk, then the last-chunk
+    std::string reply_body;
+    EXPECT_EQ(2, CountWrites(*client, server.GetUrl("/"),
+                             std::string(300, 'x'), reply_body));
+    EXPECT_NE("0", reply_body);
+}
+#endif // RESTC_CPP_WITH_ZLIB
+
+TEST(GatherWrite, ChunkIsOneWrite) {
+    std::vector<std::string> writes;
+    auto writer = DataWriter::CreateChunkedWriter(
+        nullptr, make_unique<RecordingWriter>(writes));
+
+    const std::string hello{"hello"};
+    const std::string world{" world!"};
+    writer->Write(boost::asio::const_buffers_1{hello.c_str(), hello.size()});
+    writer->Write(write_buffers_t{{hello.c_str(), hello.size()},
+                                  {world.c_str(), world.size()}});
+    writer->Finish();
+
+    ASSERT_EQ(3, writes.size());
+    EXPECT_EQ("5\r\nhello\r\n", writes[0]);
+    EXPECT_EQ("c\r\nhello world!\r\n", writes[1]);
+    EXPECT_EQ("0\r\n\r\n", writes[2]);
+}
+
+TEST(GatherWrite, HeadersAndFirstChunkInOneWrite) {
+    std::vector<std::string> writes;
+    auto writer = DataWriter::CreateChunkedWriter(
+        []{ return "\r\nX-Done: yes"s; }, make_unique<RecordingWriter>(writes));
+
+    const std::string headers{"POST / HTTP/1.1\r\n\r\n"};
+    const std::string hello{"hello"};
+    writer->WriteDirectAndData({headers.c_str(), headers.size()},
+                               {{hello.c_str(), hello.size()}});
+    writer->Finish();
+
+    ASSERT_EQ(2, writes.size());
+    EXPECT_EQ(headers + "5\r\nhello\r\n", writes[0]);
+    EXPECT_EQ("0\r\nX-Done: yes\r\n\r\n", writes[1]);
+}
+
+TEST(GatherWrite, EmptyChunkedBody) {
+    std::vector<std::string> writes;
+    auto writer = DataWriter::CreateChunkedWriter(
+        nullptr, make_unique<RecordingWriter>(writes));
+
+    const std::string headers{"POST / HTTP/1.1\r\n\r\n"};
+    writer->WriteDirectAndData({headers.c_str(), headers.size()}, {});
+    writer->Finish();
+
+    ASSERT_EQ(2, writes.size());
+    EXPECT_EQ(headers, writes[0]);
+    EXPECT_EQ("0\r\n\r\n", writes[1]);
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
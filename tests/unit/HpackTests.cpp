@@ -0,0 +1,189 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/error.h"
+
+#include "../src/Hpack.h"
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+
+using namespace std;
+using namespace restc_cpp;
+
+namespace {
+
+// The examples in RFC 7541, appendix C, are written as hex dumps
+std::string FromHex(const std::string& hex) {
+    std::string out;
+    std::string digits;
+    for(const auto ch : hex) {
+        if (isxdigit(ch)) {
+            digits += ch;
+            if (digits.size() == 2) {
+                out += static_cast<char>(stoi(digits, nullptr, 16));
+                digits.clear();
+            }
+        }
+    }
+    return out;
+}
+
+const Hpack::fields_t c3_1 = {
+    {":method", "GET"}, {":scheme", "http"}, {":path", "/"},
+    {":authority", "www.example.com"}};
+
+const Hpack::fields_t c3_2 = {
+    {":method", "GET"}, {":scheme", "http"}, {":path", "/"},
+    {":authority", "www.example.com"}, {"cache-control", "no-cache"}};
+
+const Hpack::fields_t c3_3 = {
+    {":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"},
+    {":authority", "www.example.com"}, {"custom-key", "custom-value"}};
+
+} // anon ns
+
+TEST(Hpack, EncodeInt) {
+    // RFC 7541, C.1
+    std::string out;
+    Hpack::EncodeInt(10, 5, 0, out);
+    EXPECT_EQ(FromHex("0a"), out);
+
+    out.clear();
+    Hpack::EncodeInt(1337, 5, 0, out);
+    EXPECT_EQ(FromHex("1f9a0a"), out);
+
+    out.clear();
+    Hpack::EncodeInt(42, 8, 0, out);
+    EXPECT_EQ(FromHex("2a"), out);
+}
+
+TEST(Hpack, HuffmanRoundTrip) {
+    std::string all;
+    for(int i = 0; i < 256; ++i) {
+        all += static_cast<char>(i);
+    }
+
+    for(const auto& value : {""s, "www.example.com"s, "no-cache"s, all}) {
+        std::string encoded;
+        Hpack::EncodeString(value, encoded);
+        Hpack::Decoder decoder;
+        auto fields = decoder.Decode(FromHex("00") + encoded + encoded);
+        ASSERT_EQ(1, fields.size());
+        EXPECT_EQ(value, fields[0].first);
+        EXPECT_EQ(value, fields[0].second);
+    }
+}
+
+TEST(Hpack, DecodeRequestsWithoutHuffman) {
+    // RFC 7541, C.3
+    Hpack::Decoder decoder;
+    EXPECT_EQ(c3_1, decoder.Decode(FromHex(
+        "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d")));
+    EXPECT_EQ(c3_2, decoder.Decode(FromHex(
+        "8286 84be 5808 6e6f 2d63 6163 6865")));
+    EXPECT_EQ(c3_3, decoder.Decode(FromHex(
+        "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65")));
+}
+
+TEST(Hpack, DecodeRequestsWithHuffman) {
+    // RFC 7541, C.4
+    Hpack::Decoder decoder;
+    EXPECT_EQ(c3_1, decoder.Decode(FromHex(
+        "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff")));
+    EXPECT_EQ(c3_2, decoder.Decode(FromHex(
+        "8286 84be 5886 a8eb 1064 9cbf")));
+    EXPECT_EQ(c3_3, decoder.Decode(FromHex(
+        "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf")));
+}
+
+TEST(Hpack, DecodeResponsesWithEviction) {
+    // RFC 7541, C.6. The examples assume a 256 byte table,
+    // so we start with a size update.
+    Hpack::Decoder decoder;
+    const Hpack::fields_t first = {
+        {":status", "302"}, {"cache-control", "private"},
+        {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+        {"location", "https://www.example.com"}};
+    EXPECT_EQ(first, decoder.Decode(FromHex(
+        "3fe101"
+        "4882 6402 5885 aec3 771a 4b61 96d0 7abe"
+        "9410 54d4 44a8 2005 9504 0b81 66e0 82a6"
+        "2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8"
+        "e9ae 82ae 43d3")));
+
+    const Hpack::fields_t second = {
+        {":status", "307"}, {"cache-control", "private"},
+        {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+        {"location", "https://www.example.com"}};
+    EXPECT_EQ(second, decoder.Decode(FromHex("4883 640e ffc1 c0bf")));
+
+    const Hpack::fields_t third = {
+        {":status", "200"}, {"cache-control", "private"},
+        {"date", "Mon, 21 Oct 2013 20:13:22 GMT"},
+        {"location", "https://www.example.com"},
+        {"content-encoding", "gzip"},
+        {"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"}};
+    EXPECT_EQ(third, decoder.Decode(FromHex(
+        "88c1 6196 d07a be94 1054 d444 a820 0595"
+        "040b 8166 e084 a62d 1bff c05a 839b d9ab"
+        "77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b"
+        "3960 d5af 2708 7f36 72c1 ab27 0fb5 291f"
+        "9587 3160 65c0 03ed 4ee5 b106 3d50 07")));
+}
+
+TEST(Hpack, EncodeRequests) {
+    // The encoder makes the same choices as the examples in RFC 7541, C.4
+    Hpack::Encoder encoder;
+    std::string block;
+    encoder.Encode(c3_1, block);
+    EXPECT_EQ(FromHex("8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff"), block);
+
+    block.clear();
+    encoder.Encode(c3_2, block);
+    EXPECT_EQ(FromHex("8286 84be 5886 a8eb 1064 9cbf"), block);
+
+    block.clear();
+    encoder.Encode(c3_3, block);
+    EXPECT_EQ(FromHex("8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf"),
+              block);
+}
+
+TEST(Hpack, EncoderAndDecoderStayInSync) {
+    Hpack::Encoder encoder;
+    encoder.SetMaxTableSize(128); // Forces evictions
+    Hpack::Decoder decoder;
+
+    for(int i = 0; i < 50; ++i) {
+        const Hpack::fields_t fields = {
+            {":method", "POST"}, {":scheme", "https"},
+            {":authority", "api.example.com"},
+            {":path", "/items/" + to_string(i)},
+            {"authorization", "Bearer secret"},
+            {"x-request", "value-" + to_string(i % 7)}};
+
+        std::string block;
+        encoder.Encode(fields, block);
+        EXPECT_EQ(fields, decoder.Decode(block));
+    }
+}
+
+TEST(Hpack, RejectsMalformedBlocks) {
+    Hpack::Decoder decoder;
+    // Index 70 does not exist
+    EXPECT_THROW(decoder.Decode(FromHex("c6")), ProtocolException);
+    // The string is longer than the block
+    EXPECT_THROW(decoder.Decode(FromHex("400a6375")), ProtocolException);
+    // Huffman padding that is not all ones
+    EXPECT_THROW(decoder.Decode(FromHex("00 81 00 00")), ProtocolException);
+    // Table size above what we allow
+    EXPECT_THROW(decoder.Decode(FromHex("3fe1ff03")), ProtocolException);
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
@@ -0,0 +1,665 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/error.h"
+#include "restc-cpp/RequestBody.h"
+#include "restc-cpp/config.h"
+
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifdef RESTC_CPP_WITH_TLS
+#   include <boost/asio/ssl.hpp>
+#   include <openssl/evp.h>
+#   include <openssl/x509.h>
+#endif
+
+#include "../src/Hpack.h"
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+
+using namespace std;
+using namespace restc_cpp;
+
+namespace {
+
+enum : uint8_t {
+    DATA = 0x0, HEADERS = 0x1, RST_STREAM = 0x3, SETTINGS = 0x4, PING = 0x6,
+    GOAWAY = 0x7, WINDOW_UPDATE = 0x8, CONTINUATION = 0x9
+};
+
+enum : uint8_t { END_STREAM = 0x1, ACK = 0x1, END_HEADERS = 0x4 };
+
+uint32_t Read32(const std::string& data, size_t pos) {
+    const auto p = reinterpret_cast<const uint8_t *>(data.data() + pos);
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+        | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+void Append32(std::string& out, uint32_t value) {
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+std::string MakeFrame(uint8_t type, uint8_t flags, uint32_t streamId,
+                      const std::string& payload) {
+    std::string frame;
+    Append32(frame, static_cast<uint32_t>(payload.size()) << 8 | type);
+    frame.push_back(static_cast<char>(flags));
+    Append32(frame, streamId);
+    return frame + payload;
+}
+
+/* A small HTTP/2 server, built from raw frames
+ *
+ * Each connection is served by its own thread, which reads the
+ * frames from the client and writes the responses as the flow
+ * control windows from the client allows.
+ *
+ * Paths:
+ *   /echo          The body is the request body
+ *   /size/N        The body is N bytes
+ *   /gather/N      The responses are held back until N such requests are open
+ *   /trailers      The body is followed by a "x-trailer" trailer field
+ *   Anything else  The body is the path
+ */
+class Http2Server {
+public:
+    struct Config {
+        bool tls = false;
+        bool alpn = true; // If false, the TLS server only talks HTTP/1.1
+        uint32_t maxConcurrentStreams = 100;
+        uint32_t initialWindow = 65535;
+    };
+
+    Http2Server() : Http2Server(Config{}) {}
+
+    Http2Server(Config config)
+    : config_{config}
+    , acceptor_{ioservice_, {boost::asio::ip::address_v4::loopback(), 0}}
+    {
+#ifdef RESTC_CPP_WITH_TLS
+        if (config_.tls) {
+            SetupTls();
+        }
+#endif
+        acceptor_.listen();
+        thread_ = std::thread([this] { Run(); });
+    }
+
+    ~Http2Server() {
+        done_ = true;
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::socket sck{ioservice_};
+        sck.connect(acceptor_.local_endpoint(), ec);
+        thread_.join();
+
+        {
+            lock_guard<mutex> lock{mutex_};
+            for(auto s : sockets_) {
+                s->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+            }
+        }
+
+        for(auto& t : sessions_) {
+            t.join();
+        }
+    }
+
+    std::string GetUrl(const std::string& path) const {
+        return (config_.tls ? "https://127.0.0.1:"s : "http://127.0.0.1:"s)
+            + std::to_string(acceptor_.local_endpoint().port()) + path;
+    }
+
+    int GetAccepts() const { return accepts_; }
+    int GetRequests() const { return requests_; }
+    size_t GetMaxOpenStreams() const { return max_open_; }
+    int GetFlowControlViolations() const { return flow_control_violations_; }
+
+private:
+    struct Stream {
+        Hpack::fields_t request;
+        std::string path;
+        std::string body;
+        std::string response;
+        size_t sent = 0;
+        int64_t send_window = 0;
+        int64_t recv_window = 0;
+        bool responding = false;
+        bool trailers = false;
+    };
+
+    template <typename SocketT>
+    class Session {
+    public:
+        Session(Http2Server& server, SocketT& socket)
+        : server_{server}, socket_{socket}
+        , conn_recv_window_{65535}
+        , initial_recv_window_{server.config_.initialWindow} {}
+
+        void Serve() {
+            std::string preface(24, '\0');
+            boost::asio::read(socket_, boost::asio::buffer(&preface[0], preface.size()));
+            if (preface != "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n") {
+                throw runtime_error("Invalid preface");
+            }
+
+            std::string settings;
+            settings += "\x00\x03"s;
+            Append32(settings, server_.config_.maxConcurrentStreams);
+            settings += "\x00\x04"s;
+            Append32(settings, initial_recv_window_);
+            Write(MakeFrame(SETTINGS, 0, 0, settings));
+
+            while(true) {
+                std::string header(9, '\0');
+                boost::asio::read(socket_, boost::asio::buffer(&header[0], header.size()));
+                const auto length = Read32(header, 0) >> 8;
+                const auto type = static_cast<uint8_t>(header[3]);
+                const auto flags = static_cast<uint8_t>(header[4]);
+                const auto id = Read32(header, 5) & 0x7fffffff;
+                std::string payload(length, '\0');
+                if (length) {
+                    boost::asio::read(socket_, boost::asio::buffer(&payload[0], length));
+                }
+
+                if (type == GOAWAY) {
+                    return;
+                }
+
+                OnFrame(type, flags, id, payload);
+                Pump();
+            }
+        }
+
+    private:
+        void OnFrame(uint8_t type, uint8_t flags, uint32_t id, const std::string& payload) {
+            switch(type) {
+            case SETTINGS:
+                if (!(flags & ACK)) {
+                    for(size_t pos = 0; pos < payload.size(); pos += 6) {
+                        if (payload[pos + 1] == 0x4) {
+                            const int64_t window = Read32(payload, pos + 2);
+                            for(auto& it : streams_) {
+                                it.second.send_window += window - client_window_;
+                            }
+                            client_window_ = window;
+                        }
+                    }
+                    Write(MakeFrame(SETTINGS, ACK, 0, {}));
+                }
+                break;
+            case PING:
+                Write(MakeFrame(PING, ACK, 0, payload));
+                break;
+            case WINDOW_UPDATE:
+                if (id == 0) {
+                    conn_send_window_ += Read32(payload, 0);
+                } else if (streams_.count(id)) {
+                    streams_[id].send_window += Read32(payload, 0);
+                }
+                break;
+            case RST_STREAM:
+                streams_.erase(id);
+                break;
+            case HEADERS:
+            case CONTINUATION:
+                if (type == HEADERS) {
+                    block_.clear();
+                    block_end_stream_ = (flags & END_STREAM) != 0;
+                }
+                block_ += payload;
+                if (flags & END_HEADERS) {
+                    auto& stream = streams_[id];
+                    stream.request = decoder_.Decode(block_);
+                    stream.send_window = client_window_;
+                    stream.recv_window = initial_recv_window_;
+                    for(const auto& f : stream.request) {
+                        if (f.first == ":path") {
+                            stream.path = f.second;
+                        }
+                    }
+                    server_.OnOpen(streams_.size());
+                    if (block_end_stream_) {
+                        OnRequest(id);
+                    }
+                }
+                break;
+            case DATA: {
+                conn_recv_window_ -= payload.size();
+                auto& stream = streams_[id];
+                stream.recv_window -= payload.size();
+                if ((conn_recv_window_ < 0) || (stream.recv_window < 0)) {
+                    ++server_.flow_control_violations_;
+                }
+                stream.body += payload;
+
+                // Give the window back right away
+                if (!payload.empty()) {
+                    std::string increment;
+                    Append32(increment, static_cast<uint32_t>(payload.size()));
+                    Write(MakeFrame(WINDOW_UPDATE, 0, 0, increment)
+                          + MakeFrame(WINDOW_UPDATE, 0, id, increment));
+                    conn_recv_window_ += payload.size();
+                    stream.recv_window += payload.size();
+                }
+
+                if (flags & END_STREAM) {
+                    OnRequest(id);
+                }
+            } break;
+            default:
+                ;
+            }
+        }
+
+        void OnRequest(uint32_t id) {
+            ++server_.requests_;
+            auto& stream = streams_[id];
+            const auto& path = stream.path;
+
+            if (path == "/echo") {
+                stream.response = stream.body;
+            } else if (path.compare(0, 6, "/size/") == 0) {
+                stream.response.assign(stoul(path.substr(6)), 'x');
+            } else if (path == "/trailers") {
+                stream.response = path;
+                stream.trailers = true;
+            } else if (path.compare(0, 8, "/gather/") == 0) {
+                stream.response = path;
+                gathered_.push_back(id);
+                if (gathered_.size() < stoul(path.substr(8))) {
+                    return;
+                }
+                for(auto gid : gathered_) {
+                    Respond(gid);
+                }
+                gathered_.clear();
+                return;
+            } else {
+                stream.response = path;
+            }
+
+            Respond(id);
+        }
+
+        void Respond(uint32_t id) {
+            auto& stream = streams_[id];
+            std::string block;
+            encoder_.Encode({{":status", "200"},
+                             {"content-length", to_string(stream.response.size())},
+                             {"x-path", stream.path}}, block);
+            Write(MakeFrame(HEADERS, END_HEADERS, id, block));
+            stream.responding = true;
+        }
+
+        // Send as much of the response bodies as the windows allow
+        void Pump() {
+            for(auto it = streams_.begin(); it != streams_.end();) {
+                auto& stream = it->second;
+                if (!stream.responding) {
+                    ++it;
+                    continue;
+                }
+
+                while(stream.sent < stream.response.size()) {
+                    const auto chunk = min<int64_t>({
+                        static_cast<int64_t>(stream.response.size() - stream.sent),
+                        stream.send_window, conn_send_window_, 16384});
+                    if (chunk <= 0) {
+                        break;
+                    }
+                    const bool last = (stream.sent + chunk == stream.response.size())
+                        && !stream.trailers;
+                    Write(MakeFrame(DATA, last ? END_STREAM : 0, it->first,
+                                    stream.response.substr(stream.sent, chunk)));
+                    stream.sent += chunk;
+                    stream.send_window -= chunk;
+                    conn_send_window_ -= chunk;
+                }
+
+                if (stream.sent < stream.response.size()) {
+                    ++it;
+                    continue;
+                }
+
+                if (stream.response.empty() && !stream.trailers) {
+                    Write(MakeFrame(DATA, END_STREAM, it->first, {}));
+                }
+
+                if (stream.trailers) {
+                    std::string block;
+                    encoder_.Encode({{"x-trailer", "yes"}}, block);
+                    Write(MakeFrame(HEADERS, END_HEADERS | END_STREAM, it->first, block));
+                }
+
+                it = streams_.erase(it);
+            }
+        }
+
+        void Write(const std::string& data) {
+            boost::asio::write(socket_, boost::asio::buffer(data));
+        }
+
+        Http2Server& server_;
+        SocketT& socket_;
+        std::map<uint32_t, Stream> streams_;
+        std::vector<uint32_t> gathered_;
+        Hpack::Decoder decoder_;
+        Hpack::Encoder encoder_;
+        std::string block_;
+        bool block_end_stream_ = false;
+        int64_t client_window_ = 65535;
+        int64_t conn_send_window_ = 65535;
+        int64_t conn_recv_window_;
+        const uint32_t initial_recv_window_;
+    };
+
+    void OnOpen(size_t open) {
+        lock_guard<mutex> lock{mutex_};
+        max_open_ = max(max_open_, open);
+    }
+
+    void Run() {
+        while(true) {
+            auto socket = make_shared<boost::asio::ip::tcp::socket>(ioservice_);
+            acceptor_.accept(*socket);
+            if (done_) {
+                return;
+            }
+            ++accepts_;
+
+            {
+                lock_guard<mutex> lock{mutex_};
+                sockets_.push_back(socket.get());
+            }
+
+            sessions_.emplace_back([this, socket] {
+                try {
+                    Serve(*socket);
+                } catch(const std::exception&) {
+                    ; // The client closed the connection
+                }
+                lock_guard<mutex> lock{mutex_};
+                sockets_.erase(find(sockets_.begin(), sockets_.end(), socket.get()));
+            });
+        }
+    }
+
+    void Serve(boost::asio::ip::tcp::socket& socket) {
+#ifdef RESTC_CPP_WITH_TLS
+        if (config_.tls) {
+            boost::asio::ssl::stream<boost::asio::ip::tcp::socket&> stream{socket, *ssl_ctx_};
+            stream.handshake(boost::asio::ssl::stream_base::server);
+            if (!config_.alpn) {
+                ServeHttp11(stream);
+                return;
+            }
+            Session<decltype(stream)>{*this, stream}.Serve();
+            return;
+        }
+#endif
+        Session<boost::asio::ip::tcp::socket>{*this, socket}.Serve();
+    }
+
+    // Answers "OK" to each request on the connection
+    template <typename SocketT>
+    void ServeHttp11(SocketT& stream) {
+        boost::asio::streambuf request;
+        while(true) {
+            const auto bytes = boost::asio::read_until(stream, request, "\r\n\r\n");
+            request.consume(bytes);
+            ++requests_;
+            static const std::string reply{"HTTP/1.1 200 OK\r\n"
+                "Content-Length: 2\r\n\r\nOK"};
+            boost::asio::write(stream, boost::asio::buffer(reply));
+        }
+    }
+
+#ifdef RESTC_CPP_WITH_TLS
+    void SetupTls() {
+        ssl_ctx_ = make_unique<boost::asio::ssl::context>(boost::asio::ssl::context::tls_server);
+        auto ctx = ssl_ctx_->native_handle();
+
+        EVP_PKEY *pkey = nullptr;
+        auto pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+        EVP_PKEY_keygen_init(pctx);
+        EVP_PKEY_CTX_set_rsa_keygen_bits(pctx, 2048);
+        EVP_PKEY_keygen(pctx, &pkey);
+        EVP_PKEY_CTX_free(pctx);
+
+        auto cert = X509_new();
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+        X509_set_pubkey(cert, pkey);
+        auto name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+            reinterpret_cast<const unsigned char *>("127.0.0.1"), -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        X509_sign(cert, pkey, EVP_sha256());
+
+        SSL_CTX_use_certificate(ctx, cert);
+        SSL_CTX_use_PrivateKey(ctx, pkey);
+        X509_free(cert);
+        EVP_PKEY_free(pkey);
+
+        if (config_.alpn) {
+            SSL_CTX_set_alpn_select_cb(ctx, [](SSL *, const unsigned char **out,
+                                               unsigned char *outlen,
+                                               const unsigned char *in,
+                                               unsigned int inlen, void *) -> int {
+                static const unsigned char h2[] = "\x02h2";
+                if (SSL_select_next_proto(const_cast<unsigned char **>(out), outlen,
+                                          h2, 3, in, inlen) == OPENSSL_NPN_NEGOTIATED) {
+                    return SSL_TLSEXT_ERR_OK;
+                }
+                return SSL_TLSEXT_ERR_NOACK;
+            }, nullptr);
+        }
+    }
+
+    std::unique_ptr<boost::asio::ssl::context> ssl_ctx_;
+#endif
+
+    const Config config_;
+    boost::asio::io_service ioservice_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::atomic_bool done_{false};
+    std::atomic_int accepts_{0};
+    std::atomic_int requests_{0};
+    std::atomic_int flow_control_violations_{0};
+    std::mutex mutex_;
+    size_t max_open_ = 0;
+    std::vector<boost::asio::ip::tcp::socket *> sockets_;
+    std::vector<std::thread> sessions_;
+    std::thread thread_;
+};
+
+Request::Properties Http2Properties(Request::Properties::Http2 mode
+                                    = Request::Properties::Http2::PRIOR_KNOWLEDGE) {
+    Request::Properties properties;
+    properties.http2 = mode;
+    properties.replyTimeoutMs = 5000;
+    properties.recvTimeout = 5000;
+    properties.sendTimeoutMs = 5000;
+    return properties;
+}
+
+// Run count requests at the same time, and return the connection ids
+std::vector<boost::uuids::uuid>
+GetConcurrently(RestClient& client, const std::string& url, size_t count) {
+    std::vector<std::future<boost::uuids::uuid>> replies;
+    for(size_t i = 0; i < count; ++i) {
+        replies.push_back(client.ProcessWithPromiseT<boost::uuids::uuid>(
+            [&](Context& ctx) {
+            auto reply = ctx.Get(url);
+            EXPECT_EQ(Reply::HttpResponse::HttpVersion::HTTP_2,
+                      reply->GetHttpResponse().http_version);
+            const auto id = reply->GetConnectionId();
+            reply->GetBodyAsString();
+            return id;
+        }));
+    }
+
+    std::vector<boost::uuids::uuid> ids;
+    for(auto& r : replies) {
+        ids.push_back(r.get());
+    }
+    return ids;
+}
+
+} // anon ns
+
+TEST(Http2, SimpleGet) {
+    Http2Server server;
+    auto client = RestClient::Create(Http2Properties());
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        auto reply = ctx.Get(server.GetUrl("/hello"));
+        EXPECT_EQ(200, reply->GetResponseCode());
+        EXPECT_EQ(Reply::HttpResponse::HttpVersion::HTTP_2,
+                  reply->GetHttpResponse().http_version);
+        EXPECT_EQ("/hello", *reply->GetHeader("X-Path"));
+        EXPECT_EQ("/hello", reply->GetBodyAsString());
+    }).get();
+}
+
+TEST(Http2, RequestsShareOneConnection) {
+    Http2Server server;
+    auto client = RestClient::Create(Http2Properties());
+
+    // The server only responds when all the requests are open at the same time
+    const auto ids = GetConcurrently(*client, server.GetUrl("/gather/20"), 20);
+
+    EXPECT_EQ(1, server.GetAccepts());
+    EXPECT_EQ(20, server.GetMaxOpenStreams());
+    for(const auto& id : ids) {
+        EXPECT_EQ(ids.front(), id);
+    }
+
+    // And later requests reuse it
+    GetConcurrently(*client, server.GetUrl("/again"), 3);
+    EXPECT_EQ(1, server.GetAccepts());
+}
+
+TEST(Http2, RespectsMaxConcurrentStreams) {
+    Http2Server::Config config;
+    config.maxConcurrentStreams = 2;
+    Http2Server server{config};
+    auto client = RestClient::Create(Http2Properties());
+
+    GetConcurrently(*client, server.GetUrl("/size/100000"), 10);
+
+    EXPECT_EQ(10, server.GetRequests());
+    EXPECT_EQ(1, server.GetAccepts());
+    EXPECT_LE(server.GetMaxOpenStreams(), 2);
+}
+
+TEST(Http2, LargeDownloadWithSmallWindow) {
+    Http2Server server;
+    auto properties = Http2Properties();
+    properties.http2WindowSize = 65535;
+    auto client = RestClient::Create(properties);
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        // Needs many WINDOW_UPDATE's from us
+        EXPECT_EQ(std::string(3000000, 'x'),
+                  ctx.Get(server.GetUrl("/size/3000000"))->GetBodyAsString());
+    }).get();
+}
+
+TEST(Http2, LargeUploadWithSmallWindow) {
+    Http2Server::Config config;
+    config.initialWindow = 16384;
+    Http2Server server{config};
+    auto client = RestClient::Create(Http2Properties());
+
+    std::string body;
+    for(int i = 0; body.size() < 1000000; ++i) {
+        body += to_string(i) + ',';
+    }
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        EXPECT_EQ(body, ctx.Post(server.GetUrl("/echo"), body)->GetBodyAsString());
+    }).get();
+
+    EXPECT_EQ(0, server.GetFlowControlViolations());
+}
+
+TEST(Http2, Trailers) {
+    Http2Server server;
+    auto client = RestClient::Create(Http2Properties());
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        auto reply = ctx.Get(server.GetUrl("/trailers"));
+        EXPECT_EQ("/trailers", reply->GetBodyAsString());
+        EXPECT_EQ("yes", *reply->GetHeader("x-trailer"));
+    }).get();
+}
+
+TEST(Http2, NeverUsesHttp11) {
+    Http2Server server;
+    auto client = RestClient::Create(
+        Http2Properties(Request::Properties::Http2::NEVER));
+
+    // The server only talks HTTP/2
+    EXPECT_ANY_THROW(client->ProcessWithPromise([&](Context& ctx) {
+        ctx.Get(server.GetUrl("/hello"))->GetBodyAsString();
+    }).get());
+}
+
+#ifdef RESTC_CPP_WITH_TLS
+
+TEST(Http2, NegotiatedWithAlpn) {
+    Http2Server::Config config;
+    config.tls = true;
+    Http2Server server{config};
+    auto client = RestClient::Create(
+        make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls_client),
+        Http2Properties(Request::Properties::Http2::NEGOTIATE));
+
+    const auto ids = GetConcurrently(*client, server.GetUrl("/gather/5"), 5);
+
+    EXPECT_EQ(1, server.GetAccepts());
+    for(const auto& id : ids) {
+        EXPECT_EQ(ids.front(), id);
+    }
+}
+
+TEST(Http2, FallsBackToHttp11WithoutAlpn) {
+    Http2Server::Config config;
+    config.tls = true;
+    config.alpn = false;
+    Http2Server server{config};
+    auto client = RestClient::Create(
+        make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls_client),
+        Http2Properties(Request::Properties::Http2::NEGOTIATE));
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        for(int i = 0; i < 3; ++i) {
+            auto reply = ctx.Get(server.GetUrl("/"));
+            EXPECT_EQ(Reply::HttpResponse::HttpVersion::HTTP_1_1,
+                      reply->GetHttpResponse().http_version);
+            EXPECT_EQ("OK", reply->GetBodyAsString());
+        }
+    }).get();
+
+    EXPECT_EQ(3, server.GetRequests());
+    EXPECT_EQ(1, server.GetAccepts()); // Kept alive, as HTTP/1.1
+}
+
+#endif // RESTC_CPP_WITH_TLS
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
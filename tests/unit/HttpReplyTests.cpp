@@ -2,7 +2,10 @@
 // Include before boost::log headers
 #include "restc-cpp/logging.h"
 
+#include <chrono>
+
 #include "../src/ReplyImpl.h"
+#include "../src/HeaderScanner.h"
 
 #include "gtest/gtest.h"
 #include "restc-cpp/test_helper.h"
@@ -488,6 +491,142 @@ TEST(HttpReply, ChunkedParameterAndTrailer)
      EXPECT_NO_THROW(f.get());
 }
 
+TEST(HttpReply, FoldedAndUnusualHeaders)
+{
+    ::restc_cpp::unittests::test_buffers_t buffer;
+
+    buffer.push_back("HTTP/1.1 200 OK\r\n"
+        "Server: Cowboy\r\n"
+        "X-Folded: first\r\n"
+        "\tsecond\r\n"
+        "X Spaced : value\r\n"
+        "X-Empty:\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n");
+
+     auto rest_client = RestClient::Create();
+     auto f = rest_client->ProcessWithPromise([&](Context& ctx) {
+
+         ::restc_cpp::unittests::TestReply reply(ctx, *rest_client, buffer);
+
+         reply.SimulateServerReply();
+
+         EXPECT_EQ(200, reply.GetResponseCode());
+         EXPECT_EQ("OK", reply.GetHttpResponse().reason_phrase);
+         EXPECT_EQ("Cowboy", *reply.GetHeader("Server"));
+         EXPECT_EQ("first second", *reply.GetHeader("X-Folded"));
+         EXPECT_EQ("value", *reply.GetHeader("XSpaced"));
+         EXPECT_EQ("", *reply.GetHeader("X-Empty"));
+         EXPECT_EQ("0", *reply.GetHeader("Content-Length"));
+     });
+
+     EXPECT_NO_THROW(f.get());
+}
+
+TEST(HttpReply, MalformedStatusLine)
+{
+    ::restc_cpp::unittests::test_buffers_t buffer;
+
+    buffer.push_back("HTTP/1.0 200 OK\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n");
+
+     auto rest_client = RestClient::Create();
+     auto f = rest_client->ProcessWithPromise([&](Context& ctx) {
+
+         ::restc_cpp::unittests::TestReply reply(ctx, *rest_client, buffer);
+
+         EXPECT_THROW(reply.SimulateServerReply(), ProtocolException);
+     });
+
+     EXPECT_NO_THROW(f.get());
+}
+
+namespace {
+
+/* Scan a header the way DataReaderStream does when it arrives in one buffer
+ *
+ * Returns the sum of the field value lengths, so the work is not optimized
+ * away, or 0 if a line could not be scanned.
+ */
+template <header_scanner::find_first_of_t findFirstOf>
+size_t ScanHeader(const std::string& header) {
+    const char *p = header.data();
+    const char *end = p + header.size();
+    size_t value_bytes = 0;
+
+    auto eol = header_scanner::FindEndOfLine<findFirstOf>(p, end);
+    header_scanner::StatusLine status;
+    if (!header_scanner::ScanStatusLine({p, static_cast<size_t>(eol - p)},
+                                        status, 16, 256)) {
+        return 0;
+    }
+    for(p = eol + 2; (eol = header_scanner::FindEndOfLine<findFirstOf>(p, end)) != p;
+        p = eol + 2) {
+        header_scanner::HeaderField field;
+        if (!header_scanner::ScanHeaderLine<findFirstOf>(
+            {p, static_cast<size_t>(eol - p)}, field, 256, 1024 * 8)) {
+            return 0;
+        }
+        value_bytes += field.value.size();
+    }
+    return value_bytes;
+}
+
+} // anon ns
+
+/* Not really a unit test, but a benchmark that scans the same
+ * header with the SIMD FindFirstOf() and with the scalar fallback.
+ *
+ * It is disabled. Run it with --gtest_also_run_disabled_tests, in an
+ * optimized build (without optimization the SIMD intrinsics are not inlined).
+ */
+TEST(HttpReply, DISABLED_HeaderScannerBenchmark)
+{
+    constexpr size_t iterations = 200000;
+    const std::string header = "HTTP/1.1 200 OK\r\n"
+        "Server: Cowboy\r\n"
+        "Connection: keep-alive\r\n"
+        "X-Powered-By: Express\r\n"
+        "Vary: Origin, Accept-Encoding\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Pragma: no-cache\r\n"
+        "Expires: -1\r\n"
+        "Content-Type: application/json; charset=utf-8\r\n"
+        "Content-Length: 0\r\n"
+        "Date: Thu, 21 Apr 2016 13:44:36 GMT\r\n"
+        "Set-Cookie: session=7f3a9c0e2b8d4f61a5e0c3b9d2f7e1a4; Path=/; "
+            "Expires=Fri, 22 Apr 2016 13:44:36 GMT; HttpOnly; Secure\r\n"
+        "Content-Security-Policy: default-src 'self'; script-src 'self' "
+            "https://cdn.example.com; img-src 'self' data: https:; "
+            "style-src 'self' 'unsafe-inline'\r\n"
+        "\r\n";
+
+    const auto expected = ScanHeader<header_scanner::FindFirstOfScalar>(header);
+    EXPECT_NE(0, expected);
+    EXPECT_EQ(expected, ScanHeader<header_scanner::FindFirstOf>(header));
+
+    auto run = [&](const char *name, size_t (*scan)(const std::string&)) {
+        size_t value_bytes = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < iterations; ++i) {
+            value_bytes += scan(header);
+        }
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        EXPECT_EQ(expected * iterations, value_bytes);
+        std::clog << "HttpReply: " << iterations << " headers scanned with "
+            << name << " in " << (elapsed / 1000) << " ms ("
+            << (elapsed * 1000 / iterations) << " ns/header)"
+            << std::endl;
+    };
+
+    run("FindFirstOfScalar", ScanHeader<header_scanner::FindFirstOfScalar>);
+    run("FindFirstOf", ScanHeader<header_scanner::FindFirstOf>);
+}
+
 int main( int argc, char * argv[] )
 {
     RESTC_CPP_TEST_LOGGING_SETUP("debug");
@@ -0,0 +1,254 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/error.h"
+
+#include <condition_variable>
+#include <mutex>
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace restc_cpp;
+using namespace restc_cpp::unittests;
+
+namespace {
+
+/* A small HTTP/1.1 server for pipelined requests
+ *
+ * Each connection is served by its own thread. The replies are written
+ * when there are no more requests in the buffer, so replies to pipelined
+ * requests often arrive together. Every second reply is chunked.
+ *
+ * Paths:
+ *   /gather/N      The replies are held back until N requests are waiting
+ *   /hold/N        The replies are held back until N requests are waiting
+ *                  on all the connections together
+ *   /close/N       The N'th request on a connection gets "Connection: close",
+ *                  and the connection is closed after the reply
+ *   Anything else  The body is the path
+ */
+class PipelineServer {
+public:
+    std::string GetUrl(const std::string& path) const {
+        return server_.GetUrl(path);
+    }
+
+    int GetAccepts() const { return server_.GetAccepts(); }
+    int GetRequests() const { return requests_; }
+
+    // Most requests we have had waiting for replies on one connection
+    size_t GetMaxWaiting() const {
+        lock_guard<mutex> lock{mutex_};
+        return max_waiting_;
+    }
+
+private:
+    void Serve(TestServer::socket_t& socket) {
+        boost::asio::streambuf buffer;
+        std::vector<std::string> waiting; // Paths we owe a reply
+        size_t gather = 0;
+        size_t count = 0;
+        size_t close_after = 0;
+
+        while(true) {
+            const auto head = TestServer::ReadHead(socket, buffer);
+            // Skip the body, if there is one
+            TestServer::Skip(socket, buffer, TestServer::GetContentLength(head));
+
+            const auto path = TestServer::GetPath(head);
+            ++count;
+            ++requests_;
+            waiting.push_back(path);
+
+            {
+                lock_guard<mutex> lock{mutex_};
+                max_waiting_ = max(max_waiting_, waiting.size());
+            }
+
+            if (path.compare(0, 8, "/gather/") == 0) {
+                gather = stoul(path.substr(8));
+            } else if ((path.compare(0, 7, "/close/") == 0)
+                && (stoul(path.substr(7)) == count)) {
+                close_after = waiting.size();
+            } else if (path.compare(0, 6, "/hold/") == 0) {
+                const auto total = stoul(path.substr(6));
+                unique_lock<mutex> lock{mutex_};
+                ++held_;
+                held_cv_.notify_all();
+                held_cv_.wait_for(lock, 5s, [&] { return held_ >= total; });
+            }
+
+            if ((waiting.size() < gather) || (!close_after && buffer.size())) {
+                continue; // Wait for more requests
+            }
+
+            gather = 0;
+            std::string replies;
+            for(size_t i = 0; i < waiting.size(); ++i) {
+                const bool close = (i + 1) == close_after;
+                replies += MakeReply(waiting[i], ++replies_, close);
+                if (close) {
+                    break;
+                }
+            }
+            waiting.clear();
+            boost::asio::write(socket, boost::asio::buffer(replies));
+
+            if (close_after) {
+                boost::system::error_code ec;
+                socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+                return;
+            }
+        }
+    }
+
+    static std::string MakeReply(const std::string& body, size_t num, bool close) {
+        std::string reply = "HTTP/1.1 200 OK\r\n";
+        if (close) {
+            reply += "Connection: close\r\n";
+        }
+
+        if (num % 2) {
+            return reply + "Content-Length: " + to_string(body.size())
+                + "\r\n\r\n" + body;
+        }
+
+        // Two chunks
+        const auto half = body.size() / 2;
+        std::ostringstream chunked;
+        chunked << hex << "Transfer-Encoding: chunked\r\n\r\n"
+            << half << "\r\n" << body.substr(0, half) << "\r\n"
+            << (body.size() - half) << "\r\n" << body.substr(half) << "\r\n"
+            << "0\r\n\r\n";
+        return reply + chunked.str();
+    }
+
+    std::atomic_int requests_{0};
+    std::atomic_size_t replies_{0};
+    mutable std::mutex mutex_;
+    size_t max_waiting_ = 0;
+    size_t held_ = 0;
+    std::condition_variable held_cv_;
+    // Last, so the sessions are done before the members above go away
+    TestServer server_{[this](TestServer::socket_t& socket) { Serve(socket); }};
+};
+
+Request::Properties PipelineProperties(size_t depth) {
+    auto properties = TestProperties();
+    properties.pipelineDepth = depth;
+    return properties;
+}
+
+// Make a connection the next requests can start with
+void Warmup(RestClient& client, PipelineServer& server) {
+    client.ProcessWithPromise([&](Context& ctx) {
+        EXPECT_EQ("/warmup", ctx.Get(server.GetUrl("/warmup"))->GetBodyAsString());
+    }).get();
+}
+
+// Run count requests at the same time, and return the connection ids
+std::vector<boost::uuids::uuid>
+SendConcurrently(RestClient& client, const std::string& url, size_t count,
+                 Request::Type type = Request::Type::GET) {
+    std::vector<std::future<boost::uuids::uuid>> replies;
+    for(size_t i = 0; i < count; ++i) {
+        replies.push_back(client.ProcessWithPromiseT<boost::uuids::uuid>(
+            [&, type](Context& ctx) {
+            auto reply = (type == Request::Type::POST)
+                ? ctx.Post(url, "{}") : ctx.Get(url);
+            const auto id = reply->GetConnectionId();
+            EXPECT_EQ(url.substr(url.find('/', 7)), reply->GetBodyAsString());
+            return id;
+        }));
+    }
+
+    std::vector<boost::uuids::uuid> ids;
+    for(auto& r : replies) {
+        ids.push_back(r.get());
+    }
+    return ids;
+}
+
+} // anon ns
+
+TEST(Pipeline, RequestsShareOneConnection) {
+    PipelineServer server;
+    auto client = RestClient::Create(PipelineProperties(8));
+    Warmup(*client, server);
+
+    // The server only replies when all the requests have arrived
+    const auto ids = SendConcurrently(*client, server.GetUrl("/gather/8"), 8);
+
+    EXPECT_EQ(1, server.GetAccepts());
+    EXPECT_EQ(8, server.GetMaxWaiting());
+    for(const auto& id : ids) {
+        EXPECT_EQ(ids.front(), id);
+    }
+
+    // The connection is reused when the pipeline is done
+    SendConcurrently(*client, server.GetUrl("/again"), 3);
+    EXPECT_EQ(1, server.GetAccepts());
+}
+
+TEST(Pipeline, RespectsPipelineDepth) {
+    PipelineServer server;
+    auto properties = PipelineProperties(3);
+    properties.cacheMaxConnectionsPerEndpoint = 1;
+    properties.cacheWaitTimeoutMs = 5000;
+    auto client = RestClient::Create(properties);
+    Warmup(*client, server);
+
+    // The requests that don't fit in the pipeline wait for the connection
+    SendConcurrently(*client, server.GetUrl("/depth"), 9);
+
+    EXPECT_EQ(10, server.GetRequests());
+    EXPECT_EQ(1, server.GetAccepts());
+    EXPECT_LE(server.GetMaxWaiting(), 3);
+}
+
+TEST(Pipeline, OnlyIdempotentRequests) {
+    PipelineServer server;
+    auto client = RestClient::Create(PipelineProperties(8));
+    Warmup(*client, server);
+
+    SendConcurrently(*client, server.GetUrl("/hold/4"), 4, Request::Type::POST);
+
+    EXPECT_EQ(4, server.GetAccepts());
+    EXPECT_EQ(1, server.GetMaxWaiting());
+}
+
+TEST(Pipeline, ReplaysUnansweredRequests) {
+    PipelineServer server;
+    auto client = RestClient::Create(PipelineProperties(8));
+    Warmup(*client, server);
+
+    // The third request on the connection closes it, so the
+    // requests after it must be sent again on a new connection
+    SendConcurrently(*client, server.GetUrl("/close/3"), 6);
+
+    EXPECT_GE(server.GetAccepts(), 2);
+    EXPECT_GE(server.GetRequests(), 7);
+}
+
+TEST(Pipeline, DisabledByDefault) {
+    PipelineServer server;
+    auto client = RestClient::Create(PipelineProperties(1));
+    Warmup(*client, server);
+
+    // Each request must be on its own connection for all of them to be answered
+    SendConcurrently(*client, server.GetUrl("/hold/4"), 4);
+
+    EXPECT_EQ(4, server.GetAccepts());
+    EXPECT_EQ(1, server.GetMaxWaiting());
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
@@ -0,0 +1,198 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/BufferPool.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace restc_cpp;
+using namespace restc_cpp::unittests;
+
+namespace {
+
+char BodyByte(size_t offset) {
+    return static_cast<char>('a' + (offset % 23));
+}
+
+std::string MakeBody(size_t offset, size_t len) {
+    std::string body;
+    body.reserve(len);
+    for(size_t i = 0; i < len; ++i) {
+        body += BodyByte(offset + i);
+    }
+    return body;
+}
+
+/* Sends bodies of a given size
+ *
+ * Paths:
+ *   /plain/<size>    A body with Content-Length
+ *   /chunked/<size>  A chunked body
+ */
+void ServeBody(TestServer::socket_t& socket) {
+    boost::asio::streambuf buffer;
+
+    while(true) {
+        std::vector<std::string> path;
+        boost::split(path, TestServer::GetPath(TestServer::ReadHead(socket, buffer)),
+                     boost::is_any_of("/"));
+        const auto size = stoul(path.at(2));
+
+        if (path.at(1) == "plain") {
+            boost::asio::write(socket, boost::asio::buffer(
+                "HTTP/1.1 200 OK\r\nContent-Length: "s + to_string(size)
+                + "\r\n\r\n"s + MakeBody(0, size)));
+            continue;
+        }
+
+        boost::asio::write(socket, boost::asio::buffer(
+            "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"s));
+        constexpr size_t chunk_size = 5000;
+        for(size_t offset = 0; offset < size; offset += chunk_size) {
+            const auto len = min(chunk_size, size - offset);
+            std::ostringstream chunk;
+            chunk << hex << len << "\r\n" << MakeBody(offset, len) << "\r\n";
+            boost::asio::write(socket, boost::asio::buffer(chunk.str()));
+        }
+        boost::asio::write(socket, boost::asio::buffer("0\r\n\r\n"s));
+    }
+}
+
+Request::Properties ReadAheadProperties(size_t buffers) {
+    auto properties = TestProperties();
+    properties.readAheadBuffers = buffers;
+    return properties;
+}
+
+// Read the body piece by piece, and check each byte
+size_t ReadAndVerify(Reply& reply, size_t *largestPiece = nullptr) {
+    size_t offset = 0;
+    while(reply.MoreDataToRead()) {
+        const auto data = reply.GetSomeData();
+        const auto *p = boost::asio::buffer_cast<const char *>(data);
+        const auto len = boost::asio::buffer_size(data);
+        if (largestPiece) {
+            *largestPiece = max(*largestPiece, len);
+        }
+        for(size_t i = 0; i < len; ++i, ++offset) {
+            if (p[i] != BodyByte(offset)) {
+                ADD_FAILURE() << "Unexpected data at offset " << offset;
+                return offset;
+            }
+        }
+    }
+    return offset;
+}
+
+} // anon ns
+
+TEST(ReadAhead, PlainBody) {
+    TestServer server{ServeBody};
+    for(const size_t buffers : {2, 4}) {
+        auto client = RestClient::Create(ReadAheadProperties(buffers));
+
+        client->ProcessWithPromise([&](Context& ctx) {
+            auto reply = ctx.Get(server.GetUrl("/plain/4000000"));
+            EXPECT_EQ(4000000, ReadAndVerify(*reply));
+        }).get();
+    }
+}
+
+TEST(ReadAhead, ChunkedBody) {
+    TestServer server{ServeBody};
+    for(const size_t buffers : {2, 4}) {
+        auto client = RestClient::Create(ReadAheadProperties(buffers));
+
+        client->ProcessWithPromise([&](Context& ctx) {
+            auto reply = ctx.Get(server.GetUrl("/chunked/1000000"));
+            EXPECT_EQ(1000000, ReadAndVerify(*reply));
+        }).get();
+    }
+}
+
+TEST(ReadAhead, DoesNotReadPastTheReply) {
+    TestServer server{ServeBody};
+    auto client = RestClient::Create(ReadAheadProperties(4));
+
+    // A read past the end of one reply would either steal the start
+    // of the next, or leave a read pending on the idle connection.
+    client->ProcessWithPromise([&](Context& ctx) {
+        for(const auto& path : {"/plain/100000", "/chunked/100000",
+                                "/plain/10", "/chunked/10", "/plain/0"}) {
+            auto reply = ctx.Get(server.GetUrl(path));
+            EXPECT_EQ(MakeBody(0, stoul(strrchr(path, '/') + 1)),
+                      reply->GetBodyAsString());
+        }
+    }).get();
+
+    EXPECT_EQ(1, server.GetAccepts());
+}
+
+TEST(ReadAhead, AbandonedReply) {
+    TestServer server{ServeBody};
+    auto client = RestClient::Create(ReadAheadProperties(2));
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        {
+            auto reply = ctx.Get(server.GetUrl("/plain/4000000"));
+            EXPECT_GT(boost::asio::buffer_size(reply->GetSomeData()), 0);
+        }
+
+        // The abandoned connection is closed, and we get a new one
+        auto reply = ctx.Get(server.GetUrl("/plain/1000"));
+        EXPECT_EQ(1000, ReadAndVerify(*reply));
+    }).get();
+
+    EXPECT_EQ(2, server.GetAccepts());
+}
+
+TEST(ReadAhead, BuffersGrowForLargeBodies) {
+    TestServer server{ServeBody};
+    for(const size_t buffers : {0, 4}) {
+        auto properties = ReadAheadProperties(buffers);
+        properties.ioBufferSize = 1024 * 16;
+        properties.ioBufferMaxSize = 1024 * 256;
+        auto client = RestClient::Create(properties);
+
+        size_t largest = 0;
+        client->ProcessWithPromise([&](Context& ctx) {
+            auto reply = ctx.Get(server.GetUrl("/plain/4000000"));
+            EXPECT_EQ(4000000, ReadAndVerify(*reply, &largest));
+        }).get();
+
+        EXPECT_GT(largest, properties.ioBufferSize);
+        EXPECT_LE(largest, properties.ioBufferMaxSize);
+        EXPECT_GE(BufferPool::GetDefault().GetStats().highWaterMark, largest);
+    }
+}
+
+TEST(ReadAhead, FixedBufferSize) {
+    TestServer server{ServeBody};
+    for(const size_t buffers : {0, 4}) {
+        auto properties = ReadAheadProperties(buffers);
+        properties.ioBufferSize = 1024 * 8;
+        properties.ioBufferMaxSize = 1024 * 8;
+        auto client = RestClient::Create(properties);
+
+        size_t largest = 0;
+        client->ProcessWithPromise([&](Context& ctx) {
+            auto reply = ctx.Get(server.GetUrl("/plain/1000000"));
+            EXPECT_EQ(1000000, ReadAndVerify(*reply, &largest));
+        }).get();
+
+        EXPECT_LE(largest, properties.ioBufferSize);
+    }
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
@@ -0,0 +1,108 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+
+#include "../src/ReplyHeaders.h"
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+
+using namespace std;
+using namespace restc_cpp;
+
+TEST(ReplyHeaders, CaseInsensitiveLookup) {
+    ReplyHeaders headers;
+    headers.Add("Server", "Cowboy");
+    headers.Add("X-Powered-By", "Express");
+
+    EXPECT_EQ("Cowboy", *headers.Get("server"));
+    EXPECT_EQ("Cowboy", *headers.Get("SERVER"));
+    EXPECT_EQ("Express", *headers.Get("x-powered-by"));
+    EXPECT_FALSE(headers.Get("Serve"));
+    EXPECT_FALSE(headers.Get("Servers"));
+    EXPECT_EQ(ReplyHeaders::Hash("Content-Type"), ReplyHeaders::Hash("content-type"));
+}
+
+TEST(ReplyHeaders, WellKnownHeaders) {
+    ReplyHeaders headers;
+    headers.Add("content-LENGTH", "10");
+    headers.Add("Connection", "keep-alive");
+    headers.Add("Connection", "close");
+
+    EXPECT_EQ("10", *headers.Get(ReplyHeaders::Id::CONTENT_LENGTH));
+    EXPECT_EQ("keep-alive", *headers.Get(ReplyHeaders::Id::CONNECTION));
+    EXPECT_FALSE(headers.Get(ReplyHeaders::Id::LOCATION));
+    EXPECT_FALSE(headers.Get(ReplyHeaders::Id::OTHER));
+
+    EXPECT_EQ(ReplyHeaders::Id::TRANSFER_ENCODING, ReplyHeaders::GetId("Transfer-Encoding"));
+    EXPECT_EQ(ReplyHeaders::Id::CONTENT_ENCODING, ReplyHeaders::GetId("content-encoding"));
+    EXPECT_EQ(ReplyHeaders::Id::LOCATION, ReplyHeaders::GetId("Location"));
+    EXPECT_EQ(ReplyHeaders::Id::OTHER, ReplyHeaders::GetId("Content-Type"));
+}
+
+TEST(ReplyHeaders, MultipleValues) {
+    ReplyHeaders headers;
+    headers.Add("Set-Cookie", "a=1");
+    headers.Add("Server", "Cowboy");
+    headers.Add("set-cookie", "b=2");
+
+    std::vector<std::string> values;
+    headers.ForEach("Set-Cookie", [&values](boost::string_ref value) {
+        values.push_back(value.to_string());
+    });
+
+    ASSERT_EQ(2, static_cast<int>(values.size()));
+    EXPECT_EQ("a=1", values[0]);
+    EXPECT_EQ("b=2", values[1]);
+    EXPECT_EQ(3, static_cast<int>(headers.size()));
+}
+
+TEST(ReplyHeaders, SetReplacesFirst) {
+    ReplyHeaders headers;
+    headers.Add("Server", "Cowboy");
+    const auto before = *headers.Get("Server");
+
+    headers.Set("server", "Indian");
+    headers.Set("Trailer-Only", "yes");
+
+    EXPECT_EQ("Indian", *headers.Get("Server"));
+    EXPECT_EQ("yes", *headers.Get("Trailer-Only"));
+    EXPECT_EQ(2, static_cast<int>(headers.size()));
+
+    // Views handed out before are still valid
+    EXPECT_EQ("Cowboy", before);
+}
+
+TEST(ReplyHeaders, ValuesStayInPlace) {
+    ReplyHeaders headers;
+    const std::string big(5000, 'x');
+
+    headers.Add("First", "1");
+    const auto first = *headers.Get("First");
+    for(int i = 0; i < 200; ++i) {
+        headers.Add("Name-" + to_string(i), "Value-" + to_string(i));
+    }
+    headers.Add("Big", big);
+
+    EXPECT_EQ("1", first);
+    EXPECT_EQ(first.data(), headers.Get("First")->data());
+    EXPECT_EQ("Value-150", *headers.Get("name-150"));
+    EXPECT_EQ(big, headers.Get("Big")->to_string());
+
+    headers.Add("Empty", "");
+    ASSERT_TRUE(headers.Get("Empty"));
+    EXPECT_TRUE(headers.Get("Empty")->empty());
+
+    headers.Clear();
+    EXPECT_TRUE(headers.empty());
+    EXPECT_FALSE(headers.Get("First"));
+    EXPECT_FALSE(headers.Get(ReplyHeaders::Id::CONTENT_LENGTH));
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
@@ -0,0 +1,259 @@
+#pragma once
+#ifndef RESTC_CPP_UNITTESTS_TEST_HELPERS_H_
+#define RESTC_CPP_UNITTESTS_TEST_HELPERS_H_
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/DataReader.h"
+#include "restc-cpp/DataWriter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
+/* Helpers shared by the unit tests that talk to a server,
+ * or read and write bodies without one.
+ */
+
+namespace restc_cpp {
+namespace unittests {
+
+/* A small blocking HTTP server on the loopback interface
+ *
+ * Each connection is given to the session handler, on its own thread.
+ * The handler returns (or throws) when it is done with the connection.
+ * When the server is destroyed, it stops accepting, shuts down the
+ * connections that are still open, and waits for the sessions to end.
+ *
+ * The server must be destroyed before any state the handler uses.
+ */
+class TestServer {
+public:
+    using socket_t = boost::asio::ip::tcp::socket;
+    using session_t = std::function<void (socket_t& socket)>;
+
+    explicit TestServer(session_t session,
+                        const boost::asio::ip::address& address
+                            = boost::asio::ip::address_v4::loopback())
+    : session_{std::move(session)}
+    , acceptor_{ioservice_, {address, 0}}
+    {
+        acceptor_.listen();
+        thread_ = std::thread([this] { Run(); });
+    }
+
+    TestServer(const TestServer&) = delete;
+    TestServer& operator = (const TestServer&) = delete;
+
+    ~TestServer() {
+        done_ = true;
+        boost::system::error_code ec;
+        socket_t sck{ioservice_};
+        sck.connect(acceptor_.local_endpoint(), ec);
+        thread_.join();
+
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            for(auto s : sockets_) {
+                s->shutdown(socket_t::shutdown_both, ec);
+            }
+        }
+
+        for(auto& t : sessions_) {
+            t.join();
+        }
+    }
+
+    std::string GetUrl(const std::string& path) const {
+        return "http://127.0.0.1:" + std::to_string(acceptor_.local_endpoint().port())
+            + path;
+    }
+
+    boost::asio::ip::tcp::endpoint GetEndpoint() const {
+        return acceptor_.local_endpoint();
+    }
+
+    // Connections accepted so far
+    int GetAccepts() const { return accepts_; }
+
+    // Read up to and including the delimiter
+    static std::string ReadLine(socket_t& socket, boost::asio::streambuf& buffer,
+                                const char *delimiter = "\r\n") {
+        const auto bytes = boost::asio::read_until(socket, buffer, delimiter);
+        std::string line(boost::asio::buffers_begin(buffer.data()),
+                         boost::asio::buffers_begin(buffer.data()) + bytes);
+        buffer.consume(bytes);
+        return line;
+    }
+
+    // Read the request line and the headers
+    static std::string ReadHead(socket_t& socket, boost::asio::streambuf& buffer) {
+        return ReadLine(socket, buffer, "\r\n\r\n");
+    }
+
+    // Read and discard len bytes
+    static void Skip(socket_t& socket, boost::asio::streambuf& buffer,
+                     const std::size_t len) {
+        if (buffer.size() < len) {
+            boost::asio::read(socket, buffer,
+                boost::asio::transfer_exactly(len - buffer.size()));
+        }
+        buffer.consume(len);
+    }
+
+    // The path in the request line of a request head
+    static std::string GetPath(const std::string& head) {
+        std::vector<std::string> request_line;
+        boost::split(request_line, head.substr(0, head.find("\r\n")),
+                     boost::is_any_of(" "));
+        return request_line.at(1);
+    }
+
+    // The Content-Length of a request head, or 0
+    static std::size_t GetContentLength(const std::string& head) {
+        for(const auto& line : SplitLines(head)) {
+            if (boost::istarts_with(line, "content-length:")) {
+                return std::stoul(line.substr(15));
+            }
+        }
+        return 0;
+    }
+
+    // True if the request head has a header line that is exactly line
+    static bool HasHeaderLine(const std::string& head, const std::string& line) {
+        const auto lines = SplitLines(head);
+        return std::any_of(lines.begin(), lines.end(), [&](const std::string& l) {
+            return boost::iequals(l, line);
+        });
+    }
+
+private:
+    static std::vector<std::string> SplitLines(const std::string& head) {
+        std::vector<std::string> lines;
+        boost::split(lines, head, boost::is_any_of("\r\n"), boost::token_compress_on);
+        return lines;
+    }
+
+    void Run() {
+        while(true) {
+            auto socket = std::make_shared<socket_t>(ioservice_);
+            acceptor_.accept(*socket);
+            if (done_) {
+                return;
+            }
+            ++accepts_;
+
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                sockets_.push_back(socket.get());
+            }
+
+            sessions_.emplace_back([this, socket] {
+                try {
+                    session_(*socket);
+                } catch(const std::exception&) {
+                    ; // The client closed the connection
+                }
+                std::lock_guard<std::mutex> lock{mutex_};
+                sockets_.erase(std::find(sockets_.begin(), sockets_.end(),
+                                         socket.get()));
+            });
+        }
+    }
+
+    const session_t session_;
+    boost::asio::io_service ioservice_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::atomic_bool done_{false};
+    std::atomic_int accepts_{0};
+    std::mutex mutex_;
+    std::vector<socket_t *> sockets_;
+    std::vector<std::thread> sessions_;
+    std::thread thread_;
+};
+
+// Properties with timeouts that are long enough for a slow test machine
+inline Request::Properties TestProperties() {
+    Request::Properties properties;
+    properties.replyTimeoutMs = 5000;
+    properties.recvTimeout = 5000;
+    properties.sendTimeoutMs = 5000;
+    return properties;
+}
+
+// Appends everything written to a string
+class StringWriter : public DataWriter {
+public:
+    explicit StringWriter(std::string& out)
+    : out_{out} {}
+
+    // finished is set when the writer is finished
+    StringWriter(std::string& out, bool& finished)
+    : out_{out}, finished_{&finished} {}
+
+    void WriteDirect(boost::asio::const_buffers_1 buffers) override {
+        Write(buffers);
+    }
+
+    void Write(boost::asio::const_buffers_1 buffers) override {
+        out_.append(boost::asio::buffer_cast<const char *>(buffers),
+                    boost::asio::buffer_size(buffers));
+    }
+
+    void Write(const write_buffers_t& buffers) override {
+        for(const auto& b : buffers) {
+            Write(boost::asio::const_buffers_1{b});
+        }
+    }
+
+    void Finish() override {
+        if (finished_) {
+            *finished_ = true;
+        }
+    }
+
+    void SetHeaders(Request::headers_t& ) override {
+    }
+
+private:
+    std::string& out_;
+    bool *finished_ = nullptr;
+};
+
+// Returns the data in pieces of pieceLen bytes
+class MockReader : public DataReader {
+public:
+    explicit MockReader(std::string data, std::size_t pieceLen = 1000)
+    : data_{std::move(data)}, piece_len_{pieceLen} {}
+
+    void Finish() override {
+    }
+
+    bool IsEof() const override {
+        return pos_ >= data_.size();
+    }
+
+    boost::asio::const_buffers_1 ReadSome() override {
+        const auto len = std::min(piece_len_, data_.size() - pos_);
+        const boost::asio::const_buffers_1 rval{data_.data() + pos_, len};
+        pos_ += len;
+        return rval;
+    }
+
+private:
+    const std::string data_;
+    const std::size_t piece_len_;
+    std::size_t pos_ = 0;
+};
+
+} // unittests
+} // restc_cpp
+
+#endif // RESTC_CPP_UNITTESTS_TEST_HELPERS_H_
@@ -0,0 +1,222 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+
+#include <ctime>
+#include <thread>
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+
+using namespace std;
+using namespace restc_cpp;
+
+namespace {
+
+/* A local https server that answers each request with
+ * "Connection: close", so that every request needs a new
+ * connection and a new handshake.
+ */
+class TlsServer {
+public:
+    TlsServer(int maxVersion = 0)
+    : ssl_ctx_{boost::asio::ssl::context::tls_server}
+    , acceptor_{ioservice_, {boost::asio::ip::address_v4::loopback(), 0}}
+    {
+        UseSelfSignedCertificate();
+        if (maxVersion) {
+            SSL_CTX_set_max_proto_version(ssl_ctx_.native_handle(), maxVersion);
+        }
+        acceptor_.listen();
+        thread_ = std::thread([this] { Run(); });
+    }
+
+    ~TlsServer() {
+        done_ = true;
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::socket sck{ioservice_};
+        sck.connect(acceptor_.local_endpoint(), ec);
+        thread_.join();
+    }
+
+    std::string GetUrl() const {
+        return "https://127.0.0.1:"s + std::to_string(acceptor_.local_endpoint().port()) + "/";
+    }
+
+    int GetHandshakes() const { return handshakes_; }
+    int GetResumed() const { return resumed_; }
+
+private:
+    void UseSelfSignedCertificate() {
+        EVP_PKEY *pkey = nullptr;
+        auto pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+        EVP_PKEY_keygen_init(pctx);
+        EVP_PKEY_CTX_set_rsa_keygen_bits(pctx, 2048);
+        EVP_PKEY_keygen(pctx, &pkey);
+        EVP_PKEY_CTX_free(pctx);
+
+        auto cert = X509_new();
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+        X509_set_pubkey(cert, pkey);
+        auto name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+            reinterpret_cast<const unsigned char *>("127.0.0.1"), -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        X509_sign(cert, pkey, EVP_sha256());
+
+        SSL_CTX_use_certificate(ssl_ctx_.native_handle(), cert);
+        SSL_CTX_use_PrivateKey(ssl_ctx_.native_handle(), pkey);
+        X509_free(cert);
+        EVP_PKEY_free(pkey);
+    }
+
+    void Run() {
+        while(true) {
+            boost::asio::ssl::stream<boost::asio::ip::tcp::socket> stream{ioservice_, ssl_ctx_};
+            acceptor_.accept(stream.lowest_layer());
+            if (done_) {
+                return;
+            }
+
+            boost::system::error_code ec;
+            stream.handshake(boost::asio::ssl::stream_base::server, ec);
+            if (ec) {
+                continue;
+            }
+
+            ++handshakes_;
+            if (SSL_session_reused(stream.native_handle())) {
+                ++resumed_;
+            }
+
+            boost::asio::streambuf request;
+            boost::asio::read_until(stream, request, "\r\n\r\n", ec);
+            static const std::string reply{"HTTP/1.1 200 OK\r\n"
+                "Content-Length: 2\r\n"
+                "Connection: close\r\n\r\nOK"};
+            boost::asio::write(stream, boost::asio::buffer(reply), ec);
+
+            // Send close_notify, so the server keeps the session
+            SSL_shutdown(stream.native_handle());
+        }
+    }
+
+    boost::asio::io_service ioservice_;
+    boost::asio::ssl::context ssl_ctx_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::atomic_bool done_{false};
+    std::atomic_int handshakes_{0};
+    std::atomic_int resumed_{0};
+    std::thread thread_;
+};
+
+std::shared_ptr<boost::asio::ssl::context> MakeClientContext() {
+    return make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls_client);
+}
+
+void Get(RestClient& client, const std::string& url, int count) {
+    client.ProcessWithPromise([&](Context& ctx) {
+        for(int i = 0; i < count; ++i) {
+            EXPECT_EQ("OK", ctx.Get(url)->GetBodyAsString());
+        }
+    }).get();
+}
+
+} // anon ns
+
+TEST(TlsSessionCache, ResumesTls13Sessions) {
+    TlsServer server;
+    auto client = RestClient::Create(MakeClientContext());
+
+    Get(*client, server.GetUrl(), 5);
+
+    EXPECT_EQ(5, server.GetHandshakes());
+    EXPECT_EQ(4, server.GetResumed());
+}
+
+TEST(TlsSessionCache, ResumesTls12Sessions) {
+    TlsServer server{TLS1_2_VERSION};
+    auto client = RestClient::Create(MakeClientContext());
+
+    Get(*client, server.GetUrl(), 5);
+
+    EXPECT_EQ(5, server.GetHandshakes());
+    EXPECT_EQ(4, server.GetResumed());
+}
+
+TEST(TlsSessionCache, Disabled) {
+    TlsServer server;
+    Request::Properties properties;
+    properties.tlsSessionResumption = false;
+    auto client = RestClient::Create(MakeClientContext(), properties);
+
+    Get(*client, server.GetUrl(), 3);
+
+    EXPECT_EQ(3, server.GetHandshakes());
+    EXPECT_EQ(0, server.GetResumed());
+}
+
+TEST(TlsSessionCache, SharedBetweenClientsWithSameContext) {
+    TlsServer server;
+    auto tls_ctx = MakeClientContext();
+
+    auto first = RestClient::Create(tls_ctx);
+    Get(*first, server.GetUrl(), 1);
+
+    auto second = RestClient::Create(tls_ctx);
+    Get(*second, server.GetUrl(), 1);
+    EXPECT_EQ(1, server.GetResumed());
+
+    // A client with its own context has its own cache
+    auto other = RestClient::Create(MakeClientContext());
+    Get(*other, server.GetUrl(), 1);
+    EXPECT_EQ(1, server.GetResumed());
+}
+
+/* Not really a unit test, but a benchmark that makes requests on new
+ * connections, with full handshakes and with resumed sessions.
+ *
+ * It is disabled. Run it with --gtest_also_run_disabled_tests
+ */
+TEST(TlsSessionCache, DISABLED_HandshakeBenchmark) {
+    constexpr int requests = 200;
+
+    for(const int version : {TLS1_2_VERSION, TLS1_3_VERSION}) {
+        for(const bool resume : {false, true}) {
+            TlsServer server{version};
+            Request::Properties properties;
+            properties.tlsSessionResumption = resume;
+            auto client = RestClient::Create(MakeClientContext(), properties);
+
+            const auto start = std::chrono::steady_clock::now();
+            const auto cpu_start = std::clock();
+            Get(*client, server.GetUrl(), requests);
+            const auto cpu_ms = (std::clock() - cpu_start) * 1000 / CLOCKS_PER_SEC;
+            const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+
+            // The server runs in this process, so the cpu-time is for both ends
+            std::clog << "TlsSessionCache: "
+                << (version == TLS1_3_VERSION ? "TLS 1.3" : "TLS 1.2")
+                << (resume ? ", resumed" : ", full handshakes")
+                << ": " << requests << " requests, " << server.GetResumed()
+                << " resumed, " << cpu_ms << " ms cpu, " << elapsed << " ms" << std::endl;
+
+            EXPECT_EQ(resume ? requests - 1 : 0, server.GetResumed());
+        }
+    }
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
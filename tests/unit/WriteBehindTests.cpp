@@ -0,0 +1,174 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/RequestBodyWriter.h"
+#include "restc-cpp/RapidJsonWriter.h"
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace restc_cpp;
+using namespace restc_cpp::unittests;
+
+namespace {
+
+uint32_t Fnv1a(uint32_t hash, const char *data, size_t len) {
+    for(size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+constexpr uint32_t fnv_basis = 2166136261u;
+
+/* Receives chunked uploads
+ *
+ * The reply is "<size>:<hash>" for the body it received.
+ *
+ * Paths:
+ *   /close  Closes the connection after the request headers
+ */
+void ServeUpload(TestServer::socket_t& socket) {
+    boost::asio::streambuf buffer;
+
+    while(true) {
+        const auto head = TestServer::ReadHead(socket, buffer);
+        if (TestServer::GetPath(head) == "/close") {
+            socket.close();
+            return;
+        }
+
+        size_t body_len = 0;
+        uint32_t hash = fnv_basis;
+        while(true) {
+            const auto chunk_len = stoul(TestServer::ReadLine(socket, buffer),
+                                         nullptr, 16);
+            if (chunk_len == 0) {
+                TestServer::ReadLine(socket, buffer); // No trailer
+                break;
+            }
+
+            if (buffer.size() < chunk_len) {
+                boost::asio::read(socket, buffer,
+                    boost::asio::transfer_exactly(chunk_len - buffer.size()));
+            }
+            const std::string chunk(boost::asio::buffers_begin(buffer.data()),
+                boost::asio::buffers_begin(buffer.data()) + chunk_len);
+            buffer.consume(chunk_len);
+
+            hash = Fnv1a(hash, chunk.data(), chunk.size());
+            body_len += chunk_len;
+            EXPECT_EQ("\r\n", TestServer::ReadLine(socket, buffer));
+        }
+
+        const auto body = to_string(body_len) + ":" + to_string(hash);
+        const auto reply = "HTTP/1.1 200 OK\r\nContent-Length: "s
+            + to_string(body.size()) + "\r\n\r\n" + body;
+        boost::asio::write(socket, boost::asio::buffer(reply));
+    }
+}
+
+Request::Properties WriteBehindProperties(size_t buffers) {
+    auto properties = TestProperties();
+    properties.writeBehindBuffers = buffers;
+    return properties;
+}
+
+template <typename fnT>
+unique_ptr<Reply> PostData(Context& ctx, const std::string& url, fnT fn) {
+    auto req = Request::Create(url, Request::Type::POST, ctx.GetClient(),
+                               make_unique<RequestBodyWriter<fnT>>(move(fn)));
+    return req->Execute(ctx);
+}
+
+// Like a JSON list upload, flushed by RapidJsonWriter each time its buffer fills
+std::string Upload(RestClient& client, const std::string& url, size_t items,
+                   uint32_t& hash, size_t& size) {
+    std::string result;
+    client.ProcessWithPromise([&](Context& ctx) {
+        auto reply = PostData(ctx, url, [&](DataWriter& writer) {
+            RapidJsonWriter<char> stream{writer};
+            hash = fnv_basis;
+            size = 0;
+            for(size_t i = 0; i < items; ++i) {
+                const auto item = "{\"id\":" + to_string(i) + ",\"name\":\"item\"},";
+                for(const auto ch : item) {
+                    stream.Put(ch);
+                }
+                hash = Fnv1a(hash, item.data(), item.size());
+                size += item.size();
+            }
+            stream.Flush();
+        });
+        result = reply->GetBodyAsString();
+    }).get();
+
+    return result;
+}
+
+} // anon ns
+
+TEST(WriteBehind, PushedBodyIsSentInOrder) {
+    TestServer server{ServeUpload};
+    auto client = RestClient::Create(WriteBehindProperties(4));
+
+    uint32_t hash = 0;
+    size_t size = 0;
+    const auto reply = Upload(*client, server.GetUrl("/upload"), 100000, hash, size);
+    EXPECT_EQ(to_string(size) + ":" + to_string(hash), reply);
+    EXPECT_GT(size, 1024 * 1024);
+}
+
+TEST(WriteBehind, OneBuffer) {
+    TestServer server{ServeUpload};
+    auto client = RestClient::Create(WriteBehindProperties(1));
+
+    uint32_t hash = 0;
+    size_t size = 0;
+    const auto reply = Upload(*client, server.GetUrl("/upload"), 10000, hash, size);
+    EXPECT_EQ(to_string(size) + ":" + to_string(hash), reply);
+}
+
+TEST(WriteBehind, ConnectionIsReused) {
+    TestServer server{ServeUpload};
+    auto client = RestClient::Create(WriteBehindProperties(4));
+
+    for(int i = 0; i < 3; ++i) {
+        uint32_t hash = 0;
+        size_t size = 0;
+        const auto reply = Upload(*client, server.GetUrl("/upload"), 1000, hash, size);
+        EXPECT_EQ(to_string(size) + ":" + to_string(hash), reply);
+    }
+}
+
+TEST(WriteBehind, ErrorIsThrownByLaterCall) {
+    TestServer server{ServeUpload};
+    auto client = RestClient::Create(WriteBehindProperties(4));
+
+    const std::string data(1024 * 64, 'x');
+    constexpr int max_writes = 1000;
+    int writes = 0;
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        EXPECT_ANY_THROW(PostData(ctx, server.GetUrl("/close"),
+                                  [&](DataWriter& writer) {
+            for(; writes < max_writes; ++writes) {
+                writer.Write({data.c_str(), data.size()});
+            }
+        }));
+    }).get();
+
+    // The writes failed long before we had sent 64 MB
+    EXPECT_LT(writes, max_writes);
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
@@ -0,0 +1,189 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/DataReader.h"
+#include "restc-cpp/DataWriter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace restc_cpp;
+using namespace restc_cpp::unittests;
+
+// Count all the allocations in the program. zlib allocates through these as well.
+std::atomic_size_t allocations{0};
+
+void *operator new(std::size_t size) {
+    ++allocations;
+    if (auto ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    ++allocations;
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+std::string MakeBody() {
+    std::string body;
+    for(int i = 0; i < 5000; ++i) {
+        body += "{\"id\":" + to_string(i) + ",\"name\":\"restc-cpp\"},";
+    }
+    return body;
+}
+
+const std::string body = MakeBody();
+
+std::string Compress(bool gzip) {
+    std::string rval;
+    auto writer = gzip
+        ? DataWriter::CreateGzipWriter(make_unique<StringWriter>(rval))
+        : DataWriter::CreateZipWriter(make_unique<StringWriter>(rval));
+    writer->Write({body.data(), body.size()});
+    writer->Finish();
+    return rval;
+}
+
+const std::string gzip_body = Compress(true);
+const std::string deflate_body = Compress(false);
+
+// Decompress, and compare with body. Returns the number of allocations.
+size_t Decompress(DataReader::ptr_t&& source, bool gzip, size_t bufferSize) {
+    std::vector<char> out(body.size());
+    size_t len = 0;
+
+    const size_t before = allocations;
+    {
+        auto reader = gzip
+            ? DataReader::CreateGzipReader(move(source), bufferSize)
+            : DataReader::CreateZipReader(move(source), bufferSize);
+
+        while(!reader->IsEof()) {
+            const auto b = reader->ReadSome();
+            const auto b_len = boost::asio::buffer_size(b);
+            EXPECT_LE(len + b_len, out.size());
+            if (len + b_len <= out.size()) {
+                memcpy(out.data() + len, boost::asio::buffer_cast<const char *>(b), b_len);
+            }
+            len += b_len;
+        }
+    }
+    const size_t count = allocations - before;
+
+    EXPECT_EQ(body.size(), len);
+    EXPECT_TRUE(memcmp(body.data(), out.data(), min(len, out.size())) == 0);
+    return count;
+}
+
+size_t Decompress(bool gzip, size_t bufferSize = RESTC_CPP_IO_BUFFER_SIZE) {
+    return Decompress(make_unique<MockReader>(gzip ? gzip_body : deflate_body),
+                      gzip, bufferSize);
+}
+
+} // anon ns
+
+TEST(ZipReader, SteadyStateDoesNotAllocate) {
+    Decompress(true);
+
+    for(int i = 0; i < 10; ++i) {
+        // Only the reader itself. zlib's state and window, and the buffer, are reused
+        EXPECT_EQ(1, Decompress(true));
+    }
+}
+
+TEST(ZipReader, NewThreadStartsWithEmptyPool) {
+    std::thread([] {
+        EXPECT_LT(1, Decompress(true));
+        EXPECT_EQ(1, Decompress(true));
+    }).join();
+}
+
+TEST(ZipReader, SwitchesFormat) {
+    Decompress(true);
+
+    for(int i = 0; i < 4; ++i) {
+        EXPECT_EQ(1, Decompress((i % 2) == 0));
+    }
+}
+
+TEST(ZipReader, SmallerBufferDoesNotAllocate) {
+    Decompress(true, 1024 * 16);
+    EXPECT_EQ(1, Decompress(true, 1024));
+    EXPECT_EQ(1, Decompress(true, 1024 * 16));
+}
+
+TEST(ZipReader, OverlappingReaders) {
+    auto first = DataReader::CreateGzipReader(make_unique<MockReader>(gzip_body));
+    auto second = DataReader::CreateGzipReader(make_unique<MockReader>(gzip_body));
+
+    std::string a, b;
+    while(!first->IsEof() || !second->IsEof()) {
+        for(auto p : {make_pair(first.get(), &a), make_pair(second.get(), &b)}) {
+            if (!p.first->IsEof()) {
+                const auto data = p.first->ReadSome();
+                p.second->append(boost::asio::buffer_cast<const char *>(data),
+                                 boost::asio::buffer_size(data));
+            }
+        }
+    }
+
+    EXPECT_EQ(body, a);
+    EXPECT_EQ(body, b);
+}
+
+TEST(ZipReader, ReusedAfterError) {
+    std::string corrupt = gzip_body;
+    corrupt[corrupt.size() / 2] ^= 0x55;
+    corrupt[corrupt.size() / 2 + 1] ^= 0x55;
+
+    EXPECT_THROW(Decompress(make_unique<MockReader>(corrupt), true,
+                            RESTC_CPP_IO_BUFFER_SIZE), DecompressException);
+
+    // The next body is not affected
+    Decompress(true);
+}
+
+TEST(ZipReader, ReusedAfterPartialRead) {
+    {
+        // The input is freed with the reader, before it is all inflated
+        auto reader = DataReader::CreateGzipReader(
+            make_unique<MockReader>(gzip_body, gzip_body.size()), 1024);
+        EXPECT_EQ(1024, boost::asio::buffer_size(reader->ReadSome()));
+    }
+
+    // The next body starts with no input left from the last one
+    Decompress(true);
+    Decompress(false);
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}
@@ -0,0 +1,205 @@
+
+// Include before boost::log headers
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+#include "restc-cpp/DataReader.h"
+#include "restc-cpp/DataWriter.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include "gtest/gtest.h"
+#include "restc-cpp/test_helper.h"
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace restc_cpp;
+using namespace restc_cpp::unittests;
+
+namespace {
+
+std::string Decompress(std::string data, bool gzip) {
+    auto reader = gzip
+        ? DataReader::CreateGzipReader(make_unique<MockReader>(move(data)))
+        : DataReader::CreateZipReader(make_unique<MockReader>(move(data)));
+
+    std::string rval;
+    while(!reader->IsEof()) {
+        const auto b = reader->ReadSome();
+        rval.append(boost::asio::buffer_cast<const char *>(b),
+                    boost::asio::buffer_size(b));
+    }
+    return rval;
+}
+
+std::string MakeBody(size_t len) {
+    std::string body;
+    while(body.size() < len) {
+        body += "{\"id\":" + to_string(body.size()) + ",\"name\":\"restc-cpp\"},";
+    }
+    body.resize(len);
+    return body;
+}
+
+/* Saves the request head and the de-chunked body of
+ * a request, and replies with "OK".
+ */
+class CaptureServer {
+public:
+    std::string GetUrl() const {
+        return server_.GetUrl("/upload");
+    }
+
+    std::string header_;
+    std::string body_;
+
+private:
+    void Serve(TestServer::socket_t& socket) {
+        boost::asio::streambuf buffer;
+        header_ = TestServer::ReadHead(socket, buffer);
+
+        while(true) {
+            auto line = TestServer::ReadLine(socket, buffer);
+            boost::trim(line);
+            if (line.empty()) {
+                continue; // The crlf after a chunk
+            }
+
+            const auto len = stoul(line, nullptr, 16);
+            if (buffer.size() < (len + 2)) {
+                boost::asio::read(socket, buffer,
+                    boost::asio::transfer_exactly(len + 2 - buffer.size()));
+            }
+            body_.append(boost::asio::buffers_begin(buffer.data()),
+                         boost::asio::buffers_begin(buffer.data()) + len);
+            buffer.consume(len + 2);
+
+            if (len == 0) {
+                break;
+            }
+        }
+
+        boost::asio::write(socket, boost::asio::buffer(
+            "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n"
+            "Connection: close\r\n\r\nOK"s));
+    }
+
+    // Last, so the session is done before the members above go away
+    TestServer server_{[this](TestServer::socket_t& socket) { Serve(socket); }};
+};
+
+} // anon ns
+
+TEST(ZipWriter, GzipRoundTrip) {
+    const auto body = MakeBody(200000);
+    std::string out;
+    bool finished = false;
+
+    {
+        auto writer = DataWriter::CreateGzipWriter(
+            make_unique<StringWriter>(out, finished));
+
+        // Write it in pieces, like a streaming serializer would
+        for(size_t i = 0; i < body.size(); i += 1000) {
+            writer->Write({body.data() + i, min<size_t>(1000, body.size() - i)});
+        }
+        writer->Finish();
+    }
+
+    EXPECT_TRUE(finished);
+    EXPECT_LT(out.size(), body.size() / 4);
+    EXPECT_EQ(body, Decompress(out, true));
+}
+
+TEST(ZipWriter, DeflateRoundTrip) {
+    const auto body = MakeBody(50000);
+    std::string out;
+    bool finished = false;
+
+    auto writer = DataWriter::CreateZipWriter(
+        make_unique<StringWriter>(out, finished), 9);
+    write_buffers_t buffers;
+    buffers.emplace_back(body.data(), 100);
+    buffers.emplace_back(body.data() + 100, body.size() - 100);
+    writer->Write(buffers);
+    writer->Finish();
+
+    EXPECT_EQ(body, Decompress(out, false));
+}
+
+TEST(ZipWriter, Levels) {
+    const auto body = MakeBody(100000);
+
+    std::string fastest, smallest;
+    bool finished = false;
+    for(auto level : {1, 9}) {
+        auto& out = (level == 1) ? fastest : smallest;
+        auto writer = DataWriter::CreateGzipWriter(
+            make_unique<StringWriter>(out, finished), level);
+        writer->Write({body.data(), body.size()});
+        writer->Finish();
+        EXPECT_EQ(body, Decompress(out, true));
+    }
+
+    EXPECT_LE(smallest.size(), fastest.size());
+}
+
+TEST(ZipWriter, EmptyBody) {
+    std::string out;
+    bool finished = false;
+
+    auto writer = DataWriter::CreateGzipWriter(
+        make_unique<StringWriter>(out, finished));
+    writer->Finish();
+
+    EXPECT_FALSE(out.empty());
+    EXPECT_EQ("", Decompress(out, true));
+}
+
+TEST(ZipWriter, InvalidLevel) {
+    std::string out;
+    bool finished = false;
+
+    EXPECT_THROW(DataWriter::CreateGzipWriter(
+        make_unique<StringWriter>(out, finished), 42), CompressException);
+}
+
+TEST(ZipWriter, SetsContentEncoding) {
+    std::string out;
+    bool finished = false;
+
+    Request::headers_t headers;
+    DataWriter::CreateGzipWriter(make_unique<StringWriter>(out, finished))
+        ->SetHeaders(headers);
+    EXPECT_EQ("gzip", headers["Content-Encoding"]);
+
+    DataWriter::CreateZipWriter(make_unique<StringWriter>(out, finished))
+        ->SetHeaders(headers);
+    EXPECT_EQ("deflate", headers["Content-Encoding"]);
+}
+
+TEST(ZipWriter, CompressedRequestBody) {
+    CaptureServer server;
+    const auto body = MakeBody(100000);
+
+    Request::Properties properties;
+    properties.bodyCompression = Request::Properties::BodyCompression::GZIP;
+    auto client = RestClient::Create(properties);
+
+    client->ProcessWithPromise([&](Context& ctx) {
+        auto reply = ctx.Post(server.GetUrl(), body);
+        EXPECT_EQ("OK", reply->GetBodyAsString());
+    }).get();
+    client->CloseWhenReady(true);
+
+    EXPECT_NE(string::npos, server.header_.find("Content-Encoding: gzip\r\n"));
+    EXPECT_NE(string::npos, server.header_.find("Transfer-Encoding: chunked\r\n"));
+    EXPECT_EQ(string::npos, server.header_.find("Content-Length"));
+    EXPECT_EQ(body, Decompress(server.body_, true));
+}
+
+int main( int argc, char * argv[] )
+{
+    RESTC_CPP_TEST_LOGGING_SETUP("info");
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();;
+}